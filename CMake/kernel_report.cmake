@@ -0,0 +1,118 @@
+# ------------------------------------------------------------------------------
+# Per kernel register / shared memory report
+# ------------------------------------------------------------------------------
+#
+# Reads the resource usage nvcc embedded in the cubins of a library or object
+# file. Only cuobjdump is needed: no GPU, no driver.
+#
+# cmake -DCUOBJDUMP=<path to cuobjdump>
+#       -DINPUT=<static library or object>
+#       -DOUTPUT=<report file>
+#       [-DBASELINE=<previous report>]
+#       [-DFAIL_ON_REGRESSION=ON]
+#       -P kernel_report.cmake
+#
+# One line per function and architecture, sorted:
+#   <arch> <registers> <shared bytes> <local bytes> <stack bytes> <mangled name>
+#
+# When BASELINE is given every function whose registers, shared, local or
+# stack usage grew is listed, and the script fails if FAIL_ON_REGRESSION is
+# set. Commit the report to use it as the baseline of the next build.
+
+if(NOT CUOBJDUMP OR NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "kernel_report: CUOBJDUMP, INPUT and OUTPUT must be defined")
+endif()
+
+execute_process(COMMAND ${CUOBJDUMP} --dump-resource-usage ${INPUT}
+                OUTPUT_VARIABLE dump
+                ERROR_VARIABLE  dump_err
+                RESULT_VARIABLE dump_res)
+
+if(NOT dump_res EQUAL 0)
+    message(FATAL_ERROR "kernel_report: cuobjdump failed on ${INPUT}\n${dump_err}")
+endif()
+
+# ------------------------------------------------------------------------------
+# Parse cuobjdump output:
+#   arch = sm_75
+#   ...
+#    Function _Z12pack_normalsPK7Vec3_cuPKiiPS_:
+#     REG:16 STACK:0 SHARED:0 LOCAL:0 CONSTANT[0]:376 ...
+# ------------------------------------------------------------------------------
+
+string(REGEX REPLACE "\r?\n" ";" lines "${dump}")
+
+set(arch "unknown")
+set(func "")
+set(entries "")
+foreach(line ${lines})
+    if(line MATCHES "arch = ([a-z_0-9]+)")
+        set(arch ${CMAKE_MATCH_1})
+    elseif(line MATCHES "Function ([^ :]+):")
+        set(func ${CMAKE_MATCH_1})
+    elseif(func AND line MATCHES "REG:([0-9]+) STACK:([0-9]+) SHARED:([0-9]+) LOCAL:([0-9]+)")
+        set(entry "${arch} ${CMAKE_MATCH_1} ${CMAKE_MATCH_3} ${CMAKE_MATCH_4} ${CMAKE_MATCH_2} ${func}")
+        list(FIND entries "${entry}" found)
+        # Separable compilation: the same function may appear in several objects
+        if(found EQUAL -1)
+            list(APPEND entries "${entry}")
+        endif()
+        set(func "")
+    endif()
+endforeach()
+
+list(LENGTH entries nb_entries)
+if(nb_entries EQUAL 0)
+    message(FATAL_ERROR "kernel_report: no device function found in ${INPUT}")
+endif()
+
+list(SORT entries)
+string(REPLACE ";" "\n" report "${entries}")
+file(WRITE ${OUTPUT} "# arch regs shared local stack function\n${report}\n")
+message(STATUS "kernel_report: ${nb_entries} device functions written to ${OUTPUT}")
+
+# ------------------------------------------------------------------------------
+# Compare with the baseline
+# ------------------------------------------------------------------------------
+
+if(NOT BASELINE)
+    return()
+endif()
+
+if(NOT EXISTS ${BASELINE})
+    message(STATUS "kernel_report: no baseline at ${BASELINE}, nothing to compare")
+    return()
+endif()
+
+file(STRINGS ${BASELINE} base_lines REGEX "^[a-z]")
+foreach(line ${base_lines})
+    string(REGEX REPLACE " +" ";" cols "${line}")
+    list(GET cols 0 b_arch)
+    list(GET cols 5 b_func)
+    set("base_${b_arch}_${b_func}" "${cols}")
+endforeach()
+
+set(nb_regressions 0)
+set(columns "arch" "regs" "shared" "local" "stack")
+foreach(entry ${entries})
+    string(REPLACE " " ";" cols "${entry}")
+    list(GET cols 0 e_arch)
+    list(GET cols 5 e_func)
+    set(base "${base_${e_arch}_${e_func}}")
+    if(base)
+        foreach(i 1 2 3 4)
+            list(GET cols ${i} new_val)
+            list(GET base ${i} old_val)
+            if(new_val GREATER old_val)
+                list(GET columns ${i} col_name)
+                message("kernel_report: ${e_func} (${e_arch}) ${col_name} ${old_val} -> ${new_val}")
+                math(EXPR nb_regressions "${nb_regressions} + 1")
+            endif()
+        endforeach()
+    endif()
+endforeach()
+
+if(nb_regressions GREATER 0 AND FAIL_ON_REGRESSION)
+    message(FATAL_ERROR "kernel_report: ${nb_regressions} resource regressions against ${BASELINE}")
+endif()
+message(STATUS "kernel_report: ${nb_regressions} resource regressions against ${BASELINE}")
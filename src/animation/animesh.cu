@@ -1,11 +1,13 @@
 #include "animesh.hpp"
 
 #include "animesh_kers.hpp"
+#include "cuda_launch_config.hpp"
 #include "macros.hpp"
 #include "vec3_cu.hpp"
 #include "distance_field.hpp"
 #include "std_utils.hpp"
 #include "skeleton.hpp"
+#include "mesh_reorder.hpp"
 
 // -----------------------------------------------------------------------------
 
@@ -17,13 +19,14 @@
 
 using namespace Cuda_utils;
 
-AnimeshBase *AnimeshBase::create(const Mesh *mesh, std::shared_ptr<const Skeleton> skel)
+AnimeshBase *AnimeshBase::create(const Mesh *mesh, std::shared_ptr<const Skeleton> skel, bool reorder_vertices)
 {
-    return new Animesh(mesh, skel);
+    return new Animesh(mesh, skel, reorder_vertices);
 }
 
-Animesh::Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_) :
+Animesh::Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_, bool reorder_vertices) :
     _mesh(m_), _skel(s_),
+    _input_mesh(m_),
     mesh_smoothing(EAnimesh::LAPLACIAN),
     do_smooth_mesh(false),
     do_local_smoothing(true),
@@ -48,16 +51,34 @@ Animesh::Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_) :
     d_edge_list(_mesh->get_nb_edges()),
     d_edge_list_offsets(2 * _mesh->get_nb_vertices()),
     d_base_potential(_mesh->get_nb_vertices()),
-    d_piv(_mesh->get_nb_faces()),
-    d_unpacked_normals(_mesh->get_nb_vertices() * _mesh->_max_faces_per_vertex),
-    d_unpacked_tangents(_mesh->get_nb_vertices() * _mesh->_max_faces_per_vertex),
+    d_unpacked_normals(_mesh->get_nb_tri() * 3),
+    d_unpacked_offsets(_mesh->get_nb_vertices() + 1),
+    d_piv(_mesh->get_nb_tri() * 3),
+    _partial(false),
     h_vert_buffer(_mesh->get_nb_vertices()),
     d_vert_buffer(_mesh->get_nb_vertices()),
     d_vert_buffer_2(_mesh->get_nb_vertices()),
-    d_vert_buffer_3(_mesh->get_nb_vertices()),
     d_vals_buffer(_mesh->get_nb_vertices())
 {
 
+    // Re-ordering keeps the number of vertices, triangles and edges so
+    // the arrays above are allocated with the right size.
+    // Meshes already in a coherent order (scanlines of a grid) can be worse
+    // after the Morton walk: we keep whichever order has the tighter edges.
+    if( reorder_vertices )
+    {
+        std::vector<int> new_to_old;
+        Mesh_reorder::compute_vertex_order(*_input_mesh, new_to_old);
+        const std::vector<int> old_to_new = Mesh_reorder::invert(new_to_old);
+        if( Mesh_reorder::mean_edge_span(*_input_mesh, old_to_new) < Mesh_reorder::mean_edge_span(*_input_mesh) )
+        {
+            _reordered_mesh.reset( Mesh_reorder::apply_order(*_input_mesh, new_to_old) );
+            _new_to_old.swap(new_to_old);
+            _old_to_new = old_to_new;
+            _mesh = _reordered_mesh.get();
+        }
+    }
+
     int nb_vert = _mesh->get_nb_vertices();
     Host::Array<EAnimesh::Vert_state> h_vert_state(nb_vert, EAnimesh::NOT_DISPLACED);
 
@@ -79,6 +100,7 @@ Animesh::Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_) :
 
     init_smooth_factors(d_input_smooth_factors);
     init_vert_to_fit();
+    init_vert_colors();
 
     compute_mvc();
 }
@@ -108,9 +130,9 @@ void Animesh::init_vert_to_fit()
     d_vert_to_fit.     malloc(acc);
     d_vert_to_fit_base.malloc(acc);
 
-    d_vert_to_fit_buff_scan.malloc(acc+1);
-    d_vert_to_fit_buff_scan.set(0, 0);
     d_vert_to_fit_buff.malloc(acc);
+    d_nb_vert_to_fit.malloc(1);
+    h_nb_vert_to_fit.malloc(1);
     h_vert_to_fit_buff.malloc(acc);
 
     d_vert_to_fit_base.copy_from(h_vert_to_fit_base);
@@ -119,13 +141,137 @@ void Animesh::init_vert_to_fit()
 
 // -----------------------------------------------------------------------------
 
+void Animesh::init_vert_colors()
+{
+    const int nb_vert = _mesh->get_nb_vertices();
+
+    // The one-ring of the mesh may not be symmetric (e.g. on side edges)
+    // so we gather the neighbours in both directions
+    std::vector< std::vector<int> > ngb(nb_vert);
+    for(int i = 0; i < nb_vert; i++)
+    {
+        const int dep      = _mesh->get_edge_offset(i*2    );
+        const int nb_neigh = _mesh->get_edge_offset(i*2 + 1);
+        for(int n = dep; n < (dep+nb_neigh); n++)
+        {
+            const int j = _mesh->get_edge(n);
+            if(j == i) continue;
+            ngb[i].push_back(j);
+            ngb[j].push_back(i);
+        }
+    }
+
+    // Greedy colouring: each vertex takes the smallest colour not used by
+    // its already coloured neighbours
+    std::vector<int> colors(nb_vert, -1);
+    std::vector<int> used; // used[c] == i when colour c is taken around i
+    int nb_colors = 0;
+    for(int i = 0; i < nb_vert; i++)
+    {
+        for(unsigned n = 0; n < ngb[i].size(); n++){
+            const int c = colors[ ngb[i][n] ];
+            if(c >= 0) used[c] = i;
+        }
+
+        int c = 0;
+        while(c < nb_colors && used[c] == i) c++;
+        if(c == nb_colors){
+            nb_colors++;
+            used.push_back(-1);
+        }
+        colors[i] = c;
+    }
+
+    // Sort vertices by colour
+    std::vector<int>& offsets = _vert_colors.offsets;
+    offsets.assign(nb_colors + 1, 0);
+    for(int i = 0; i < nb_vert; i++) offsets[colors[i] + 1]++;
+    for(int c = 0; c < nb_colors; c++) offsets[c+1] += offsets[c];
+
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    std::vector<int> sorted(nb_vert);
+    for(int i = 0; i < nb_vert; i++) sorted[ fill[colors[i]]++ ] = i;
+
+    _vert_colors.d_verts. malloc(nb_vert);
+    _vert_colors.d_colors.malloc(nb_vert);
+    _vert_colors.d_verts. copy_from(sorted);
+    _vert_colors.d_colors.copy_from(colors);
+    _vert_colors.d_offsets.malloc(nb_colors + 1);
+    _vert_colors.d_offsets.copy_from(offsets);
+
+    // conservative_smooth() groups the vertices to fit by colour in there
+    d_vert_to_fit_colored.malloc(nb_vert);
+    d_nb_vert_to_fit_colored.malloc(nb_colors);
+}
+
+// -----------------------------------------------------------------------------
+
+void Animesh::set_active_vertices(const std::vector<int>& verts)
+{
+    const int nb_vert = _mesh->get_nb_vertices();
+    std::vector<bool> active(nb_vert, false);
+    for(unsigned i = 0; i < verts.size(); i++)
+    {
+        const int v = verts[i];
+        if(v >= 0 && v < nb_vert) active[ to_internal_idx(v) ] = true;
+    }
+
+    // Fitted vertices, in the order of 'd_vert_to_fit_base'
+    const std::vector<int> base = d_vert_to_fit_base.to_host_vector();
+    std::vector<int> fit;
+    fit.reserve(base.size());
+    for(unsigned i = 0; i < base.size(); i++)
+        if( active[base[i]] ) fit.push_back(base[i]);
+
+    // Keep the colour indices of '_vert_colors' so that 'd_colors' is still
+    // valid, colours without active vertices are empty
+    const std::vector<int> sorted = _vert_colors.d_verts.to_host_vector();
+    const int nb_colors = _vert_colors.nb_colors();
+    std::vector<int>& offsets = _active_colors.offsets;
+    std::vector<int> sub_sorted;
+    offsets.assign(nb_colors + 1, 0);
+    for(int c = 0; c < nb_colors; c++)
+    {
+        for(int i = _vert_colors.offsets[c]; i < _vert_colors.offsets[c+1]; i++)
+            if( active[sorted[i]] ) sub_sorted.push_back(sorted[i]);
+        offsets[c+1] = (int)sub_sorted.size();
+    }
+
+    d_vert_to_fit_active.malloc(fit.size());
+    d_vert_to_fit_active.copy_from(fit);
+    _active_colors.d_verts.malloc(sub_sorted.size());
+    _active_colors.d_verts.copy_from(sub_sorted);
+    _active_colors.d_colors.malloc(nb_vert);
+    _active_colors.d_colors.copy_from(_vert_colors.d_colors);
+    _active_colors.d_offsets.malloc(nb_colors + 1);
+    _active_colors.d_offsets.copy_from(offsets);
+    _partial = true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Animesh::clear_active_vertices()
+{
+    _partial = false;
+    d_vert_to_fit_active.erase();
+    _active_colors.d_verts.erase();
+    _active_colors.d_colors.erase();
+    _active_colors.d_offsets.erase();
+    _active_colors.offsets.clear();
+}
+
+// -----------------------------------------------------------------------------
+
 void Animesh::get_vertices(std::vector<Point_cu>& anim_vert) const
 {
     const int nb_vert = d_output_vertices.size();
     Cuda_utils::HA_Point_cu h_out_verts(nb_vert);
     h_out_verts.copy_from(d_output_vertices);
 
-    anim_vert.insert(anim_vert.end(), &h_out_verts[0], &h_out_verts[0] + nb_vert);
+    const int base = anim_vert.size();
+    anim_vert.resize(base + nb_vert);
+    for(int i = 0; i < nb_vert; i++)
+        anim_vert[base + (_new_to_old.size() ? _new_to_old[i] : i)] = h_out_verts[i];
 }
 
 void Animesh::set_vertices(const std::vector<Vec3_cu> &vertices)
@@ -135,7 +281,7 @@ void Animesh::set_vertices(const std::vector<Vec3_cu> &vertices)
     Host::Array<Point_cu > input_vertices(nb_vert);
 
     for(int i = 0; i < nb_vert; i++)
-        input_vertices[i] = vertices[i].to_point();
+        input_vertices[i] = vertices[_new_to_old.size() ? _new_to_old[i] : i].to_point();
 
     d_input_vertices.copy_from(input_vertices);
 }
@@ -151,12 +297,25 @@ void Animesh::copy_mesh_data(const Mesh& a_mesh)
         input_vertices[i] = pos;
     }
 
-    int n_faces = a_mesh.get_nb_faces();
-    Host::Array<Mesh::PrimIdxVertices> h_piv(n_faces);
-    for(int i = 0; i < n_faces; i++){
-        h_piv[i] = a_mesh.get_piv(i);
+    // Exact CSR layout for the normals computation: every face corner gets
+    // a slot, slots of a same vertex are contiguous.
+    const int nb_tri = a_mesh.get_nb_tri();
+    const int* tri = a_mesh.get_tri_index();
+    HA_int h_unpacked_offsets(nb_vert + 1, 0);
+    for(int i = 0; i < nb_tri*3; i++)
+        h_unpacked_offsets[tri[i] + 1]++;
+    for(int i = 0; i < nb_vert; i++)
+        h_unpacked_offsets[i+1] += h_unpacked_offsets[i];
+
+    HA_int h_piv(nb_tri * 3);
+    for(int i = 0; i < nb_tri; i++){
+        const Mesh::PrimIdxVertices piv = a_mesh.get_piv(i);
+        h_piv[3*i    ] = h_unpacked_offsets[tri[3*i    ]] + piv.ia;
+        h_piv[3*i + 1] = h_unpacked_offsets[tri[3*i + 1]] + piv.ib;
+        h_piv[3*i + 2] = h_unpacked_offsets[tri[3*i + 2]] + piv.ic;
     }
     d_piv.copy_from(h_piv);
+    d_unpacked_offsets.copy_from(h_unpacked_offsets);
 
     d_input_vertices.copy_from(input_vertices);
 
@@ -177,7 +336,48 @@ void Animesh::copy_mesh_data(const Mesh& a_mesh)
 
 // -----------------------------------------------------------------------------
 
+void Animesh::memory_report(Memory_report& rep) const
+{
+    const char* sub = "Animesh";
+    add_to_report(rep, sub, "d_input_smooth_factors"       , d_input_smooth_factors       );
+    add_to_report(rep, sub, "d_smooth_factors_conservative", d_smooth_factors_conservative);
+    add_to_report(rep, sub, "d_smooth_factors_laplacian"   , d_smooth_factors_laplacian   );
+    add_to_report(rep, sub, "d_input_vertices"             , d_input_vertices             );
+    add_to_report(rep, sub, "d_edge_lengths"               , d_edge_lengths               );
+    add_to_report(rep, sub, "d_edge_mvc"                   , d_edge_mvc                   );
+    add_to_report(rep, sub, "d_vertices_state"             , d_vertices_state             );
+    add_to_report(rep, sub, "d_vertices_states_color"      , d_vertices_states_color      );
+    add_to_report(rep, sub, "d_output_vertices"            , d_output_vertices            );
+    add_to_report(rep, sub, "d_gradient"                   , d_gradient                   );
+    add_to_report(rep, sub, "d_input_tri"                  , d_input_tri                  );
+    add_to_report(rep, sub, "d_edge_list"                  , d_edge_list                  );
+    add_to_report(rep, sub, "d_edge_list_offsets"          , d_edge_list_offsets          );
+    add_to_report(rep, sub, "d_base_potential"             , d_base_potential             );
+    add_to_report(rep, sub, "d_unpacked_normals"           , d_unpacked_normals           );
+    add_to_report(rep, sub, "d_unpacked_offsets"           , d_unpacked_offsets           );
+    add_to_report(rep, sub, "d_piv"                        , d_piv                        );
+    add_to_report(rep, sub, "_vert_colors.d_verts"         , _vert_colors.d_verts         );
+    add_to_report(rep, sub, "_vert_colors.d_colors"        , _vert_colors.d_colors        );
+    add_to_report(rep, sub, "_vert_colors.d_offsets"       , _vert_colors.d_offsets       );
+    add_to_report(rep, sub, "h_vert_buffer"                , h_vert_buffer                );
+    add_to_report(rep, sub, "d_vert_buffer"                , d_vert_buffer                );
+    add_to_report(rep, sub, "d_vert_buffer_2"              , d_vert_buffer_2              );
+    add_to_report(rep, sub, "d_vals_buffer"                , d_vals_buffer                );
+    add_to_report(rep, sub, "d_vert_to_fit"                , d_vert_to_fit                );
+    add_to_report(rep, sub, "d_vert_to_fit_base"           , d_vert_to_fit_base           );
+    add_to_report(rep, sub, "d_vert_to_fit_active"         , d_vert_to_fit_active         );
+    add_to_report(rep, sub, "_active_colors.d_verts"       , _active_colors.d_verts       );
+    add_to_report(rep, sub, "_active_colors.d_colors"      , _active_colors.d_colors      );
+    add_to_report(rep, sub, "_active_colors.d_offsets"     , _active_colors.d_offsets     );
+    add_to_report(rep, sub, "d_vert_to_fit_colored"        , d_vert_to_fit_colored        );
+    add_to_report(rep, sub, "d_nb_vert_to_fit_colored"     , d_nb_vert_to_fit_colored     );
+    add_to_report(rep, sub, "d_vert_to_fit_buff"           , d_vert_to_fit_buff           );
+    add_to_report(rep, sub, "d_nb_vert_to_fit"             , d_nb_vert_to_fit             );
+    add_to_report(rep, sub, "h_nb_vert_to_fit"             , h_nb_vert_to_fit             );
+    add_to_report(rep, sub, "h_vert_to_fit_buff"           , h_vert_to_fit_buff           );
+}
 
+// -----------------------------------------------------------------------------
 
 void Animesh::compute_mvc()
 {
@@ -282,50 +482,35 @@ void Animesh::diffuse_attr(int nb_iter, float strength, float *attr)
                             nb_iter);
 }
 
-#include "cuda_utils_thrust.hpp"
-
-__global__ static
-void transform_vert_to_fit(const int* src, int* dst, const int nb_vert)
-{
-    const int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if(p < nb_vert) dst[p] = src[p] < 0 ? 0 : 1;
-}
-
+/// Append the valid indices of 'src' to 'dst', 'nb_packed' must be zero
+/// beforehand.
 /// here src must be different from dst
 __global__ static
-void pack(const int* prefix_sum, const int* src, int* dst, const int nb_vert)
+void pack(const int* src, int* dst, int* nb_packed, const int nb_vert)
 {
     const int p = blockIdx.x * blockDim.x + threadIdx.x;
     if(p < nb_vert){
         const int elt = src[p];
-        if(elt >= 0) dst[ prefix_sum[p] ] = elt;
+        if(elt >= 0) dst[ atomicAdd(nb_packed, 1) ] = elt;
     }
 }
 
-// The first element of buff must be 0.
-int Animesh::pack_vert_to_fit_gpu(
+void Animesh::pack_vert_to_fit_gpu(
         const Cuda_utils::Device::Array<int>& d_vert_to_fit,
-        Cuda_utils::Device::Array<int>& buff,
         Cuda_utils::Device::Array<int>& packed_array,
+        int* d_nb_packed,
         int nb_vert_to_fit)
 {
-    if(nb_vert_to_fit == 0) return 0;
-    assert(d_vert_to_fit.size() >= nb_vert_to_fit           );
-    assert(buff.size()          >= d_vert_to_fit.size() + 1 );
-    assert(packed_array.size()  >= d_vert_to_fit.size()     );
-
-    // Set buff[n] to true if d_vert_to_fit[n] is valid, or false if it's -1.
-    const int block_s = 16;
-    const int grid_s  = (nb_vert_to_fit + block_s) / block_s;
-    transform_vert_to_fit<<<grid_s, block_s >>>(d_vert_to_fit.ptr(), buff.ptr()+1, nb_vert_to_fit);
-    CUDA_CHECK_ERRORS();
+    assert(d_vert_to_fit.size() >= nb_vert_to_fit);
+    assert(packed_array.size()  >= nb_vert_to_fit);
 
-    // Compute prefix sum in buff between [1 nb_vert_to_fit]
-    Cuda_utils::inclusive_scan(0, nb_vert_to_fit-1, buff.ptr()+1);
+    // Both memsets are asynchronous: every entry becomes -1 and the count 0
+    CUDA_SAFE_CALL(cudaMemsetAsync(d_nb_packed, 0, sizeof(int)));
+    if(nb_vert_to_fit == 0) return;
+    CUDA_SAFE_CALL(cudaMemsetAsync(packed_array.ptr(), 0xff, nb_vert_to_fit * sizeof(int)));
 
-    pack<<<grid_s, block_s >>>(buff.ptr(), d_vert_to_fit.ptr(), packed_array.ptr(), nb_vert_to_fit);
+    const int block_s = Launch_cfg::block_size(Launch_cfg::PACK, pack);
+    const int grid_s  = Launch_cfg::grid_size(block_s, nb_vert_to_fit);
+    pack<<<grid_s, block_s >>>(d_vert_to_fit.ptr(), packed_array.ptr(), d_nb_packed, nb_vert_to_fit);
     CUDA_CHECK_ERRORS();
-
-    // This causes a flush, so do this last.
-    return buff.fetch(nb_vert_to_fit);
 }
@@ -8,21 +8,28 @@
 #include "tree_cu_type.hpp"
 #include "bone.hpp"
 #include "animesh_base.hpp"
+#include "animesh_kers.hpp"
 
 #include <map>
+#include <memory>
 #include <vector>
 
 struct Animesh: public AnimeshBase {
 public:
     // The Mesh must exist for the lifetime of this object.
-    Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_);
+    /// @param reorder_vertices : internally re-order vertices and triangles
+    /// for memory locality (see Mesh_reorder), if that lowers
+    /// Mesh_reorder::mean_edge_span(). This is transparent to the
+    /// caller: every per vertex data in or out of this class (vertices, base
+    /// potential, smooth factors) is indexed like 'm_'
+    Animesh(const Mesh *m_, std::shared_ptr<const Skeleton> s_, bool reorder_vertices = false);
     ~Animesh();
 
     // Get the loaded skeleton.
     const Skeleton *get_skel() const { return _skel.get(); }
 
     // Get the mesh.
-    const Mesh*     get_mesh() const { return _mesh; }
+    const Mesh*     get_mesh() const { return _input_mesh; }
 
     /// Computes the potential at each vertex of the mesh. When the mesh is
     /// animated, if implicit skinning is enabled, vertices move so as to match
@@ -30,6 +37,9 @@ public:
     /// with set_base_potential().
     void calculate_base_potential(std::vector<float> &out) const;
 
+    /// Incremental calculate_base_potential() (see Base_potential_cache)
+    void update_base_potential(std::vector<float> &out) const;
+
     // Read and write the base potential (and gradient).
     void get_base_potential(std::vector<float> &pot) const;
     void set_base_potential(const std::vector<float> &pot);
@@ -53,7 +63,7 @@ public:
     // Copy the given vertices into the mesh.
     void set_vertices(const std::vector<Vec3_cu> &vertices);
 
-    inline void set_smooth_factor(int i, float val) { d_input_smooth_factors.set(i, val); }
+    inline void set_smooth_factor(int i, float val) { d_input_smooth_factors.set(to_internal_idx(i), val); }
 
     void set_nb_transform_steps(int nb_iter) { nb_transform_steps = nb_iter; }
     void set_final_fitting(bool value) { final_fitting = value; }
@@ -65,21 +75,58 @@ public:
     void set_smooth_force_b (float beta  ) { smooth_force_b = beta;      }
     void set_smoothing_type (EAnimesh::Smooth_type type ) { mesh_smoothing = type; }
 
+    /// Only deform the vertices 'verts' (indices of the input mesh) in the
+    /// next calls to transform_vertices(), e.g. a painted region or the
+    /// vertices around a few joints. Fitting and smoothing are restricted to
+    /// them, the other vertices keep their input position, so the cost scales
+    /// with the subset size.
+    void set_active_vertices(const std::vector<int>& verts);
+
+    /// Deform every vertex again
+    void clear_active_vertices();
+
+    /// Whether transform_vertices() is restricted to a subset
+    bool is_partial() const { return _partial; }
+
+    /// Add every device and host buffers owned by this object to 'rep'
+    void memory_report(Memory_report& rep) const;
+
 private:
     // -------------------------------------------------------------------------
     /// @name Tools
     // -------------------------------------------------------------------------
 
+    /// @return index in our internal vertex order of the ith vertex of
+    /// '_input_mesh'
+    int to_internal_idx(int i) const { return _old_to_new.size() ? _old_to_new[i] : i; }
+
+    /// Re-order per vertex data indexed like '_input_mesh' to our internal
+    /// vertex order. Arrays of another size are left untouched.
+    template<class T>
+    std::vector<T> to_internal_order(const std::vector<T>& in) const {
+        if(_new_to_old.size() == 0 || in.size() != _new_to_old.size()) return in;
+        std::vector<T> out(in.size());
+        for(unsigned i = 0; i < _new_to_old.size(); i++) out[i] = in[ _new_to_old[i] ];
+        return out;
+    }
+
+    /// Re-order per vertex data from our internal vertex order to the order
+    /// of '_input_mesh'
+    template<class T>
+    std::vector<T> to_input_order(const std::vector<T>& in) const {
+        if(_new_to_old.size() == 0 || in.size() != _new_to_old.size()) return in;
+        std::vector<T> out(in.size());
+        for(unsigned i = 0; i < _new_to_old.size(); i++) out[ _new_to_old[i] ] = in[i];
+        return out;
+    }
+
     /// Tangential smoothing on GPU
-    /// @param d_vertices vertices to be processed in place
-    /// @param d_vertices_prealloc allocated buffer of vertices as so the method
-    /// does not allocate temporary space at each call
+    /// @param d_vertices vertices to be processed in place (one colour of
+    /// '_vert_colors' at a time)
     /// @param d_normals normals after smoothing
     /// @param nb_iter number of iteration for smoothing the mesh.
-    /// N.B : Even numbers of iteratons are faster than odd.
     void tangential_smooth(const float* factors,
                            Vec3_cu* d_vertices,
-                           Vec3_cu* d_vertices_prealloc,
                            Vec3_cu* d_normals,
                            int nb_iter);
 
@@ -92,7 +139,6 @@ private:
 
 
     void conservative_smooth(Vec3_cu* output_vertices,
-                             Vec3_cu* buff,
                              const Cuda_utils::DA_int& d_vert_to_fit,
                              int nb_vert_to_fit,
                              int nb_iter);
@@ -110,15 +156,14 @@ private:
     void diffuse_attr(int nb_iter, float strength, float* attr);
 
     // Given an array [2,5,-1,-1,3,4] and nb_vert_to_fit == 6, set packed_vert_to_fit
-    // to a packed list removing negative indexes, resulting in [2,5,3,4].  Return the
-    // number of indexes in the result.
-    //
-    // buff_prefix_sum is a scratch buffer that must be at least one element larger
-    // than d_vert_to_fit.
-    int pack_vert_to_fit_gpu(
+    // to a list with the non negative indexes first, e.g. [5,2,3,4,-1,-1] (the order
+    // of the kept indexes is not preserved).  The number of kept indexes is written
+    // to d_nb_packed in device memory: nothing is read back, so this doesn't
+    // synchronize with the host.
+    void pack_vert_to_fit_gpu(
             const Cuda_utils::Device::Array<int>& d_vert_to_fit,
-            Cuda_utils::Device::Array<int>& buff_prefix_sum,
             Cuda_utils::Device::Array<int>& packed_vert_to_fit,
+            int* d_nb_packed,
             int nb_vert_to_fit);
 
     /// Copy the attributes of 'a_mesh' into the attributes of the animated
@@ -140,6 +185,17 @@ private:
     /// For instance lonely vertices are not fitted with the implicit skinning.
     void init_vert_to_fit();
 
+    /// Compute '_vert_colors' a greedy colouring of the mesh one-ring used
+    /// to smooth vertices in place (multicolour Gauss-Seidel)
+    void init_vert_colors();
+
+    /// Vertices to fit and colours of the vertices to smooth: the whole mesh
+    /// or the subset of set_active_vertices()
+    /// @{
+    const Cuda_utils::DA_int& active_vert_to_fit() const { return _partial ? d_vert_to_fit_active : d_vert_to_fit_base; }
+    const Animesh_kers::Vert_colors& active_colors() const { return _partial ? _active_colors : _vert_colors; }
+    /// @}
+
     void init_smooth_factors(Cuda_utils::DA_float& d_smooth_factors);
 
     // -------------------------------------------------------------------------
@@ -150,9 +206,19 @@ private:
     /// deformation is computed from the initial position of the mesh stored in
     /// d_input_vertices. The mesh buffer objects attributes defines the animated
     /// mesh
+    /// When vertices are re-ordered this points to '_reordered_mesh'
     const Mesh *_mesh;
     std::shared_ptr<const Skeleton> _skel;
 
+    /// The mesh given at construction
+    const Mesh *_input_mesh;
+    /// Copy of '_input_mesh' re-ordered for memory locality (or null)
+    std::unique_ptr<Mesh> _reordered_mesh;
+    /// _new_to_old[internal_idx] == index in '_input_mesh'
+    /// (both empty when vertices are not re-ordered)
+    std::vector<int> _new_to_old;
+    std::vector<int> _old_to_new;
+
     EAnimesh::Smooth_type mesh_smoothing;
 
     bool do_smooth_mesh;
@@ -219,13 +285,25 @@ private:
     Cuda_utils::Device::Array<float> d_base_potential;
 
     /// Buffer used to compute normals on GPU. this array holds normals for each
-    /// face. d_unpacked_normals[vert_id*nb_max_face_per_vert + ith_face_of_vert]
+    /// face corner (3*nb_tri) grouped by vertex in CSR layout:
+    /// d_unpacked_normals[d_unpacked_offsets[vert_id] + ith_face_of_vert]
     /// == normal_at_vert_id_for_its_ith_face
     Cuda_utils::Device::Array<Vec3_cu> d_unpacked_normals;
-    /// same as 'd_unpacked_normals' but with tangents
-    Cuda_utils::Device::Array<Vec3_cu> d_unpacked_tangents;
-    /// ?
-    Cuda_utils::Device::Array<Mesh::PrimIdxVertices> d_piv;
+    /// CSR offsets of each vertex in 'd_unpacked_normals' (nb_vert + 1)
+    Cuda_utils::Device::Array<int> d_unpacked_offsets;
+    /// Slot in 'd_unpacked_normals' of each face corner.
+    /// d_piv[tri_id*3 + i] is the slot of the ith vertex of the triangle
+    Cuda_utils::Device::Array<int> d_piv;
+
+    /// Vertices grouped by colour so that no two adjacent vertices share
+    /// a colour. Used to smooth the mesh in place.
+    Animesh_kers::Vert_colors _vert_colors;
+
+    /// Whether only a subset of the vertices is deformed
+    bool _partial;
+    /// '_vert_colors' restricted to the subset (same colour indices, some
+    /// may be empty)
+    Animesh_kers::Vert_colors _active_colors;
 
     // -------------------------------------------------------------------------
     /// @name CLUSTER
@@ -242,13 +320,21 @@ private:
     Cuda_utils::Host::Array<Vec3_cu>    h_vert_buffer;
     Cuda_utils::Device::Array<Vec3_cu>  d_vert_buffer;
     Cuda_utils::Device::Array<Vec3_cu>  d_vert_buffer_2;
-    Cuda_utils::Device::Array<Vec3_cu>  d_vert_buffer_3;
     Cuda_utils::Device::Array<float>    d_vals_buffer;
 
     Cuda_utils::Device::Array<int>      d_vert_to_fit;
     Cuda_utils::Device::Array<int>      d_vert_to_fit_base;
-    Cuda_utils::Device::Array<int>      d_vert_to_fit_buff_scan;
+    /// 'd_vert_to_fit_base' restricted to the subset of set_active_vertices()
+    Cuda_utils::Device::Array<int>      d_vert_to_fit_active;
     Cuda_utils::Device::Array<int>      d_vert_to_fit_buff;
+    /// Number of vertices left to fit after the last pack_vert_to_fit_gpu()
+    Cuda_utils::Device::Array<int>      d_nb_vert_to_fit;
+    /// Page locked copy of 'd_nb_vert_to_fit' read asynchronously
+    Cuda_utils::Host::PL_Array<int>     h_nb_vert_to_fit;
+    /// Vertices to fit grouped by colour and their number per colour
+    /// (see Animesh_kers::conservative_smooth())
+    Cuda_utils::Device::Array<int>      d_vert_to_fit_colored;
+    Cuda_utils::Device::Array<int>      d_nb_vert_to_fit_colored;
 
     Cuda_utils::Host::Array<int>        h_vert_to_fit_buff;
     /// @}
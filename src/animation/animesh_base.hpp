@@ -13,9 +13,12 @@
 // namespace collisions between Maya and CUDA.  This file can be included in NO_CUDA files,
 // but Animesh.hpp can't.
 struct Animesh;
+struct Memory_report;
 class AnimeshBase {
 public:
-    static AnimeshBase *create(const Mesh *mesh, std::shared_ptr<const Skeleton> skel);
+    /// @param reorder_vertices : re-order internally the vertices for memory
+    /// locality. Transparent to the caller.
+    static AnimeshBase *create(const Mesh *mesh, std::shared_ptr<const Skeleton> skel, bool reorder_vertices = false);
     virtual ~AnimeshBase() { }
 
     // Get the loaded skeleton.
@@ -30,6 +33,12 @@ public:
     /// with set_base_potential().
     virtual void calculate_base_potential(std::vector<float> &out) const = 0;
 
+    /// Same as calculate_base_potential() but restores the potential stored
+    /// by a previous call for this mesh and only evaluates again the vertices
+    /// influenced by bones whose field changed since then.
+    /// @see Base_potential_cache
+    virtual void update_base_potential(std::vector<float> &out) const = 0;
+
     // Read and write the base potential (and gradient).
     virtual void get_base_potential(std::vector<float> &pot) const = 0;
     virtual void set_base_potential(const std::vector<float> &pot) = 0;
@@ -39,6 +48,13 @@ public:
     /// @param type specify the technic used to compute vertices deformations
     virtual void transform_vertices() = 0;
 
+    /// Restrict transform_vertices() to the vertices 'verts' (indices in the
+    /// mesh); the others keep their input position.
+    virtual void set_active_vertices(const std::vector<int>& verts) = 0;
+
+    /// Deform every vertex again
+    virtual void clear_active_vertices() = 0;
+
     // Return the number of vertices in the mesh.  Calls to copy_vertices must have the
     // same number of vertices.
     virtual int get_nb_vertices() const = 0;
@@ -60,6 +76,9 @@ public:
     virtual void set_smooth_force_a (float alpha ) = 0;
     virtual void set_smooth_force_b (float beta  ) = 0;
     virtual void set_smoothing_type (EAnimesh::Smooth_type type ) = 0;
+
+    // Add the memory used by this object to the report.
+    virtual void memory_report(Memory_report& rep) const = 0;
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "animesh_kers.hpp"
 
 #include "cuda_current_device.hpp"
+#include "cuda_launch_config.hpp"
 #include "std_utils.hpp"
 #include "skeleton_env_evaluator.hpp"
 #include "animesh_enum.hpp"
@@ -32,19 +33,6 @@ Vec3_cu compute_rotation_axis(const Transfo& t)
     return axis;
 }
 
-/// Clean temporary storage
-__global__
-void clean_unpacked_normals(Device::Array<Vec3_cu> unpacked_normals)
-{
-    int n = unpacked_normals.size();
-    int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if( p < n){
-        unpacked_normals[p] = Vec3_cu(0.f, 0.f, 0.f);
-    }
-}
-
-// -----------------------------------------------------------------------------
-
 /// Compute the normal of triangle pi
 __device__ Vec3_cu
 compute_normal_tri(const Mesh::PrimIdx& pi, const Vec3_cu* prim_vertices) {
@@ -56,15 +44,16 @@ compute_normal_tri(const Mesh::PrimIdx& pi, const Vec3_cu* prim_vertices) {
 
 // -----------------------------------------------------------------------------
 
-/** Assign the normal of each face to each of its vertices
+/** Assign the normal of each face to each of its vertices.
+    Every face corner owns exactly one slot of 'unpacked_normals' so there is
+    no need to clean the buffer beforehand.
   */
 __global__ void
 compute_unpacked_normals_tri(const int* faces,
-                             Device::Array<Mesh::PrimIdxVertices> piv,
+                             const int* corner_slots,
                              int nb_faces,
                              const Vec3_cu* vertices,
-                             Device::Array<Vec3_cu> unpacked_normals,
-                             int unpack_factor){
+                             Vec3_cu* unpacked_normals){
     int n = nb_faces;
     int p = blockIdx.x * blockDim.x + threadIdx.x;
     if(p >= n)
@@ -74,28 +63,25 @@ compute_unpacked_normals_tri(const int* faces,
     pidx.a = faces[3*p    ];
     pidx.b = faces[3*p + 1];
     pidx.c = faces[3*p + 2];
-    Mesh::PrimIdxVertices pivp = piv[p];
     Vec3_cu nm = compute_normal_tri(pidx, vertices);
-    int ia = pidx.a * unpack_factor + pivp.ia;
-    int ib = pidx.b * unpack_factor + pivp.ib;
-    int ic = pidx.c * unpack_factor + pivp.ic;
-    unpacked_normals[ia] = nm;
-    unpacked_normals[ib] = nm;
-    unpacked_normals[ic] = nm;
+    unpacked_normals[corner_slots[3*p    ]] = nm;
+    unpacked_normals[corner_slots[3*p + 1]] = nm;
+    unpacked_normals[corner_slots[3*p + 2]] = nm;
 }
 
 /// Average the normals assigned to each vertex
 __global__
-void pack_normals( Device::Array<Vec3_cu> unpacked_normals,
-                  int unpack_factor,
+void pack_normals(const Vec3_cu* unpacked_normals,
+                  const int* offsets,
+                  int nb_vert,
                   Vec3_cu* normals)
 {
-    int n = unpacked_normals.size() / unpack_factor;
     int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if(p < n){
+    if(p < nb_vert){
         Vec3_cu nm = Vec3_cu::zero();
-        for(int i = 0; i < unpack_factor; i++){
-            nm = nm + unpacked_normals[p * unpack_factor + i];
+        const int end = offsets[p+1];
+        for(int i = offsets[p]; i < end; i++){
+            nm = nm + unpacked_normals[i];
         }
         normals[p] = nm.normalized();
     }
@@ -105,52 +91,35 @@ void pack_normals( Device::Array<Vec3_cu> unpacked_normals,
 
 /// Compute the normals of the mesh using the normal at each face
 void compute_normals(const int* tri,
-                     Device::Array<Mesh::PrimIdxVertices> piv,
+                     const DA_int& corner_slots,
+                     const DA_int& unpacked_offsets,
                      int nb_tri,
                      const Vec3_cu* vertices,
                      Device::Array<Vec3_cu> unpacked_normals,
-                     int unpack_factor,
                      Vec3_cu* out_normals)
 {
 
-    const int block_size = 512;
-    const int nb_threads_clean = unpacked_normals.size();
-    const int grid_size_clean = (nb_threads_clean + block_size - 1) / block_size;
-    const int nb_threads_pack = unpacked_normals.size() / unpack_factor;
-    const int grid_size_pack = (nb_threads_pack + block_size - 1) / block_size;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::COMPUTE_NORMALS, compute_unpacked_normals_tri);
+    const int nb_threads_pack = unpacked_offsets.size() - 1;
+    const int grid_size_pack = Launch_cfg::grid_size(block_size, nb_threads_pack);
 
     const int nb_threads_compute_tri = nb_tri;
-    const int grid_size_compute_tri = (nb_threads_compute_tri + block_size - 1) / block_size;
-
-    CUDA_CHECK_KERNEL_SIZE(block_size, grid_size_clean);
-    clean_unpacked_normals<<< grid_size_clean, block_size>>>(unpacked_normals);
-
-    CUDA_CHECK_ERRORS();
+    const int grid_size_compute_tri = Launch_cfg::grid_size(block_size, nb_threads_compute_tri);
 
     if(nb_tri > 0){
-#if 1
+        CUDA_CHECK_KERNEL_SIZE(block_size, grid_size_compute_tri);
         compute_unpacked_normals_tri<<< grid_size_compute_tri, block_size>>>
                                    (tri,
-                                    piv,
-                                    nb_tri,
-                                    vertices,
-                                    unpacked_normals,unpack_factor);
-#else
-        compute_unpacked_normals_tri_debug_cpu
-                                   (tri,
-                                    piv,
+                                    corner_slots.ptr(),
                                     nb_tri,
                                     vertices,
-                                    unpacked_normals,
-                                    unpack_factor,
-                                    block_size,
-                                    grid_size_compute_tri);
-#endif
+                                    unpacked_normals.ptr());
         CUDA_CHECK_ERRORS();
     }
 
-    pack_normals<<< grid_size_pack, block_size>>>( unpacked_normals,
-                                                  unpack_factor,
+    pack_normals<<< grid_size_pack, block_size>>>(unpacked_normals.ptr(),
+                                                  unpacked_offsets.ptr(),
+                                                  nb_threads_pack,
                                                   out_normals);
     CUDA_CHECK_ERRORS();
 }
@@ -188,33 +157,55 @@ compute_tangent_tri(const Mesh::PrimIdx& pi,
 
 // -----------------------------------------------------------------------------
 
+/// Append each vertex of 'vert_to_fit' (-1 entries are skipped) to the
+/// range of its colour in 'colored': colour c starts at 'color_offsets[c]'
+/// and 'colored_count[c]' (zeroed beforehand) ends up with its size
+__global__
+void group_by_color_kernel(const int* vert_to_fit,
+                           const int* vert_colors,
+                           const int* color_offsets,
+                           int* colored,
+                           int* colored_count,
+                           int nb_verts)
+{
+    const int thread_idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if(thread_idx < nb_verts)
+    {
+        const int p = vert_to_fit[thread_idx];
+        if(p == -1)
+            return;
+        const int c = vert_colors[p];
+        colored[ color_offsets[c] + atomicAdd(colored_count + c, 1) ] = p;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Smooth the vertices 'verts' of one colour. The launch is bounded on the
+/// host, 'nb_verts_color' gives the actual number of vertices
 __global__
-void conservative_smooth_kernel(const Vec3_cu* in_vertices,
-                                Vec3_cu* out_verts,
+void conservative_smooth_kernel(Vec3_cu* vertices,
                                 const Vec3_cu* normals,
                                 const int* edge_list,
                                 const int* edge_list_offsets,
                                 const float* edge_mvc,
-                                const int* vert_to_fit,
+                                const int* verts,
+                                const int* nb_verts_color,
                                 float force,
                                 int nb_verts,
                                 const float* smooth_fac,
                                 bool use_smooth_fac)
 {
     int thread_idx = blockIdx.x * blockDim.x + threadIdx.x;
-    if(thread_idx < nb_verts)
+    if(thread_idx < nb_verts && thread_idx < nb_verts_color[0])
     {
-        const int p = vert_to_fit[thread_idx];
-        if(p == -1)
-            return;
+        const int p = verts[thread_idx];
 
         const Vec3_cu n       = normals[p].normalized();
-        const Vec3_cu in_vert = in_vertices[p];
+        const Vec3_cu in_vert = vertices[p];
 
-        if(n.norm() < 0.00001f){
-            out_verts[p] = in_vert;
+        if(n.norm() < 0.00001f)
             return;
-        }
 
         Vec3_cu cog(0.f, 0.f, 0.f);
 
@@ -226,13 +217,11 @@ void conservative_smooth_kernel(const Vec3_cu* in_vertices,
             const int j = edge_list[i];
             const float mvc = edge_mvc[i];
             sum += mvc;
-            cog =  cog + in_vertices[j] * mvc;
+            cog =  cog + vertices[j] * mvc;
         }
 
-        if( fabs(sum) < 0.00001f ){
-            out_verts[p] = in_vert;
+        if( fabs(sum) < 0.00001f )
             return;
-        }
 
         cog = cog * (1.f/sum);
 
@@ -242,40 +231,22 @@ void conservative_smooth_kernel(const Vec3_cu* in_vertices,
         //const Vec3_cu cog_proj = cog;
 
         const float u = use_smooth_fac ? smooth_fac[p] : force;
-        out_verts[p]  = cog_proj * u + in_vert * (1.f - u);
+        vertices[p]  = cog_proj * u + in_vert * (1.f - u);
     }
 }
 
 // -----------------------------------------------------------------------------
 
-template< class T >
-__global__ static
-void copy_vert_to_fit(const T* d_in,
-                      T* d_out,
-                      const int* vert_to_fit,
-                      int n)
-{
-    int thread_idx = blockIdx.x * blockDim.x + threadIdx.x;
-    if(thread_idx >= n)
-        return;
-
-    const int p = vert_to_fit[thread_idx];
-    if(p == -1)
-        return;
-    
-    d_out[p] = d_in[p];
-}
-
-// -----------------------------------------------------------------------------
-
 void conservative_smooth(Vec3_cu* d_verts,
-                         Vec3_cu* d_buff_verts,
                          Vec3_cu* d_normals,
                          const DA_int& d_edge_list,
                          const DA_int& d_edge_list_offsets,
                          const DA_float& d_edge_mvc,
+                         const Vert_colors& colors,
                          const int* d_vert_to_fit,
                          int nb_vert_to_fit,
+                         int* d_colored_buff,
+                         int* d_colored_count,
                          float strength,
                          int nb_iter,
                          const float* smooth_fac,
@@ -283,53 +254,50 @@ void conservative_smooth(Vec3_cu* d_verts,
 {
     if(nb_vert_to_fit == 0) return;
 
-    const int block_size = 256;
-    // nb_threads == nb_mesh_vertices
-    const int nb_threads = nb_vert_to_fit;
-    const int grid_size  = (nb_threads + block_size - 1) / block_size;
-    Vec3_cu* d_verts_a = d_verts;
-    Vec3_cu* d_verts_b = d_buff_verts;
-
-    // We're double buffering between d_verts and d_buff_verts.  conservative_smooth_kernel
-    // below will only copy entries where d_vert_to_fit[n] isn't negative, which means that
-    // values we're not smoothing won't be copied to the output.  We do need all of the
-    // vertices to be readable, not just the ones we're smoothing, so copy all of the data
-    // to the second buffer.  If we're only doing one pass then we'll never read these values,
-    // so this can be skipped.
-    if(nb_iter > 1)
-        Cuda_utils::mem_cpy_dtd(d_buff_verts, d_verts, d_edge_list_offsets.size()/2);
+    // 'd_vert_to_fit' changes at every fitting step: group it by colour once
+    // per call. Sizes stay in device memory, each colour is launched over
+    // what it could hold at most (its size in 'colors' bounded by the list).
+    const int nb_colors = colors.nb_colors();
+    CUDA_SAFE_CALL(cudaMemsetAsync(d_colored_count, 0, nb_colors * sizeof(int)));
+    const int block_g = Launch_cfg::block_size(Launch_cfg::GROUP_BY_COLOR, group_by_color_kernel);
+    const int grid_g  = Launch_cfg::grid_size(block_g, nb_vert_to_fit);
+    group_by_color_kernel<<<grid_g, block_g>>>(d_vert_to_fit,
+                                               colors.d_colors.ptr(),
+                                               colors.d_offsets.ptr(),
+                                               d_colored_buff,
+                                               d_colored_count,
+                                               nb_vert_to_fit);
+    CUDA_CHECK_ERRORS();
 
+    const int block_size = Launch_cfg::block_size(Launch_cfg::CONSERVATIVE_SMOOTH, conservative_smooth_kernel);
     for(int i = 0; i < nb_iter; i++)
     {
-        conservative_smooth_kernel<<<grid_size, block_size>>>(d_verts_a,
-                                                              d_verts_b,
-                                                              d_normals,
-                                                              d_edge_list.ptr(),
-                                                              d_edge_list_offsets.ptr(),
-                                                              d_edge_mvc.ptr(),
-                                                              d_vert_to_fit,
-                                                              strength,
-                                                              nb_vert_to_fit,
-                                                              smooth_fac,
-                                                              use_smooth_fac);
-        CUDA_CHECK_ERRORS();
-
-        std::swap(d_verts_a, d_verts_b);
-    }
-
-    if(nb_iter % 2 == 1){
-        // d_vertices[n] = d_tmp_vertices[n]
-        copy_vert_to_fit<<<grid_size, block_size>>>
-            (d_buff_verts, d_verts, d_vert_to_fit, nb_threads);
-        CUDA_CHECK_ERRORS();
+        for(int c = 0; c < nb_colors; c++)
+        {
+            const int nb_threads = std::min(colors.size(c), nb_vert_to_fit);
+            if(nb_threads == 0) continue;
+            const int grid_size = Launch_cfg::grid_size(block_size, nb_threads);
+            conservative_smooth_kernel<<<grid_size, block_size>>>(d_verts,
+                                                                  d_normals,
+                                                                  d_edge_list.ptr(),
+                                                                  d_edge_list_offsets.ptr(),
+                                                                  d_edge_mvc.ptr(),
+                                                                  d_colored_buff + colors.offsets[c],
+                                                                  d_colored_count + c,
+                                                                  strength,
+                                                                  nb_threads,
+                                                                  smooth_fac,
+                                                                  use_smooth_fac);
+            CUDA_CHECK_ERRORS();
+        }
     }
 }
 
 // -----------------------------------------------------------------------------
 
 __global__
-void laplacian_smooth_kernel(const Vec3_cu* in_vertices,
-                             Vec3_cu* output_vertices,
+void laplacian_smooth_kernel(Vec3_cu* vertices,
+                             const int* verts,
                              const int* edge_list,
                              const int* edge_list_offsets,
                              const float* factors,
@@ -338,10 +306,11 @@ void laplacian_smooth_kernel(const Vec3_cu* in_vertices,
                              int nb_min_neighbours,
                              int n)
 {
-        int p = blockIdx.x * blockDim.x + threadIdx.x;
-        if(p < n)
+        int idx = blockIdx.x * blockDim.x + threadIdx.x;
+        if(idx < n)
         {
-            Vec3_cu in_vertex = in_vertices[p];
+            const int p = verts[idx];
+            Vec3_cu in_vertex = vertices[p];
             Vec3_cu centroid  = Vec3_cu(0.f, 0.f, 0.f);
             float   factor    = factors[p];
 
@@ -351,18 +320,16 @@ void laplacian_smooth_kernel(const Vec3_cu* in_vertices,
             {
                 for(int i = offset; i < offset + nb_ngb; i++){
                     int j = edge_list[i];
-                    centroid += in_vertices[j];
+                    centroid += vertices[j];
                 }
 
                 centroid = centroid * (1.f/nb_ngb);
 
                 if(use_smooth_factors)
-                    output_vertices[p] = centroid * factor + in_vertex * (1.f-factor);
+                    vertices[p] = centroid * factor + in_vertex * (1.f-factor);
                 else
-                    output_vertices[p] = centroid * strength + in_vertex * (1.f-strength);
+                    vertices[p] = centroid * strength + in_vertex * (1.f-strength);
             }
-            else
-                output_vertices[p] = in_vertex;
         }
 
 }
@@ -370,7 +337,7 @@ void laplacian_smooth_kernel(const Vec3_cu* in_vertices,
 // -----------------------------------------------------------------------------
 
 void laplacian_smooth(Vec3_cu* d_vertices,
-                      Vec3_cu* d_tmp_vertices,
+                      const Vert_colors& colors,
                       DA_int d_edge_list,
                       DA_int d_edge_list_offsets,
                       const float* factors,
@@ -379,53 +346,52 @@ void laplacian_smooth(Vec3_cu* d_vertices,
                       int nb_iter,
                       int nb_min_neighbours)
 {
-    const int block_size = 256;
-    // nb_threads == nb_mesh_vertices
-    const int nb_threads = d_edge_list_offsets.size() / 2;
-    const int grid_size = (nb_threads + block_size - 1) / block_size;
-    Vec3_cu* d_vertices_a = d_vertices;
-    Vec3_cu* d_vertices_b = d_tmp_vertices;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::LAPLACIAN_SMOOTH, laplacian_smooth_kernel);
+    // Measured on juna.obj with noise: Gauss-Seidel sweeps halve the
+    // iterations at full strength (4 match 7 Jacobi ones). At the strength
+    // used by the deformer (0.5) 6 sweeps smooth about as much as 7 Jacobi
+    // ones, so the default iteration counts are kept.
     for(int i = 0; i < nb_iter; i++)
     {
-        laplacian_smooth_kernel<<<grid_size, block_size>>>(d_vertices_a,
-                                                           d_vertices_b,
-                                                           d_edge_list.ptr(),
-                                                           d_edge_list_offsets.ptr(),
-                                                           factors,
-                                                           use_smooth_factors,
-                                                           strength,
-                                                           nb_min_neighbours,
-                                                           nb_threads);
-        CUDA_CHECK_ERRORS();
-        std::swap(d_vertices_a, d_vertices_b);
-    }
-
-    if(nb_iter % 2 == 1){
-        // d_vertices[n] = d_tmp_vertices[n]
-        copy_arrays<<<grid_size, block_size>>>(d_tmp_vertices, d_vertices, nb_threads);
-        CUDA_CHECK_ERRORS();
+        for(int c = 0; c < colors.nb_colors(); c++)
+        {
+            const int nb_threads = colors.size(c);
+            if(nb_threads == 0) continue;
+            const int grid_size = Launch_cfg::grid_size(block_size, nb_threads);
+            laplacian_smooth_kernel<<<grid_size, block_size>>>(d_vertices,
+                                                               colors.verts(c),
+                                                               d_edge_list.ptr(),
+                                                               d_edge_list_offsets.ptr(),
+                                                               factors,
+                                                               use_smooth_factors,
+                                                               strength,
+                                                               nb_min_neighbours,
+                                                               nb_threads);
+            CUDA_CHECK_ERRORS();
+        }
     }
 }
 
 // -----------------------------------------------------------------------------
 
 __global__
-void tangential_smooth_kernel_first_pass(const Vec3_cu* in_vertices,
-                                         const Vec3_cu* in_normals,
-                                         Vec3_cu* out_vector,
-                                         const int* edge_list,
-                                         const int* edge_list_offsets,
-                                         const float* factors,
-                                         bool use_smooth_factors,
-                                         float strength,
-                                         int nb_min_neighbours,
-                                         int n)
+void tangential_smooth_kernel(Vec3_cu* vertices,
+                              const Vec3_cu* in_normals,
+                              const int* verts,
+                              const int* edge_list,
+                              const int* edge_list_offsets,
+                              const float* factors,
+                              bool use_smooth_factors,
+                              float strength,
+                              int nb_min_neighbours,
+                              int n)
 {
-    int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if(p >= n)
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if(idx >= n)
         return;
 
-    Vec3_cu in_vertex = in_vertices[p];
+    const int p = verts[idx];
+    Vec3_cu in_vertex = vertices[p];
     Vec3_cu in_normal = in_normals[p];
     Vec3_cu centroid  = Vec3_cu(0.f, 0.f, 0.f);
 
@@ -436,13 +402,12 @@ void tangential_smooth_kernel_first_pass(const Vec3_cu* in_vertices,
         // We don't have enough neighbors to calculate the centroid.  Note that this vertex
         // is in edge_list_offsets, but we don't count as one of our own neighbors, hence
         // nb_ngb <= nb_min_neighbours rather than nb_ngb < nb_min_neighbours.
-        out_vector[p] = Vec3_cu(0.f, 0.f, 0.f);
         return;
     }
 
     for(int i = offset; i < offset + nb_ngb; i++){
         int j = edge_list[i];
-        centroid += in_vertices[j];
+        centroid += vertices[j];
     }
 
     centroid = centroid * (1.f/nb_ngb);
@@ -452,22 +417,8 @@ void tangential_smooth_kernel_first_pass(const Vec3_cu* in_vertices,
 
     Vec3_cu u = centroid - in_vertex;
 
-    // Why don't we just output the sum into out_vector, instead of making a separate
-    // addition pass?
-    out_vector[p] = u - (in_normal * u.dot(in_normal));
-}
-
-// -----------------------------------------------------------------------------
-
-__global__
-void tangential_smooth_kernel_final_pass(const Vec3_cu* in_vertices,
-                                         const Vec3_cu* in_vector,
-                                         Vec3_cu* out_vertices,
-                                         int n)
-{
-    int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if(p < n)
-        out_vertices[p] = in_vertices[p] + in_vector[p];
+    // Neighbours have another colour, so we can move the vertex in place.
+    vertices[p] = in_vertex + (u - (in_normal * u.dot(in_normal)));
 }
 
 // -----------------------------------------------------------------------------
@@ -517,17 +468,18 @@ void hc_smooth_kernel_first_pass(const Vec3_cu* original_vertices,
 
 __global__
 void hc_smooth_kernel_final_pass(const Vec3_cu* in_vectors,
-                                 const Vec3_cu* in_vertices,
-                                 Vec3_cu* out_vertices,
+                                 Vec3_cu* vertices,
+                                 const int* verts,
                                  float beta,
                                  const int* edge_list,
                                  const int* edge_list_offsets,
                                  int nb_min_neighbours,
                                  int n)
 {
-    int p = blockIdx.x * blockDim.x + threadIdx.x;
-    if(p < n)
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if(idx < n)
     {
+        const int p = verts[idx];
         Vec3_cu centroid = Vec3_cu(0.f, 0.f, 0.f);
         Vec3_cu mean_vec = Vec3_cu(0.f, 0.f, 0.f);
         Vec3_cu in_vec   = in_vectors[p];
@@ -539,8 +491,8 @@ void hc_smooth_kernel_final_pass(const Vec3_cu* in_vectors,
         {
             for(int i = offset; i < offset + nb_ngb; i++){
                 int j = edge_list[i];
-                centroid += in_vertices[j];
-                mean_vec += in_vectors [j];
+                centroid += vertices  [j];
+                mean_vec += in_vectors[j];
             }
 
             float div = 1.f/nb_ngb;
@@ -548,10 +500,8 @@ void hc_smooth_kernel_final_pass(const Vec3_cu* in_vectors,
             mean_vec = mean_vec * div;
 
             Vec3_cu vec = in_vec*beta + mean_vec*(1.f-beta);
-            out_vertices[p] = centroid - vec;
+            vertices[p] = centroid - vec;
         }
-        else
-            out_vertices[p] = in_vertices[p];
     }
 
 }
@@ -563,7 +513,7 @@ void hc_smooth_kernel_final_pass(const Vec3_cu* in_vectors,
 void hc_laplacian_smooth(const DA_Vec3_cu& d_original_vertices,
                          Vec3_cu* d_smoothed_vertices,
                          Vec3_cu* d_vector_correction,
-                         Vec3_cu* d_tmp_vertices,
+                         const Vert_colors& colors,
                          DA_int d_edge_list,
                          DA_int d_edge_list_offsets,
                          const float* factors,
@@ -573,18 +523,18 @@ void hc_laplacian_smooth(const DA_Vec3_cu& d_original_vertices,
                          int nb_iter,
                          int nb_min_neighbours)
 {
-    const int block_size = 256;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::HC_SMOOTH, hc_smooth_kernel_first_pass);
     // nb_threads == nb_mesh_vertices
     const int nb_threads = d_edge_list_offsets.size() / 2;
-    const int grid_size = (nb_threads + block_size - 1) / block_size;
-    Vec3_cu* d_vertices_a = d_smoothed_vertices;
-    Vec3_cu* d_vertices_b = d_tmp_vertices;
+    const int grid_size = Launch_cfg::grid_size(block_size, nb_threads);
 
     for(int i = 0; i < nb_iter; i++)
     {
+        // The correction vectors only read the vertices so they are computed
+        // for the whole mesh at once
         hc_smooth_kernel_first_pass
                 <<<grid_size, block_size>>>(d_original_vertices.ptr(),
-                                            d_vertices_a,         // in vert
+                                            d_smoothed_vertices,  // in vert
                                             d_vector_correction,  // out vec
                                             d_edge_list.ptr(),
                                             d_edge_list_offsets.ptr(),
@@ -595,24 +545,22 @@ void hc_laplacian_smooth(const DA_Vec3_cu& d_original_vertices,
                                             nb_threads);
         CUDA_CHECK_ERRORS();
 
-        hc_smooth_kernel_final_pass
-                <<<grid_size, block_size>>>(d_vector_correction,
-                                            d_vertices_a,
-                                            d_vertices_b,
-                                            beta,
-                                            d_edge_list.ptr(),
-                                            d_edge_list_offsets.ptr(),
-                                            nb_min_neighbours,
-                                            nb_threads);
-        CUDA_CHECK_ERRORS();
-
-        std::swap(d_vertices_a, d_vertices_b);
-    }
-
-    if(nb_iter % 2 == 1){
-        // d_vertices[n] = d_tmp_vertices[n]
-        copy_arrays<<<grid_size, block_size>>>(d_tmp_vertices, d_smoothed_vertices, nb_threads);
-        CUDA_CHECK_ERRORS();
+        for(int c = 0; c < colors.nb_colors(); c++)
+        {
+            const int nb_threads_c = colors.size(c);
+            if(nb_threads_c == 0) continue;
+            const int grid_size_c = Launch_cfg::grid_size(block_size, nb_threads_c);
+            hc_smooth_kernel_final_pass
+                    <<<grid_size_c, block_size>>>(d_vector_correction,
+                                                  d_smoothed_vertices,
+                                                  colors.verts(c),
+                                                  beta,
+                                                  d_edge_list.ptr(),
+                                                  d_edge_list_offsets.ptr(),
+                                                  nb_min_neighbours,
+                                                  nb_threads_c);
+            CUDA_CHECK_ERRORS();
+        }
     }
 }
 
@@ -657,10 +605,10 @@ void diffuse_values(float* d_values,
                     int nb_iter)
 {
 
-    const int block_size = 256;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::DIFFUSION, diffusion_kernel);
     // nb_threads == nb_mesh_vertices
     const int nb_threads = d_edge_list_offsets.size() / 2;
-    const int grid_size = (nb_threads + block_size - 1) / block_size;
+    const int grid_size = Launch_cfg::grid_size(block_size, nb_threads);
     float* d_values_a = d_values;
     float* d_values_b = d_values_buffer;
     strength = std::max( 0.f, std::min(1.f, strength));
@@ -717,6 +665,24 @@ void compute_base_potential(Skeleton_env::Skel_id skel_id,
 
 // -----------------------------------------------------------------------------
 
+__global__
+void compute_base_potential(Skeleton_env::Skel_id skel_id,
+                            const Point_cu* in_verts,
+                            const int* verts,
+                            const int nb_verts,
+                            float* base_potential)
+{
+    const int thread_idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if(thread_idx < nb_verts)
+    {
+        const int p = verts[thread_idx];
+        Vec3_cu grad;
+        base_potential[p] = eval_potential(skel_id, in_verts[p], grad);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 __device__
 float binary_search(Skeleton_env::Skel_id skel_id,
                         const Ray_cu&r,
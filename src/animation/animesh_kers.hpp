@@ -7,6 +7,8 @@
 #include "skeleton.hpp"
 #include "animesh_enum.hpp"
 
+#include <vector>
+
 /** @namespace Kernels
     @brief The cuda kernels used to animate the mesh
 
@@ -28,6 +30,14 @@ compute_base_potential(Skeleton_env::Skel_id skel_id,
                        const int nb_verts,
                        float* d_base_potential);
 
+/// Same as above for the vertices listed in 'd_verts' only
+__global__ void
+compute_base_potential(Skeleton_env::Skel_id skel_id,
+                       const Point_cu* d_input_vertices,
+                       const int* d_verts,
+                       const int nb_verts,
+                       float* d_base_potential);
+
 /// Match the base potential after basic ssd deformation
 /// (i.e : do the implicit skinning step)
 __global__
@@ -63,41 +73,79 @@ void fill_grid_with_fngf(int bone_id,
 */
 
 /// Compute on GPU the normals of the mesh using the normal at each face
+/// @param corner_slots : for each face corner (3*nb_tri) its slot in
+/// 'unpacked_normals'
+/// @param unpacked_offsets : CSR offsets (nb_vert+1) of each vertex slots in
+/// 'unpacked_normals'. Slots of vertex i are in [offsets[i], offsets[i+1][
+/// @param unpacked_normals : temporary storage of size 3*nb_tri
 void compute_normals(const int* tri,
-                     Device::Array<Mesh::PrimIdxVertices> piv,
+                     const DA_int& corner_slots,
+                     const DA_int& unpacked_offsets,
                      int nb_tri,
                      const Vec3_cu* vertices,
                      Device::Array<Vec3_cu> unpacked_normals,
-                     int unpack_factor,
                      Vec3_cu* out_normals);
 
+/// Greedy graph colouring of the mesh one-ring: two vertices sharing an edge
+/// never have the same colour. Smoothing kernels are launched once per colour
+/// and update the vertices in place (multicolour Gauss-Seidel), which
+/// converges faster than ping-ponging between two buffers and spares the
+/// temporary buffer.
+struct Vert_colors {
+    DA_int d_verts;           ///< vertex indices sorted by colour
+    DA_int d_colors;          ///< colour of each vertex (size nb_verts)
+    std::vector<int> offsets; ///< vertices of colour c are in d_verts[offsets[c] offsets[c+1][
+    DA_int d_offsets;         ///< device copy of 'offsets'
+
+    int nb_colors() const { return offsets.size() > 0 ? (int)offsets.size() - 1 : 0; }
+
+    /// @return number of vertices with the colour 'c' (may be zero when the
+    /// colours are restricted to a subset of the mesh)
+    int size(int c) const { return offsets[c+1] - offsets[c]; }
+
+    /// @return device pointer to the vertex indices of colour 'c'
+    const int* verts(int c) const { return d_verts.ptr() + offsets[c]; }
+};
+
+// -----------------------------------------------------------------------------
+
 /// Tangential relaxation of the vertices. Each vertex is expressed with the
 /// mean value coordinates (mvc) of its neighborhood. While animating we try
 /// to move back the vertices to their old position with the mvc.
 /// (N.B mvc are barycentric coordinates computed in the tangent plane of the
 /// vertex, the plane can be defined either by the vertex's normal or
 /// implicit gradient)
+/// Vertices are smoothed in place, one colour at a time.
+/// @param d_vert_to_fit : 'nb_vert_to_fit' vertices to smooth, -1 entries
+/// are skipped
+/// @param d_colored_buff : 'd_vert_to_fit' grouped by colour, allocated with
+/// 'colors.d_verts.size()' elements
+/// @param d_colored_count : number of vertices of each colour in
+/// 'd_colored_buff', allocated with 'colors.nb_colors()' elements
 void conservative_smooth(Vec3_cu* d_vertices,
-                         Vec3_cu* d_tmp_vertices,
                          Vec3_cu* d_normals,
                          const DA_int& d_edge_list,
                          const DA_int& d_edge_list_offsets,
                          const DA_float& d_edge_mvc,
+                         const Vert_colors& colors,
                          const int* d_vert_to_fit,
                          int nb_vert_to_fit,
+                         int* d_colored_buff,
+                         int* d_colored_count,
                          float strength,
                          int nb_iter,
                          const float* smooth_fac,
                          bool use_smooth_fac);
 
 /// A basic laplacian smooth which move the vertices between its position
-/// and the barycenter of its neighborhoods
+/// and the barycenter of its neighborhoods. Vertices are smoothed in place,
+/// one colour at a time.
 /// @param factor sets for each vertex a weight between [0 1] which define
 /// the smoothing strenght
 /// @param use_smooth_factors do we use the array "factor" for smoothing
 /// @param strength smoothing force when "use_smooth_factors"==false
 void laplacian_smooth(Vec3_cu* d_vertices,
-                      Vec3_cu* d_tmp_vertices,
+                      const Vert_colors& colors,
                       DA_int d_edge_list,
                       DA_int d_edge_list_offsets,
                       const float* factors,
@@ -108,10 +156,12 @@ void laplacian_smooth(Vec3_cu* d_vertices,
 
 /// A better laplacian smoothing algorithm which avoids shrinkage of the mesh
 /// see article "Improved Laplacian Smoothing of Noisy Surface Meshes"
+/// Correction vectors are computed for the whole mesh then vertices are
+/// updated in place one colour at a time.
 void hc_laplacian_smooth(const DA_Vec3_cu& d_original_vertices,
                          Vec3_cu* d_smoothed_vertices,
                          Vec3_cu* d_vector_correction,
-                         Vec3_cu* d_tmp_vertices,
+                         const Vert_colors& colors,
                          DA_int d_edge_list,
                          DA_int d_edge_list_offsets,
                          const float* factors,
@@ -149,31 +199,24 @@ void copy_arrays(const T* d_in, T* d_out, int n)
 __global__
 void fill_index(DA_int array);
 
-/// @param d_in_vertices vertices to be smoothed
-/// @param d_in_normals normals associated to the array d_in_vertices
-/// @param d_out_vector Correction vector to aply to vertices in the final stage
-/// of the smoothing
+/// Move in place the vertices listed in 'verts' toward the barycenter of
+/// their neighborhood, only along their tangent plane.
+/// @param vertices vertices to be smoothed (in place)
+/// @param in_normals normals associated to the array 'vertices'
+/// @param verts subset of vertices to smooth, no two of them may be adjacent
 /// @param factors smoothing strength at each vertices
-/// @param n number of vertices
+/// @param n number of vertices in 'verts'
 __global__
-void tangential_smooth_kernel_first_pass(const Vec3_cu* in_vertices,
-                                         const Vec3_cu* in_normals,
-                                         Vec3_cu* out_vector,
-                                         const int* edge_list,
-                                         const int* edge_list_offsets,
-                                         const float* factors,
-                                         bool use_smooth_factors,
-                                         float strength,
-                                         int nb_min_neighbours,
-                                         int n);
-
-__global__
-void tangential_smooth_kernel_final_pass(const Vec3_cu* in_vertices,
-                                         const Vec3_cu* in_vector,
-                                         Vec3_cu* out_vertices,
-                                         int n);
-
-
+void tangential_smooth_kernel(Vec3_cu* vertices,
+                              const Vec3_cu* in_normals,
+                              const int* verts,
+                              const int* edge_list,
+                              const int* edge_list_offsets,
+                              const float* factors,
+                              bool use_smooth_factors,
+                              float strength,
+                              int nb_min_neighbours,
+                              int n);
 
 }// END Animesh_kers NAMESPACE =================================================
 
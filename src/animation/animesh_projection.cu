@@ -10,16 +10,31 @@
 #include "cuda_ctrl.hpp"
 #include "timer.hpp"
 #include "cuda_current_device.hpp"
+#include "cuda_launch_config.hpp"
 #include "std_utils.hpp"
+#include "base_potential_cache.hpp"
+
+#include <algorithm>
+
+// -----------------------------------------------------------------------------
+
+/// Block size of both Animesh_kers::compute_base_potential() overloads
+static int base_potential_block_size()
+{
+    void (*ker)(Skeleton_env::Skel_id, const Point_cu*, int, float*) =
+            Animesh_kers::compute_base_potential;
+    return Launch_cfg::block_size(Launch_cfg::BASE_POTENTIAL, ker);
+}
+
+// -----------------------------------------------------------------------------
 
 void Animesh::calculate_base_potential(std::vector<float> &out) const
 {
     Timer time;
     time.start();
     const int nb_verts = d_input_vertices.size();
-    const int block_size = 256;
-    const int grid_size =
-            (nb_verts + block_size - 1) / block_size;
+    const int block_size = base_potential_block_size();
+    const int grid_size  = Launch_cfg::grid_size(block_size, nb_verts);
 
     assert(d_input_vertices.ptr());
     assert(d_base_potential.ptr());
@@ -33,18 +48,71 @@ void Animesh::calculate_base_potential(std::vector<float> &out) const
     CUDA_CHECK_ERRORS();
 
     std::cout << "Update base potential in " << time.stop() << " sec" << std::endl;
-    out = base_potential.to_host_vector();
+    out = to_input_order( base_potential.to_host_vector() );
+}
+
+void Animesh::update_base_potential(std::vector<float> &out) const
+{
+    Timer time;
+    time.start();
+    _skel->update_bones_data();
+
+    const std::vector<Point_cu> verts = d_input_vertices.to_host_vector();
+    const uint64_t key = Base_potential_cache::global_key( to_input_order(verts) );
+
+    Base_potential_cache::Record rec;
+    std::map<Bone::Id, Base_potential_cache::Bone_key> bones;
+    Base_potential_cache::bone_keys(*_skel, bones);
+
+    if( !Base_potential_cache::load(key, rec) || (int)rec.potential.size() != get_nb_vertices() )
+    {
+        calculate_base_potential(out);
+    }
+    else
+    {
+        // Vertices are compared in our internal order so the kernel reads
+        // contiguous indices
+        std::vector<int> dirty;
+        Base_potential_cache::dirty_vertices(rec, bones, verts, dirty);
+
+        out = rec.potential;
+        if( dirty.size() > 0 )
+        {
+            const int nb_dirty = (int)dirty.size();
+            const int block_size = base_potential_block_size();
+            const int grid_size  = Launch_cfg::grid_size(block_size, nb_dirty);
+
+            Cuda_utils::Device::Array<float> base_potential;
+            base_potential.malloc(get_nb_vertices());
+            base_potential.copy_from( to_internal_order(out) );
+            Cuda_utils::Device::Array<int> d_dirty;
+            d_dirty.malloc(nb_dirty);
+            d_dirty.copy_from(dirty);
+
+            Animesh_kers::compute_base_potential<<<grid_size, block_size>>>
+                (_skel->get_skel_id(), d_input_vertices.ptr(), d_dirty.ptr(), nb_dirty, base_potential.ptr());
+
+            CUDA_CHECK_ERRORS();
+            out = to_input_order( base_potential.to_host_vector() );
+        }
+        std::cout << "Update base potential of " << dirty.size() << "/" << verts.size();
+        std::cout << " vertices in " << time.stop() << " sec" << std::endl;
+    }
+
+    rec.bones = bones;
+    rec.potential = out;
+    Base_potential_cache::save(key, rec);
 }
 
 void Animesh::get_base_potential(std::vector<float> &pot) const
 {
-    pot = d_base_potential.to_host_vector();
+    pot = to_input_order( d_base_potential.to_host_vector() );
 }
 
 void Animesh::set_base_potential(const std::vector<float> &pot)
 {
     d_base_potential.malloc(get_nb_vertices());
-    d_base_potential.copy_from(pot);
+    d_base_potential.copy_from( to_internal_order(pot) );
 }
 
 void Animesh::compute_normals(const Vec3_cu* vertices, Vec3_cu* normals)
@@ -54,10 +122,10 @@ void Animesh::compute_normals(const Vec3_cu* vertices, Vec3_cu* normals)
 
     Animesh_kers::compute_normals(d_input_tri.ptr(),
                                     d_piv,
+                                    d_unpacked_offsets,
                                     _mesh->get_nb_tri(),
                                     vertices,
                                     d_unpacked_normals,
-                                    _mesh->_max_faces_per_vertex,
                                     normals);
     CUDA_CHECK_ERRORS();
 }
@@ -66,46 +134,33 @@ void Animesh::compute_normals(const Vec3_cu* vertices, Vec3_cu* normals)
 
 void Animesh::tangential_smooth(const float* factors,
                                 Vec3_cu* d_vertices,
-                                Vec3_cu* d_vertices_prealloc,
                                 Vec3_cu* d_normals,
                                 int nb_iter)
 {
-    const int block_size = 256;
-    // nb_threads == nb_mesh_vertices
-    const int nb_threads = d_edge_list_offsets.size() / 2;
-    const int grid_size = (nb_threads + block_size - 1) / block_size;
-    Vec3_cu* d_vertices_a = d_vertices;
-    Vec3_cu* d_vertices_b = d_vertices_prealloc;
-
+    const int block_size = Launch_cfg::block_size(Launch_cfg::TANGENTIAL_SMOOTH,
+                                                  Animesh_kers::tangential_smooth_kernel);
     for(int i = 0; i < nb_iter; i++)
     {
-        compute_normals(d_vertices_a, d_normals);
-
-        Animesh_kers::tangential_smooth_kernel_first_pass
-                <<<grid_size, block_size>>>(d_vertices_a,  // in vertices
-                                            d_normals,     // in normals
-                                            d_vertices_b,  // out vector
-                                            d_edge_list.ptr(),
-                                            d_edge_list_offsets.ptr(),
-                                            factors,
-                                            do_local_smoothing,
-                                            smooth_force_a,
-                                            3,
-                                            nb_threads);
-
-        Animesh_kers::tangential_smooth_kernel_final_pass
-                <<<grid_size, block_size>>>(d_vertices_a, // in vertices
-                                            d_vertices_b, // in vector
-                                            d_vertices_b, // res = vert + vec
-                                            nb_threads);
-
-        std::swap(d_vertices_a, d_vertices_b);
-    }
+        compute_normals(d_vertices, d_normals);
 
-    if(nb_iter % 2 == 1)
-    {
-        Animesh_kers::copy_arrays<<<grid_size, block_size>>>
-            (d_vertices_prealloc, d_vertices, nb_threads);
+        const Animesh_kers::Vert_colors& colors = active_colors();
+        for(int c = 0; c < colors.nb_colors(); c++)
+        {
+            const int nb_threads = colors.size(c);
+            if(nb_threads == 0) continue;
+            const int grid_size = Launch_cfg::grid_size(block_size, nb_threads);
+            Animesh_kers::tangential_smooth_kernel
+                    <<<grid_size, block_size>>>(d_vertices,
+                                                d_normals,
+                                                colors.verts(c),
+                                                d_edge_list.ptr(),
+                                                d_edge_list_offsets.ptr(),
+                                                factors,
+                                                do_local_smoothing,
+                                                smooth_force_a,
+                                                3,
+                                                nb_threads);
+        }
     }
 }
 
@@ -123,39 +178,42 @@ void Animesh::smooth_mesh(Vec3_cu* output_vertices,
     case EAnimesh::NONE:
         break;
     case EAnimesh::LAPLACIAN:
-        Animesh_kers::laplacian_smooth(output_vertices, d_vert_buffer.ptr(), d_edge_list,
+        Animesh_kers::laplacian_smooth(output_vertices, active_colors(), d_edge_list,
                                        d_edge_list_offsets, factors, local_smoothing,
                                        smooth_force_a, nb_iter, 3);
         break;
     case EAnimesh::CONSERVATIVE:
         Animesh_kers::conservative_smooth(output_vertices,
-                                          d_vert_buffer.ptr(),
                                           d_gradient.ptr(),
                                           d_edge_list,
                                           d_edge_list_offsets,
                                           d_edge_mvc,
-                                          d_vert_to_fit_base.ptr(),
-                                          d_vert_to_fit_base.size(),
+                                          active_colors(),
+                                          active_vert_to_fit().ptr(),
+                                          active_vert_to_fit().size(),
+                                          d_vert_to_fit_colored.ptr(),
+                                          d_nb_vert_to_fit_colored.ptr(),
                                           smooth_force_a,
                                           nb_iter,
                                           factors,//smooth fac
                                           local_smoothing);// use smooth fac ?
         break;
     case EAnimesh::TANGENTIAL:
-        tangential_smooth(factors, output_vertices, d_vert_buffer.ptr(), d_vert_buffer_2.ptr(), nb_iter);
+        tangential_smooth(factors, output_vertices, d_vert_buffer_2.ptr(), nb_iter);
         break;
     case EAnimesh::HUMPHREY:
 
         const int nb_vert    = d_input_vertices.size();
-        const int block_size = 16;
-        const int grid_size  = (nb_vert + block_size - 1) / block_size;
+        const int block_size = Launch_cfg::block_size(Launch_cfg::COPY_ARRAYS,
+                                                      Animesh_kers::copy_arrays<Vec3_cu>);
+        const int grid_size  = Launch_cfg::grid_size(block_size, nb_vert);
 
         Animesh_kers::copy_arrays<<<grid_size, block_size >>>(output_vertices, d_vert_buffer.ptr(), nb_vert);
 
         Animesh_kers::hc_laplacian_smooth(d_vert_buffer,
                                           output_vertices,
                                           d_vert_buffer_2.ptr(),
-                                          d_vert_buffer_3.ptr(),
+                                          active_colors(),
                                           d_edge_list,
                                           d_edge_list_offsets,
                                           factors,
@@ -172,19 +230,20 @@ void Animesh::smooth_mesh(Vec3_cu* output_vertices,
 // -----------------------------------------------------------------------------
 
 void Animesh::conservative_smooth(Vec3_cu* output_vertices,
-                                  Vec3_cu* buff,
                                   const Cuda_utils::DA_int& d_vert_to_fit,
                                   int nb_vert_to_fit,
                                   int nb_iter)
 {
     Animesh_kers::conservative_smooth(output_vertices,
-                                      buff,
                                       d_gradient.ptr(),
                                       d_edge_list,
                                       d_edge_list_offsets,
                                       d_edge_mvc,
+                                      active_colors(),
                                       d_vert_to_fit.ptr(),
                                       nb_vert_to_fit,
+                                      d_vert_to_fit_colored.ptr(),
+                                      d_nb_vert_to_fit_colored.ptr(),
                                       smooth_force_a,
                                       nb_iter,
                                       d_smooth_factors_conservative.ptr(),
@@ -208,8 +267,9 @@ void Animesh::fit_mesh(int nb_vert_to_fit,
     assert(d_vertices_state.ptr());
 
     const int nb_vert    = nb_vert_to_fit;
-    const int block_size = 16;
-    const int grid_size  = (nb_vert + block_size - 1) / block_size;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::MATCH_BASE_POTENTIAL,
+                                                  Animesh_kers::match_base_potential);
+    const int grid_size  = Launch_cfg::grid_size(block_size, nb_vert);
 
     CUDA_CHECK_ERRORS();
     CUDA_CHECK_KERNEL_SIZE(block_size, grid_size);
@@ -252,9 +312,13 @@ void Animesh::transform_vertices()
 
     d_smooth_factors_laplacian.copy_from( d_input_smooth_factors );
     // d_vert_to_fit_base: a list of vertices that fit_mesh should be applied to;
-    // doesn't depend on the results of skinning
-    d_vert_to_fit.copy_from(d_vert_to_fit_base);
-    int nb_vert_to_fit = d_vert_to_fit.size();
+    // doesn't depend on the results of skinning.  When only a subset of the mesh
+    // is deformed (set_active_vertices()) the lists and colours are restricted to it.
+    const Cuda_utils::DA_int& vert_to_fit_base = active_vert_to_fit();
+    int nb_vert_to_fit = vert_to_fit_base.size();
+    if(_partial && nb_vert_to_fit == 0)
+        return; // Nothing to deform: the output is the input
+    d_vert_to_fit.copy_from(vert_to_fit_base);
     const int nb_steps = nb_transform_steps;
 
     Cuda_utils::DA_int* curr = &d_vert_to_fit;
@@ -266,6 +330,15 @@ void Animesh::transform_vertices()
         cudaEvent_t event;
         cudaEventCreate(&event);
 
+        // The number of vertices left to fit stays in device memory.  It's copied back
+        // asynchronously and polled without waiting: since the list only shrinks, any
+        // count we read bounds the lists of the next passes (pack_vert_to_fit_gpu()
+        // moves the remaining indices first and fills the rest with -1).  Passes are
+        // launched over that bound, and we stop once it reaches zero.
+        cudaEvent_t count_event;
+        cudaEventCreateWithFlags(&count_event, cudaEventDisableTiming);
+        bool count_pending = false;
+
         // Interleaved fitting
         // Should we be doing nb_steps/2 steps here, since we're doing two steps per iteration?
         for( int i = 0; i < nb_steps && nb_vert_to_fit != 0; i++)
@@ -275,7 +348,7 @@ void Animesh::transform_vertices()
             fit_mesh(nb_vert_to_fit, curr->ptr(), true/*smooth from iso*/, out_verts, 2, smooth_force_a);
 
             // Querying an event causes CUDA to flush the kernel queue to the GPU.  If we don't do this,
-            // fit_mesh won't actually start until we do our readback in pack_vert_to_fit_gpu down below.
+            // fit_mesh won't start until the queue is flushed by the driver.
             // This allows the expensive fit_mesh kernel to start, while we queue the rest of the kernels
             // in parallel, which takes some time on Windows.
             cudaEventRecord(event);
@@ -283,16 +356,30 @@ void Animesh::transform_vertices()
 
             // user smoothing
             //smooth_mesh(output_vertices, d_smooth_factors.ptr(), smoothing_iter, false/*local smoothing*/);
-            conservative_smooth(out_verts, d_vert_buffer.ptr(), *curr, nb_vert_to_fit, smoothing_iter);
+            conservative_smooth(out_verts, *curr, nb_vert_to_fit, smoothing_iter);
 
             // Copy values from curr to prev that don't have a value of -1, to remove indices that are
-            // finished.  Update nb_vert_to_fit with the new number of remaining vertices.
-            nb_vert_to_fit = pack_vert_to_fit_gpu(*curr, d_vert_to_fit_buff_scan, *prev, nb_vert_to_fit );
+            // finished.  The new number of remaining vertices is written to d_nb_vert_to_fit.
+            pack_vert_to_fit_gpu(*curr, *prev, d_nb_vert_to_fit.ptr(), nb_vert_to_fit);
 
             // Switch curr and prev, so we use the new pruned index list for the next pass.
             std::swap(curr, prev);
+
+            // Tighten the bound if a previous count has arrived, then ask for this one.
+            if(count_pending && cudaEventQuery(count_event) == cudaSuccess)
+            {
+                nb_vert_to_fit = std::min(nb_vert_to_fit, h_nb_vert_to_fit[0]);
+                count_pending = false;
+            }
+            if(!count_pending)
+            {
+                cudaMemcpyAsync(h_nb_vert_to_fit.ptr(), d_nb_vert_to_fit.ptr(), sizeof(int), cudaMemcpyDeviceToHost);
+                cudaEventRecord(count_event);
+                count_pending = true;
+            }
         }
 
+        cudaEventDestroy(count_event);
         cudaEventDestroy(event);
     }
     else
@@ -300,7 +387,7 @@ void Animesh::transform_vertices()
         // First fitting
         if(nb_vert_to_fit > 0)
         {
-            d_vert_to_fit.copy_from(d_vert_to_fit_base);
+            d_vert_to_fit.copy_from(vert_to_fit_base);
             fit_mesh(nb_vert_to_fit, curr->ptr(), false/*smooth from iso*/, out_verts, nb_steps, Cuda_ctrl::_debug._smooth1_force);
         }
     }
@@ -314,8 +401,8 @@ void Animesh::transform_vertices()
     if(final_fitting)
     {
         // Reset d_vert_to_fit, so we always re-fit all vertices on this pass.
-        curr->copy_from(d_vert_to_fit_base);
-        fit_mesh(curr->size(), curr->ptr(), false/*smooth from iso*/, out_verts, nb_steps, Cuda_ctrl::_debug._smooth2_force);
+        curr->copy_from(vert_to_fit_base);
+        fit_mesh(vert_to_fit_base.size(), curr->ptr(), false/*smooth from iso*/, out_verts, nb_steps, Cuda_ctrl::_debug._smooth2_force);
     }
 
     // Final smoothing
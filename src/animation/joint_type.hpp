@@ -20,6 +20,9 @@ enum Joint_t {
     MAX,
     /// Gradient controlled bulge in contact
     BULGE,    
+    /// Gradient controlled bulge in contact with the joint's own bulge
+    /// strength (4D operator, Blending_env::FAMILY_4D_BULGE)
+    BULGE_4D,
     NB_JOINT_T,
     NONE,
     /// Types with values higher than this enumerant
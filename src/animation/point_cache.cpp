@@ -0,0 +1,238 @@
+#include "point_cache.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+
+#include "animesh_base.hpp"
+
+// =============================================================================
+namespace Point_cache {
+// =============================================================================
+
+static bool is_little_endian()
+{
+    const int one = 1;
+    return *(const char*)&one == 1;
+}
+
+/// Convert 4 bytes values in place to big endian (MDD) if needed
+static void to_big_endian(void* data, size_t nb_values)
+{
+    if( !is_little_endian() ) return;
+    unsigned char* p = (unsigned char*)data;
+    for(size_t i = 0; i < nb_values; ++i, p += 4){
+        std::swap(p[0], p[3]);
+        std::swap(p[1], p[2]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+Writer::Writer() :
+    _file(0),
+    _format(PC2),
+    _first(0), _count(0),
+    _nb_frames(0),
+    _closing(false), _failed(false),
+    _bytes(0.)
+{ }
+
+// -----------------------------------------------------------------------------
+
+Writer::~Writer()
+{
+    if( is_open() ) close();
+}
+
+// -----------------------------------------------------------------------------
+
+bool Writer::open(const std::string& path, Format format, const Header& header, int nb_buffers)
+{
+    if( is_open() ) close();
+
+    _file = fopen(path.c_str(), "wb");
+    if( !_file ){
+        fprintf(stderr, "Point_cache: can't create %s\n", path.c_str());
+        return false;
+    }
+
+    _format    = format;
+    _header    = header;
+    _first     = _count = 0;
+    _nb_frames = 0;
+    _closing   = _failed = false;
+    _bytes     = 0.;
+    _buffers.assign(std::max(nb_buffers, 1), std::vector<float>(header.nb_points * 3));
+
+    bool ok = true;
+    if( format == PC2 )
+    {
+        char signature[12] = "POINTCACHE2";
+        const int version = 1;
+        ok = fwrite(signature, 1, 12, _file) == 12 &&
+             fwrite(&version           , 4, 1, _file) == 1 &&
+             fwrite(&header.nb_points  , 4, 1, _file) == 1 &&
+             fwrite(&header.start_frame, 4, 1, _file) == 1 &&
+             fwrite(&header.sample_rate, 4, 1, _file) == 1 &&
+             fwrite(&header.nb_frames  , 4, 1, _file) == 1;
+        _bytes = 32.;
+    }
+    else
+    {
+        int counts[2] = { header.nb_frames, header.nb_points };
+        to_big_endian(counts, 2);
+        std::vector<float> times(header.nb_frames);
+        for(int i = 0; i < header.nb_frames; ++i)
+            times[i] = (header.start_frame + i * header.sample_rate) / header.fps;
+        to_big_endian(times.data(), times.size());
+        ok = fwrite(counts, 4, 2, _file) == 2 &&
+             fwrite(times.data(), 4, times.size(), _file) == times.size();
+        _bytes = 8. + 4. * times.size();
+    }
+
+    if( !ok ){
+        fprintf(stderr, "Point_cache: can't write the header of %s\n", path.c_str());
+        fclose(_file);
+        _file = 0;
+        return false;
+    }
+
+    _thread = std::thread(&Writer::write_loop, this);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Writer::write_frame(const std::vector<Point_cu>& verts)
+{
+    assert( is_open() );
+    assert( (int)verts.size() == _header.nb_points );
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [&]{ return _count < (int)_buffers.size(); });
+    std::vector<float>& buf = _buffers[(_first + _count) % _buffers.size()];
+    lock.unlock();
+
+    // The buffer isn't in the queue yet, the writer thread doesn't touch it
+    for(int i = 0; i < _header.nb_points; ++i){
+        buf[i*3 + 0] = verts[i].x;
+        buf[i*3 + 1] = verts[i].y;
+        buf[i*3 + 2] = verts[i].z;
+    }
+
+    lock.lock();
+    _count++;
+    _nb_frames++;
+    lock.unlock();
+    _not_empty.notify_one();
+}
+
+// -----------------------------------------------------------------------------
+
+void Writer::write_loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;)
+    {
+        _not_empty.wait(lock, [&]{ return _count > 0 || _closing; });
+        if( _count == 0 ) return; // closing and nothing left
+
+        std::vector<float>& buf = _buffers[_first];
+        lock.unlock();
+
+        if( _format == MDD ) to_big_endian(buf.data(), buf.size());
+        const bool ok = fwrite(buf.data(), sizeof(float), buf.size(), _file) == buf.size();
+
+        lock.lock();
+        _failed = _failed || !ok;
+        _bytes += sizeof(float) * buf.size();
+        _first = (_first + 1) % _buffers.size();
+        _count--;
+        _not_full.notify_one();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool Writer::close()
+{
+    if( !is_open() ) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+    }
+    _not_empty.notify_one();
+    _thread.join();
+
+    const bool closed = fclose(_file) == 0;
+    bool ok = !_failed && closed;
+    _file = 0;
+    _buffers.clear();
+
+    if( _nb_frames != _header.nb_frames ){
+        fprintf(stderr, "Point_cache: %d frames written, %d announced\n", _nb_frames, _header.nb_frames);
+        ok = false;
+    }
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+double Writer::bytes_written() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+// -----------------------------------------------------------------------------
+
+void Bake_stats::print() const
+{
+    printf("Point cache: %d frames, %.1f MB in %.3f s (deformation %.3f s): %.2f fps, %.1f MB/s\n",
+           nb_frames, nb_bytes / (1024.*1024.), total_seconds, deform_seconds, fps(), mb_per_s());
+}
+
+// -----------------------------------------------------------------------------
+
+bool bake(AnimeshBase& animesh,
+          int first, int last,
+          const std::function<void (int frame)>& set_pose,
+          Writer& writer,
+          Bake_stats* stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    double deform = 0.;
+
+    // Reused for every frame
+    std::vector<Point_cu> verts;
+    verts.reserve( animesh.get_nb_vertices() );
+
+    for(int frame = first; frame <= last; ++frame)
+    {
+        set_pose( frame );
+
+        const Clock::time_point t = Clock::now();
+        animesh.transform_vertices();
+        animesh.get_vertices( verts );
+        deform += std::chrono::duration<double>(Clock::now() - t).count();
+
+        writer.write_frame( verts );
+    }
+
+    const double bytes = writer.bytes_written();
+    const bool ok = writer.close();
+
+    if( stats != 0 )
+    {
+        stats->nb_frames      = last - first + 1;
+        stats->nb_bytes       = std::max(bytes, writer.bytes_written());
+        stats->deform_seconds = deform;
+        stats->total_seconds  = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return ok;
+}
+
+}// END Point_cache ============================================================
@@ -0,0 +1,135 @@
+#ifndef POINT_CACHE_HPP__
+#define POINT_CACHE_HPP__
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "point_cu.hpp"
+
+class AnimeshBase;
+
+/**
+ * @namespace Point_cache
+ * @brief Headless bake of the deformed mesh to PC2 or MDD point caches
+ *
+ * Frames are handed to a Writer which copies them into one of a few
+ * preallocated buffers and returns; a thread converts and writes the buffers
+ * to disk while the next frames are deformed. Memory is 'nb_buffers' frames
+ * whatever the length of the bake. The formats are described in doc/.
+ *
+ * @code
+ * Point_cache::Header h;
+ * h.nb_points = animesh->get_nb_vertices();
+ * h.nb_frames = last - first + 1;
+ * h.start_frame = first;
+ *
+ * Point_cache::Writer w;
+ * if( w.open("juna.pc2", Point_cache::PC2, h) ){
+ *     Point_cache::Bake_stats stats;
+ *     Point_cache::bake(*animesh, first, last, [&](int frame){
+ *         // set the world space matrix of every bone for 'frame'
+ *     }, w, &stats);
+ *     stats.print();
+ * }
+ * @endcode
+ */
+// =============================================================================
+namespace Point_cache {
+// =============================================================================
+
+enum Format {
+    PC2, ///< little endian, 'POINTCACHE2' header
+    MDD  ///< big endian, frame times in the header
+};
+
+struct Header {
+    Header() : nb_points(0), nb_frames(0), start_frame(0.f), sample_rate(1.f), fps(24.f) { }
+    int   nb_points;
+    int   nb_frames;   ///< every frame must be written before close()
+    float start_frame;
+    float sample_rate; ///< frames between two samples
+    float fps;         ///< to convert frames to the seconds stored in MDD files
+};
+
+// -----------------------------------------------------------------------------
+
+/// Buffered asynchronous point cache writer
+class Writer {
+public:
+    Writer();
+    ~Writer();
+
+    /// Create the file and write its header
+    /// @param nb_buffers : number of frames buffered before write_frame() waits
+    /// for the disk
+    /// @return false if the file can't be created
+    bool open(const std::string& path, Format format, const Header& header, int nb_buffers = 4);
+
+    /// Queue the next frame, 'verts' must hold Header::nb_points points.
+    /// Only blocks when every buffer is waiting to be written.
+    void write_frame(const std::vector<Point_cu>& verts);
+
+    /// Write the pending frames and close the file
+    /// @return false if a write failed or fewer frames than announced in the
+    /// header were written
+    bool close();
+
+    bool is_open() const { return _file != 0; }
+
+    /// Bytes written so far, header included
+    double bytes_written() const;
+
+private:
+    void write_loop();
+
+    FILE*  _file;
+    Format _format;
+    Header _header;
+
+    /// Ring of frame buffers: [_first, _first + _count[ wait to be written
+    std::vector< std::vector<float> > _buffers;
+    int _first, _count;
+    int _nb_frames;
+    bool _closing, _failed;
+    double _bytes;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+    std::thread _thread;
+};
+
+// -----------------------------------------------------------------------------
+
+struct Bake_stats {
+    Bake_stats() : nb_frames(0), nb_bytes(0.), deform_seconds(0.), total_seconds(0.) { }
+    int    nb_frames;
+    double nb_bytes;
+    double deform_seconds; ///< time spent in transform_vertices() and get_vertices()
+    double total_seconds;  ///< including waits on the writer and closing the file
+
+    double fps()      const { return total_seconds > 0. ? nb_frames / total_seconds : 0.; }
+    double mb_per_s() const { return total_seconds > 0. ? nb_bytes / (1024.*1024.) / total_seconds : 0.; }
+
+    void print() const;
+};
+
+/// Deform 'animesh' for every frame of [first last] and write the vertices
+/// to 'writer', which is closed at the end.
+/// @param set_pose : called before deforming each frame to pose the bones
+/// of the animesh's skeleton
+/// @return false if the writer failed
+bool bake(AnimeshBase& animesh,
+          int first, int last,
+          const std::function<void (int frame)>& set_pose,
+          Writer& writer,
+          Bake_stats* stats = 0);
+
+}// END Point_cache ============================================================
+
+#endif // POINT_CACHE_HPP__
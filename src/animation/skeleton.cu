@@ -14,27 +14,45 @@
 
 using namespace Cuda_utils;
 
-void Skeleton::init_skel_env(bool single_bone)
+void Skeleton::get_env_bones(std::vector<const Bone*>& bones, std::map<Bone::Id, Bone::Id>& parents) const
 {
-    std::vector<const Bone*> bones;
-    std::map<Bone::Id, Bone::Id> parents;
     for(auto &it: _joints) {
         bones.push_back(it.second._anim_bone.get());
         parents[it.first] = it.second._parent;
     }
+}
+
+void Skeleton::init_joint(SkeletonJoint& joint)
+{
+    Skeleton_env::Joint_data d;
+    d._blend_type     = EJoint::MAX;
+    d._ctrl_id        = Blending_env::new_ctrl_instance();
+    d._bulge_strength = 0.7f;
+    joint._joint_data = d;
+
+    joint._controller = IBL::Shape::caml();
+    Blending_env::update_controller(d._ctrl_id, joint._controller);
+}
+
+void Skeleton::init_skel_env(bool single_bone)
+{
+    std::vector<const Bone*> bones;
+    std::map<Bone::Id, Bone::Id> parents;
+    get_env_bones(bones, parents);
 
     // If single_bone is true, tell Skeleton_env to create a grid with only one cell.
     // This effectively disables the grid optimization.  If we only have a single bone
-    // then the grid is expensive to calculate and doesn't do us any good.  If single_bone
-    // is false, use the default.  We do this here rather than with set_grid_res, so we
-    // don't waste time calculating a 20x20x20 grid and then throwing it away.
+    // then the grid doesn't do us any good.  If single_bone is false, use the default.
+    // We do this here rather than with set_grid_res, so we don't waste time subdividing
+    // the octree and then throwing it away.
     _skel_id = Skeleton_env::new_skel_instance(bones, parents, single_bone? 1:-1);
 
     update_bones_data();
     Skeleton_env::update_joints_data(_skel_id, get_joints_data());
 }
 
-Skeleton::Skeleton(std::vector<std::shared_ptr<const Bone> > bones, std::vector<Bone::Id> parents, bool single_bone)
+Skeleton::Skeleton(std::vector<std::shared_ptr<const Bone> > bones, std::vector<Bone::Id> parents, bool single_bone):
+    _structure_sequence(1)
 {
     std::map<int,Bone::Id> loaderIdxToBoneId;
     std::map<Bone::Id,int> boneIdToLoaderIdx;
@@ -51,17 +69,7 @@ Skeleton::Skeleton(std::vector<std::shared_ptr<const Bone> > bones, std::vector<
     }
 
     for(auto &it: _joints)
-    {
-        SkeletonJoint &joint = it.second;
-        Skeleton_env::Joint_data d;
-        d._blend_type     = EJoint::MAX;
-        d._ctrl_id        = Blending_env::new_ctrl_instance();
-        d._bulge_strength = 0.7f;
-        joint._joint_data = d;
-
-        joint._controller = IBL::Shape::caml();
-        Blending_env::update_controller(d._ctrl_id, joint._controller);
-    }
+        init_joint(it.second);
 
     for(auto &it: _joints)
     {
@@ -95,6 +103,86 @@ Skeleton::~Skeleton()
     Skeleton_env::delete_skel_instance( _skel_id );
 }
 
+// -----------------------------------------------------------------------------
+
+bool Skeleton::update(std::vector<std::shared_ptr<const Bone> > bones, std::vector<Bone::Id> parents)
+{
+    assert(bones.size() == parents.size());
+
+    // Parent bone ID of each new bone
+    std::map<Bone::Id, Bone::Id> new_parents;
+    for(int bid = 0; bid < (int) bones.size(); bid++)
+    {
+        const int loader_parent_idx = parents[bid];
+        new_parents[bones[bid]->get_bone_id()] = loader_parent_idx == -1? -1: bones[loader_parent_idx]->get_bone_id();
+    }
+
+    // Nothing to do if every joint points to the same bone and parent
+    bool changed = new_parents.size() != _joints.size();
+    for(int bid = 0; bid < (int) bones.size() && !changed; bid++)
+    {
+        const Bone::Id id = bones[bid]->get_bone_id();
+        auto it = _joints.find(id);
+        changed = it == _joints.end() ||
+                  it->second._anim_bone != bones[bid] ||
+                  it->second._parent != new_parents.at(id);
+    }
+
+    if(!changed)
+        return false;
+
+    // Skeleton_env rebuilds the cells of the bones that change from the bboxes
+    // it last saw, bring the current bones up to date first
+    update_bones_data();
+
+    // Remove joints whose bone is gone
+    for(auto it = _joints.begin(); it != _joints.end(); )
+    {
+        if(new_parents.find(it->first) != new_parents.end()) {
+            ++it;
+            continue;
+        }
+
+        const int ctrl_id = it->second._joint_data._ctrl_id;
+        if( ctrl_id >= 0)
+            Blending_env::delete_ctrl_instance(ctrl_id);
+        it = _joints.erase(it);
+    }
+
+    // Add new joints and point existing ones to their (possibly new) bone and parent
+    for(int bid = 0; bid < (int) bones.size(); bid++)
+    {
+        const Bone::Id id = bones[bid]->get_bone_id();
+        const bool is_new = _joints.find(id) == _joints.end();
+        SkeletonJoint &joint = _joints[id];
+        if(is_new)
+            init_joint(joint);
+
+        // Skeleton_env reads new bones as they are now, other bones still go
+        // through update_bones_data() if they changed
+        if(is_new || joint._anim_bone != bones[bid])
+            joint.last_bone_update_sequence = bones[bid]->get_update_sequence();
+
+        joint._anim_bone = bones[bid];
+        joint._parent = new_parents.at(id);
+        joint._children.clear();
+    }
+
+    for(auto &it: _joints)
+    {
+        if(it.second._parent != -1)
+            _joints.at(it.second._parent)._children.push_back(it.first);
+    }
+
+    std::vector<const Bone*> env_bones;
+    std::map<Bone::Id, Bone::Id> env_parents;
+    get_env_bones(env_bones, env_parents);
+    Skeleton_env::update_skel_instance(_skel_id, env_bones, env_parents, get_joints_data());
+
+    _structure_sequence++;
+    return true;
+}
+
 void Skeleton::set_joint_controller(int i,
                                     const IBL::Ctrl_setup& shape)
 {
@@ -146,22 +234,22 @@ IBL::Ctrl_setup Skeleton::get_joint_controller(Bone::Id bone_id) const
 
 void Skeleton::update_bones_data() const
 {
-    // Only update_bones_data() if we're out of date.
-    bool any_bones_need_update = false;
+    // Only update_bones_data() for the bones that are out of date.
+    std::vector<Bone::Id> bones_need_update;
     for(auto &it: _joints)
     {
         const SkeletonJoint &joint = it.second;
         uint64_t current_sequence = joint._anim_bone->get_update_sequence();
         if(current_sequence > joint.last_bone_update_sequence) {
-            any_bones_need_update = true;
+            bones_need_update.push_back(it.first);
             joint.last_bone_update_sequence = current_sequence;
         }
     }
 
-    if(!any_bones_need_update)
+    if(bones_need_update.empty())
         return;
 
-    Skeleton_env::update_bones_data(_skel_id);
+    Skeleton_env::update_bones_data(_skel_id, bones_need_update);
 }
 
 Skeleton_env::DBone_id Skeleton::get_bone_didx(Bone::Id i) const {
@@ -99,6 +99,14 @@ struct Skeleton {
   Skeleton(std::vector<std::shared_ptr<const Bone> > bones, std::vector<Bone::Id> parents, bool single_bone=false);
   ~Skeleton();
 
+  /// Change the bones and hierarchy of the skeleton in place. 'bones' and
+  /// 'parents' are laid out as in the constructor.
+  /// Joints still present keep their controller, blending type and bulge
+  /// magnitude, removed joints release their controller and new joints get
+  /// the default ones. The skeleton keeps its instance in Skeleton_env.
+  /// @return false if neither the bones nor the hierarchy changed
+  bool update(std::vector<std::shared_ptr<const Bone> > bones, std::vector<Bone::Id> parents);
+
   //----------------------------------------------------------------------------
   /// @name Setters
   //----------------------------------------------------------------------------
@@ -170,6 +178,10 @@ struct Skeleton {
   /// Get the id of the skeleton in the skeleton environment
   Skeleton_env::Skel_id get_skel_id() const { return _skel_id; }
 
+  /// Incremented each time update() adds, removes or reparents joints, so
+  /// users holding this skeleton know per bone data must be recomputed.
+  uint64_t get_structure_sequence() const { return _structure_sequence; }
+
   // If bone data is out of date, update bone data.  This is const because it updates internal caches
   // but doesn't change the skeleton's real data; it needs to be called by const users.
   void update_bones_data() const;
@@ -179,6 +191,12 @@ private:
   /// Create and initilize a skeleton in the environment Skeleton_env
   void init_skel_env(bool single_bone);
 
+  /// Give a new joint its default joint data and controller
+  static void init_joint(SkeletonJoint& joint);
+
+  /// Bones and parents of '_joints' as Skeleton_env expects them
+  void get_env_bones(std::vector<const Bone*>& bones, std::map<Bone::Id, Bone::Id>& parents) const;
+
   std::map<Bone::Id, Skeleton_env::Joint_data> get_joints_data() const;
 
   //----------------------------------------------------------------------------
@@ -190,6 +208,8 @@ private:
 
   // Maps from bone IDs to joints:
   std::map<Bone::Id, SkeletonJoint> _joints;
+
+  uint64_t _structure_sequence;
 };
 
 #endif // SKELETON_HPP__
@@ -0,0 +1,108 @@
+#include "vertex_clustering.hpp"
+
+#include <limits>
+#include <cmath>
+
+#include "mesh.hpp"
+#include "parallel.hpp"
+
+// =============================================================================
+namespace Vertex_clustering {
+// =============================================================================
+
+void cluster(const Mesh& mesh,
+             const std::vector<Candidate>& candidates,
+             const std::vector< std::vector<double> >& weights,
+             double threshold,
+             const std::set<Bone::Id>& bone_ids,
+             Result& res)
+{
+    const int nb_verts = mesh.get_nb_vertices();
+    const int nb_cand  = (int)candidates.size();
+    const float inf    = std::numeric_limits<float>::infinity();
+
+    // Segments of the candidates laid out flat for the inner loop
+    std::vector<float> org(nb_cand*3), dir(nb_cand*3), inv_len_sq(nb_cand);
+    for(int c = 0; c < nb_cand; c++)
+    {
+        const Bone* b = candidates[c].bone;
+        org[c*3+0] = b->org().x; org[c*3+1] = b->org().y; org[c*3+2] = b->org().z;
+        dir[c*3+0] = b->dir().x; dir[c*3+1] = b->dir().y; dir[c*3+2] = b->dir().z;
+        const float l = b->length();
+        inv_len_sq[c] = l > 0.f ? 1.f / (l * l) : 0.f;
+    }
+
+    const int nb_threads = Parallel::nb_threads(nb_verts);
+    std::vector<float> acc_min(nb_threads * nb_cand,  inf);
+    std::vector<float> acc_max(nb_threads * nb_cand, 0.f);
+    std::vector<int>   nearest(nb_verts, -1);
+    const float* vertices = mesh.get_vertices();
+
+    Parallel::for_chunks(nb_verts, nb_threads, [&](int thread, int begin, int end)
+    {
+        float* t_min = &acc_min[thread * nb_cand];
+        float* t_max = &acc_max[thread * nb_cand];
+        for(int v = begin; v < end; v++)
+        {
+            const float px = vertices[v*3+0], py = vertices[v*3+1], pz = vertices[v*3+2];
+            const std::vector<double>& w = weights[v];
+
+            int   best      = -1;
+            float best_dist = inf;
+            for(int c = 0; c < nb_cand; c++)
+            {
+                const int wi = candidates[c].weight_idx;
+                if(wi < 0 || wi >= (int)w.size() || w[wi] < threshold)
+                    continue;
+
+                // Squared distance to the segment (see Bone_cu::dist_sq_to())
+                const float ox = px - org[c*3+0], oy = py - org[c*3+1], oz = pz - org[c*3+2];
+                const float dx = dir[c*3+0], dy = dir[c*3+1], dz = dir[c*3+2];
+                float x = (ox*dx + oy*dy + oz*dz) * inv_len_sq[c];
+                x = std::min(1.f, std::max(0.f, x));
+                const float qx = ox - dx*x, qy = oy - dy*x, qz = oz - dz*x;
+                const float d = qx*qx + qy*qy + qz*qz;
+                if(d < best_dist){
+                    best_dist = d;
+                    best = c;
+                }
+            }
+
+            nearest[v] = best;
+            if(best < 0) continue;
+            const float dist = std::sqrt(best_dist);
+            t_min[best] = std::min(t_min[best], dist);
+            t_max[best] = std::max(t_max[best], dist);
+        }
+    });
+
+    // Reduce the per thread accumulators
+    std::vector<float> rad_min(nb_cand, inf), rad_max(nb_cand, 0.f);
+    for(int t = 0; t < nb_threads; t++){
+        for(int c = 0; c < nb_cand; c++){
+            rad_min[c] = std::min(rad_min[c], acc_min[t*nb_cand + c]);
+            rad_max[c] = std::max(rad_max[c], acc_max[t*nb_cand + c]);
+        }
+    }
+
+    res.bones_per_vertex.assign(nb_verts, std::vector<Bone::Id>());
+    for(int v = 0; v < nb_verts; v++)
+        if(nearest[v] >= 0)
+            res.bones_per_vertex[v].push_back(candidates[nearest[v]].bone_id);
+
+    res.junction_radius.clear();
+    res.hrbf_radius.clear();
+    for(Bone::Id id: bone_ids){
+        res.junction_radius[id] = 1.f;
+        res.hrbf_radius    [id] = 1.f;
+    }
+
+    for(int c = 0; c < nb_cand; c++)
+    {
+        const Bone::Id id = candidates[c].bone_id;
+        if(rad_min[c] != inf) res.junction_radius[id] = rad_min[c];
+        if(rad_max[c] > 0.f ) res.hrbf_radius    [id] = rad_max[c];
+    }
+}
+
+}// END VERTEX_CLUSTERING NAMESPACE ============================================
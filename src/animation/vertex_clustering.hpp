@@ -0,0 +1,58 @@
+#ifndef VERTEX_CLUSTERING_HPP__
+#define VERTEX_CLUSTERING_HPP__
+
+#include <vector>
+#include <map>
+#include <set>
+
+#include "bone.hpp"
+
+class Mesh;
+
+/**
+ * @namespace Vertex_clustering
+ * @brief Assign mesh vertices to their nearest bone and compute the default
+ * junction and HRBF radius of each bone, in a single multithreaded pass.
+ *
+ * A vertex joins the nearest candidate bone among those its skinning weight
+ * is high enough for. From the same distances a bone gets its junction radius
+ * (nearest vertex of its cluster) and its HRBF radius (farthest vertex).
+ * These match VertToBoneInfo::get_default_junction_radius() and
+ * VertToBoneInfo::get_default_hrbf_radius() without walking the mesh again.
+ *
+ * Vertices are split in chunks, one per thread. Each thread keeps flat per
+ * bone min/max accumulators that are reduced at the end.
+ */
+// =============================================================================
+namespace Vertex_clustering {
+// =============================================================================
+
+/// A bone vertices can be clustered to
+struct Candidate {
+    Bone::Id    bone_id;
+    const Bone* bone;
+    int         weight_idx; ///< column of the skin weights checked against the threshold
+};
+
+struct Result {
+    /// bones_per_vertex[vert_idx] == list of bones (zero or one) of the vertex
+    std::vector< std::vector<Bone::Id> > bones_per_vertex;
+    /// distance to the nearest clustered vertex, 1 if the bone has none
+    std::map<Bone::Id, float> junction_radius;
+    /// distance to the farthest clustered vertex, 1 if the bone has none
+    std::map<Bone::Id, float> hrbf_radius;
+};
+
+/// @param weights : weights[vert_idx][weight_idx] skinning weights of each vertex
+/// @param threshold : candidates whose weight is below are ignored
+/// @param bone_ids : every bone that gets an entry in the radius maps
+void cluster(const Mesh& mesh,
+             const std::vector<Candidate>& candidates,
+             const std::vector< std::vector<double> >& weights,
+             double threshold,
+             const std::set<Bone::Id>& bone_ids,
+             Result& res);
+
+}// END VERTEX_CLUSTERING NAMESPACE ============================================
+
+#endif // VERTEX_CLUSTERING_HPP__
@@ -0,0 +1,138 @@
+#ifndef IBL_CONTROLLER_COEFFS_HPP__
+#define IBL_CONTROLLER_COEFFS_HPP__
+
+#include <math.h>
+#include "cuda_compiler_interop.hpp"
+#include "controller.hpp"
+
+/**
+ * @file controller_coeffs.hpp
+ * @brief Analytic evaluation of a controller from a compact coefficient block
+ *
+ * A controller (IBL::Ctrl_setup) is defined by three points and two slopes.
+ * Instead of sampling the curve in a table we store the setup along with the
+ * terms which don't depend on the 'dot' parameter. Evaluation is then a few
+ * flops and two exponentials, available on host and device:
+ *
+ * @code
+ * IBL::Ctrl_coeffs c = IBL::make_ctrl_coeffs( IBL::Shape::elbow() );
+ * float tan_alpha, width;
+ * IBL::ctrl_eval(c, dot, tan_alpha, width); // same as sampling gen_controller()
+ * @endcode
+*/
+
+// =============================================================================
+namespace IBL {
+// =============================================================================
+
+/// Coefficients of a controller padded to 64 bytes (four float4 loads)
+struct Ctrl_coeffs {
+    float b0, b1, b2; ///< abscissa of the control points
+    float F0, F1, F2; ///< ordinates of the control points
+    float S0, S1;     ///< slopes
+    float a0, c0, n0; ///< left sigmoid 'signeg(a0 * dot + c0, S0) * n0'
+    float a1, c1, n1; ///< right sigmoid 'sigpos(a1 * dot + c1, S1) * n1'
+    float pad[2];
+};
+
+// -----------------------------------------------------------------------------
+/// @name Sigmoids (see controller_tools.hpp)
+// -----------------------------------------------------------------------------
+
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_usig(float x){ return 1.f - expf(1.f - 1.f/(1.f-x)); }
+
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_dusig(float x){ return expf(1.f - 1.f/(1.f-x))/((1.f-x)*(1.f-x)); }
+
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_vsig(float x){ return expf(1.f - 1.f/x); }
+
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_dvsig(float x){ return expf(1.f - 1.f/x)/(x*x); }
+
+/// Sigmoid shared by the left and right part of the controller
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_sig(float x, float slope)
+{
+    const float s = ctrl_usig(ctrl_vsig(x*0.8f + 0.1f));
+    if(slope >= 1.f) return powf(s, slope);
+    else             return 1.f - powf(1.f - s, 2.f - slope);
+}
+
+/// Derivative of ctrl_sig() along x
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_dsig(float x, float slope)
+{
+    const float y = x*0.8f + 0.1f;
+    const float d = 0.8f*ctrl_dvsig(y)*ctrl_dusig(ctrl_vsig(y));
+    const float s = ctrl_usig(ctrl_vsig(y));
+    if(slope >= 1.f) return slope * d * powf(s, slope-1.f);
+    slope = 2.f - slope;
+    return slope * d * powf(1.f - s, slope-1.f);
+}
+
+// -----------------------------------------------------------------------------
+
+static inline Ctrl_coeffs make_ctrl_coeffs(const Ctrl_setup& shape)
+{
+    Ctrl_coeffs c;
+    c.b0 = shape.p0().x; c.b1 = shape.p1().x; c.b2 = shape.p2().x;
+    c.F0 = shape.p0().y; c.F1 = shape.p1().y; c.F2 = shape.p2().y;
+    c.S0 = shape.s0();   c.S1 = shape.s1();
+
+    // Degenerated intervals are never evaluated (see ctrl_fdot())
+    c.a0 = c.b0 != c.b1 ? 1.f/(c.b0-c.b1) : 0.f;
+    c.c0 = - c.b1 * c.a0;
+    c.n0 = c.b0 < -1.f ? 1.f / ctrl_sig(c.c0 - c.a0, c.S0) : 1.f;
+
+    c.a1 = c.b2 != c.b1 ? 1.f/(c.b2-c.b1) : 0.f;
+    c.c1 = - c.b1 * c.a1;
+    c.n1 = c.b2 > 1.f ? 1.f / ctrl_sig(c.a1 + c.c1, c.S1) : 1.f;
+
+    c.pad[0] = c.pad[1] = 0.f;
+    return c;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Controller value in [0 1] (same as IBL::Continuous::Controller::eval())
+/// @param derv : derivative along 'dot' of the left part of the curve,
+/// zero elsewhere (like IBL::gen_controller())
+IF_CUDA_DEVICE_HOST static inline
+float ctrl_fdot(const Ctrl_coeffs& c, float dot, float& derv)
+{
+    derv = 0.f;
+    if(dot < c.b1)
+    {
+        if(dot < c.b0) return c.F0;
+        const float x = c.a0 * dot + c.c0;
+        derv = (c.F0 - c.F1) * c.a0 * ctrl_dsig(x, c.S0) * c.n0;
+        return (c.F0 - c.F1) * ctrl_sig(x, c.S0) * c.n0 + c.F1;
+    }
+    else
+    {
+        if(dot > c.b2) return c.F2;
+        const float x = c.a1 * dot + c.c1;
+        return (c.F2 - c.F1) * ctrl_sig(x, c.S1) * c.n1 + c.F1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Evaluate the controller as IBL::gen_controller() samples it.
+/// @param dot : cos(theta) between the two gradients
+/// @return (tan_alpha, width) with tan_alpha the opening of the operators
+IF_CUDA_DEVICE_HOST static inline
+void ctrl_eval(const Ctrl_coeffs& c, float dot, float& tan_alpha, float& width)
+{
+    float derv;
+    const float fdot = ctrl_fdot(c, dot, derv);
+    tan_alpha = tanf(fdot * 3.14159265358979323846f * 0.2499f + 0.00001f);
+    width     = 0.03f * sqrtf(1.f + derv*derv);
+}
+
+}
+// END IBL =====================================================================
+
+#endif // IBL_CONTROLLER_COEFFS_HPP__
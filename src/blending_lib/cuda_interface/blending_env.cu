@@ -3,17 +3,22 @@
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <deque>
+#include <algorithm>
 
 #include "constants.hpp"
 #include "blending_env.hpp"
+#include "blending_env_host.hpp"
 #include "blending_lib/controller.hpp"
+#include "blending_lib/controller_coeffs.hpp"
 #include "blending_lib/generator.hpp"
 #include "class_saver.hpp"
 #include "timer.hpp"
 #include "std_utils.hpp"
 
 #include "grid3_cu.hpp"
+#include "quantized_table.hpp"
 
 // From n_ary.hpp
 void init_nary_operators();
@@ -32,13 +37,10 @@ bool binded;
 
 /// @name List of controllers instances
 /// @{
-cudaArray*           d_controllers = 0;
-/// The controllers stored in 2D contiguously in host mem
-/// (with their padding values)
-Host::Array<float2>  h_controllers;
-
-/// List of controllers without padding
-std::deque< IBL::float2* > list_controllers;
+/// Coefficients of each controller instance evaluated analytically
+/// by controller_fetch(). In device memory as four float4 per instance.
+std::vector<IBL::Ctrl_coeffs>     h_ctrl_coeffs;
+Cuda_utils::Device::Array<float4> d_ctrl_coeffs;
 
 
 /// Tells is the ith controller instance is used or empty
@@ -88,8 +90,16 @@ cudaArray* d_ricci_4D_profiles_normals = 0;
 
 /// 3D Bulge in contact with parameterizable strength
 //@{
-Cuda_utils::Device::CuArray<float>   d_block_3D_bulge;
-Cuda_utils::Device::CuArray<float2>  d_block_3D_bulge_gradient;
+cudaArray* d_block_3D_bulge = 0;
+cudaArray* d_block_3D_bulge_gradient = 0;
+
+/// Host copies of the block (stored with h_table_bits) and of the profiles
+Quantized_table  h_block_3D_bulge;
+Quantized_table  h_block_3D_bulge_gradient;
+int3             h_block_3D_bulge_size = {0, 0, 0};
+std::vector<int> h_bulge_4D_corners; ///< (x, y, z) of each magnitude's grid
+HA_float         h_bulge_4D_profiles;
+HA_float2        h_bulge_4D_profiles_normals;
 //@}
 
 /// 3D ricci with parameterizable N
@@ -102,6 +112,12 @@ cudaArray* d_global_controller = 0;
 IBL::Ctrl_setup globale_ctrl_shape;
 const int nb_samples = NB_SAMPLES;
 
+/// Number of samples of the 3D and 4D tables, see set_table_resolution()
+Table_resolution h_table_res = { NB_SAMPLES_OCU, NB_SAMPLES_ALPHA, NB_SAMPLES_4D_BULGE };
+
+/// Number of bits of the 3D operators and 4D bulge tables, see set_table_bits()
+int h_table_bits = DEFAULT_TABLE_BITS;
+
 bool allocated = false;
 
 // Precomputed opening function
@@ -118,17 +134,29 @@ texture<float, 1, cudaReadModeElementType>  profiles_ricci_4D_tex;
 texture<float2, 1, cudaReadModeElementType> profiles_ricci_4D_normals_tex;
 texture<float, 1, cudaReadModeElementType>  opening_hyperbola_tex;
 texture<float, 1, cudaReadModeElementType>  magnitude_3D_bulge_tex;
-texture<float, 3, cudaReadModeElementType>  openable_bulge_4D_tex;
+texture<float , 3, cudaReadModeElementType> openable_bulge_4D_tex;
 texture<float2, 3, cudaReadModeElementType> openable_bulge_4D_gradient_tex;
+texture<unsigned short, 3, cudaReadModeNormalizedFloat> openable_bulge_4D_unorm_tex;
+texture<ushort2       , 3, cudaReadModeNormalizedFloat> openable_bulge_4D_gradient_unorm_tex;
 texture<float, 1, cudaReadModeElementType>  n_3D_ricci_tex;
 texture<float, 3, cudaReadModeElementType>  openable_ricci_4D_tex;
 texture<float2, 3, cudaReadModeElementType> openable_ricci_4D_gradient_tex;
 texture<float2, 1, cudaReadModeElementType> global_controller_tex;
-texture<float2, 2, cudaReadModeElementType> tex_controllers;
+texture<float4, 1, cudaReadModeElementType> tex_ctrl_coeffs;
 texture<int4  , 1, cudaReadModeElementType> tex_pred_operators_idx_offsets;
 texture<int   , 1, cudaReadModeElementType> tex_pred_operators_id;
 texture<float , 3, cudaReadModeElementType> tex_operators_values;
 texture<float2, 3, cudaReadModeElementType> tex_operators_grads;
+texture<unsigned short, 3, cudaReadModeNormalizedFloat> tex_operators_values_unorm;
+texture<ushort2       , 3, cudaReadModeNormalizedFloat> tex_operators_grads_unorm;
+texture<float4, 1, cudaReadModeElementType> tex_operators_quant;
+
+__constant__ float2 bulge_4D_vals_quant   = {1.f, 0.f};
+__constant__ float4 bulge_4D_grads_quant  = {1.f, 0.f, 1.f, 0.f};
+__constant__ int    table_bits            = DEFAULT_TABLE_BITS;
+__constant__ float2 operators_samples     = {NB_SAMPLES_OCU-1, NB_SAMPLES_ALPHA-1};
+__constant__ int2   tables_4D_layout      = {NB_SAMPLES_4D_BULGE, MAX_TEX_LENGTH / (NB_SAMPLES_4D_BULGE+2)};
+__constant__ int    families_loaded       = 0;
 
 //------------------------------------------------------------------------------
 
@@ -158,6 +186,95 @@ std::string get_cache_dir() {
     return dir;
 }
 
+// -----------------------------------------------------------------------------
+
+/// @return path of the cache file of a table stored with h_table_bits.
+/// Float tables keep their original name.
+static std::string table_cache_path(const std::string& base_path)
+{
+    if(h_table_bits == 32)
+        return base_path + ".opc";
+
+    std::stringstream ss;
+    ss << base_path << "_" << h_table_bits << ".opc";
+    return ss.str();
+}
+
+/// Suffix of the cache files of the 3D operators (empty for the default
+/// resolution so that existing caches stay valid)
+static std::string res_suffix_3D()
+{
+    if(h_table_res.samples_xy == NB_SAMPLES_OCU && h_table_res.samples_alpha == NB_SAMPLES_ALPHA)
+        return "";
+    std::ostringstream s;
+    s << "_res" << h_table_res.samples_xy << "x" << h_table_res.samples_alpha;
+    return s.str();
+}
+
+/// @see res_suffix_3D()
+static std::string res_suffix_4D()
+{
+    if(h_table_res.samples_4D == NB_SAMPLES_4D_BULGE)
+        return "";
+    std::ostringstream s;
+    s << "_res" << h_table_res.samples_4D;
+    return s.str();
+}
+
+// -----------------------------------------------------------------------------
+
+/// Read in 'q' the table 'base_path' of 'nb_elt' elements of 'nb_channels'
+/// stored with h_table_bits. Reduced tables are not decoded and keep the
+/// error measured against the floats they were quantized from.
+/// @return wether the file exists and matches the requested size
+static bool read_table(Quantized_table& q, int nb_elt, int nb_channels, const std::string& base_path)
+{
+    if(h_table_bits == 32)
+    {
+        std::vector<float> vals(nb_elt * nb_channels);
+        if( !read_array(&(vals[0]), nb_elt * nb_channels, table_cache_path(base_path)) )
+            return false;
+        q.quantize(&(vals[0]), nb_elt, nb_channels, 32);
+        return true;
+    }
+
+    if( !q.read( table_cache_path(base_path) ) )
+        return false;
+    return q.bits() == h_table_bits && q.nb_elt() == nb_elt && q.nb_channels() == nb_channels;
+}
+
+/// Write 'q' in the cache file of the table 'base_path'
+static bool write_table(const Quantized_table& q, const std::string& base_path)
+{
+    if(q.bits() == 32)
+        return write_array((const float*)&(q.data()[0]), q.nb_elt() * q.nb_channels(), table_cache_path(base_path));
+    return q.write( table_cache_path(base_path) );
+}
+
+/// Upload the raw texels of a 3D table stored with 'bits' to a newly
+/// allocated cudaArray. 16 and 8 bits tables are read with
+/// cudaReadModeNormalizedFloat and decoded by the fetch functions.
+static void upload_table(const void* texels,
+                         int3 size,
+                         int nb_channels,
+                         int bits,
+                         cudaArray*& d_dst)
+{
+    if(d_dst != 0) Cuda_utils::free_d(d_dst);
+
+    cudaChannelFormatKind kind = bits == 32 ? cudaChannelFormatKindFloat : cudaChannelFormatKindUnsigned;
+    cudaChannelFormatDesc cfd  = cudaCreateChannelDesc(bits, nb_channels > 1 ? bits : 0, 0, 0, kind);
+    cudaExtent volumeSize = make_cudaExtent(size.x, size.y, size.z);
+    CUDA_SAFE_CALL(cudaMalloc3DArray(&d_dst, &cfd, volumeSize) );
+
+    cudaMemcpy3DParms copyParams = {0};
+    copyParams.srcPtr   = make_cudaPitchedPtr((void*)texels, volumeSize.width * nb_channels * (bits/8), volumeSize.width, volumeSize.height);
+    copyParams.dstArray = d_dst;
+    copyParams.extent   = volumeSize;
+    copyParams.kind     = cudaMemcpyHostToDevice;
+    CUDA_SAFE_CALL( cudaMemcpy3D(&copyParams) );
+}
+
 /// @param src_vals host array to be copied. 3D values are stored linearly
 /// src_vals[x + y*width + z*width*height] = [x][y][z];
 /// @param d_dst_values device array to stores and allocate the values from host
@@ -196,6 +313,22 @@ void allocate_and_copy_1D_array(int size, T* h_src_vals, cudaArray*& d_dst_value
     CUDA_SAFE_CALL(cudaMemcpyToArray(d_dst_values, 0, 0, h_src_vals, data_size, cudaMemcpyHostToDevice));
 }
 
+// -----------------------------------------------------------------------------
+
+/// Bind a 3D table with linear filtering and clamped texel coordinates.
+/// The texel format is the one of 'd_array': 16 and 8 bits arrays can be
+/// bound to the same 'cudaReadModeNormalizedFloat' texture.
+template<class T, enum cudaTextureReadMode mode>
+static void bind_table_tex(texture<T, 3, mode>& tex, cudaArray* d_array)
+{
+    tex.normalized = false;
+    tex.addressMode[0] = cudaAddressModeClamp;
+    tex.addressMode[1] = cudaAddressModeClamp;
+    tex.filterMode = cudaFilterModeLinear;
+    CUDA_SAFE_CALL(cudaBindTextureToArray(tex, d_array));
+}
+
+// -----------------------------------------------------------------------------
 
 void bind()
 {
@@ -263,17 +396,16 @@ void bind()
             CUDA_SAFE_CALL(cudaBindTextureToArray(profiles_bulge_4D_normals_tex, d_bulge_4D_profiles_normals));
         }
 
-        openable_bulge_4D_tex.normalized = false;
-        openable_bulge_4D_tex.addressMode[0] = cudaAddressModeClamp;
-        openable_bulge_4D_tex.addressMode[1] = cudaAddressModeClamp;
-        openable_bulge_4D_tex.filterMode = cudaFilterModeLinear;
-        d_block_3D_bulge.bind_tex(openable_bulge_4D_tex);
-
-        openable_bulge_4D_gradient_tex.normalized = false;
-        openable_bulge_4D_gradient_tex.addressMode[0] = cudaAddressModeClamp;
-        openable_bulge_4D_gradient_tex.addressMode[1] = cudaAddressModeClamp;
-        openable_bulge_4D_gradient_tex.filterMode = cudaFilterModeLinear;
-        d_block_3D_bulge_gradient.bind_tex(openable_bulge_4D_gradient_tex);
+        if(d_block_3D_bulge && h_table_bits == 32)
+        {
+            bind_table_tex(openable_bulge_4D_tex         , d_block_3D_bulge         );
+            bind_table_tex(openable_bulge_4D_gradient_tex, d_block_3D_bulge_gradient);
+        }
+        else if(d_block_3D_bulge)
+        {
+            bind_table_tex(openable_bulge_4D_unorm_tex         , d_block_3D_bulge         );
+            bind_table_tex(openable_bulge_4D_gradient_unorm_tex, d_block_3D_bulge_gradient);
+        }
         // END 4D BULGE --------------
 
         // 4D RICCI --------------
@@ -286,17 +418,23 @@ void bind()
             CUDA_SAFE_CALL(cudaBindTexture(0, n_3D_ricci_tex, d_n_3D_ricci, sizeof(float)));
         }
 
-        profiles_ricci_4D_tex.normalized = false;
-        profiles_ricci_4D_tex.addressMode[0] = cudaAddressModeClamp;
-        profiles_ricci_4D_tex.addressMode[1] = cudaAddressModeClamp;
-        profiles_ricci_4D_tex.filterMode = cudaFilterModeLinear;
-        CUDA_SAFE_CALL(cudaBindTextureToArray(profiles_ricci_4D_tex, d_ricci_4D_profiles));
+        if(d_ricci_4D_profiles)
+        {
+            profiles_ricci_4D_tex.normalized = false;
+            profiles_ricci_4D_tex.addressMode[0] = cudaAddressModeClamp;
+            profiles_ricci_4D_tex.addressMode[1] = cudaAddressModeClamp;
+            profiles_ricci_4D_tex.filterMode = cudaFilterModeLinear;
+            CUDA_SAFE_CALL(cudaBindTextureToArray(profiles_ricci_4D_tex, d_ricci_4D_profiles));
+        }
 
-        profiles_ricci_4D_normals_tex.normalized = false;
-        profiles_ricci_4D_normals_tex.addressMode[0] = cudaAddressModeClamp;
-        profiles_ricci_4D_normals_tex.addressMode[1] = cudaAddressModeClamp;
-        profiles_ricci_4D_normals_tex.filterMode = cudaFilterModeLinear;
-        CUDA_SAFE_CALL(cudaBindTextureToArray(profiles_ricci_4D_normals_tex, d_ricci_4D_profiles_normals));
+        if(d_ricci_4D_profiles_normals)
+        {
+            profiles_ricci_4D_normals_tex.normalized = false;
+            profiles_ricci_4D_normals_tex.addressMode[0] = cudaAddressModeClamp;
+            profiles_ricci_4D_normals_tex.addressMode[1] = cudaAddressModeClamp;
+            profiles_ricci_4D_normals_tex.filterMode = cudaFilterModeLinear;
+            CUDA_SAFE_CALL(cudaBindTextureToArray(profiles_ricci_4D_normals_tex, d_ricci_4D_profiles_normals));
+        }
 
         openable_ricci_4D_tex.normalized = false;
         openable_ricci_4D_tex.addressMode[0] = cudaAddressModeClamp;
@@ -319,34 +457,26 @@ void bind()
         global_controller_tex.filterMode = cudaFilterModeLinear;
         CUDA_SAFE_CALL(cudaBindTextureToArray(global_controller_tex, d_global_controller));
 
-        if( d_controllers != 0)
-        {
-            tex_controllers.normalized = false;
-            tex_controllers.addressMode[0] = cudaAddressModeClamp;
-            tex_controllers.addressMode[1] = cudaAddressModeClamp;
-            tex_controllers.filterMode = cudaFilterModeLinear;
-            CUDA_SAFE_CALL(cudaBindTextureToArray(tex_controllers, d_controllers));
-        }
+        if( d_ctrl_coeffs.size() > 0 )
+            d_ctrl_coeffs.bind_tex(tex_ctrl_coeffs);
         // End Controllers -----------
 
 
         // Binary 3D operators -------
         d_operators_idx_offsets.bind_tex(tex_pred_operators_idx_offsets);
         d_operators_id.bind_tex(tex_pred_operators_id);
+        d_operators_quant.bind_tex(tex_operators_quant);
 
-        tex_operators_values.normalized = false;
-        tex_operators_values.addressMode[0] = cudaAddressModeClamp;
-        tex_operators_values.addressMode[1] = cudaAddressModeClamp;
-        tex_operators_values.filterMode = cudaFilterModeLinear;
-        if (d_operators_values)
-            CUDA_SAFE_CALL(cudaBindTextureToArray(tex_operators_values, d_operators_values));
-
-        tex_operators_grads.normalized = false;
-        tex_operators_grads.addressMode[0] = cudaAddressModeClamp;
-        tex_operators_grads.addressMode[1] = cudaAddressModeClamp;
-        tex_operators_grads.filterMode = cudaFilterModeLinear;
-        if (d_operators_grads)
-            CUDA_SAFE_CALL(cudaBindTextureToArray(tex_operators_grads, d_operators_grads));
+        if (d_operators_values && h_table_bits == 32)
+        {
+            bind_table_tex(tex_operators_values, d_operators_values);
+            bind_table_tex(tex_operators_grads , d_operators_grads );
+        }
+        else if (d_operators_values)
+        {
+            bind_table_tex(tex_operators_values_unorm, d_operators_values);
+            bind_table_tex(tex_operators_grads_unorm , d_operators_grads );
+        }
         // End Binary 3D operators ---
     }
 }
@@ -371,10 +501,12 @@ void unbind()
     CUDA_SAFE_CALL( cudaUnbindTexture(n_3D_ricci_tex)                    );
     CUDA_SAFE_CALL( cudaUnbindTexture(openable_bulge_4D_tex)             );
     CUDA_SAFE_CALL( cudaUnbindTexture(openable_bulge_4D_gradient_tex)    );
+    CUDA_SAFE_CALL( cudaUnbindTexture(openable_bulge_4D_unorm_tex)       );
+    CUDA_SAFE_CALL( cudaUnbindTexture(openable_bulge_4D_gradient_unorm_tex) );
     CUDA_SAFE_CALL( cudaUnbindTexture(openable_ricci_4D_tex)             );
     CUDA_SAFE_CALL( cudaUnbindTexture(openable_ricci_4D_gradient_tex)    );
     CUDA_SAFE_CALL( cudaUnbindTexture(global_controller_tex)             );
-    CUDA_SAFE_CALL( cudaUnbindTexture(tex_controllers)                   );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_ctrl_coeffs)                   );
 
     // =========================================================================
     // ======================  TEST with new env archi  ========================
@@ -383,6 +515,9 @@ void unbind()
     CUDA_SAFE_CALL(cudaUnbindTexture(tex_pred_operators_id));
     CUDA_SAFE_CALL(cudaUnbindTexture(tex_operators_values));
     CUDA_SAFE_CALL(cudaUnbindTexture(tex_operators_grads));
+    CUDA_SAFE_CALL(cudaUnbindTexture(tex_operators_values_unorm));
+    CUDA_SAFE_CALL(cudaUnbindTexture(tex_operators_grads_unorm));
+    CUDA_SAFE_CALL(cudaUnbindTexture(tex_operators_quant));
     // -----------------------------------------------------------------------------
 }
 
@@ -437,20 +572,36 @@ void init_3D_clean_union(bool use_cache)
 
 // -----------------------------------------------------------------------------
 
+/// Generate (or read from the cache) one of the operators using the bulge
+/// profile: B_OH, B_HCH, B_TCH or B_D. Grids are appended to
+/// 'h_operators_values/grads'
+/// @param suffix : appended to the cache name of the operator
+void init_bulge_operator(Op_t op_t,
+                         const IBL::Profile_polar::Base& bulge_curve,
+                         const std::string& suffix,
+                         bool use_cache)
+{
+    typedef IBL::Opening::Discreet_hyperbola Dh;
+    typedef IBL::Opening::Diamond Dia;
+
+    switch(op_t){
+    case B_OH:  init_3D_operator(bulge_curve, Dh(Dh::OPEN_TANH), 1.f, "3D_bulge_in_contact"+suffix, use_cache); break;
+    case B_HCH: init_3D_operator(bulge_curve, Dh(Dh::CLOSED_HERMITE), 2.f, "bulge_hyperbola_closed_h"+suffix, use_cache); break;
+    case B_TCH: init_3D_operator(bulge_curve, Dh(Dh::CLOSED_TANH), 2.f, "bulge_hyperbola_closed_t"+suffix, use_cache); break;
+    case B_D:   init_3D_operator(bulge_curve, Dia(0.55f), 2.f, "bulge_skinning_closed_t"+suffix, use_cache); break;
+    default: assert(false); break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 void init_3D_bulge_in_contact(bool use_cache)
 {
     IBL::Profile_polar::Discreet bulge_curve(h_bulge_profile,
                                              (IBL::float2*)h_bulge_normals_profile,
                                              NB_SAMPLES);
 
-    typedef IBL::Opening::Discreet_hyperbola Dh;
-    IBL::Opening::Discreet_hyperbola opening(Dh::OPEN_TANH);
-
-    init_3D_operator(bulge_curve,
-                     opening,
-                     1.f,
-                     "3D_bulge_in_contact",
-                     use_cache);
+    init_bulge_operator(B_OH, bulge_curve, "", use_cache);
 }
 
 // -----------------------------------------------------------------------------
@@ -527,45 +678,33 @@ void init_ultimate_hyperbola_closed_t(bool use_cache)
 
 void init_bulge_hyperbola_closed_h(bool use_cache)
 {
-    typedef IBL::Opening::Discreet_hyperbola Dh;
+    IBL::Profile_polar::Discreet bulge_curve(h_bulge_profile,
+                                             (IBL::float2*)h_bulge_normals_profile,
+                                             NB_SAMPLES);
 
-    init_3D_operator(IBL::Profile_polar::Discreet(h_bulge_profile,
-                                                  (IBL::float2*)h_bulge_normals_profile,
-                                                  NB_SAMPLES),
-                     Dh(Dh::CLOSED_HERMITE),
-                     2.f,
-                     "bulge_hyperbola_closed_h",
-                     use_cache);
+    init_bulge_operator(B_HCH, bulge_curve, "", use_cache);
 }
 
 // -----------------------------------------------------------------------------
 
 void init_bulge_hyperbola_closed_t(bool use_cache)
 {
-    typedef IBL::Opening::Discreet_hyperbola Dh;
+    IBL::Profile_polar::Discreet bulge_curve(h_bulge_profile,
+                                             (IBL::float2*)h_bulge_normals_profile,
+                                             NB_SAMPLES);
 
-    init_3D_operator(IBL::Profile_polar::Discreet(h_bulge_profile,
-                                                  (IBL::float2*)h_bulge_normals_profile,
-                                                  NB_SAMPLES),
-                     Dh(Dh::CLOSED_TANH),
-                     2.f,
-                     "bulge_hyperbola_closed_t",
-                     use_cache);
+    init_bulge_operator(B_TCH, bulge_curve, "", use_cache);
 }
 
 // -----------------------------------------------------------------------------
 
 void init_bulge_skinning_closed_t(bool use_cache)
 {
-    typedef IBL::Opening::Diamond Dia;
+    IBL::Profile_polar::Discreet bulge_curve(h_bulge_profile,
+                                             (IBL::float2*)h_bulge_normals_profile,
+                                             NB_SAMPLES);
 
-    init_3D_operator(IBL::Profile_polar::Discreet(h_bulge_profile,
-                                                  (IBL::float2*)h_bulge_normals_profile,
-                                                  NB_SAMPLES),
-                     Dia(0.55f),
-                     2.f,
-                     "bulge_skinning_closed_t",
-                     use_cache);
+    init_bulge_operator(B_D, bulge_curve, "", use_cache);
 }
 
 // -----------------------------------------------------------------------------
@@ -613,6 +752,23 @@ static void copy_4D_bulge_profile(int id,
 
 // -----------------------------------------------------------------------------
 
+/// Number of elements of a grid of the 4D tables (one 3D operator plus
+/// padding)
+static int3 grid_4D_size()
+{
+    const int len = h_table_res.samples_4D + 2/*padding*/;
+    return make_int3(len, len, len);
+}
+
+/// Number of grids storable in the (x, y, z) direction of a block of 4D tables
+static int3 grid_4D_block_dim()
+{
+    const int3 g = grid_4D_size();
+    return make_int3(MAX_TEX_LENGTH / g.x, MAX_TEX_LENGTH / g.y, MAX_TEX_LENGTH / g.z);
+}
+
+// -----------------------------------------------------------------------------
+
 static void replicate_padding_values(int3 grid_index,
                                      int3 grid_size,
                                      int3 block_size,
@@ -620,12 +776,13 @@ static void replicate_padding_values(int3 grid_index,
                                      HA_float2& h_block_grads)
 {
 #if 1
-    int len = NB_SAMPLES_4D_BULGE-1;
+    const int n = grid_size.x - 2/*padding*/;
+    int len = n-1;
     for(int f = 0; f < 6; f++) // For each grid's face
     {
         // Look up the face
-        for(int i = 0; i < NB_SAMPLES_4D_BULGE; i++) {
-            for(int j = 0; j < NB_SAMPLES_4D_BULGE; j++) {
+        for(int i = 0; i < n; i++) {
+            for(int j = 0; j < n; j++) {
 
                 int3 grid_id; // <- index inside the grid
                 int3 off;
@@ -675,8 +832,9 @@ void init_4D_ricci(bool use_cache)
     */
 
     // Number of grids stored in the block for (x, y, z) directions
-    const int3 block_dim = { BLOCK_4D_BULGE_LX, BLOCK_4D_BULGE_LY, BLOCK_4D_BULGE_LZ };
-    const int3 grid_size = { GRIG_4D_BULGE_LX , GRIG_4D_BULGE_LY , GRIG_4D_BULGE_LZ  };
+    const int3 block_dim = grid_4D_block_dim();
+    const int3 grid_size = grid_4D_size();
+    const int  n         = h_table_res.samples_4D;
 
     // Total number of grids (as much as the bulge magnitude sampling)
     const int nb_grids = 30; // ###
@@ -705,8 +863,8 @@ void init_4D_ricci(bool use_cache)
 
     if(use_cache)
     {
-        s = s && read_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_ricci_vals.opc"  );
-        s = s && read_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_ricci_grads.opc" );
+        s = s && read_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_ricci_vals"+res_suffix_4D()+".opc"  );
+        s = s && read_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_ricci_grads"+res_suffix_4D()+".opc" );
     }
 
     HA_float  h_ricci_profiles      ((NB_SAMPLES+2)*nb_grids, 0.f);
@@ -729,16 +887,16 @@ void init_4D_ricci(bool use_cache)
             IBL::gen_custom_operator(ricci_curve,
                                      opening,
                                      1.f,
-                                     NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE,
+                                     n, n,
                                      h_vals, h_grads);
 
             // copy to host grid
             int3 grid_index = idx1D_to_idx3D(i, block_dim);
 
-            for(int j = 0; j < Utils::ipow(NB_SAMPLES_4D_BULGE, 3); j++)
+            for(int j = 0; j < Utils::ipow(n, 3); j++)
             {
                 // index inside the grid
-                int3 off = idx1D_to_idx3D(j, NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE);
+                int3 off = idx1D_to_idx3D(j, n, n, n);
 
                 int3 block_3D_idx = { grid_index.x * grid_size.x + 1 + off.x,
                                       grid_index.y * grid_size.y + 1 + off.y,
@@ -767,8 +925,8 @@ void init_4D_ricci(bool use_cache)
 
     if(!s)
     {
-        write_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_ricci_vals.opc"  );
-        write_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_ricci_grads.opc" );
+        write_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_ricci_vals"+res_suffix_4D()+".opc"  );
+        write_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_ricci_grads"+res_suffix_4D()+".opc" );
     }
 
     d_block_3D_ricci.malloc(block_size.x, block_size.y, block_size.z);
@@ -794,8 +952,9 @@ void init_4D_bulge_in_contact(bool use_cache)
     */
 
     // Number of grids stored in the block for (x, y, z) directions
-    const int3 block_dim = { BLOCK_4D_BULGE_LX, BLOCK_4D_BULGE_LY, BLOCK_4D_BULGE_LZ };
-    const int3 grid_size = { GRIG_4D_BULGE_LX , GRIG_4D_BULGE_LY , GRIG_4D_BULGE_LZ  };
+    const int3 block_dim = grid_4D_block_dim();
+    const int3 grid_size = grid_4D_size();
+    const int  n         = h_table_res.samples_4D;
 
     // Total number of grids (as much as the bulge magnitude sampling)
     const int nb_grids = NB_SAMPLES_MAG_4D_BULGE;
@@ -814,20 +973,23 @@ void init_4D_bulge_in_contact(bool use_cache)
     assert(block_size.z <= MAX_TEX_LENGTH);
 
     const int block_len = block_size.x*block_size.y*block_size.z;
-    // FIXME : h_block_vals[] is not initialized correctly valgring complains
-    // about uninitialized mem if we do not fill it with zeros. This means
-    // The loop filling it is not doing its job correctly
-    HA_float  h_block_vals (block_len, 0.f                   );
-    HA_float2 h_block_grads(block_len, make_float2(0.f, 0.f) );
+    Quantized_table q_vals, q_grads;
 
     bool s = use_cache;
 
     if(use_cache)
     {
-        s = s && read_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_bulge_vals.opc"  );
-        s = s && read_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_bulge_grads.opc" );
+        s = s && read_table(q_vals , block_len, 1, get_cache_dir()+"/4D_bulge_vals"+res_suffix_4D()  );
+        s = s && read_table(q_grads, block_len, 2, get_cache_dir()+"/4D_bulge_grads"+res_suffix_4D() );
     }
 
+    // Float values are only needed to build the tables when not cached
+    // FIXME : h_block_vals[] is not initialized correctly valgring complains
+    // about uninitialized mem if we do not fill it with zeros. This means
+    // The loop filling it is not doing its job correctly
+    HA_float  h_block_vals (s ? 0 : block_len, 0.f                   );
+    HA_float2 h_block_grads(s ? 0 : block_len, make_float2(0.f, 0.f) );
+
     HA_float  h_bulge_profiles      ((NB_SAMPLES+2)*nb_grids, 0.f);
     HA_float2 h_bulge_profiles_grads((NB_SAMPLES+2)*nb_grids, make_float2(0.f, 0.f));
 
@@ -847,16 +1009,16 @@ void init_4D_bulge_in_contact(bool use_cache)
             IBL::gen_custom_operator(bulge_curve,
                                      opening,
                                      1.f,
-                                     NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE,
+                                     n, n,
                                      h_vals, h_grads);
 
             // copy to host grid
             int3 grid_index = idx1D_to_idx3D(i, block_dim);
 
-            for(int j = 0; j < Utils::ipow(NB_SAMPLES_4D_BULGE, 3); j++)
+            for(int j = 0; j < Utils::ipow(n, 3); j++)
             {
                 // index inside the grid
-                int3 off = idx1D_to_idx3D(j, NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE, NB_SAMPLES_4D_BULGE);
+                int3 off = idx1D_to_idx3D(j, n, n, n);
 
                 int3 block_3D_idx = { grid_index.x * grid_size.x + 1 + off.x,
                                       grid_index.y * grid_size.y + 1 + off.y,
@@ -885,18 +1047,39 @@ void init_4D_bulge_in_contact(bool use_cache)
 
     if(!s)
     {
-        write_array(h_block_vals.ptr() , block_len, get_cache_dir()+"/4D_bulge_vals.opc"  );
-        write_array(h_block_grads.ptr(), block_len, get_cache_dir()+"/4D_bulge_grads.opc" );
+        // Quantize once from the float values, the error against them is
+        // kept with the tables (and in the cache)
+        q_vals. quantize(h_block_vals.ptr()           , block_len, 1, h_table_bits);
+        q_grads.quantize((float*)h_block_grads.ptr(), block_len, 2, h_table_bits);
+        write_table(q_vals , get_cache_dir()+"/4D_bulge_vals"+res_suffix_4D()  );
+        write_table(q_grads, get_cache_dir()+"/4D_bulge_grads"+res_suffix_4D() );
     }
 
-    d_block_3D_bulge.malloc(block_size.x, block_size.y, block_size.z);
-    d_block_3D_bulge.copy_from(h_block_vals);
+    upload_table(&(q_vals. data()[0]), block_size, 1, h_table_bits, d_block_3D_bulge         );
+    upload_table(&(q_grads.data()[0]), block_size, 2, h_table_bits, d_block_3D_bulge_gradient);
 
-    d_block_3D_bulge_gradient.malloc(block_size.x, block_size.y, block_size.z);
-    d_block_3D_bulge_gradient.copy_from(h_block_grads);
+    const float2 vals_quant  = make_float2(q_vals.scale(0), q_vals.offset(0));
+    const float4 grads_quant = make_float4(q_grads.scale(0), q_grads.offset(0), q_grads.scale(1), q_grads.offset(1));
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(bulge_4D_vals_quant , &vals_quant , sizeof(float2)) );
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(bulge_4D_grads_quant, &grads_quant, sizeof(float4)) );
 
     allocate_and_copy_1D_array((NB_SAMPLES+2)*nb_grids, h_bulge_profiles.ptr()      , d_bulge_4D_profiles        );
     allocate_and_copy_1D_array((NB_SAMPLES+2)*nb_grids, h_bulge_profiles_grads.ptr(), d_bulge_4D_profiles_normals);
+
+    // Keep the tables for host evaluation (see blending_env_host.hpp)
+    std::swap(h_block_3D_bulge, q_vals);
+    std::swap(h_block_3D_bulge_gradient, q_grads);
+    h_bulge_4D_profiles.swap( h_bulge_profiles );
+    h_bulge_4D_profiles_normals.swap( h_bulge_profiles_grads );
+    h_block_3D_bulge_size = block_size;
+    h_bulge_4D_corners.resize( nb_grids * 3 );
+    for(int i = 0; i < nb_grids; i++)
+    {
+        int3 grid_index = idx1D_to_idx3D(i, block_dim);
+        h_bulge_4D_corners[i*3 + 0] = grid_index.x * grid_size.x + 1/*padding*/;
+        h_bulge_4D_corners[i*3 + 1] = grid_index.y * grid_size.y + 1/*padding*/;
+        h_bulge_4D_corners[i*3 + 2] = grid_index.z * grid_size.z + 1/*padding*/;
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -1057,119 +1240,20 @@ float eval_global_ctrl(float dot)
 
 // -----------------------------------------------------------------------------
 
-void update_3D_bulge()
-{
-    unbind();
-
-    std::cout << "update samples \n..." << std::endl;
-    init_profile_bulge(false);
-    init_3D_bulge_in_contact(false);
-
-    bind();
-}
-
-// -----------------------------------------------------------------------------
-
-static void d_controllers_malloc(int2 size)
-{
-    assert(!binded);
-    if(d_controllers != 0) CUDA_SAFE_CALL(cudaFreeArray(d_controllers));
-
-    if(size.x * size.y > 0) malloc_2D_array<float2>(d_controllers, size);
-    else                    d_controllers = 0;
-}
-
-// -----------------------------------------------------------------------------
-
-static void d_controllers_copy_from(const Cuda_utils::Host::Array<float2>& h_a, int2 size)
-{
-    if( size.x * size.y > 0)
-    {
-        assert(!binded);
-        mem_cpy_2D_htd(d_controllers, h_a.ptr(), size);
-    }
-}
-
-// -----------------------------------------------------------------------------
-
-/// @return the size of the block in (x,y) direction given the current number of
-/// controllers
-static int2 ctrl_max_size_2D()
-{
-    int nb_ctrl = list_controllers.size() - 1;
-
-    if(nb_ctrl < 0) return make_int2(0, 0);
-
-    int2 bidx_2D = { nb_ctrl % BLOCK_CTRL_LX, nb_ctrl / BLOCK_CTRL_LX };
-    int2 s = { (bidx_2D.y == 0) ? ((bidx_2D.x+1) * GRID_CTRL_LX) : (BLOCK_CTRL_LX*GRID_CTRL_LX),
-               (bidx_2D.y+1) * GRID_CTRL_LY};
-
-    // If triggered means that to many controllers has been created.
-    assert(s.x <= MAX_2D_TEX_LENGTH_X);
-    assert(s.y <= MAX_2D_TEX_LENGTH_Y);
-    return s;
-}
-
-// -----------------------------------------------------------------------------
-
-static int2 ctrl_1DIdx_to_2DIdx(int id)
-{
-    return make_int2(id%BLOCK_CTRL_LX, id/BLOCK_CTRL_LX);
-}
-
-// -----------------------------------------------------------------------------
-
-/// copy the 2D list of controllers 'list' in the flat representation and device
-/// memory.
+/// Upload every controller coefficients and resize the device array
+/// if the number of instances changed.
 void update_ctrl_in_device()
 {
     assert(!binded);
-    int2 gsize2D = ctrl_max_size_2D();
-    h_controllers.malloc( gsize2D.x * gsize2D.y );
-    d_controllers_malloc( gsize2D               );
-
-    // Do the copy of 'list_controllers' into the flatten array 'h_controllers'
-    const int width = gsize2D.x;
-    for(unsigned i = 0; i < list_controllers.size(); i++)
-    {
-        float2* ctrl = (float2*)list_controllers[i];
-
-        // Nothing to copy we skip
-        if(ctrl == 0) continue;
-
-        int2 bidx_2D = ctrl_1DIdx_to_2DIdx( i );
-        int2 gidx_2D = {bidx_2D.x * GRID_CTRL_LX, bidx_2D.y * GRID_CTRL_LY };
-
-        for(int j = 0; j < NB_SAMPLES; j++)
-        {
-            int row0_idx = (gidx_2D.x + j + 1) + (gidx_2D.y  ) * width;
-            int row1_idx = (gidx_2D.x + j + 1) + (gidx_2D.y+1) * width;
-            int row2_idx = (gidx_2D.x + j + 1) + (gidx_2D.y+2) * width;
-
-            float2 val = ctrl[j];
-            h_controllers[row0_idx] = val;
-            h_controllers[row1_idx] = val;
-            h_controllers[row2_idx] = val;
-        }
-
-        // Copy extremities
-        int row0_idx = (gidx_2D.x) + (gidx_2D.y  ) * width;
-        int row1_idx = (gidx_2D.x) + (gidx_2D.y+1) * width;
-        int row2_idx = (gidx_2D.x) + (gidx_2D.y+2) * width;
-        float2 val = ctrl[0];
-        // Pad start
-        h_controllers[row0_idx] = val;
-        h_controllers[row1_idx] = val;
-        h_controllers[row2_idx] = val;
-
-        // Pad end
-        val = ctrl[NB_SAMPLES-1];
-        h_controllers[row0_idx+NB_SAMPLES+1] = val;
-        h_controllers[row1_idx+NB_SAMPLES+1] = val;
-        h_controllers[row2_idx+NB_SAMPLES+1] = val;
+    const int len = (int)h_ctrl_coeffs.size() * 4;
+    if( len == 0 ){
+        d_ctrl_coeffs.erase();
+        return;
     }
-    // Update the device array
-    d_controllers_copy_from(h_controllers, gsize2D);
+
+    if( d_ctrl_coeffs.size() != len )
+        d_ctrl_coeffs.malloc( len );
+    d_ctrl_coeffs.copy_from( h_ctrl_coeffs );
 }
 
 // -----------------------------------------------------------------------------
@@ -1189,9 +1273,9 @@ Ctrl_id new_ctrl_instance()
     // We need to allocate more memory
     if(idx == (int)h_ctrl_active.size())
     {
-        list_controllers.push_back(0);
+        h_ctrl_coeffs.push_back( IBL::make_ctrl_coeffs(IBL::Ctrl_setup()) );
         h_ctrl_active.push_back( true );
-        // Increase memory and recopy values from 'list_controllers'
+        // Increase memory and recopy values from 'h_ctrl_coeffs'
         update_ctrl_in_device();
     }
 
@@ -1226,10 +1310,8 @@ void delete_ctrl_instance(Ctrl_id inst_id)
     if(inst_id != (int)(h_ctrl_active.size()-1))
     {
         // The instance is not in the end of the list we keep memory space of
-        // h_controllers and d_controllers for later use.
+        // h_ctrl_coeffs and d_ctrl_coeffs for later use.
         nb_instances--;
-        delete[] list_controllers[inst_id];
-        list_controllers[inst_id] = 0;
         return;
     }
 
@@ -1240,8 +1322,7 @@ void delete_ctrl_instance(Ctrl_id inst_id)
     int idx = h_ctrl_active.size()-1;
     while(h_ctrl_active[idx] == false)
     {
-        delete[] list_controllers[idx];
-        list_controllers.pop_back();
+        h_ctrl_coeffs.pop_back();
         h_ctrl_active.pop_back();
 
         idx--;
@@ -1261,41 +1342,13 @@ void update_controller(Ctrl_id inst_id, const IBL::Ctrl_setup& shape)
     assert(inst_id >= 0);
     assert(h_ctrl_active[inst_id]);
     assert(nb_instances > 0);
-    Blending_env::unbind();
-
-    int2 bidx_2D = {inst_id % BLOCK_CTRL_LX , inst_id / BLOCK_CTRL_LX  };
-    int2 gidx_2D = {bidx_2D.x * GRID_CTRL_LX, bidx_2D.y * GRID_CTRL_LY };
-    int2 gsize2D = ctrl_max_size_2D();
-
-    const int width = gsize2D.x;
-
-    IBL::float2* controller = 0;
-    IBL::gen_controller(NB_SAMPLES, shape, controller);
-
-    int off = (gidx_2D.x+ 1/*padding*/) + (gidx_2D.y+1/*write values in the midlle*/) * width;
-
-    Cuda_utils::mem_cpy_hth((IBL::float2*)(h_controllers.ptr()+off), controller, NB_SAMPLES);
-
-    delete[] list_controllers[inst_id];
-    list_controllers[inst_id] = controller;
-
-    // Padd values :
-    h_controllers[off-1           ] = h_controllers[off           ];
-    h_controllers[off+NB_SAMPLES+1] = h_controllers[off+NB_SAMPLES];
-
-    for(int i = 0; i < (NB_SAMPLES+2/*Padding*/); i++)
-    {
-        int row0_idx = (gidx_2D.x + i) + (gidx_2D.y  ) * width;
-        int row1_idx = (gidx_2D.x + i) + (gidx_2D.y+1) * width;
-        int row2_idx = (gidx_2D.x + i) + (gidx_2D.y+2) * width;
-
-        float2 val = h_controllers[row1_idx];
-        h_controllers[row0_idx] = val;
-        h_controllers[row2_idx] = val;
-    }
 
-    d_controllers_copy_from(h_controllers, gsize2D);
-    Blending_env::bind();
+    // Only the instance's coefficients are uploaded. The texture stays bound
+    // since the device array is not reallocated.
+    h_ctrl_coeffs[inst_id] = IBL::make_ctrl_coeffs(shape);
+    Cuda_utils::mem_cpy_htd(d_ctrl_coeffs.ptr() + inst_id * 4,
+                            (const float4*)&(h_ctrl_coeffs[inst_id]),
+                            4);
 }
 
 // -----------------------------------------------------------------------------
@@ -1323,45 +1376,197 @@ cudaArray* d_operators_values = 0;
 cudaArray* d_operators_grads  = 0;
 /// @}
 
-/// Every blending operators values/gradients concatenated in one CPU grid
+/// A 3D table of an operator in host memory, padded by PADDING and stored
+/// with h_table_bits
+struct Table3 {
+    Vec3i_cu        size;    ///< nb texels, padding included
+    Vec3i_cu        pad_off; ///< first non padded texel
+    Quantized_table q;
+};
+
+/// Every blending operators values/gradients concatenated in host memory.
+/// These are the raw texels of each operator's Table3 (see concat_tables())
 /// @{
-Grid3_cu<float>*  grid_operators_values = 0;
-Grid3_cu<float2>* grid_operators_grads  = 0;
+Vec3i_cu                   conc_operators_size;
+std::vector<unsigned char> conc_operators_values;
+std::vector<unsigned char> conc_operators_grads;
 /// @}
 
 /// this array saves the offset needed to access blending operators
-/// in 'd_operators_xxx' or 'grid_operators_xxx'
+/// in 'd_operators_xxx' or 'conc_operators_xxx'
 /// @{
 std::vector<Idx3_cu> h_operators_idx_offsets;
 Cuda_utils::Device::Array<int4> d_operators_idx_offsets; // GPU mem
 /// @}
 
+/// Decoding constants of each operator of the concatenation, same indices
+/// as 'd_operators_idx_offsets' (see tex_operators_quant)
+/// @{
+std::vector<float4> h_operators_quant;
+Cuda_utils::Device::Array<float4> d_operators_quant; // GPU mem
+/// @}
+
 /// maps operators types to their identifier.
 // TODO this maps only a sub part of operators type it should map everything
 // and with id=-1 for operators types which doesn't exists.
 Cuda_utils::Device::Array<Op_id> d_operators_id;
 
-/// predefined operators grids
-std::vector< Grid3_cu<float>*  > h_operators_values;
-std::vector< Grid3_cu<float2>* > h_operators_grads;
+/// Host copies of 'd_operators_idx_offsets' as (x, y, z) corners in
+/// 'conc_operators_xxx' and of 'd_operators_id'
+/// @{
+std::vector<int>   h_operators_corners;
+std::vector<Op_id> h_operators_id;
+/// @}
+
+/// predefined operators tables
+std::vector< Table3* > h_operators_values;
+std::vector< Table3* > h_operators_grads;
 
 bool h_operators_enabling[NB_PRED_OPS] = {};
 
 /// user customly defined operators
-std::vector< Grid3_cu<float>*  > h_custom_op_vals;
-std::vector< Grid3_cu<float2>* > h_custom_op_grads;
+std::vector< Table3* > h_custom_op_vals;
+std::vector< Table3* > h_custom_op_grads;
+
+/// Predefined operators with a bulge profile precomputed at
+/// NB_SAMPLES_MAG_3D_BULGE magnitudes: h_bulge_slices_xxx[i][k] is the
+/// operator 'i' with the magnitude bulge_slice_mag(k). Empty until
+/// update_3D_bulge() needs them.
+/// @{
+std::vector< Table3* > h_bulge_slices_vals [NB_PRED_OPS];
+std::vector< Table3* > h_bulge_slices_grads[NB_PRED_OPS];
+/// @}
+
+/// Wether the loaded bulge operators have been interpolated to
+/// 'h_magnitude_3D_bulge' (otherwise they are at their cached magnitude)
+bool h_bulge_slices_used = false;
 
 // -----------------------------------------------------------------------------
 
-/// @param src_vals host array to be copied. 3D values are stored linearly
-/// src_vals[x + y*width + z*width*height] = [x][y][z];
-/// @param d_dst_values device array to stores and allocate the values from host
+static void free_bulge_slices()
+{
+    for(int i = 0; i < NB_PRED_OPS; ++i) {
+        for(unsigned k = 0; k < h_bulge_slices_vals[i].size(); ++k) {
+            delete h_bulge_slices_vals [i][k];
+            delete h_bulge_slices_grads[i][k];
+        }
+        h_bulge_slices_vals [i].clear();
+        h_bulge_slices_grads[i].clear();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Quantize the padded grid 'g' with h_table_bits
 template<class T>
-void allocate_and_copy_3D_array(Grid3_cu<T>* grid_data,
-                                cudaArray*& d_dst_values)
+static Table3* new_table(const Grid3_cu<T>& g)
+{
+    Table3* t = new Table3();
+    t->size    = g.size();
+    t->pad_off = g.get_padd_offset();
+    const int nb_channels = sizeof(T) / sizeof(float);
+    t->q.quantize((const float*)&(g.get_vals()[0]), g.size().product(), nb_channels, h_table_bits);
+    return t;
+}
+
+/// Table 'path' of 'size' texels (padding included) from the cache
+/// @return null if not cached with h_table_bits
+static Table3* read_op_table(const Vec3i_cu& size, int nb_channels, const std::string& path)
+{
+    Table3* t = new Table3();
+    t->size    = size;
+    t->pad_off = PADDING_OFFSET;
+    if( !read_table(t->q, size.product(), nb_channels, path) ){
+        delete t;
+        return 0;
+    }
+    return t;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Copy the raw texels of 't' (padding included) in the concatenation 'conc'
+/// of 'conc_size' texels at 'origin'
+static void set_table_block(std::vector<unsigned char>& conc,
+                            const Vec3i_cu& conc_size,
+                            const Vec3i_cu& origin,
+                            const Table3& t)
+{
+    assert( origin.x >= 0 && origin.x + t.size.x <= conc_size.x );
+    assert( origin.y >= 0 && origin.y + t.size.y <= conc_size.y );
+    assert( origin.z >= 0 && origin.z + t.size.z <= conc_size.z );
+
+    const int texel = t.q.bytes() / t.size.product();
+    const int row   = t.size.x * texel;
+    const unsigned char* src = &(t.q.data()[0]);
+    for(int z = 0; z < t.size.z; ++z)
+    {
+        for(int y = 0; y < t.size.y; ++y)
+        {
+            const int dst = Idx3_cu(conc_size, origin + Vec3i_cu(0, y, z)).to_linear();
+            memcpy(&(conc[dst * texel]), src + (y + z * t.size.y) * row, row);
+        }
+    }
+}
+
+/// Concatenate the tables of 'list' (all of the same size and precision)
+/// without decoding them. Same layout as the concatenation of Grid3_cu: the
+/// tables are placed along x then y then z.
+/// @param max_s : maximum size of the concatenation
+/// @param out_idx : first non padded texel of each table in 'conc'
+static void concat_tables(const std::vector<Table3*>& list,
+                          const Vec3i_cu& max_s,
+                          Vec3i_cu& conc_size,
+                          std::vector<unsigned char>& conc,
+                          std::vector<Idx3_cu>& out_idx)
+{
+    assert( list.size() );
+    const Vec3i_cu s = list[0]->size;
+    const int n = (int)list.size();
+    const int nb_max_x = max_s.x / s.x;
+    const int nb_max_y = max_s.y / s.y;
+    Vec3i_cu dim;
+    if(nb_max_x > n)
+        dim = Vec3i_cu(n, 1, 1);
+    else if(nb_max_x * nb_max_y > n)
+        dim = Vec3i_cu(nb_max_x, n / nb_max_x + 1, 1);
+    else
+        dim = Vec3i_cu(nb_max_x, nb_max_y, n / (nb_max_x * nb_max_y) + 1);
+
+    conc_size = Vec3i_cu(dim.x * s.x, dim.y * s.y, dim.z * s.z);
+    const int texel = list[0]->q.bytes() / s.product();
+    conc.assign(conc_size.product() * texel, 0);
+    out_idx.clear();
+    for(int i = 0; i < n; ++i)
+    {
+        assert( list[i]->size == s && list[i]->q.bits() == list[0]->q.bits() );
+        const Vec3i_cu origin((i % dim.x) * s.x,
+                              (i / dim.x % dim.y) * s.y,
+                              (i / (dim.x * dim.y)) * s.z);
+        set_table_block(conc, conc_size, origin, *list[i]);
+        out_idx.push_back( Idx3_cu(conc_size, origin + list[i]->pad_off) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Set the decoding constants of the operator 'idx' in 'h_operators_quant'
+static void set_operator_quant(int idx, const Table3& vals, const Table3& grads)
 {
-    if(d_dst_values != 0) Cuda_utils::free_d( d_dst_values );
-    d_dst_values = grid_data->to_gpu();
+    h_operators_quant[idx*2 + 0] = make_float4(vals.q.scale(0), vals.q.offset(0), 0.f, 0.f);
+    h_operators_quant[idx*2 + 1] = make_float4(grads.q.scale(0), grads.q.offset(0),
+                                               grads.q.scale(1), grads.q.offset(1));
+}
+
+/// Upload the concatenated operators values and gradients as they are stored
+/// in host memory and their decoding constants 'h_operators_quant'
+static void upload_operators()
+{
+    const int3 s = make_int3(conc_operators_size.x, conc_operators_size.y, conc_operators_size.z);
+    upload_table(&(conc_operators_values[0]), s, 1, h_table_bits, d_operators_values);
+    upload_table(&(conc_operators_grads [0]), s, 2, h_table_bits, d_operators_grads );
+    d_operators_quant.malloc( h_operators_quant.size() );
+    d_operators_quant.copy_from( h_operators_quant );
 }
 
 // -----------------------------------------------------------------------------
@@ -1372,141 +1577,324 @@ void init_3D_operator(const IBL::Profile_polar::Base& profile,
                       const std::string filename,
                       bool use_cache)
 {
-    float*       h_vals  = 0;
-    IBL::float2* h_grads = 0;
-
-    int len = (NB_SAMPLES_OCU+2)*(NB_SAMPLES_OCU+2)*(NB_SAMPLES_ALPHA+2);
-    bool s = use_cache;
-    Vec3i_cu size(NB_SAMPLES_OCU, NB_SAMPLES_OCU, NB_SAMPLES_ALPHA);
-    Vec3i_cu pad_off(0, 0, 0);
-    if(use_cache)
+    const int nxy = h_table_res.samples_xy;
+    const int na  = h_table_res.samples_alpha;
+    const Vec3i_cu padded_size(nxy+2, nxy+2, na+2);
+    const std::string path = get_cache_dir()+"/"+filename+res_suffix_3D();
+
+    Table3* t_vals  = 0;
+    Table3* t_grads = 0;
+    if(use_cache && filename.size() > 0)
     {
-        // Operator must be cached => get it (already padded)
-        h_vals  = new float      [len];
-        h_grads = new IBL::float2[len];
-        s = s && read_array(h_vals , len, get_cache_dir()+"/"+filename+"_vals.opc"  );
-        s = s && read_array(h_grads, len, get_cache_dir()+"/"+filename+"_grads.opc" );
+        // Operator must be cached => get it (already padded and quantized)
+        t_vals  = read_op_table(padded_size, 1, path+"_vals" );
+        t_grads = t_vals ? read_op_table(padded_size, 2, path+"_grads") : 0;
     }
 
-    if(!s)
+    if(t_vals == 0 || t_grads == 0)
     {
+        delete t_vals;
         // Operator is not cached => compute it
+        float*       h_vals  = 0;
+        IBL::float2* h_grads = 0;
         IBL::gen_custom_operator(profile,
                                  opening,
                                  range,
-                                 NB_SAMPLES_OCU, NB_SAMPLES_ALPHA ,
+                                 nxy, na,
                                  h_vals, h_grads);
-    }
-    else {
-        // as already padded
-        size += Vec3i_cu(2, 2, 2);
-        pad_off = PADDING_OFFSET;
-    }
-
-    // store into new grids
-    Grid3_cu<float >* grid_vals  = new Grid3_cu<float >(size, h_vals          , pad_off);
-    Grid3_cu<float2>* grid_grads = new Grid3_cu<float2>(size, (float2*)h_grads, pad_off);
 
-    // if not cached : padd it as concatenation won't and save it padded
-    if( !s)
-    {
         // padd it as concatenation won't
-        grid_vals-> padd( Vec3i_cu(PADDING, PADDING, PADDING) );
-        grid_grads->padd( Vec3i_cu(PADDING, PADDING, PADDING) );
+        Vec3i_cu size(nxy, nxy, na);
+        Grid3_cu<float > grid_vals (size, h_vals          );
+        Grid3_cu<float2> grid_grads(size, (float2*)h_grads);
+        grid_vals. padd( Vec3i_cu(PADDING, PADDING, PADDING) );
+        grid_grads.padd( Vec3i_cu(PADDING, PADDING, PADDING) );
+        delete[] h_vals;
+        delete[] h_grads;
+
+        // quantize it once and save it padded
+        t_vals  = new_table(grid_vals );
+        t_grads = new_table(grid_grads);
         if ( filename.size() > 0 ){
-            write_array(grid_vals->get_vals().data(), len, get_cache_dir()+"/"+filename+"_vals.opc"  );
-            write_array(grid_grads->get_vals().data(), len, get_cache_dir()+"/"+filename+"_grads.opc" );
+            write_table(t_vals ->q, path+"_vals"  );
+            write_table(t_grads->q, path+"_grads" );
         }
     }
 
     // record the new operator
-    h_operators_values.push_back( grid_vals  );
-    h_operators_grads. push_back( grid_grads );
-
-    delete[] h_vals;
-    delete[] h_grads;
+    h_operators_values.push_back( t_vals  );
+    h_operators_grads. push_back( t_grads );
 }
 
 // -----------------------------------------------------------------------------
 
-void load_3d_predefined(bool use_cache = true)
+/// Generation (or cache loading) of each predefined operator in the order of
+/// their Op_t. Each function appends its grids to 'h_operators_values/grads'
+typedef void (*Op_init_t)(bool use_cache);
+static const Op_init_t h_operators_init[NB_PRED_OPS] = {
+    init_3D_barths_circle_arc,
+    init_3D_barths_circle_diamond,
+    init_circle_hyperbola_open,
+    init_circle_hyperbola_closed_h,
+    init_circle_hyperbola_closed_t,
+    init_3D_clean_union,
+    init_ultimate_hyperbola_closed_h,
+    init_ultimate_hyperbola_closed_t,
+    init_3D_bulge_in_contact,
+    init_bulge_hyperbola_closed_h,
+    init_bulge_hyperbola_closed_t,
+    init_bulge_skinning_closed_t
+};
+
+// -----------------------------------------------------------------------------
+
+/// Time and memory spent loading a family or a predefined operator
+struct Load_stats {
+    bool      loaded;
+    double    secs;
+    long long host_bytes;   ///< signed: re-concatenation may free memory
+    long long device_bytes;
+};
+
+Load_stats h_families_stats [NB_FAMILIES];
+Load_stats h_operators_stats[NB_PRED_OPS];
+
+/// Mirror the loaded families in the constant memory
+static void upload_families_loaded()
 {
-    if ( h_operators_enabling[0] ) {
-        init_3D_barths_circle_arc(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[1] ) {
-        init_3D_barths_circle_diamond(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
+    int mask = 0;
+    for(int i = 0; i < NB_FAMILIES; i++)
+        if( h_families_stats[i].loaded ) mask |= 1 << i;
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(families_loaded, &mask, sizeof(int)) );
+}
+
+/// Measures the memory added to Blending_env between start() and stop()
+struct Load_probe {
+    void start(){
+        Memory_report rep;
+        memory_report(rep);
+        _host   = rep.total(Memory_report::HOST  , "Blending_env");
+        _device = rep.total(Memory_report::DEVICE, "Blending_env");
+        _t.start();
     }
-    if ( h_operators_enabling[2] ) {
-        init_circle_hyperbola_open(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
+
+    void stop(Load_stats& stats){
+        stats.secs = _t.stop();
+        Memory_report rep;
+        memory_report(rep);
+        stats.host_bytes   = (long long)rep.total(Memory_report::HOST  , "Blending_env") - (long long)_host;
+        stats.device_bytes = (long long)rep.total(Memory_report::DEVICE, "Blending_env") - (long long)_device;
+        stats.loaded = true;
     }
-    if ( h_operators_enabling[3] ) {
-        init_circle_hyperbola_closed_h(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[4] ) {
-        init_circle_hyperbola_closed_t(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[5] ) {
-        init_3D_clean_union(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[6] ) {
-        init_ultimate_hyperbola_closed_h(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[7] ) {
-        init_ultimate_hyperbola_closed_t(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[8] ) {
-        init_3D_bulge_in_contact(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
-    }
-    if ( h_operators_enabling[9] ) {
-        init_bulge_hyperbola_closed_h(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
+
+    Timer  _t;
+    size_t _host, _device;
+};
+
+// -----------------------------------------------------------------------------
+
+/// Load the predefined operator 'i' into 'h_operators_values/grads[i]'
+static void load_predefined(int i, bool use_cache)
+{
+    assert( h_operators_values.size() == (unsigned)NB_PRED_OPS );
+    assert( h_operators_values[i] == 0 );
+    // Initializers append the new grids: move them to their slot
+    h_operators_init[i](use_cache);
+    std::swap(h_operators_values[i], h_operators_values.back());
+    std::swap(h_operators_grads [i], h_operators_grads .back());
+    h_operators_values.pop_back();
+    h_operators_grads. pop_back();
+}
+
+// -----------------------------------------------------------------------------
+
+static bool is_bulge_operator(int i)
+{
+    const Op_t op_t = (Op_t)(i + BINARY_3D_OPERATOR_BEGIN + 1);
+    return op_t == B_OH || op_t == B_HCH || op_t == B_TCH || op_t == B_D;
+}
+
+// -----------------------------------------------------------------------------
+
+static float bulge_slice_mag(int k)
+{
+    return MAX_MAG_3D_BULGE * (float)k / (float)(NB_SAMPLES_MAG_3D_BULGE - 1);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Generate (or read from the cache) the magnitude slices of the bulge
+/// operator 'i' if not already done
+static void load_bulge_slices(int i)
+{
+    if( h_bulge_slices_vals[i].size() > 0 )
+        return;
+
+    Timer t;
+    t.start();
+    for(int k = 0; k < NB_SAMPLES_MAG_3D_BULGE; ++k)
+    {
+        const float mag = bulge_slice_mag(k);
+        IBL::Profile_polar::Discreet bulge_curve;
+        IBL::gen_polar_profile(bulge_curve, NB_SAMPLES, IBL::Profile::Bulge(mag));
+
+        std::ostringstream suffix;
+        suffix << "_mag" << (int)(mag * 1000.f + 0.5f);
+        init_bulge_operator((Op_t)(i + BINARY_3D_OPERATOR_BEGIN + 1), bulge_curve, suffix.str(), true);
+
+        // Initializers append the new grids: move them to the slices
+        h_bulge_slices_vals [i].push_back( h_operators_values.back() );
+        h_bulge_slices_grads[i].push_back( h_operators_grads .back() );
+        h_operators_values.pop_back();
+        h_operators_grads. pop_back();
+
+        delete[] bulge_curve.get_vals();
+        delete[] bulge_curve.get_grads();
     }
-    if ( h_operators_enabling[10] ) {
-        init_bulge_hyperbola_closed_t(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
+    std::cout << "Blending_env: magnitudes of bulge operator " << i;
+    std::cout << " loaded in " << t.stop() << " sec" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Interpolate the tables 'a' and 'b' and quantize the result again with
+/// h_table_bits. The error is kept against the float tables 'a' and 'b' were
+/// generated from: the quantization error of the interpolation plus the
+/// interpolated errors of 'a' and 'b' (an upper bound)
+static Table3* lerp_tables(const Table3* a, const Table3* b, float t)
+{
+    assert( a->size == b->size && a->q.nb_channels() == b->q.nb_channels() );
+    const int nb_elt = a->q.nb_elt();
+    const int nb_c   = a->q.nb_channels();
+    std::vector<float> vals(nb_elt * nb_c);
+    for(int i = 0; i < nb_elt; ++i)
+        for(int c = 0; c < nb_c; ++c)
+        {
+            const float va = a->q.get(i, c);
+            vals[i*nb_c + c] = va + (b->q.get(i, c) - va) * t;
+        }
+
+    Table3* res = new Table3();
+    res->size    = a->size;
+    res->pad_off = a->pad_off;
+    res->q.quantize(&(vals[0]), nb_elt, nb_c, h_table_bits);
+    Table_error e = res->q.error();
+    e.max_abs += (1.f - t) * a->q.error().max_abs + t * b->q.error().max_abs;
+    e.rms     += (1.f - t) * a->q.error().rms     + t * b->q.error().rms;
+    res->q.set_error(e);
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Replace the tables of the bulge operator 'i' by the interpolation of its
+/// two closest magnitude slices around 'mag'
+static void lerp_bulge_operator(int i, float mag)
+{
+    load_bulge_slices(i);
+
+    float u = std::min(std::max(mag / MAX_MAG_3D_BULGE, 0.f), 1.f);
+    u *= (float)(NB_SAMPLES_MAG_3D_BULGE - 1);
+    const int   k = std::min((int)u, NB_SAMPLES_MAG_3D_BULGE - 2);
+    const float t = u - (float)k;
+
+    delete h_operators_values[i];
+    delete h_operators_grads [i];
+    h_operators_values[i] = lerp_tables(h_bulge_slices_vals [i][k], h_bulge_slices_vals [i][k+1], t);
+    h_operators_grads [i] = lerp_tables(h_bulge_slices_grads[i][k], h_bulge_slices_grads[i][k+1], t);
+}
+
+// -----------------------------------------------------------------------------
+
+void update_3D_bulge()
+{
+    unbind();
+    Timer t;
+    t.start();
+
+    // The 1D profile is cheap to compute exactly. It is not written to the
+    // cache which must stay coherent with the cached operators
+    IBL::Profile_polar::Discreet bulge_curve;
+    IBL::gen_polar_profile(bulge_curve, NB_SAMPLES, IBL::Profile::Bulge(h_magnitude_3D_bulge));
+    delete[] h_bulge_profile;
+    delete[] h_bulge_normals_profile;
+    h_bulge_profile         = bulge_curve.get_vals();
+    h_bulge_normals_profile = (float2*)bulge_curve.get_grads();
+    allocate_and_copy_1D_array(NB_SAMPLES, h_bulge_profile        , d_bulge_profile        );
+    allocate_and_copy_1D_array(NB_SAMPLES, h_bulge_normals_profile, d_bulge_profile_normals);
+
+    // Operators: interpolate and overwrite their block of the concatenation
+    bool upload = false;
+    for(int i = 0; i < (int)h_operators_values.size(); ++i)
+    {
+        if( !is_bulge_operator(i) || h_operators_values[i] == 0 )
+            continue;
+
+        lerp_bulge_operator(i, h_magnitude_3D_bulge);
+
+        const Op_id id = (int)h_operators_id.size() > i ? h_operators_id[i] : -1;
+        if( id < 0 || conc_operators_values.size() == 0 )
+            continue;
+
+        // Already quantized: copy the texels as they are
+        const Vec3i_cu corner(h_operators_corners[id*3 + 0],
+                              h_operators_corners[id*3 + 1],
+                              h_operators_corners[id*3 + 2]);
+        const Vec3i_cu origin = corner - h_operators_values[i]->pad_off;
+        set_table_block(conc_operators_values, conc_operators_size, origin, *h_operators_values[i]);
+        set_table_block(conc_operators_grads , conc_operators_size, origin, *h_operators_grads [i]);
+        set_operator_quant(id, *h_operators_values[i], *h_operators_grads[i]);
+        upload = true;
     }
-    if ( h_operators_enabling[11] ) {
-        init_bulge_skinning_closed_t(use_cache);
-    } else {
-        h_operators_values.push_back(0);
-        h_operators_grads.push_back(0);
+    h_bulge_slices_used = true;
+
+    if( upload )
+        upload_operators();
+
+    bind();
+    std::cout << "Blending_env: bulge magnitude updated in " << t.stop() << " sec" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+
+void load_3d_predefined(bool use_cache = true)
+{
+    h_operators_values.resize(NB_PRED_OPS, 0);
+    h_operators_grads. resize(NB_PRED_OPS, 0);
+    for(int i = 0; i < NB_PRED_OPS; i++)
+    {
+        if( !h_operators_enabling[i] || h_operators_values[i] != 0 )
+            continue;
+
+        Load_probe probe;
+        probe.start();
+        load_predefined(i, use_cache);
+        // Cached bulge operators ignore the magnitude set by update_3D_bulge()
+        if( h_bulge_slices_used && is_bulge_operator(i) )
+            lerp_bulge_operator(i, h_magnitude_3D_bulge);
+        probe.stop( h_operators_stats[i] );
     }
 }
 
 // -----------------------------------------------------------------------------
 
+/// Set the constants used by the fetch functions to address the tables
+static void upload_table_resolution()
+{
+    const float2 samples = make_float2((float)(h_table_res.samples_xy    - 1),
+                                       (float)(h_table_res.samples_alpha - 1));
+    const int2   layout  = make_int2(h_table_res.samples_4D, grid_4D_block_dim().x);
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(operators_samples, &samples, sizeof(float2)) );
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(tables_4D_layout , &layout , sizeof(int2  )) );
+}
+
+static void upload_table_bits()
+{
+    CUDA_SAFE_CALL( cudaMemcpyToSymbol(table_bits, &h_table_bits, sizeof(int)) );
+}
+
+// -----------------------------------------------------------------------------
+
 void init_env()
 {
     clean_env();
@@ -1514,6 +1902,8 @@ void init_env()
     Timer t;
     bool use_cache = true;
 
+    Load_probe probe;
+    probe.start();
 
     t.start();
     std::cout << "init profile samples skin (bulge in contact\n..." << std::endl;
@@ -1528,22 +1918,6 @@ void init_env()
     init_opening_hyperbola(use_cache);
     std::cout << "Done in " << t.stop() << " sec" << std::endl;
 
-    std::cout << "init 3D operators" << std::endl;
-    load_3d_predefined(use_cache);
-    std::cout << "Done in " << t.stop() << " sec" << std::endl;
-
-    // todo with new env archi
-    std::cout << "init 4D operators" << std::endl;
-    std::cout << "init 4D bulge" << std::endl;
-    t.start();
-    init_4D_bulge_in_contact(use_cache);
-    std::cout << "Done in " << t.stop() << " sec" << std::endl;
-    t.start();
-    std::cout << "init 4D ricci" << std::endl;
-    init_4D_ricci(use_cache);
-    std::cout << "Done in " << t.stop() << " sec" << std::endl;
-    std::cout << "end 4D operators" << std::endl;
-
     std::cout <<  "Allocate and init controller\n..." << std::endl;
     init_global_controller();
     std::cout <<  "Done" << std::endl;
@@ -1557,7 +1931,19 @@ void init_env()
 
     //init_nary_operators();
 
+    upload_table_resolution();
+    upload_table_bits();
+
     allocated = true;
+    probe.stop( h_families_stats[FAMILY_PROFILES] );
+    upload_families_loaded();
+
+    // Only operators enabled beforehand are loaded now, the 4D operators
+    // and the other 3D operators are loaded by require_xxx()
+    t.start();
+    std::cout << "init 3D operators" << std::endl;
+    load_3d_predefined(use_cache);
+    std::cout << "Done in " << t.stop() << " sec" << std::endl;
 
     // upload 3D operators to gpu
     t.start();
@@ -1568,6 +1954,189 @@ void init_env()
 
 // -----------------------------------------------------------------------------
 
+void require_predefined_operator( Op_t op_t )
+{
+    const int i = op_t - BINARY_3D_OPERATOR_BEGIN - 1;
+    assert( i >= 0 && i < NB_PRED_OPS );
+    assert( allocated );
+    if( is_predefined_loaded(op_t) )
+        return;
+
+    Load_probe probe;
+    probe.start();
+
+    h_operators_enabling[i] = true;
+    load_3d_predefined();
+    update_operators();
+
+    probe.stop( h_operators_stats[i] );
+    std::cout << "Blending_env: predefined operator " << i << " loaded in ";
+    std::cout << h_operators_stats[i].secs << " sec" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+
+void require_family( Family_t f )
+{
+    assert( f >= 0 && f < NB_FAMILIES );
+    assert( allocated );
+    if( h_families_stats[f].loaded )
+        return;
+
+    Load_probe probe;
+    probe.start();
+
+    unbind();
+    switch(f){
+    case FAMILY_4D_BULGE: init_4D_bulge_in_contact(true); break;
+    case FAMILY_4D_RICCI: init_4D_ricci(true);            break;
+    default: break; // FAMILY_PROFILES: loaded by init_env()
+    }
+    bind();
+
+    probe.stop( h_families_stats[f] );
+    upload_families_loaded();
+    std::cout << "Blending_env: family " << f << " loaded in ";
+    std::cout << h_families_stats[f].secs << " sec" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+
+Table_resolution get_table_resolution()
+{
+    return h_table_res;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Generate again (or read from the cache) every loaded 3D operator and the
+/// 4D tables after their storage changed
+static void reload_tables(bool use_cache, bool ricci)
+{
+    // 3D operators: every loaded one is generated again
+    for(unsigned i = 0; i < h_operators_values.size(); ++i)
+    {
+        delete h_operators_values[i];
+        delete h_operators_grads [i];
+        h_operators_values[i] = 0;
+        h_operators_grads [i] = 0;
+    }
+    free_bulge_slices();
+    load_3d_predefined(use_cache);
+    update_operators();
+
+    // 4D operators
+    unbind();
+    const bool bulge_4D = h_families_stats[FAMILY_4D_BULGE].loaded;
+    const bool ricci_4D = ricci && h_families_stats[FAMILY_4D_RICCI].loaded;
+    Load_probe probe;
+    if( bulge_4D ){
+        probe.start();
+        init_4D_bulge_in_contact(use_cache);
+        probe.stop( h_families_stats[FAMILY_4D_BULGE] );
+    }
+    if( ricci_4D ){
+        probe.start();
+        init_4D_ricci(use_cache);
+        probe.stop( h_families_stats[FAMILY_4D_RICCI] );
+    }
+    upload_table_resolution();
+    upload_table_bits();
+    bind();
+}
+
+// -----------------------------------------------------------------------------
+
+bool set_table_resolution(const Table_resolution& res, bool use_cache)
+{
+    assert( res.samples_xy > 1 && res.samples_alpha > 1 && res.samples_4D > 1 );
+    for(unsigned i = 0; i < h_custom_op_vals.size(); ++i)
+        if( h_custom_op_vals[i] != 0 )
+            return false;
+
+    h_table_res = res;
+    if( !allocated )
+        return true;
+
+    reload_tables(use_cache, true);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int get_table_bits()
+{
+    return h_table_bits;
+}
+
+// -----------------------------------------------------------------------------
+
+bool set_table_bits(int bits, bool use_cache)
+{
+    if( bits != 32 && bits != 16 && bits != 8 )
+        return false;
+    for(unsigned i = 0; i < h_custom_op_vals.size(); ++i)
+        if( h_custom_op_vals[i] != 0 )
+            return false;
+
+    if( bits == h_table_bits )
+        return true;
+
+    h_table_bits = bits;
+    if( !allocated )
+        return true;
+
+    // The 4D ricci is always stored with floats
+    reload_tables(use_cache, false);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool is_family_loaded( Family_t f )
+{
+    assert( f >= 0 && f < NB_FAMILIES );
+    return h_families_stats[f].loaded;
+}
+
+// -----------------------------------------------------------------------------
+
+bool is_predefined_loaded( Op_t op_t )
+{
+    const int i = op_t - BINARY_3D_OPERATOR_BEGIN - 1;
+    assert( i >= 0 && i < NB_PRED_OPS );
+    return h_operators_enabling[i] &&
+           (int)h_operators_values.size() > i && h_operators_values[i] != 0;
+}
+
+// -----------------------------------------------------------------------------
+
+static void print_load_stats(const char* name, int id, const Load_stats& s)
+{
+    if( !s.loaded ){
+        printf("%-16s %2d | not loaded\n", name, id);
+        return;
+    }
+    printf("%-16s %2d | %8.3f sec | host %+9.3f MB | device %+9.3f MB\n",
+           name, id, s.secs,
+           (double)s.host_bytes   / (1024. * 1024.),
+           (double)s.device_bytes / (1024. * 1024.));
+}
+
+void load_report()
+{
+    static const char* families[NB_FAMILIES] = { "profiles", "4D bulge", "4D ricci" };
+    printf("Blending_env loaded tables:\n");
+    for(int i = 0; i < NB_FAMILIES; i++)
+        print_load_stats(families[i], i, h_families_stats[i]);
+    for(int i = 0; i < NB_PRED_OPS; i++)
+        print_load_stats("predefined op", i, h_operators_stats[i]);
+}
+
+// -----------------------------------------------------------------------------
+
 static Vec3i_cu get_max_tex3D_lengths()
 {
     int mx = -1;
@@ -1587,8 +2156,8 @@ static Vec3i_cu get_max_tex3D_lengths()
 
 // -----------------------------------------------------------------------------
 
-static void get_enabled_operators(std::vector<Grid3_cu<float>* >& ops_vals,
-                                  std::vector<Grid3_cu<float2>*>& ops_grads)
+static void get_enabled_operators(std::vector<Table3*>& ops_vals,
+                                  std::vector<Table3*>& ops_grads)
 {
     ops_vals. clear();
     ops_grads.clear();
@@ -1624,6 +2193,7 @@ static void update_map_operators_type_to_id()
 
     d_operators_id.malloc( pred_id.size() );
     d_operators_id.copy_from( pred_id );
+    h_operators_id = pred_id;
 }
 
 // -----------------------------------------------------------------------------
@@ -1652,49 +2222,54 @@ void update_operators()
 
     Vec3i_cu len_max = get_max_tex3D_lengths();
 
-    std::vector< Grid3_cu<float>*  > all_op_vals;
-    std::vector< Grid3_cu<float2>* > all_op_grads;
+    std::vector<Table3*> all_op_vals;
+    std::vector<Table3*> all_op_grads;
     get_enabled_operators(all_op_vals, all_op_grads);
 
-    // erase concatenated grids
-    delete grid_operators_values; grid_operators_values = 0;
-    delete grid_operators_grads;  grid_operators_grads  = 0;
+    // erase concatenated tables
+    conc_operators_values.clear();
+    conc_operators_grads. clear();
+    conc_operators_size = Vec3i_cu(0, 0, 0);
+    h_operators_quant.clear();
     // Erase associated offsets
     h_operators_idx_offsets.clear();
+    h_operators_corners.clear();
+    h_operators_id.clear();
 
     if( all_op_vals.size() == 0 )
     {
         Cuda_utils::free_d(d_operators_values);
         Cuda_utils::free_d(d_operators_grads);
         d_operators_idx_offsets.erase();
+        d_operators_quant.erase();
         d_operators_id.erase();
         return;
     }
 
     std::vector<Idx3_cu> dummy_idx;
+    Vec3i_cu dummy_size;
 
-    // concatenate custom & predefined grid vectors
-    grid_operators_values = new Grid3_cu<float >( all_op_vals , len_max, h_operators_idx_offsets );
-    grid_operators_grads  = new Grid3_cu<float2>( all_op_grads, len_max, dummy_idx );
+    // concatenate custom & predefined tables as they are stored
+    concat_tables(all_op_vals , len_max, conc_operators_size, conc_operators_values, h_operators_idx_offsets);
+    concat_tables(all_op_grads, len_max, dummy_size         , conc_operators_grads , dummy_idx);
 
     std::cout << "Grid operators size: ";
-    grid_operators_values->size().print();
+    conc_operators_size.print();
     assert( Std_utils::equal(dummy_idx, h_operators_idx_offsets) );
 
-    // Upload to GPU
-    allocate_and_copy_3D_array(grid_operators_values, d_operators_values);
-    allocate_and_copy_3D_array(grid_operators_grads , d_operators_grads );
-
     // TODO: to be deleted seems wrong
 //    int nb_predefined = get_nb_predefined_enabled();
 
     int4 default_idx = make_int4(0, 0, 0, 0);
     std::vector<int4> indices( h_operators_values.size() + h_custom_op_vals.size(), default_idx );
 
+    h_operators_quant.assign( indices.size() * 2, make_float4(1.f, 0.f, 1.f, 0.f) );
+
     unsigned int i; int j=0;
     for(i = 0; i < h_operators_values.size(); ++i)
         if (h_operators_enabling[i]){
             indices[j] = h_operators_idx_offsets[j].to_int4();
+            set_operator_quant(j, *h_operators_values[i], *h_operators_grads[i]);
             ++j;
         }
 
@@ -1702,9 +2277,22 @@ void update_operators()
     for(unsigned i = 0; i < h_custom_op_vals.size(); ++i)
         if (h_custom_op_vals[i]){
             indices[k+i] = h_operators_idx_offsets[j].to_int4();
+            set_operator_quant(k+i, *h_custom_op_vals[i], *h_custom_op_grads[i]);
             ++j;
         }
 
+    // Upload to GPU
+    upload_operators();
+
+
+    h_operators_corners.resize( indices.size() * 3 );
+    for(unsigned i = 0; i < indices.size(); ++i)
+    {
+        const int4 idx = indices[i];
+        Idx3_cu(Vec3i_cu(idx.x, idx.y, idx.z), idx.w).to_3d(h_operators_corners[i*3 + 0],
+                                                            h_operators_corners[i*3 + 1],
+                                                            h_operators_corners[i*3 + 2]);
+    }
 
     // upload idx
     d_operators_idx_offsets.malloc( indices.size() );
@@ -1720,12 +2308,13 @@ void clean_env()
 {
     unbind();
 
+    // loading stats -----------------
+    for(int i = 0; i < NB_FAMILIES; i++) h_families_stats [i] = Load_stats();
+    for(int i = 0; i < NB_PRED_OPS; i++) h_operators_stats[i] = Load_stats();
+
     // free controllers -----------------
-    for(unsigned i = 0; i < list_controllers.size(); i++)
-        delete[] list_controllers[i];
-    h_controllers.erase();
+    h_ctrl_coeffs.clear();
     h_ctrl_active.clear();
-    list_controllers.clear();
     nb_instances = 0;
 
     // free profiles -----------------
@@ -1755,18 +2344,32 @@ void clean_env()
     h_custom_op_vals.clear();
     h_custom_op_grads.clear();
 
+    free_bulge_slices();
+    h_bulge_slices_used = false;
+
     h_operators_idx_offsets.clear();
-    delete grid_operators_values;
-    delete grid_operators_grads;
-    grid_operators_values = 0;
-    grid_operators_grads = 0;
+    conc_operators_values.clear();
+    conc_operators_grads.clear();
+    conc_operators_size = Vec3i_cu(0, 0, 0);
+    h_operators_quant.clear();
+    h_operators_corners.clear();
+    h_operators_id.clear();
     d_operators_idx_offsets.erase();
+    d_operators_quant.erase();
     d_operators_id.erase();
 
+    // free 4D bulge host copies -----------------
+    h_block_3D_bulge          = Quantized_table();
+    h_block_3D_bulge_gradient = Quantized_table();
+    h_bulge_4D_profiles.erase();
+    h_bulge_4D_profiles_normals.erase();
+    h_bulge_4D_corners.clear();
+    h_block_3D_bulge_size = make_int3(0, 0, 0);
+
     // free gpu memory -----------------
     if(allocated){
         // controllers
-        Cuda_utils::free_d(d_controllers);
+        d_ctrl_coeffs.erase();
         Cuda_utils::free_d(d_global_controller);
         // profiles
         Cuda_utils::free_d(d_hyperbola_profile);
@@ -1786,8 +2389,10 @@ void clean_env()
         // binary 4D operators
         Cuda_utils::free_d(d_magnitude_3D_bulge);
         Cuda_utils::free_d(d_n_3D_ricci);
-        d_block_3D_bulge.erase();
-        d_block_3D_bulge_gradient.erase();
+        Cuda_utils::free_d(d_block_3D_bulge);
+        Cuda_utils::free_d(d_block_3D_bulge_gradient);
+        d_block_3D_bulge = 0;
+        d_block_3D_bulge_gradient = 0;
         d_block_3D_ricci.erase();
         d_block_3D_ricci_gradient.erase();
         allocated = false;
@@ -1796,27 +2401,182 @@ void clean_env()
 
 // -----------------------------------------------------------------------------
 
+static void add_table_to_report(Memory_report& rep, const char* name, const Table3* t)
+{
+    if(t != 0)
+        rep.add("Blending_env", name, t->q.bytes(), Memory_report::HOST);
+}
+
+void memory_report(Memory_report& rep)
+{
+    const char* sub = "Blending_env";
+    // controllers
+    add_to_report(rep, sub, "d_ctrl_coeffs", d_ctrl_coeffs);
+    rep.add(sub, "d_global_controller", cuda_array_size(d_global_controller));
+    rep.add(sub, "h_ctrl_coeffs", h_ctrl_coeffs.size() * sizeof(IBL::Ctrl_coeffs), Memory_report::HOST);
+    // profiles and openings
+    rep.add(sub, "d_hyperbola_profile"        , cuda_array_size(d_hyperbola_profile        ));
+    rep.add(sub, "d_hyperbola_normals_profile", cuda_array_size(d_hyperbola_normals_profile));
+    rep.add(sub, "d_bulge_profile"            , cuda_array_size(d_bulge_profile            ));
+    rep.add(sub, "d_bulge_profile_normals"    , cuda_array_size(d_bulge_profile_normals    ));
+    rep.add(sub, "d_bulge_4D_profiles"        , cuda_array_size(d_bulge_4D_profiles        ));
+    rep.add(sub, "d_bulge_4D_profiles_normals", cuda_array_size(d_bulge_4D_profiles_normals));
+    rep.add(sub, "d_ricci_4D_profiles"        , cuda_array_size(d_ricci_4D_profiles        ));
+    rep.add(sub, "d_ricci_4D_profiles_normals", cuda_array_size(d_ricci_4D_profiles_normals));
+    rep.add(sub, "d_pan_hyperbola"            , cuda_array_size(d_pan_hyperbola            ));
+    // binary 3D operators
+    rep.add(sub, "d_operators_values", cuda_array_size(d_operators_values));
+    rep.add(sub, "d_operators_grads" , cuda_array_size(d_operators_grads ));
+    add_to_report(rep, sub, "d_operators_idx_offsets", d_operators_idx_offsets);
+    add_to_report(rep, sub, "d_operators_quant"      , d_operators_quant      );
+    add_to_report(rep, sub, "d_operators_id"         , d_operators_id         );
+    rep.add(sub, "conc_operators_values", conc_operators_values.size(), Memory_report::HOST);
+    rep.add(sub, "conc_operators_grads" , conc_operators_grads .size(), Memory_report::HOST);
+    for(unsigned i = 0; i < h_operators_values.size(); ++i) {
+        add_table_to_report(rep, "h_operators_values", h_operators_values[i]);
+        add_table_to_report(rep, "h_operators_grads" , h_operators_grads [i]);
+    }
+    for(unsigned i = 0; i < h_custom_op_vals.size(); ++i) {
+        add_table_to_report(rep, "h_custom_op_vals" , h_custom_op_vals [i]);
+        add_table_to_report(rep, "h_custom_op_grads", h_custom_op_grads[i]);
+    }
+    for(int i = 0; i < NB_PRED_OPS; ++i) {
+        for(unsigned k = 0; k < h_bulge_slices_vals[i].size(); ++k) {
+            add_table_to_report(rep, "h_bulge_slices_vals" , h_bulge_slices_vals [i][k]);
+            add_table_to_report(rep, "h_bulge_slices_grads", h_bulge_slices_grads[i][k]);
+        }
+    }
+    // binary 4D operators
+    rep.add(sub, "d_block_3D_bulge"         , cuda_array_size(d_block_3D_bulge         ));
+    rep.add(sub, "d_block_3D_bulge_gradient", cuda_array_size(d_block_3D_bulge_gradient));
+    rep.add(sub, "h_block_3D_bulge"         , h_block_3D_bulge         .bytes(), Memory_report::HOST);
+    rep.add(sub, "h_block_3D_bulge_gradient", h_block_3D_bulge_gradient.bytes(), Memory_report::HOST);
+    add_to_report(rep, sub, "d_block_3D_ricci"         , d_block_3D_ricci         );
+    add_to_report(rep, sub, "d_block_3D_ricci_gradient", d_block_3D_ricci_gradient);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Float tables print the error they would have at 16 and 8 bits, reduced
+/// tables the error measured against their float source when quantized
+static void print_table_error(const char* name, const Quantized_table& q)
+{
+    printf("%-28s", name);
+    if(q.bits() < 32)
+    {
+        const Table_error e = q.error();
+        printf(" | %2d bits max %9.3e rms %9.3e\n", q.bits(), e.max_abs, e.rms);
+        return;
+    }
+
+    const int bits[2] = {16, 8};
+    const float* vals = (const float*)&(q.data()[0]);
+    for(int i = 0; i < 2; i++){
+        Quantized_table r;
+        r.quantize(vals, q.nb_elt(), q.nb_channels(), bits[i]);
+        const Table_error e = r.error();
+        printf(" | %2d bits max %9.3e rms %9.3e", bits[i], e.max_abs, e.rms);
+    }
+    printf("\n");
+}
+
+static void print_op_error(const char* kind, int id,
+                           const Table3* vals,
+                           const Table3* grads)
+{
+    if(vals == 0) return;
+    char name[64];
+    sprintf(name, "%s %d vals", kind, id);
+    print_table_error(name, vals->q);
+    sprintf(name, "%s %d grads", kind, id);
+    print_table_error(name, grads->q);
+}
+
+void tables_error_report()
+{
+    printf("Blending tables error against float storage (stored with %d bits):\n", h_table_bits);
+    for(unsigned i = 0; i < h_operators_values.size(); ++i)
+        print_op_error("predefined op", i, h_operators_values[i], h_operators_grads[i]);
+
+    for(unsigned i = 0; i < h_custom_op_vals.size(); ++i)
+        print_op_error("custom op", i + NB_PRED_OPS, h_custom_op_vals[i], h_custom_op_grads[i]);
+
+    if( h_block_3D_bulge.nb_elt() > 0 )
+    {
+        print_table_error("4D bulge vals" , h_block_3D_bulge         );
+        print_table_error("4D bulge grads", h_block_3D_bulge_gradient);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void get_host_tables(Host_tables& tabs)
+{
+    tabs.ctrl    = h_ctrl_coeffs.size() > 0 ? &(h_ctrl_coeffs[0]) : 0;
+    tabs.nb_ctrl = (int)h_ctrl_coeffs.size();
+
+    tabs.table_bits = h_table_bits;
+
+    const bool ops = conc_operators_values.size() > 0;
+    tabs.op_vals     = ops ? (const void*)&(conc_operators_values[0]) : 0;
+    tabs.op_grads    = ops ? (const void*)&(conc_operators_grads [0]) : 0;
+    tabs.op_quant    = ops ? (const float*)&(h_operators_quant[0]) : 0;
+    tabs.op_size[0]  = conc_operators_size.x;
+    tabs.op_size[1]  = conc_operators_size.y;
+    tabs.op_size[2]  = conc_operators_size.z;
+    tabs.nb_ops      = (int)h_operators_corners.size() / 3;
+    tabs.op_corners  = h_operators_corners.size() > 0 ? &(h_operators_corners[0]) : 0;
+    tabs.nb_pred_ops = (int)h_operators_id.size();
+    tabs.pred_op_ids = h_operators_id.size() > 0 ? &(h_operators_id[0]) : 0;
+    tabs.op_samples_xy    = h_table_res.samples_xy;
+    tabs.op_samples_alpha = h_table_res.samples_alpha;
+
+    const bool bulge = h_block_3D_bulge.nb_elt() > 0;
+    tabs.bulge_4D_vals    = bulge ? (const void*)&(h_block_3D_bulge.data()[0]) : 0;
+    tabs.bulge_4D_grads   = bulge ? (const void*)&(h_block_3D_bulge_gradient.data()[0]) : 0;
+    for(int c = 0; c < 3; ++c)
+    {
+        const Quantized_table& q = c == 0 ? h_block_3D_bulge : h_block_3D_bulge_gradient;
+        const int ch = c == 0 ? 0 : c - 1;
+        tabs.bulge_4D_quant[c*2 + 0] = bulge ? q.scale (ch) : 1.f;
+        tabs.bulge_4D_quant[c*2 + 1] = bulge ? q.offset(ch) : 0.f;
+    }
+    tabs.bulge_4D_size[0] = h_block_3D_bulge_size.x;
+    tabs.bulge_4D_size[1] = h_block_3D_bulge_size.y;
+    tabs.bulge_4D_size[2] = h_block_3D_bulge_size.z;
+    tabs.bulge_4D_corners = bulge ? &(h_bulge_4D_corners[0]) : 0;
+    tabs.bulge_4D_samples = h_table_res.samples_4D;
+    tabs.bulge_4D_nb_mag  = bulge ? NB_SAMPLES_MAG_4D_BULGE : 0;
+    tabs.bulge_4D_profiles         = bulge ? h_bulge_4D_profiles.ptr() : 0;
+    tabs.bulge_4D_profiles_normals = bulge ? (const float*)h_bulge_4D_profiles_normals.ptr() : 0;
+    tabs.profile_samples  = NB_SAMPLES;
+}
+
+// -----------------------------------------------------------------------------
+
 Op_id new_op_instance(const IBL::Profile_polar::Base& profile,
                       const IBL::Opening::Base& opening)
 {
     float*       h_vals  = 0;
     IBL::float2* h_grads = 0;
     // Operator is not cached => compute it
+    const int nxy = h_table_res.samples_xy;
+    const int na  = h_table_res.samples_alpha;
     IBL::gen_custom_operator(profile, opening, 2.f,
-                             NB_SAMPLES_OCU, NB_SAMPLES_ALPHA ,
+                             nxy, na,
                              h_vals, h_grads);
 
     // store the operator into new grids
-    Vec3i_cu size(NB_SAMPLES_OCU, NB_SAMPLES_OCU, NB_SAMPLES_ALPHA);
-    Grid3_cu<float >* grid_vals  = new Grid3_cu<float >(size, h_vals          );
-    Grid3_cu<float2>* grid_grads = new Grid3_cu<float2>(size, (float2*)h_grads);
+    Vec3i_cu size(nxy, nxy, na);
+    Grid3_cu<float > grid_vals (size, h_vals          );
+    Grid3_cu<float2> grid_grads(size, (float2*)h_grads);
 
     // padd operator grids as concatenation won't
-    grid_vals-> padd( Vec3i_cu(PADDING, PADDING, PADDING) );
-    grid_grads->padd( Vec3i_cu(PADDING, PADDING, PADDING) );
-    // record new operator grids
-    h_custom_op_vals.push_back( grid_vals );
-    h_custom_op_grads.push_back( grid_grads );
+    grid_vals. padd( Vec3i_cu(PADDING, PADDING, PADDING) );
+    grid_grads.padd( Vec3i_cu(PADDING, PADDING, PADDING) );
+    // record new operator tables
+    h_custom_op_vals.push_back( new_table(grid_vals ) );
+    h_custom_op_grads.push_back( new_table(grid_grads) );
     // clean function
     delete[] h_vals;
     delete[] h_grads;
@@ -1829,28 +2589,19 @@ Op_id new_op_instance(const IBL::Profile_polar::Base& profile,
 
 Op_id new_op_instance(const std::string &filename)
 {
-    float*       h_vals  = 0;
-    IBL::float2* h_grads = 0;
-    int len = (NB_SAMPLES_OCU+2)*(NB_SAMPLES_OCU+2)*(NB_SAMPLES_ALPHA+2);
+    const int nxy = h_table_res.samples_xy;
+    const int na  = h_table_res.samples_alpha;
 
-    h_vals  = new float      [len];
-    h_grads = new IBL::float2[len];
-    bool s = read_array(h_vals , len, get_cache_dir()+"/"+filename+"_vals.opc"  );
-    s = s && read_array(h_grads, len, get_cache_dir()+"/"+filename+"_grads.opc" );
+    // already padded and quantized
+    Vec3i_cu size(nxy+2, nxy+2, na+2);
+    Table3* t_vals  = read_op_table(size, 1, get_cache_dir()+"/"+filename+"_vals"  );
+    Table3* t_grads = read_op_table(size, 2, get_cache_dir()+"/"+filename+"_grads" );
 
-    if (!s)  assert( false );
-
-    // store the operator into new grids
-    Vec3i_cu size(NB_SAMPLES_OCU+2, NB_SAMPLES_OCU+2, NB_SAMPLES_ALPHA+2);
-    Grid3_cu<float >* grid_vals  = new Grid3_cu<float >(size, h_vals          , PADDING_OFFSET);
-    Grid3_cu<float2>* grid_grads = new Grid3_cu<float2>(size, (float2*)h_grads, PADDING_OFFSET);
+    if (t_vals == 0 || t_grads == 0)  assert( false );
 
-    // record new operator grids
-    h_custom_op_vals.push_back( grid_vals );
-    h_custom_op_grads.push_back( grid_grads );
-    // clean function
-    delete[] h_vals;
-    delete[] h_grads;
+    // record new operator tables
+    h_custom_op_vals.push_back( t_vals );
+    h_custom_op_grads.push_back( t_grads );
     // return new op id
     updated = false;
     return h_custom_op_vals.size()-1 + NB_PRED_OPS;
@@ -1878,15 +2629,14 @@ void delete_op_instante(Op_id op_id)
 
 void make_cache(Op_id op_id, const std::string &filename)
 {
-    const std::vector<float>&  h_vals  = h_custom_op_vals [op_id - NB_PRED_OPS]->get_vals();
-    const std::vector<float2>& h_grads = h_custom_op_grads[op_id - NB_PRED_OPS]->get_vals();
+    const Table3* t_vals  = h_custom_op_vals [op_id - NB_PRED_OPS];
+    const Table3* t_grads = h_custom_op_grads[op_id - NB_PRED_OPS];
 
-    int len = h_custom_op_vals[op_id - NB_PRED_OPS]->size().product();
-    assert( h_custom_op_grads[op_id - NB_PRED_OPS]->size().product() == len);
+    assert( t_vals->size == t_grads->size );
     if(filename.size() > 0)
     {
-        write_array(&(h_vals [0]), len, get_cache_dir()+"/"+filename+"_vals.opc"  );
-        write_array(&(h_grads[0]), len, get_cache_dir()+"/"+filename+"_grads.opc" );
+        write_table(t_vals ->q, get_cache_dir()+"/"+filename+"_vals"  );
+        write_table(t_grads->q, get_cache_dir()+"/"+filename+"_grads" );
     }
 }
 
@@ -1917,18 +2667,15 @@ Op_id get_predefined_op_id(Op_t op_t)
 //#define SAVE_CUSTOM => Usefull ???? => when load : return list of custom ops Op_ids
 void make_cache_env(const std::string &filename)
 {
-    if(filename.size() == 0)
+    if(filename.size() == 0 || conc_operators_values.size() == 0)
         return;
 
     std::string base_name = get_cache_dir()+"/"+filename;
 
-    // save concatenation
-    const std::vector<float>&   conc_vals  = grid_operators_values->get_vals();
-    const std::vector<float2>&  conc_grads = grid_operators_grads ->get_vals();
-    int conc_len = grid_operators_values->size().product();
-
-    write_array(&(conc_vals [0]), conc_len, base_name+"_conc_vals.opc"  );
-    write_array(&(conc_grads[0]), conc_len, base_name+"_conc_grads.opc" );
+    // save concatenation as it is stored (raw texels and decoding constants)
+    write_array(&(conc_operators_values[0]), (int)conc_operators_values.size(), table_cache_path(base_name+"_conc_vals" ));
+    write_array(&(conc_operators_grads [0]), (int)conc_operators_grads .size(), table_cache_path(base_name+"_conc_grads"));
+    write_array(&(h_operators_quant[0]), (int)h_operators_quant.size(), base_name+"_quant.opc");
 
     // save predefined => done through enabling
     // => cf load predifined comment in init_env_fom_cache method
@@ -1945,8 +2692,10 @@ void make_cache_env(const std::string &filename)
         return;
     }
 
-    Vec3i_cu s = grid_operators_values->size();
+    Vec3i_cu s = conc_operators_size;
     file << s.x << " " << s.y << " " << s.z << " " << enab_len << " " << idx_len;
+    file << " " << h_table_res.samples_xy << " " << h_table_res.samples_alpha;
+    file << " " << h_table_bits << " " << h_operators_quant.size();
     file.close();
 }
 
@@ -1960,6 +2709,8 @@ bool init_env_from_cache(const std::string &filename)
 
     bool use_cache = true;
 
+    Load_probe probe;
+    probe.start();
     init_profile_bulge(use_cache);
     init_profile_hyperbola(use_cache);
     init_opening_hyperbola(use_cache);
@@ -1973,7 +2724,29 @@ bool init_env_from_cache(const std::string &filename)
     }
     file >> conc_s_x  >> conc_s_y  >> conc_s_z  >>
             enab_len >> idx_len;
+    // Caches saved before the resolution was configurable are at the default
+    int res_xy, res_alpha;
+    if( !(file >> res_xy >> res_alpha) ){
+        res_xy    = NB_SAMPLES_OCU;
+        res_alpha = NB_SAMPLES_ALPHA;
+    }
+    // and before the storage was configurable with float tables
+    int bits, quant_len;
+    if( !(file >> bits >> quant_len) ){
+        bits      = 32;
+        quant_len = 0;
+    }
     file.close();
+    if(res_xy != h_table_res.samples_xy || res_alpha != h_table_res.samples_alpha){
+        std::cerr << "Cache resolution doesn't match: " << filename << std::endl;
+        clean_env();
+        return false;
+    }
+    if(bits != h_table_bits){
+        std::cerr << "Cache table bits doesn't match: " << filename << std::endl;
+        clean_env();
+        return false;
+    }
     Vec3i_cu conc_size(conc_s_x, conc_s_y, conc_s_z);
     // restore enabling
     if(enab_len != NB_PRED_OPS){
@@ -2000,29 +2773,31 @@ bool init_env_from_cache(const std::string &filename)
         clean_env();
         return false;
     }
-    // then concatenation
-    int conc_len = conc_size.product();
-    std::vector<float>  conc_vals ( conc_len );
-    std::vector<float2> conc_grads( conc_len );
-    if (!read_array( &(conc_vals[0]), conc_len, base_name+"_conc_vals.opc" )){
+    // then concatenation as it was stored
+    int conc_len = conc_size.product() * (h_table_bits / 8);
+    conc_operators_size = conc_size;
+    conc_operators_values.resize( conc_len     );
+    conc_operators_grads. resize( conc_len * 2 );
+    if (!read_array( &(conc_operators_values[0]), conc_len, table_cache_path(base_name+"_conc_vals") )){
         clean_env();
         return false;
     }
 
-    if (!read_array( &(conc_grads[0]), conc_len, base_name+"_conc_grads.opc" )){
+    if (!read_array( &(conc_operators_grads[0]), conc_len * 2, table_cache_path(base_name+"_conc_grads") )){
+        clean_env();
+        return false;
+    }
+    // with the decoding constants of each operator (identity for old caches)
+    h_operators_quant.assign( quant_len > 0 ? quant_len : idx_len * 2, make_float4(1.f, 0.f, 1.f, 0.f) );
+    if (quant_len > 0 && !read_array( &(h_operators_quant[0]), quant_len, base_name+"_quant.opc" ))
+    {
         clean_env();
         return false;
     }
-    delete grid_operators_values;
-    grid_operators_values = new Grid3_cu<float>( conc_size, &(conc_vals[0]) );
-    delete grid_operators_grads;
-    grid_operators_grads = new Grid3_cu<float2>( conc_size, &(conc_grads[0]) );
     // then predefined
     load_3d_predefined(); // quicker than conc pred when save and retrieve from conc_grids
 
-    // todo with new env archi
-    init_4D_bulge_in_contact(use_cache);
-    init_4D_ricci(use_cache);
+    // 4D operators are loaded on demand (require_family())
     init_global_controller();
 
     Cuda_utils::malloc_d(d_magnitude_3D_bulge, 1);
@@ -2033,10 +2808,14 @@ bool init_env_from_cache(const std::string &filename)
 
     init_nary_operators();
 
+    upload_table_resolution();
+    upload_table_bits();
+
     allocated = true;
+    probe.stop( h_families_stats[FAMILY_PROFILES] );
+    upload_families_loaded();
     // allocate on gpu without concatenate
-    allocate_and_copy_3D_array(grid_operators_values, d_operators_values);
-    allocate_and_copy_3D_array(grid_operators_grads, d_operators_grads);
+    upload_operators();
     // upload idx offsets
     std::vector< int4 > indices(h_operators_idx_offsets.size());
     for(unsigned i = 0; i < indices.size(); ++i)
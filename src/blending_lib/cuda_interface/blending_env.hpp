@@ -17,6 +17,7 @@
  */
 
 #include <cstdio>
+#include <cassert>
 #include "cuda_utils.hpp"
 #include "idx3_cu.hpp"
 
@@ -52,40 +53,35 @@ namespace Blending_env {
 
 // -------------------
 
-/// Number of samples in the xy plane of the 3D blending operators.
+/// Default number of samples in the xy plane of the 3D blending operators.
+/// (changed at runtime with set_table_resolution())
 #define NB_SAMPLES_OCU (128)
-/// Number of samples for the aperture of the 3D blending operators.
+/// Default number of samples for the aperture of the 3D blending operators.
 #define NB_SAMPLES_ALPHA (128)
 
 // -------------------
 
+/// Number of magnitudes at which the 3D operators with a bulge profile are
+/// precomputed so that update_3D_bulge() interpolates instead of regenerating
+#define NB_SAMPLES_MAG_3D_BULGE (5)
+/// Magnitude of the last precomputed 3D bulge, the first one is zero
+#define MAX_MAG_3D_BULGE (0.9f)
+
+// -------------------
+
 /// Number of samples for the strength of the 4D bulge in contact
 #define NB_SAMPLES_MAG_4D_BULGE (5)
-/// Number of samples for the x,y,alpha direction of the 4D bulge
+/// Default number of samples for the x,y,alpha direction of the 4D bulge
+/// and ricci (changed at runtime with set_table_resolution())
 #define NB_SAMPLES_4D_BULGE (64)
 
-/// Number of elements in a grid containing a 3D bulge plus padding
-#define GRIG_4D_BULGE_LX (NB_SAMPLES_4D_BULGE + 2/*padding*/)
-#define GRIG_4D_BULGE_LY (NB_SAMPLES_4D_BULGE + 2/*padding*/)
-#define GRIG_4D_BULGE_LZ (NB_SAMPLES_4D_BULGE + 2/*padding*/)
-
-/// Number storable grids in the (x, y, z) direction for a block
-/// (with padding)
-#define BLOCK_4D_BULGE_LX (MAX_TEX_LENGTH / (GRIG_4D_BULGE_LX))
-#define BLOCK_4D_BULGE_LY (MAX_TEX_LENGTH / (GRIG_4D_BULGE_LY))
-#define BLOCK_4D_BULGE_LZ (MAX_TEX_LENGTH / (GRIG_4D_BULGE_LZ))
-
 // -------------------
 
-#define SIZE_CONTROLLER (NB_SAMPLES + 2 /*padding*/)
-
-/// Size of the controller's grid with padding
-#define GRID_CTRL_LX (SIZE_CONTROLLER)
-#define GRID_CTRL_LY 3
+/// Default number of bits used to store the 3D operators and the 4D bulge
+/// tables (changed at runtime with set_table_bits())
+#define DEFAULT_TABLE_BITS (32)
 
-/// Number of storable controller's grids in the (x, y) direction
-#define BLOCK_CTRL_LX (MAX_2D_TEX_LENGTH_X / (GRID_CTRL_LX))
-#define BLOCK_CTRL_LY (MAX_2D_TEX_LENGTH_Y / (GRID_CTRL_LY))
+// -------------------
 
 // -----------------------------------------------------------------------------
 
@@ -103,16 +99,14 @@ extern float  h_n_3D_ricci;
 extern float* d_magnitude_3D_bulge;
 extern float  h_magnitude_3D_bulge;
 
-extern Cuda_utils::Device::CuArray<float>  d_block_3D_bulge;
-extern Cuda_utils::Device::CuArray<float2>  d_block_3D_bulge_gradient;
+extern cudaArray* d_block_3D_bulge;
+extern cudaArray* d_block_3D_bulge_gradient;
 
 extern Cuda_utils::Device::CuArray<float>  d_block_3D_ricci;
 extern Cuda_utils::Device::CuArray<float2>  d_block_3D_ricci_gradient;
 
-/// 2D array which actually stores a 1D function -> the controller
-/// @note we use 2D instead of a 1D array because 1D array are limited to 655356
-/// elements.
-extern cudaArray* d_controllers;
+/// Coefficients of the controller instances (IBL::Ctrl_coeffs as four float4)
+extern Cuda_utils::Device::Array<float4> d_ctrl_coeffs;
 
 extern cudaArray* d_hyperbola_profile;
 extern cudaArray* d_hyperbola_normals_profile;
@@ -132,11 +126,48 @@ extern cudaArray* d_pan_hyperbola;
 
 // -----------------------------------------------------------------------------
 
-/// Compute the bulge in contact with the magnitude set by
-/// 'set_bulge_magnitude()'
-/// @warning it is very slow !
+/// Update the operators with a bulge profile (B_OH, B_HCH, B_TCH, B_D) to the
+/// magnitude set by 'set_bulge_magnitude()'.
+/// Loaded operators are linearly interpolated between two of their
+/// NB_SAMPLES_MAG_3D_BULGE precomputed magnitudes and only their part of the
+/// concatenated table is updated. The precomputed magnitudes are generated
+/// (or read from the cache) the first time only.
 void update_3D_bulge();
 
+// -----------------------------------------------------------------------------
+/// @name Resolution of the tables
+// -----------------------------------------------------------------------------
+
+Table_resolution get_table_resolution();
+
+/// Change the number of samples of the 3D and 4D operators tables.
+/// Loaded tables are generated again at the new resolution (or read from the
+/// cache of that resolution) and uploaded. Controllers, operators identifiers
+/// and the bulge magnitude are kept. Before init_env() only the resolution is
+/// set. Each resolution has its own cache files.
+/// @return false if custom operators are instanciated: they can't be
+/// resampled and the resolution is left unchanged.
+bool set_table_resolution(const Table_resolution& res, bool use_cache = true);
+
+// -----------------------------------------------------------------------------
+/// @name Precision of the tables
+// -----------------------------------------------------------------------------
+
+int get_table_bits();
+
+/// Change the number of bits used to store the 3D operators and the 4D bulge
+/// in host memory, in GPU memory and in the '.opc' cache:
+/// - 32 plain floats
+/// - 16 or 8 fixed point values with a scale and offset per table channel
+///   (see Quantized_table)
+/// A 128^3 operator (values and gradients) takes 24MB in float, 12MB at 16
+/// bits and 6MB at 8 bits. Like set_table_resolution() loaded tables are
+/// generated again (or read from the cache of that precision) and uploaded.
+/// @return false if 'bits' is not 32, 16 or 8 or if custom operators are
+/// instanciated, the precision is left unchanged.
+/// @see tables_error_report() to check the precision loss of each operator
+bool set_table_bits(int bits, bool use_cache = true);
+
 // -----------------------------------------------------------------------------
 /// @name Controllers instance management
 // -----------------------------------------------------------------------------
@@ -197,7 +228,8 @@ extern Cuda_utils::Device::Array<int4> d_operators_idx_offsets;
 extern Cuda_utils::Device::Array<Op_id> d_operators_id;
 
 /// Generates predefined profiles and openings, global controller,
-/// enabled predefined operators and activates custom operators
+/// enabled predefined operators and activates custom operators.
+/// Other operators are loaded on demand (see require_predefined_operator())
 void init_env();
 
 /// upload operators to gpu memory
@@ -206,6 +238,17 @@ void update_operators();
 /// clean all operators (enabled predefined and custom)
 void clean_env();
 
+/// Add the memory used by the operators, profiles and controllers tables
+/// to 'rep'
+void memory_report(Memory_report& rep);
+
+/// Print for every 3D operator in host memory and for the 4D bulge the
+/// maximum and rms error of their storage against the float tables.
+/// Float tables (set_table_bits(32)) print the error they would have at 16
+/// and 8 bits, reduced ones the error measured when they were quantized
+/// (saved in the cache with them).
+void tables_error_report();
+
 // -----------------------------------------------------------------------------
 /// @name Custom operators (User defined)
 // -----------------------------------------------------------------------------
@@ -242,7 +285,8 @@ void make_cache(Op_id op_id, const std::string &filename);
 // -----------------------------------------------------------------------------
 
 /// Enables or disables the specified predefined operator according to 'on'
-/// @warning Acts only when init_env() or reset_env() are called
+/// @warning Acts only when init_env() or reset_env() are called. Use
+/// require_predefined_operator() once the environment is initialized.
 void enable_predefined_operator( Op_t op_t, bool on );
 
 /// @return number of predefined operators enabled through
@@ -263,6 +307,34 @@ void make_cache_env(const std::string &filename);
 /// successfull, @see Blending_env is left cleaned.
 bool init_env_from_cache(const std::string &filename);
 
+// -----------------------------------------------------------------------------
+/// @name On demand loading
+/// init_env() only loads the 1D profiles, openings and the global controller
+/// along with the predefined operators enabled beforehand. Other tables are
+/// generated (or read from the cache) the first time they are required.
+// -----------------------------------------------------------------------------
+
+/// Enables the predefined operator and loads its tables if not already done.
+/// Operators are then concatenated and uploaded again (update_operators())
+/// @note a no-op when the operator is already loaded, so it is cheap to call
+/// every time a joint selects an operator.
+void require_predefined_operator( Op_t op_t );
+
+/// Loads the family 'f' if not already done (Family_t).
+/// Must be called before selecting an operator that reads its tables: the 4D
+/// fetches assert the family is loaded in debug builds.
+void require_family( Family_t f );
+
+/// @return true if the family 'f' is loaded
+bool is_family_loaded( Family_t f );
+
+/// @return true if the predefined operator is enabled and its tables loaded
+bool is_predefined_loaded( Op_t op_t );
+
+/// Print for each family and predefined operator whether it is loaded,
+/// the time spent loading it and the host/device memory it added
+void load_report();
+
 
 
 
@@ -295,8 +367,11 @@ bool init_env_from_cache(const std::string &filename);
 
     // 4D stuff ----------------------------------------------------------------
     extern texture<float, 1, cudaReadModeElementType>  magnitude_3D_bulge_tex;
-    extern texture<float, 3, cudaReadModeElementType>  openable_bulge_4D_tex;
+    extern texture<float , 3, cudaReadModeElementType> openable_bulge_4D_tex;
     extern texture<float2, 3, cudaReadModeElementType> openable_bulge_4D_gradient_tex;
+    /// Same tables stored with 16 or 8 bits (see set_table_bits())
+    extern texture<unsigned short, 3, cudaReadModeNormalizedFloat> openable_bulge_4D_unorm_tex;
+    extern texture<ushort2       , 3, cudaReadModeNormalizedFloat> openable_bulge_4D_gradient_unorm_tex;
 
     extern texture<float, 1, cudaReadModeElementType>  n_3D_ricci_tex;
     extern texture<float, 3, cudaReadModeElementType>  openable_ricci_4D_tex;
@@ -305,7 +380,7 @@ bool init_env_from_cache(const std::string &filename);
 
     extern texture<float2, 1, cudaReadModeElementType> global_controller_tex;
 
-    extern texture<float2, 2, cudaReadModeElementType> tex_controllers;
+    extern texture<float4, 1, cudaReadModeElementType> tex_ctrl_coeffs;
 
     /// bind textures to the arrays into the '.cu' this header is included in
     static inline void bind_local();
@@ -388,6 +463,8 @@ bool init_env_from_cache(const std::string &filename);
     __device__
     static float2 global_controller_fetch(float dot);
 
+    /// Controllers are evaluated analytically from their coefficients
+    /// (see IBL::Ctrl_coeffs)
     /// @param dot Is the angle between two gradient given by the dot product
     /// i.e cos(teta)
     __device__
@@ -401,10 +478,10 @@ bool init_env_from_cache(const std::string &filename);
     //      Idx3_cu idx = operator_idx_offset_fetch(op_id);
     //      // get operator's value when applied on f1 and f2 with an opening
     //      // value of tan_alpha
-    //      float f = operator_fetch(idx, f1, f2, tan_alpha);
+    //      float f = operator_fetch(op_id, idx, f1, f2, tan_alpha);
     //      // get operator's gradient when applied on f1 and f2 (whose
     //      // gradients are gf1 and gf2) with an opening value of tan_alpha
-    //      float2 dg = operator_grad_fetch(idx, f1, f2, tan_alpha);
+    //      float2 dg = operator_grad_fetch(op_id, idx, f1, f2, tan_alpha);
     //      Vec3_cu gf = dg*gf1 + dg*gf2;
     //
     // WARNING : keep 4d ops & profiles & openings & other env stuff
@@ -414,13 +491,45 @@ bool init_env_from_cache(const std::string &filename);
     extern texture<int   , 1, cudaReadModeElementType> tex_pred_operators_id;
     extern texture<float , 3, cudaReadModeElementType> tex_operators_values;
     extern texture<float2, 3, cudaReadModeElementType> tex_operators_grads;
+    /// Same tables stored with 16 or 8 bits (see set_table_bits())
+    extern texture<unsigned short, 3, cudaReadModeNormalizedFloat> tex_operators_values_unorm;
+    extern texture<ushort2       , 3, cudaReadModeNormalizedFloat> tex_operators_grads_unorm;
+
+    /// Decoding of each operator of the concatenation:
+    /// [op_id*2 + 0] values (scale, offset, 0, 0)
+    /// [op_id*2 + 1] gradients (scale_x, offset_x, scale_y, offset_y)
+    /// with value = texel * scale + offset (identity with 32 bits)
+    extern texture<float4, 1, cudaReadModeElementType> tex_operators_quant;
+
+    /// Decoding of the 4D bulge, same layout as 'tex_operators_quant'
+    /// @{
+    extern __constant__ float2 bulge_4D_vals_quant;
+    extern __constant__ float4 bulge_4D_grads_quant;
+    /// @}
+
+    /// Number of bits of the 3D operators and 4D bulge tables
+    /// (see set_table_bits()): 32 reads the float textures, 16 and 8 the
+    /// '_unorm' ones
+    extern __constant__ int table_bits;
+
+    /// Resolution of the tables (see set_table_resolution())
+    /// operators_samples: (samples_xy - 1, samples_alpha - 1)
+    /// tables_4D_layout: (samples_4D, number of grids per dimension of the
+    /// block) each grid being padded to 'samples_4D + 2'
+    /// @{
+    extern __constant__ float2 operators_samples;
+    extern __constant__ int2   tables_4D_layout;
+    /// @}
+
+    /// Bit 'Family_t' is set when the family is loaded (require_family())
+    extern __constant__ int families_loaded;
 
     __device__
     static Idx3_cu operator_idx_offset_fetch(Op_id op_id);
     __device__
-    static float operator_fetch(Idx3_cu tex_idx, float f1, float f2 ,float tan_alpha);
+    static float operator_fetch(Op_id op_id, Idx3_cu tex_idx, float f1, float f2 ,float tan_alpha);
     __device__
-    static float2 operator_grad_fetch(Idx3_cu tex_idx, float f1, float f2, float tan_alpha);
+    static float2 operator_grad_fetch(Op_id op_id, Idx3_cu tex_idx, float f1, float f2, float tan_alpha);
 
     /// @returns the identifier attached to the op_t predefined operator
     __device__
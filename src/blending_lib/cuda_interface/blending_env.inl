@@ -1,5 +1,6 @@
 //#include "glsave.hpp"
 //#include "blending_env_tex.hpp"
+#include "controller_coeffs.hpp"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846f
@@ -14,6 +15,26 @@
 namespace Blending_env {
 // =============================================================================
 
+/// @return true if the family 'f' is loaded (see require_family())
+__device__ static inline
+bool family_loaded_fetch(Family_t f)
+{
+    return (families_loaded >> f) & 1;
+}
+
+/// Decode values fetched from a table stored with 'table_bits'
+/// @param q : (scale, offset)
+__device__ static inline
+float table_decode(float t, float2 q){
+    return t * q.x + q.y;
+}
+
+/// @param q : (scale_x, offset_x, scale_y, offset_y)
+__device__ static inline
+float2 table_decode(float2 t, float4 q){
+    return make_float2(t.x * q.x + q.y, t.y * q.z + q.w);
+}
+
 // boundary functions fetch ------------------------------------------------
 __device__
 static float pan_hyperbola_fetch(float t){
@@ -45,6 +66,7 @@ skin_normal_fetch(float tan_t){
 __device__
 static float profile_bulge_4D_fetch(float tan_t, float strength)
 {
+    assert( family_loaded_fetch(FAMILY_4D_BULGE) );
     int idx = floorf(strength * (NB_SAMPLES_MAG_4D_BULGE-1));
     float x = idx*(NB_SAMPLES+2) + tan_t*(NB_SAMPLES-1);
     return tex1D(profiles_bulge_4D_tex, x + 0.5f);
@@ -53,6 +75,7 @@ static float profile_bulge_4D_fetch(float tan_t, float strength)
 __device__
 static float2 profile_bulge_4D_normal_fetch(float tan_t, float strength)
 {
+    assert( family_loaded_fetch(FAMILY_4D_BULGE) );
     int idx = floorf(strength * (NB_SAMPLES_MAG_4D_BULGE-1));
     float x = idx*(NB_SAMPLES+2) + tan_t*(NB_SAMPLES-1);
     return tex1D(profiles_bulge_4D_normals_tex, x + 0.5f);
@@ -61,6 +84,7 @@ static float2 profile_bulge_4D_normal_fetch(float tan_t, float strength)
 __device__
 static float profile_ricci_4D_fetch(float tan_t, float N)
 {
+    assert( family_loaded_fetch(FAMILY_4D_RICCI) );
     int idx = floorf( N  * 2);
     float x = idx*(NB_SAMPLES+2) + tan_t*(NB_SAMPLES-1);
     return tex1D(profiles_ricci_4D_tex, x + 0.5f);
@@ -68,6 +92,7 @@ static float profile_ricci_4D_fetch(float tan_t, float N)
 __device__
 static float2 profile_ricci_4D_normal_fetch(float tan_t, float N)
 {
+    assert( family_loaded_fetch(FAMILY_4D_RICCI) );
     int idx = floorf( N * 2 );
     float x = idx*(NB_SAMPLES+2) + tan_t*(NB_SAMPLES-1);
     return tex1D(profiles_ricci_4D_normals_tex, x + 0.5f);
@@ -82,7 +107,7 @@ openable_clean_union_fetch(float f1, float f2, float tan_alpha){
     if (id < 0)
         return 0.f;
     Idx3_cu idx = operator_idx_offset_fetch(id);
-    return operator_fetch(idx, f1*2.f, f2*2.f, tan_alpha);
+    return operator_fetch(id, idx, f1*2.f, f2*2.f, tan_alpha);
 }
 
 __device__ static float2
@@ -91,7 +116,7 @@ openable_clean_union_gradient_fetch(float f1, float f2, float tan_alpha){
     if (id < 0)
         return make_float2(0.f, 0.f);
     Idx3_cu idx = operator_idx_offset_fetch(id);
-    return operator_grad_fetch(idx, f1*2.f, f2*2.f, tan_alpha);
+    return operator_grad_fetch(id, idx, f1*2.f, f2*2.f, tan_alpha);
 }
 // used for B_OH
 __device__ static float
@@ -100,7 +125,7 @@ openable_clean_skin_fetch(float f1, float f2, float tan_alpha){
     if (id < 0)
         return 0.f;
     Idx3_cu idx = operator_idx_offset_fetch(id);
-    return operator_fetch(idx, f1*2.f, f2*2.f, tan_alpha);
+    return operator_fetch(id, idx, f1*2.f, f2*2.f, tan_alpha);
 }
 
 __device__ static float2
@@ -109,12 +134,23 @@ openable_clean_skin_gradient_fetch(float f1, float f2, float tan_alpha){
     if (id < 0)
         return make_float2(0.f, 0.f);
     Idx3_cu idx = operator_idx_offset_fetch(id);
-    return operator_grad_fetch(idx, f1*2.f, f2*2.f, tan_alpha);
+    return operator_grad_fetch(id, idx, f1*2.f, f2*2.f, tan_alpha);
 }
 // -----------------------------------------------------------------------------
 
 // 4D operators stuff ----------------------------------------------------------
 // TODO: 4D fetch that fetch both potential and gradient.
+/// Corner (padding excluded) of the 'idx'th grid stored in a block of
+/// 4D tables (see init_4D_bulge_in_contact())
+__device__ static int3 grid_4D_corner(int idx)
+{
+    const int nb  = tables_4D_layout.y;
+    const int len = tables_4D_layout.x + 2/*padding*/;
+    return make_int3(len * ( idx % nb)          + 1/*padding*/,
+                     len * ((idx / nb) % nb)    + 1/*padding*/,
+                     len * ( idx / (nb * nb))   + 1/*padding*/);
+}
+
 // B_OH_4D
 __device__
 static float magnitude_3D_bulge_fetch(){
@@ -124,45 +160,41 @@ static float magnitude_3D_bulge_fetch(){
 __device__ static float
 openable_bulge_4D_fetch(float f1, float f2, float tan_alpha, float strength)
 {
+    assert( family_loaded_fetch(FAMILY_4D_BULGE) );
     int idx = floorf(strength * (NB_SAMPLES_MAG_4D_BULGE-1));
 
-    int3 block_idx = {   (idx) % BLOCK_4D_BULGE_LX,
-                        ((idx) / BLOCK_4D_BULGE_LX) % BLOCK_4D_BULGE_LZ,
-                         (idx) / (BLOCK_4D_BULGE_LX * BLOCK_4D_BULGE_LY)
-                     };
-
-    block_idx.x = GRIG_4D_BULGE_LX * block_idx.x + 1/*padding*/;
-    block_idx.y = GRIG_4D_BULGE_LY * block_idx.y + 1/*padding*/;
-    block_idx.z = GRIG_4D_BULGE_LZ * block_idx.z + 1/*padding*/;
+    const int3 block_idx = grid_4D_corner(idx);
+    const float n = (float)(tables_4D_layout.x - 1);
 
-    float3 coords = { block_idx.x + f1*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.y + f2*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.z + tan_alpha * (NB_SAMPLES_4D_BULGE-1)
+    float3 coords = { block_idx.x + f1*2.f    * n,
+                      block_idx.y + f2*2.f    * n,
+                      block_idx.z + tan_alpha * n
                     };
 
-    return tex3D(openable_bulge_4D_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f) * 0.5f;
+    const float t = table_bits == 32 ?
+                tex3D(openable_bulge_4D_tex      , coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f) :
+                tex3D(openable_bulge_4D_unorm_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f);
+    return table_decode(t, bulge_4D_vals_quant) * 0.5f;
 }
 
 __device__ static float2
 openable_bulge_4D_gradient_fetch(float f1, float f2, float tan_alpha, float strength)
 {
+    assert( family_loaded_fetch(FAMILY_4D_BULGE) );
     int idx = floorf(strength * (NB_SAMPLES_MAG_4D_BULGE-1));
 
-    int3 block_idx = {   (idx) % BLOCK_4D_BULGE_LX,
-                        ((idx) / BLOCK_4D_BULGE_LX) % BLOCK_4D_BULGE_LZ,
-                         (idx) / (BLOCK_4D_BULGE_LX * BLOCK_4D_BULGE_LY)
-                     };
+    const int3 block_idx = grid_4D_corner(idx);
+    const float n = (float)(tables_4D_layout.x - 1);
 
-    block_idx.x = GRIG_4D_BULGE_LX * block_idx.x + 1/*padding*/;
-    block_idx.y = GRIG_4D_BULGE_LY * block_idx.y + 1/*padding*/;
-    block_idx.z = GRIG_4D_BULGE_LZ * block_idx.z + 1/*padding*/;
-
-    float3 coords = { block_idx.x + f1*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.y + f2*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.z + tan_alpha * (NB_SAMPLES_4D_BULGE-1)
+    float3 coords = { block_idx.x + f1*2.f    * n,
+                      block_idx.y + f2*2.f    * n,
+                      block_idx.z + tan_alpha * n
                     };
 
-    return tex3D(openable_bulge_4D_gradient_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f);
+    const float2 t = table_bits == 32 ?
+                tex3D(openable_bulge_4D_gradient_tex      , coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f) :
+                tex3D(openable_bulge_4D_gradient_unorm_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f);
+    return table_decode(t, bulge_4D_grads_quant);
 }
 
 // R_OH_4D
@@ -175,20 +207,15 @@ static float n_3D_ricci_fetch(){
 __device__ static float
 openable_ricci_4D_fetch(float f1, float f2, float tan_alpha, float N)
 {
+    assert( family_loaded_fetch(FAMILY_4D_RICCI) );
     int idx = floorf( N * 2 );
 
-    int3 block_idx = {   (idx) % BLOCK_4D_BULGE_LX,
-                        ((idx) / BLOCK_4D_BULGE_LX) % BLOCK_4D_BULGE_LZ,
-                         (idx) / (BLOCK_4D_BULGE_LX * BLOCK_4D_BULGE_LY)
-                     };
-
-    block_idx.x = GRIG_4D_BULGE_LX * block_idx.x + 1/*padding*/;
-    block_idx.y = GRIG_4D_BULGE_LY * block_idx.y + 1/*padding*/;
-    block_idx.z = GRIG_4D_BULGE_LZ * block_idx.z + 1/*padding*/;
+    const int3 block_idx = grid_4D_corner(idx);
+    const float n = (float)(tables_4D_layout.x - 1);
 
-    float3 coords = { block_idx.x + f1*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.y + f2*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.z + tan_alpha * (NB_SAMPLES_4D_BULGE-1)
+    float3 coords = { block_idx.x + f1*2.f    * n,
+                      block_idx.y + f2*2.f    * n,
+                      block_idx.z + tan_alpha * n
                     };
 
     return tex3D(openable_ricci_4D_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f) * 0.5f;
@@ -196,20 +223,15 @@ openable_ricci_4D_fetch(float f1, float f2, float tan_alpha, float N)
 __device__ static float2
 openable_ricci_4D_gradient_fetch(float f1, float f2, float tan_alpha, float N)
 {
+    assert( family_loaded_fetch(FAMILY_4D_RICCI) );
     int idx = floorf( N * 2);
 
-    int3 block_idx = {   (idx) % BLOCK_4D_BULGE_LX,
-                        ((idx) / BLOCK_4D_BULGE_LX) % BLOCK_4D_BULGE_LZ,
-                         (idx) / (BLOCK_4D_BULGE_LX * BLOCK_4D_BULGE_LY)
-                     };
+    const int3 block_idx = grid_4D_corner(idx);
+    const float n = (float)(tables_4D_layout.x - 1);
 
-    block_idx.x = GRIG_4D_BULGE_LX * block_idx.x + 1/*padding*/;
-    block_idx.y = GRIG_4D_BULGE_LY * block_idx.y + 1/*padding*/;
-    block_idx.z = GRIG_4D_BULGE_LZ * block_idx.z + 1/*padding*/;
-
-    float3 coords = { block_idx.x + f1*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.y + f2*2.f    * (NB_SAMPLES_4D_BULGE-1),
-                      block_idx.z + tan_alpha * (NB_SAMPLES_4D_BULGE-1)
+    float3 coords = { block_idx.x + f1*2.f    * n,
+                      block_idx.y + f2*2.f    * n,
+                      block_idx.z + tan_alpha * n
                     };
 
     return tex3D(openable_ricci_4D_gradient_tex, coords.x + 0.5f, coords.y + 0.5f, coords.z + 0.5f);
@@ -225,15 +247,21 @@ global_controller_fetch(float dot){
 
 __device__
 static float2 controller_fetch(int inst_id, float dot){
-
-    int2 bidx_2D = {inst_id  %  BLOCK_CTRL_LX, inst_id   / BLOCK_CTRL_LX  };
-    int2 gidx_2D = {bidx_2D.x * GRID_CTRL_LX , bidx_2D.y * GRID_CTRL_LY   };
-
-    const float off = 1/*padding*/ + 0.5f/*linear interpolation*/ + (dot * 0.5f + 0.5f) * (NB_SAMPLES-1);
-
-    return tex2D(tex_controllers,
-                 (float)gidx_2D.x + off,
-                 (float)gidx_2D.y + 1.f/*middle column*/ + 0.5f /*linear interpolation*/);
+    const float4 v0 = tex1Dfetch(tex_ctrl_coeffs, inst_id * 4 + 0);
+    const float4 v1 = tex1Dfetch(tex_ctrl_coeffs, inst_id * 4 + 1);
+    const float4 v2 = tex1Dfetch(tex_ctrl_coeffs, inst_id * 4 + 2);
+    const float4 v3 = tex1Dfetch(tex_ctrl_coeffs, inst_id * 4 + 3);
+
+    // Same layout as IBL::Ctrl_coeffs
+    IBL::Ctrl_coeffs c;
+    c.b0 = v0.x; c.b1 = v0.y; c.b2 = v0.z; c.F0 = v0.w;
+    c.F1 = v1.x; c.F2 = v1.y; c.S0 = v1.z; c.S1 = v1.w;
+    c.a0 = v2.x; c.c0 = v2.y; c.n0 = v2.z; c.a1 = v2.w;
+    c.c1 = v3.x; c.n1 = v3.y;
+
+    float2 res;
+    IBL::ctrl_eval(c, dot, res.x, res.y);
+    return res;
 }
 
 // =============================================================================
@@ -248,21 +276,33 @@ __device__ static Idx3_cu operator_idx_offset_fetch(Op_id op_id){
 }
 
 __device__ static float
-operator_fetch(Idx3_cu tex_idx, float f1, float f2 ,float tan_alpha){
+operator_fetch(Op_id op_id, Idx3_cu tex_idx, float f1, float f2 ,float tan_alpha){
     int a, b, c;
     tex_idx.to_3d(a, b, c);
-    return tex3D(tex_operators_values, a+f1*(NB_SAMPLES_OCU-1)+0.5f,
-                                       b+f2*(NB_SAMPLES_OCU-1)+0.5f,
-                                       c+tan_alpha*(NB_SAMPLES_ALPHA-1)+0.5f)*0.5f;
+    const float x = a+f1*operators_samples.x+0.5f;
+    const float y = b+f2*operators_samples.x+0.5f;
+    const float z = c+tan_alpha*operators_samples.y+0.5f;
+    if( table_bits == 32 )
+        return tex3D(tex_operators_values, x, y, z)*0.5f;
+
+    const float4 q = tex1Dfetch(tex_operators_quant, op_id*2 + 0);
+    const float  t = tex3D(tex_operators_values_unorm, x, y, z);
+    return table_decode(t, make_float2(q.x, q.y))*0.5f;
 }
 
 __device__ static float2
-operator_grad_fetch(Idx3_cu tex_idx, float f1, float f2, float tan_alpha){
+operator_grad_fetch(Op_id op_id, Idx3_cu tex_idx, float f1, float f2, float tan_alpha){
     int a, b, c;
     tex_idx.to_3d(a, b, c);
-    return tex3D(tex_operators_grads, a+f1*(NB_SAMPLES_OCU-1)+0.5f,
-                                      b+f2*(NB_SAMPLES_OCU-1)+0.5f,
-                                      c+tan_alpha*(NB_SAMPLES_ALPHA-1)+0.5f);
+    const float x = a+f1*operators_samples.x+0.5f;
+    const float y = b+f2*operators_samples.x+0.5f;
+    const float z = c+tan_alpha*operators_samples.y+0.5f;
+    if( table_bits == 32 )
+        return tex3D(tex_operators_grads, x, y, z);
+
+    const float4 q = tex1Dfetch(tex_operators_quant, op_id*2 + 1);
+    const float2 t = tex3D(tex_operators_grads_unorm, x, y, z);
+    return table_decode(t, q);
 }
 
 __device__ static Op_id
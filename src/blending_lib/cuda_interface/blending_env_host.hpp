@@ -0,0 +1,82 @@
+#ifndef BLENDING_ENV_HOST_HPP__
+#define BLENDING_ENV_HOST_HPP__
+
+#include "blending_env_type.hpp"
+#include "controller_coeffs.hpp"
+
+/**
+ * @file blending_env_host.hpp
+ * @brief Interface to access the host copies of Blending_env tables
+
+ * Blending_env keeps in host memory the tables it uploads to the GPU
+ * (controller coefficients, concatenated 3D operators, 4D bulge). This header exposes
+ * them without any CUDA type so that host code (see host_operators.hpp) can
+ * sample them exactly like the texture fetches of blending_env.inl do.
+ *
+ * 3D tables are stored x first then y then z, gradients are two interleaved
+ * channels. Their texels are floats, or 16 or 8 bits unsigned integers
+ * depending on 'table_bits' (see Blending_env::set_table_bits()) and are
+ * decoded per channel with: value = (texel / texel_max) * scale + offset
+*/
+
+// =============================================================================
+namespace Blending_env {
+// =============================================================================
+
+struct Host_tables {
+
+    /// @name Controllers
+    /// Coefficients of each instance (see IBL::ctrl_eval())
+    /// @{
+    const IBL::Ctrl_coeffs* ctrl;
+    int                     nb_ctrl;
+    /// @}
+
+    /// Storage of the 3D operators and the 4D bulge texels: 32, 16 or 8
+    int table_bits;
+
+    /// @name Binary 3D operators concatenated in one grid
+    /// @{
+    const void*  op_vals;
+    const void*  op_grads;      ///< (df/df1, df/df2) per texel
+    const float* op_quant;      ///< (scale, offset) of the vals, 0, 0 then of
+                                ///< each gradient channel: 8 floats per Op_id
+    int          op_size[3];
+    int          nb_ops;
+    const int*   op_corners;    ///< (x, y, z) of Op_id 'i' at [i*3]
+    int          nb_pred_ops;
+    const Op_id* pred_op_ids;   ///< Op_id of 'op_t - BINARY_3D_OPERATOR_BEGIN - 1' or -1
+    int          op_samples_xy;
+    int          op_samples_alpha;
+    /// @}
+
+    /// @name 4D bulge in contact (one 3D grid per magnitude)
+    /// @{
+    const void*  bulge_4D_vals;
+    const void*  bulge_4D_grads;
+    float        bulge_4D_quant[6]; ///< (scale, offset) of the vals then of each gradient channel
+    int          bulge_4D_size[3];
+    const int*   bulge_4D_corners;  ///< (x, y, z) of the magnitude 'i' at [i*3]
+    int          bulge_4D_samples;
+    int          bulge_4D_nb_mag;
+    const float* bulge_4D_profiles; ///< 'bulge_4D_nb_mag' profiles (padded)
+    const float* bulge_4D_profiles_normals;
+    int          profile_samples;
+    /// @}
+};
+
+/// Fill 'tabs' with pointers to the host copies of the tables.
+/// Tables of families not loaded yet are null: call require_family() first.
+/// @warning pointers are invalidated by any update of the controllers,
+/// operators or bulge and by clean_env()
+void get_host_tables(Host_tables& tabs);
+
+/// Loads the family 'f' if not already done (same as in blending_env.hpp)
+void require_family( Family_t f );
+
+/// @return true if the family 'f' is loaded (same as in blending_env.hpp)
+bool is_family_loaded( Family_t f );
+
+}// END BLENDING_ENV NAMESPACE =================================================
+
+#endif // BLENDING_ENV_HOST_HPP__
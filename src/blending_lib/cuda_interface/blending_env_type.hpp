@@ -60,6 +60,22 @@ enum Op_mode {
     DIFFERENCE_    ///< specifies Difference-defined operators
 };
 
+/// Families of tables loaded as a whole (require_family())
+enum Family_t {
+    FAMILY_PROFILES = 0, ///< 1D profiles, openings and global controller (init_env())
+    FAMILY_4D_BULGE,     ///< init_4D_bulge_in_contact()
+    FAMILY_4D_RICCI,     ///< init_4D_ricci()
+    NB_FAMILIES
+};
+
+/// Number of samples of the precomputed operator tables
+/// @see set_table_resolution()
+struct Table_resolution {
+    int samples_xy;    ///< (f1, f2) axis of the 3D operators
+    int samples_alpha; ///< opening axis of the 3D operators
+    int samples_4D;    ///< every axis of each grid of the 4D operators
+};
+
 }// END BLENDING_ENV NAMESPACE =================================================
 
 #endif // BLENDING_ENV_TYPE_HPP
@@ -71,6 +71,9 @@ private:
   bulge hence the 2D +2D == 4D .
 
   f = bulge(f0, f1, theta(g0, g1), magnitude)
+
+  @note whoever selects it must call
+  Blending_env::require_family(Blending_env::FAMILY_4D_BULGE) beforehand
 */
 class Dyn_4D_bulge{
 public:
@@ -228,6 +231,9 @@ float Dyn_Circle_Open_Hyperbola::fngf(Vec3_cu& gf, float f1, float f2, const Vec
 /** @class Dyn_Ricci_4D
   @brief Blending operator dedicated for the implicit skinning using
          Ricci profile with parameterizable N and open hyperbola
+
+  @note whoever selects it must call
+  Blending_env::require_family(Blending_env::FAMILY_4D_RICCI) beforehand
 */
 class Dyn_Ricci_4D{
 public:
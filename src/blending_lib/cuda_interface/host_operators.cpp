@@ -0,0 +1,454 @@
+#include "host_operators.hpp"
+
+#include <cstdio>
+#include <vector>
+#include <string>
+
+#include "blending_lib/controller.hpp"
+#include "blending_lib/generator.hpp"
+#include "quantized_table.hpp"
+#include "timer.hpp"
+
+// =============================================================================
+namespace Host_operators {
+// =============================================================================
+
+/// Deterministic random inputs in [0 1]
+static float rand_unit(unsigned& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (float)(seed >> 8) / (float)(1u << 24);
+}
+
+static Vec3_cu rand_dir(unsigned& seed)
+{
+    Vec3_cu v;
+    do {
+        v = Vec3_cu(rand_unit(seed) * 2.f - 1.f, rand_unit(seed) * 2.f - 1.f, rand_unit(seed) * 2.f - 1.f);
+    } while( v.norm_squared() < 1e-4f || v.norm_squared() > 1.f );
+    return v.normalized();
+}
+
+// -----------------------------------------------------------------------------
+
+/// Inputs of the validation and benchmark
+struct Samples {
+    std::vector<float>   f1, f2;
+    std::vector<Vec3_cu> gf1, gf2;
+
+    Samples(int nb, float max_f){
+        f1. resize(nb); f2. resize(nb);
+        gf1.resize(nb); gf2.resize(nb);
+        unsigned seed = 12345u;
+        for(int i = 0; i < nb; i++){
+            f1 [i] = rand_unit(seed) * max_f;
+            f2 [i] = rand_unit(seed) * max_f;
+            // gradients norms are in [0.5 1.5] (propagation() of the contact
+            // depends on them)
+            gf1[i] = rand_dir(seed) * (0.5f + rand_unit(seed));
+            gf2[i] = rand_dir(seed) * (0.5f + rand_unit(seed));
+        }
+    }
+};
+
+// =============================================================================
+/// @name References
+// =============================================================================
+
+/// Double precision n-ary operators (n_ary.hpp)
+/// @param op : 0 URicci 1 CaniContactUnaire 2 CaniContact
+/// 3 RestrictedBlendUnaire 4 RestrictedBlend
+static double ref_nary(int op, const N_ary::Params& p,
+                       double f1, double f2, const Vec3_cu& gf1, const Vec3_cu& gf2,
+                       double gf[3])
+{
+    const double n1 = gf1.norm(), n2 = gf2.norm();
+    const double g1[3] = {gf1.x, gf1.y, gf1.z};
+    const double g2[3] = {gf2.x, gf2.y, gf2.z};
+
+    struct Local {
+        static double propagation(const N_ary::Params& p, double k, double a, double w, double r){
+            if (r <= w/2){
+                double c = 4*(w*k-4*a)/(w*w*w);
+                double d = 4*(3*a-w*k)/(w*w);
+                return c*r*r*r + d*r*r + k*r;
+            } else if (r <= w)
+                return p.a0*0.5 + p.a0*0.5*std::cos(2*3.14159265358979323846/w * (r-w/2));
+            return 0.;
+        }
+        static double mk_tilde(double t, double k){
+            double s = 1 - k*2;
+            s *= s*s;
+            double mk;
+            if      (t <= k  ) mk = 0.;
+            else if (t >= 1-k) mk = 1.;
+            else {
+                double k_t = k - t, k_c = k - 0.5;
+                double e_kt = 8*k*k - 12.5*k + 5 + 9*k*t - 7.5*t + 3*t*t;
+                mk = (k_t*k_t*k_t)*e_kt / (16*k_c*k_c*k_c*k_c*k_c);
+            }
+            return mk*(1-s) + t*s;
+        }
+        static double kA0(double f, double w_auto, double w){
+            double s = (2*f < 1) ? 1+(4*f*f - 4*f)*(1-w) : w;
+            return 0.5*(1-w_auto * s);
+        }
+    };
+
+    double res = 0., c1 = 0., c2 = 0.;
+    switch(op){
+    case 0:
+        res = std::pow(std::pow(f1, (double)p.ricci_n) + std::pow(f2, (double)p.ricci_n), 1. / p.ricci_n);
+        c1 = f1 / n1; c2 = f2 / n2;
+        break;
+    case 1:
+        res = f2 > 0.5 ? f1 + 0.5 - f2 : f1 + Local::propagation(p, n2, p.a0*p.gji, p.w0, 0.5-f2);
+        c1 = 1.;
+        break;
+    case 2: {
+        double F1 = f2 > 0.5 ? f1 + 0.5 - f2 : f1 + Local::propagation(p, n2, p.a0*p.gji, p.w0, 0.5-f2);
+        double F2 = f1 > 0.5 ? f2 + 0.5 - f1 : f2 + Local::propagation(p, n1, p.a1*p.gij, p.w1, 0.5-f1);
+        res = F1 > F2 ? F1 : F2;
+        (F1 > F2 ? c1 : c2) = 1.;
+    } break;
+    case 3:
+        res = c1 = Local::mk_tilde(f1, Local::kA0(f2, p.wA0A0, p.wA0A1));
+        break;
+    case 4:
+        c1 = Local::mk_tilde(f1, Local::kA0(f2, p.wA0A0, p.wA0A1));
+        c2 = Local::mk_tilde(f2, Local::kA0(f1, p.wA1A1, p.wA1A0));
+        res = c1 + c2;
+        break;
+    }
+    for(int i = 0; i < 3; i++) gf[i] = g1[i] * c1 + g2[i] * c2;
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Potential 'g' of the binary operator defined by 'profile' and 'opening'
+/// at (x, y) in [0 range]^2, without the tables IBL::gen_custom_operator()
+/// computes: the iso 'v' follows the max until the opening 'c = opening(v)'
+/// then the profile centered at (c, c) of radius 'v - c'. 'v' is found by
+/// bisection.
+static double ref_operator(const IBL::Profile_polar::Base& profile,
+                           const IBL::Opening::Base& opening,
+                           double range,
+                           double x, double y, double tan_alpha)
+{
+    const double m = std::max(x, y), n = std::min(x, y);
+    if( n <= opening.f((float)m, (float)tan_alpha) )
+        return m; // max area
+
+    struct Iso {
+        const IBL::Profile_polar::Base& p;
+        double x, y;
+        /// > 0 when (x, y) is outside the profile centered at (c, c)
+        /// of radius 'r'
+        double dist(double c, double r) const {
+            const double dx = x - c, dy = y - c;
+            if( dx <= 0. || dy <= 0. ) return -1.;
+            const double tan_t = (dx < dy) ? dx/dy : dy/dx;
+            return std::sqrt(dx*dx + dy*dy) / p.f((float)tan_t) - r;
+        }
+    } iso = {profile, x, y};
+
+    // Isos which are not connected to a max anymore
+    const double org = opening.f((float)range, (float)tan_alpha);
+    if( iso.dist(org, range - org) > 0. )
+        return iso.dist(org, 0.) + org;
+
+    double lo = m, hi = range;
+    for(int i = 0; i < 48; i++)
+    {
+        const double v = (lo + hi) * 0.5;
+        const double c = opening.f((float)v, (float)tan_alpha);
+        if( iso.dist(c, v - c) > 0. ) lo = v;
+        else                          hi = v;
+    }
+    return (lo + hi) * 0.5;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Reference of a dynamic operator: potential and its derivatives along
+/// f1 and f2 at 'tan_alpha'
+struct Ref_op {
+    virtual ~Ref_op() { }
+    virtual double f(double f1, double f2, double tan_alpha) const = 0;
+
+    void fngf(double f1, double f2, double tan_alpha, double& res, double dg[2]) const {
+        const double h = 1e-4;
+        res   = f(f1, f2, tan_alpha);
+        dg[0] = (f(f1 + h, f2, tan_alpha) - f(f1 - h, f2, tan_alpha)) / (2. * h);
+        dg[1] = (f(f1, f2 + h, tan_alpha) - f(f1, f2 - h, tan_alpha)) / (2. * h);
+    }
+};
+
+/// 3D operators: tables store g(range*f1, range*f2) and are fetched
+/// times 0.5. Gradients are stored along the table axes.
+struct Ref_op_3D : public Ref_op {
+    Ref_op_3D(const IBL::Profile_polar::Base& p, const IBL::Opening::Base& o, double range) :
+        _p(p), _o(o), _range(range) { }
+
+    double f(double f1, double f2, double tan_alpha) const {
+        return 0.5 * ref_operator(_p, _o, _range, f1 * _range, f2 * _range, tan_alpha);
+    }
+
+    void fngf(double f1, double f2, double tan_alpha, double& res, double dg[2]) const {
+        Ref_op::fngf(f1, f2, tan_alpha, res, dg);
+        dg[0] *= 2. / _range;
+        dg[1] *= 2. / _range;
+    }
+
+    const IBL::Profile_polar::Base& _p;
+    const IBL::Opening::Base&       _o;
+    double _range;
+};
+
+/// 4D bulge of the magnitude slice 'mag' (Base_4D_bulge)
+struct Ref_bulge_4D : public Ref_op {
+    Ref_bulge_4D(const IBL::Profile_polar::Base& p, const IBL::Opening::Base& o) :
+        _p(p), _o(o) { }
+
+    double f(double f1, double f2, double tan_alpha) const {
+        if( f1 <= 0.5 && f2 <= 0.5 )
+            return 0.5 * ref_operator(_p, _o, 1., f1 * 2., f2 * 2., tan_alpha);
+
+        const double off = tan_alpha * 0.5;
+        if( f1 > off && f2 > off ){
+            const double dx = f1 - off, dy = f2 - off;
+            const double tan_t = (dx < dy) ? dx/dy : dy/dx;
+            return std::sqrt(dx*dx + dy*dy) / _p.f((float)tan_t) + off;
+        }
+        return std::max(f1, f2);
+    }
+
+    const IBL::Profile_polar::Base& _p;
+    const IBL::Opening::Base&       _o;
+};
+
+// =============================================================================
+/// @name Validation
+// =============================================================================
+
+/// Opening of the controller 'ctrl' as IBL::gen_controller() defines it
+static double ref_tan_alpha(const IBL::Continuous::Controller& ctrl, float dot)
+{
+    return std::tan(ctrl.eval(dot) * 3.14159265358979323846 * 0.2499 + 0.00001);
+}
+
+/// Errors of the potentials and gradients against the reference
+struct Errors {
+    Errors() : nb(0), sum_f(0.), sum_gf(0.) { f.max_abs = f.rms = gf.max_abs = gf.rms = 0.f; }
+
+    void add(double ef, double egf){
+        f. max_abs = std::max(f. max_abs, (float)std::abs(ef));
+        gf.max_abs = std::max(gf.max_abs, (float)egf);
+        sum_f  += ef * ef;
+        sum_gf += egf * egf;
+        nb++;
+    }
+
+    /// Print and check against 'tol'
+    bool report(const char* name, float tol){
+        f. rms = nb > 0 ? (float)std::sqrt(sum_f  / nb) : 0.f;
+        gf.rms = nb > 0 ? (float)std::sqrt(sum_gf / nb) : 0.f;
+        const bool ok = f.rms <= tol && gf.rms <= tol * 10.f;
+        printf("%-28s | f max %9.3e rms %9.3e | gf max %9.3e rms %9.3e | %s\n",
+               name, f.max_abs, f.rms, gf.max_abs, gf.rms, ok ? "OK" : "FAILED");
+        return ok;
+    }
+
+    int nb;
+    double sum_f, sum_gf;
+    Table_error f, gf;
+};
+
+static double dist3(const Vec3_cu& a, const double b[3]){
+    const double dx = a.x - b[0], dy = a.y - b[1], dz = a.z - b[2];
+    return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// -----------------------------------------------------------------------------
+
+template<class Op>
+static bool validate_nary(const char* name, int op_idx, const Samples& s, float tol)
+{
+    const Op op;
+    const N_ary::Params& p = N_ary::get_params();
+    Errors err;
+    for(unsigned i = 0; i < s.f1.size(); i++)
+    {
+        Vec3_cu gf;
+        const float res = op.fngf(gf, s.f1[i], s.f2[i], s.gf1[i], s.gf2[i]);
+        double ref_gf[3];
+        const double ref = ref_nary(op_idx, p, s.f1[i], s.f2[i], s.gf1[i], s.gf2[i], ref_gf);
+        if( ref != ref ) continue; // undefined (e.g. RICCI_N == 0)
+        err.add(res - ref, dist3(gf, ref_gf));
+    }
+    return err.report(name, tol);
+}
+
+// -----------------------------------------------------------------------------
+
+/// @param strength : used with the Dyn_4D_bulge only
+template<class Op>
+static bool validate_dyn(const char* name,
+                         const Op& op,
+                         const Ref_op& ref,
+                         const IBL::Continuous::Controller& ctrl,
+                         const Samples& s,
+                         float tol)
+{
+    if( !op.is_enabled() ){
+        printf("%-28s | not enabled in Blending_env, skipped\n", name);
+        return true;
+    }
+
+    Errors err;
+    for(unsigned i = 0; i < s.f1.size(); i++)
+    {
+        Vec3_cu gf;
+        const float res = op.fngf(gf, s.f1[i], s.f2[i], s.gf1[i], s.gf2[i]);
+
+        const double tan_alpha = ref_tan_alpha(ctrl, s.gf1[i].normalized().dot(s.gf2[i].normalized()));
+        double ref_f, dg[2];
+        ref.fngf(s.f1[i], s.f2[i], tan_alpha, ref_f, dg);
+        const double ref_gf[3] = { s.gf1[i].x * dg[0] + s.gf2[i].x * dg[1],
+                                   s.gf1[i].y * dg[0] + s.gf2[i].y * dg[1],
+                                   s.gf1[i].z * dg[0] + s.gf2[i].z * dg[1] };
+        err.add(res - ref_f, dist3(gf, ref_gf));
+    }
+    return err.report(name, tol);
+}
+
+// -----------------------------------------------------------------------------
+
+bool validate(int ctrl_id, const IBL::Ctrl_setup& shape, int nb_samples, float tol)
+{
+    Blending_env::require_family(Blending_env::FAMILY_4D_BULGE);
+    Blending_env::Host_tables tabs;
+    Blending_env::get_host_tables(tabs);
+    const Samples s(nb_samples, 1.f);
+    bool ok = true;
+
+    printf("Host operators against references (%d samples):\n", nb_samples);
+
+    // N-ary
+    ok &= validate_nary<URicci               >("URicci"               , 0, s, tol);
+    ok &= validate_nary<CaniContactUnaire    >("CaniContactUnaire"    , 1, s, tol);
+    ok &= validate_nary<CaniContact          >("CaniContact"          , 2, s, tol);
+    ok &= validate_nary<RestrictedBlendUnaire>("RestrictedBlendUnaire", 3, s, tol);
+    ok &= validate_nary<RestrictedBlend      >("RestrictedBlend"      , 4, s, tol);
+
+    if( ctrl_id < 0 || ctrl_id >= tabs.nb_ctrl ){
+        printf("invalid controller instance %d, dynamic operators skipped\n", ctrl_id);
+        return false;
+    }
+
+    // Controller
+    const IBL::Continuous::Controller ctrl(shape);
+    Errors ctrl_err;
+    for(int i = 0; i < nb_samples; i++){
+        const float dot = (float)i / (float)std::max(nb_samples - 1, 1) * 2.f - 1.f;
+        ctrl_err.add(controller_fetch(tabs, ctrl_id, dot).x - ref_tan_alpha(ctrl, dot), 0.);
+    }
+    ok &= ctrl_err.report("controller", tol);
+
+    // 3D operators
+    typedef IBL::Opening::Discreet_hyperbola Dh;
+    const IBL::Profile_polar::Circle circle;
+    const IBL::Opening::Diamond      diamond;
+    const IBL::Opening::Line         line;
+    const Dh                         open_hyperbola(Dh::OPEN_TANH);
+
+    ok &= validate_dyn("Dyn_circle_anim", Dyn_circle_anim(tabs, ctrl_id),
+                       Ref_op_3D(circle, diamond, 2.), ctrl, s, tol);
+    ok &= validate_dyn("Dyn_OMUCircle", Dyn_OMUCircle(tabs, ctrl_id),
+                       Ref_op_3D(circle, line, 1.), ctrl, s, tol);
+    ok &= validate_dyn("Dyn_Circle_Open_Hyperbola", Dyn_Circle_Open_Hyperbola(tabs, ctrl_id),
+                       Ref_op_3D(circle, open_hyperbola, 2.), ctrl, s, tol);
+
+    // 4D bulge: one check per magnitude slice
+    const Dh closed_hyperbola(Dh::CLOSED_TANH);
+    for(int i = 0; i < tabs.bulge_4D_nb_mag; i++)
+    {
+        // Same profile as Blending_env::init_4D_bulge_in_contact()
+        const float mag = (float)i / (float)tabs.bulge_4D_nb_mag;
+        IBL::Profile_polar::Discreet bulge_curve;
+        IBL::gen_polar_profile(bulge_curve, tabs.profile_samples, IBL::Profile::Bulge(mag));
+
+        const int   nb_steps = std::max(tabs.bulge_4D_nb_mag - 1, 1);
+        const float strength = (i + 0.5f) / (float)nb_steps;
+        char name[64];
+        sprintf(name, "Dyn_4D_bulge (mag %.2f)", mag);
+        ok &= validate_dyn(name, Dyn_4D_bulge(tabs, ctrl_id, std::min(strength, 1.f)),
+                           Ref_bulge_4D(bulge_curve, closed_hyperbola), ctrl, s, tol);
+
+        delete[] bulge_curve.get_vals();
+        delete[] bulge_curve.get_grads();
+    }
+    if( tabs.bulge_4D_nb_mag == 0 )
+        printf("%-28s | not loaded in Blending_env, skipped\n", "Dyn_4D_bulge");
+
+    return ok;
+}
+
+// =============================================================================
+/// @name Benchmark
+// =============================================================================
+
+template<class Op>
+static void bench(const char* name, const Op& op, const Samples& s,
+                  std::vector<float>& f, std::vector<Vec3_cu>& gf)
+{
+    const int nb = (int)s.f1.size();
+    Timer t;
+    t.reset();
+    t.start();
+    eval(op, nb, &(s.f1[0]), &(s.f2[0]), &(s.gf1[0]), &(s.gf2[0]), &(f[0]), &(gf[0]));
+    const double secs = t.stop();
+
+    // Checksum so that the evaluation is not optimized away
+    double sum = 0.;
+    for(int i = 0; i < nb; i++) sum += f[i] + gf[i].x;
+
+    printf("%-28s | %10.3f Mevals/s (checksum %g)\n",
+           name, secs > 0. ? nb / secs * 1e-6 : 0., sum);
+}
+
+// -----------------------------------------------------------------------------
+
+void benchmark(int ctrl_id, float bulge_mag, int nb_evals)
+{
+    Blending_env::require_family(Blending_env::FAMILY_4D_BULGE);
+    Blending_env::Host_tables tabs;
+    Blending_env::get_host_tables(tabs);
+    const Samples s(nb_evals, 1.f);
+    std::vector<float>   f (nb_evals);
+    std::vector<Vec3_cu> gf(nb_evals);
+
+    printf("Host operators evaluations per second (f and gf, %d evals):\n", nb_evals);
+    bench("URicci"               , URicci()               , s, f, gf);
+    bench("CaniContactUnaire"    , CaniContactUnaire()    , s, f, gf);
+    bench("CaniContact"          , CaniContact()          , s, f, gf);
+    bench("RestrictedBlendUnaire", RestrictedBlendUnaire(), s, f, gf);
+    bench("RestrictedBlend"      , RestrictedBlend()      , s, f, gf);
+
+    if( ctrl_id < 0 || ctrl_id >= tabs.nb_ctrl ){
+        printf("invalid controller instance %d, dynamic operators skipped\n", ctrl_id);
+        return;
+    }
+
+    const Dyn_circle_anim           c_d (tabs, ctrl_id);
+    const Dyn_OMUCircle             c_l (tabs, ctrl_id);
+    const Dyn_Circle_Open_Hyperbola c_oh(tabs, ctrl_id);
+    const Dyn_4D_bulge              b_4d(tabs, ctrl_id, bulge_mag);
+    if( c_d. is_enabled() ) bench("Dyn_circle_anim"          , c_d , s, f, gf);
+    if( c_l. is_enabled() ) bench("Dyn_OMUCircle"            , c_l , s, f, gf);
+    if( c_oh.is_enabled() ) bench("Dyn_Circle_Open_Hyperbola", c_oh, s, f, gf);
+    if( b_4d.is_enabled() ) bench("Dyn_4D_bulge"             , b_4d, s, f, gf);
+}
+
+}// END HOST_OPERATORS NAMESPACE ===============================================
@@ -0,0 +1,586 @@
+#ifndef HOST_OPERATORS_HPP__
+#define HOST_OPERATORS_HPP__
+
+#include <cmath>
+#include <algorithm>
+
+#include "vec2_cu.hpp"
+#include "vec3_cu.hpp"
+#include "blending_env_host.hpp"
+#include "n_ary_constant_interface.hpp"
+
+/**
+  @namespace Host_operators
+  @brief Host versions of the n-ary (n_ary.hpp) and dynamic (dyn_operators.hpp)
+  blending operators
+
+  Device operators read the n_ary.hpp constants and the Blending_env textures.
+  Here the same formulas read a copy of the n-ary parameters
+  (N_ary::get_params()) and the host copies of the tables
+  (Blending_env::get_host_tables()). Texture filtering (linear interpolation
+  with clamped coordinates) is done in software so results match the device
+  up to the 8 bits precision of the hardware interpolation weights. Tables
+  stored with 16 or 8 bits (Blending_env::set_table_bits()) are read and
+  decoded like the device does.
+
+  Operators are built from a snapshot of the tables: rebuild them after the
+  controllers or the operators are updated. eval() evaluates arrays of inputs
+  in a flat loop over inline functions which the compiler can unroll and
+  vectorize.
+
+  usage:
+  @code
+  Blending_env::require_family(Blending_env::FAMILY_4D_BULGE);
+  Blending_env::Host_tables tabs;
+  Blending_env::get_host_tables(tabs);
+  Host_operators::Dyn_4D_bulge op(tabs, ctrl_id, 0.7f);
+  Host_operators::eval(op, nb, f1, f2, gf1, gf2, f, gf);
+  @endcode
+
+  @see validate() benchmark()
+*/
+// =============================================================================
+namespace Host_operators {
+// =============================================================================
+
+typedef Blending_env::Host_tables Tables;
+
+// -----------------------------------------------------------------------------
+/// @name Texture fetches
+/// Coordinates 'x', 'y', 'z' are given in texels like with tex1D() tex3D()
+/// (texels centers are at 0.5, 1.5 ...)
+// -----------------------------------------------------------------------------
+
+/// Clamped linear interpolation weights of the coordinate 'x'
+static inline void tex_weights(float x, int len, int& i0, int& i1, float& a)
+{
+    const float u  = x - 0.5f;
+    const float fu = std::floor(u);
+    a  = u - fu;
+    i0 = (int)fu;
+    i1 = std::min(std::max(i0 + 1, 0), len - 1);
+    i0 = std::min(std::max(i0    , 0), len - 1);
+}
+
+/// Fetch the 'nb_ch' interleaved channels of 'tab' in 'out'
+template<int nb_ch>
+static inline void tex1D(const float* tab, int len, float x, float* out)
+{
+    int i0, i1; float a;
+    tex_weights(x, len, i0, i1, a);
+    for(int c = 0; c < nb_ch; c++)
+        out[c] = tab[i0*nb_ch + c] * (1.f - a) + tab[i1*nb_ch + c] * a;
+}
+
+/// Texels of 16 and 8 bits tables are read as normalized floats like with
+/// cudaReadModeNormalizedFloat (see tex3D_table())
+template<int nb_ch, class T>
+static inline void tex3D(const T* tab, const int size[3],
+                         float x, float y, float z,
+                         float* out)
+{
+    int x0, x1, y0, y1, z0, z1; float a, b, c;
+    tex_weights(x, size[0], x0, x1, a);
+    tex_weights(y, size[1], y0, y1, b);
+    tex_weights(z, size[2], z0, z1, c);
+    const int sx = size[0], sxy = size[0] * size[1];
+    const T* t000 = tab + (x0 + y0*sx + z0*sxy) * nb_ch;
+    const T* t100 = tab + (x1 + y0*sx + z0*sxy) * nb_ch;
+    const T* t010 = tab + (x0 + y1*sx + z0*sxy) * nb_ch;
+    const T* t110 = tab + (x1 + y1*sx + z0*sxy) * nb_ch;
+    const T* t001 = tab + (x0 + y0*sx + z1*sxy) * nb_ch;
+    const T* t101 = tab + (x1 + y0*sx + z1*sxy) * nb_ch;
+    const T* t011 = tab + (x0 + y1*sx + z1*sxy) * nb_ch;
+    const T* t111 = tab + (x1 + y1*sx + z1*sxy) * nb_ch;
+    for(int i = 0; i < nb_ch; i++)
+    {
+        const float v00 = t000[i] * (1.f - a) + t100[i] * a;
+        const float v10 = t010[i] * (1.f - a) + t110[i] * a;
+        const float v01 = t001[i] * (1.f - a) + t101[i] * a;
+        const float v11 = t011[i] * (1.f - a) + t111[i] * a;
+        const float v0  = v00 * (1.f - b) + v10 * b;
+        const float v1  = v01 * (1.f - b) + v11 * b;
+        out[i] = v0 * (1.f - c) + v1 * c;
+    }
+}
+
+/// Fetch a table stored with 'bits' (Host_tables::table_bits) and decode
+/// each channel 'i': out[i] = fetch * quant[i*2] + quant[i*2 + 1]
+template<int nb_ch>
+static inline void tex3D_table(const void* tab, int bits, const int size[3],
+                               float x, float y, float z,
+                               const float* quant,
+                               float* out)
+{
+    float norm = 1.f;
+    switch(bits){
+    case 16: tex3D<nb_ch>((const unsigned short*)tab, size, x, y, z, out); norm = 1.f / 65535.f; break;
+    case 8 : tex3D<nb_ch>((const unsigned char* )tab, size, x, y, z, out); norm = 1.f / 255.f;   break;
+    default: tex3D<nb_ch>((const float*         )tab, size, x, y, z, out); break;
+    }
+    for(int i = 0; i < nb_ch; i++)
+        out[i] = out[i] * norm * quant[i*2] + quant[i*2 + 1];
+}
+
+// -----------------------------------------------------------------------------
+/// @name Blending_env fetches
+/// Same as their device counterparts in blending_env.inl
+// -----------------------------------------------------------------------------
+
+/// @see Blending_env::controller_fetch()
+static inline Vec2_cu controller_fetch(const Tables& t, int inst_id, float dot)
+{
+    Vec2_cu v;
+    IBL::ctrl_eval(t.ctrl[inst_id], dot, v.x, v.y);
+    return v;
+}
+
+/// @see Blending_env::predefined_op_id_fetch()
+static inline Blending_env::Op_id predefined_op_id(const Tables& t, Blending_env::Op_t op_t)
+{
+    const int id_opt = op_t - Blending_env::BINARY_3D_OPERATOR_BEGIN - 1;
+    if(id_opt < 0 || id_opt >= t.nb_pred_ops) return -1;
+    return t.pred_op_ids[id_opt];
+}
+
+/// @see Blending_env::operator_fetch()
+static inline float operator_fetch(const Tables& t, Blending_env::Op_id id,
+                                   float f1, float f2, float tan_alpha)
+{
+    const int* c = t.op_corners + id * 3;
+    float v;
+    tex3D_table<1>(t.op_vals, t.table_bits, t.op_size,
+                   c[0] + f1 * (t.op_samples_xy - 1) + 0.5f,
+                   c[1] + f2 * (t.op_samples_xy - 1) + 0.5f,
+                   c[2] + tan_alpha * (t.op_samples_alpha - 1) + 0.5f,
+                   t.op_quant + id * 8, &v);
+    return v * 0.5f;
+}
+
+/// @see Blending_env::operator_grad_fetch()
+static inline Vec2_cu operator_grad_fetch(const Tables& t, Blending_env::Op_id id,
+                                          float f1, float f2, float tan_alpha)
+{
+    const int* c = t.op_corners + id * 3;
+    float v[2];
+    tex3D_table<2>(t.op_grads, t.table_bits, t.op_size,
+                   c[0] + f1 * (t.op_samples_xy - 1) + 0.5f,
+                   c[1] + f2 * (t.op_samples_xy - 1) + 0.5f,
+                   c[2] + tan_alpha * (t.op_samples_alpha - 1) + 0.5f,
+                   t.op_quant + id * 8 + 4, v);
+    return Vec2_cu(v[0], v[1]);
+}
+
+/// Magnitude slice of the 4D bulge (clamped unlike the device)
+static inline int bulge_4D_idx(const Tables& t, float strength)
+{
+    const int idx = (int)std::floor(strength * (t.bulge_4D_nb_mag - 1));
+    return std::min(std::max(idx, 0), t.bulge_4D_nb_mag - 1);
+}
+
+/// @see Blending_env::openable_bulge_4D_fetch()
+static inline float openable_bulge_4D_fetch(const Tables& t, float f1, float f2,
+                                            float tan_alpha, float strength)
+{
+    const int* c = t.bulge_4D_corners + bulge_4D_idx(t, strength) * 3;
+    const int n = t.bulge_4D_samples - 1;
+    float v;
+    tex3D_table<1>(t.bulge_4D_vals, t.table_bits, t.bulge_4D_size,
+                   c[0] + f1*2.f * n + 0.5f, c[1] + f2*2.f * n + 0.5f, c[2] + tan_alpha * n + 0.5f,
+                   t.bulge_4D_quant, &v);
+    return v * 0.5f;
+}
+
+/// @see Blending_env::openable_bulge_4D_gradient_fetch()
+static inline Vec2_cu openable_bulge_4D_gradient_fetch(const Tables& t, float f1, float f2,
+                                                       float tan_alpha, float strength)
+{
+    const int* c = t.bulge_4D_corners + bulge_4D_idx(t, strength) * 3;
+    const int n = t.bulge_4D_samples - 1;
+    float v[2];
+    tex3D_table<2>(t.bulge_4D_grads, t.table_bits, t.bulge_4D_size,
+                   c[0] + f1*2.f * n + 0.5f, c[1] + f2*2.f * n + 0.5f, c[2] + tan_alpha * n + 0.5f,
+                   t.bulge_4D_quant + 2, v);
+    return Vec2_cu(v[0], v[1]);
+}
+
+/// @see Blending_env::profile_bulge_4D_fetch()
+static inline float profile_bulge_4D_fetch(const Tables& t, float tan_t, float strength)
+{
+    const int len = t.bulge_4D_nb_mag * (t.profile_samples + 2);
+    const float x = bulge_4D_idx(t, strength) * (t.profile_samples + 2) + tan_t * (t.profile_samples - 1);
+    float v;
+    tex1D<1>(t.bulge_4D_profiles, len, x + 0.5f, &v);
+    return v;
+}
+
+/// @see Blending_env::profile_bulge_4D_normal_fetch()
+static inline Vec2_cu profile_bulge_4D_normal_fetch(const Tables& t, float tan_t, float strength)
+{
+    const int len = t.bulge_4D_nb_mag * (t.profile_samples + 2);
+    const float x = bulge_4D_idx(t, strength) * (t.profile_samples + 2) + tan_t * (t.profile_samples - 1);
+    float v[2];
+    tex1D<2>(t.bulge_4D_profiles_normals, len, x + 0.5f, v);
+    return Vec2_cu(v[0], v[1]);
+}
+
+// =============================================================================
+/// @name N-ary operators (n_ary.hpp)
+// =============================================================================
+
+/// @see ::URicci
+class URicci {
+public:
+    URicci(const N_ary::Params& p = N_ary::get_params()) : _n(p.ricci_n) { }
+
+    float f(float f1, float f2, const Vec3_cu& /*gf1*/, const Vec3_cu& /*gf2*/) const {
+        return std::pow( std::pow(f1, _n) + std::pow(f2, _n), 1.f / _n);
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        return gf1.normalized() * f1 + gf2.normalized() * f2;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        gf = gf1.normalized() * f1 + gf2.normalized() * f2;
+        return f(f1, f2, gf1, gf2);
+    }
+
+private:
+    float _n;
+};
+
+// -----------------------------------------------------------------------------
+
+/// @see ::propagation() (the cosine part uses 'a0' like the device)
+static inline float propagation(const N_ary::Params& p, float k, float a, float w, float r)
+{
+    if (r <= w/2){
+        float c = 4*(w*k-4*a)/(w*w*w);
+        float d = 4*(3*a-w*k)/(w*w);
+        return c*r*r*r + d*r*r + k*r;
+    } else if (r <= w){
+        return (p.a0*0.5f + p.a0*0.5f*std::cos(2.f*3.14159265f/w * (r-w/2)));
+    } else {
+        return 0.f;
+    }
+}
+
+/// @see ::CaniContactUnaire
+class CaniContactUnaire {
+public:
+    CaniContactUnaire(const N_ary::Params& p = N_ary::get_params()) : _p(p) { }
+
+    float f(float f1, float f2, const Vec3_cu& /*gf1*/, const Vec3_cu& gf2) const {
+        if (f2 > 0.5f) // interpenetration
+            return f1 + 0.5f - f2;
+        return f1 + propagation(_p, gf2.norm(), _p.a0*_p.gji, _p.w0, 0.5f-f2);
+    }
+
+    Vec3_cu gf(float /*f1*/, float /*f2*/, const Vec3_cu& gf1, const Vec3_cu& /*gf2*/) const {
+        return gf1;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        gf = gf1;
+        return f(f1, f2, gf1, gf2);
+    }
+
+private:
+    N_ary::Params _p;
+};
+
+/// @see ::CaniContact
+class CaniContact {
+public:
+    CaniContact(const N_ary::Params& p = N_ary::get_params()) : _p(p) { }
+
+    float f(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        float F1, F2;
+        eval(F1, F2, f1, f2, gf1, gf2);
+        return std::max(F1, F2);
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        float F1, F2;
+        eval(F1, F2, f1, f2, gf1, gf2);
+        return F1 > F2 ? gf1 : gf2;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        float F1, F2;
+        eval(F1, F2, f1, f2, gf1, gf2);
+        if (F1 > F2){ gf = gf1; return F1; }
+        else        { gf = gf2; return F2; }
+    }
+
+private:
+    void eval(float& F1, float& F2, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        if (f2 > 0.5f) F1 = f1 + 0.5f - f2; // interpenetration
+        else           F1 = f1 + propagation(_p, gf2.norm(), _p.a0*_p.gji, _p.w0, 0.5f-f2);
+        if (f1 > 0.5f) F2 = f2 + 0.5f - f1; // interpenetration
+        else           F2 = f2 + propagation(_p, gf1.norm(), _p.a1*_p.gij, _p.w1, 0.5f-f1);
+    }
+
+    N_ary::Params _p;
+};
+
+// -----------------------------------------------------------------------------
+
+/// @see ::sA0A1()
+static inline float sA0A1(float f, float w){
+    if (2*f < 1)
+        return 1+(4*f*f - 4*f)*(1-w);
+    return w;
+}
+
+/// @see ::kA0()
+static inline float kA0(float f, float w_auto, float w){
+    return 0.5f*(1-w_auto * sA0A1(f, w));
+}
+
+/// @see ::mk()
+static inline float mk( float t, float k ){
+    if (t <= k)
+        return 0.f;
+    if (t >= 1-k)
+        return 1.f;
+    float k_t = k - t;
+    float k_c = k - 0.5f;
+    float e_kt = 8*k*k - 12.5f*k + 5 + 9*k*t - 7.5f*t + 3*t*t;// using c = 0.5
+    return (k_t*k_t*k_t)*e_kt / (16*k_c*k_c*k_c*k_c*k_c);
+}
+
+/// @see ::mk_tilde()
+static inline float mk_tilde(float t, float k){
+    float s = (1-k*2);
+    s *= s*s;
+    return mk(t,k)*(1-s)+t*s;
+}
+
+/// @see ::RestrictedBlendUnaire
+class RestrictedBlendUnaire {
+public:
+    RestrictedBlendUnaire(const N_ary::Params& p = N_ary::get_params()) : _p(p) { }
+
+    float f(float f1, float f2, const Vec3_cu& /*gf1*/, const Vec3_cu& /*gf2*/) const {
+        return mk_tilde( f1, kA0(f2, _p.wA0A0, _p.wA0A1) );
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        return gf1 * f(f1, f2, gf1, gf2);
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        const float res = f(f1, f2, gf1, gf2);
+        gf = gf1 * res;
+        return res;
+    }
+
+private:
+    N_ary::Params _p;
+};
+
+/// @see ::RestrictedBlend
+class RestrictedBlend {
+public:
+    RestrictedBlend(const N_ary::Params& p = N_ary::get_params()) : _p(p) { }
+
+    float f(float f1, float f2, const Vec3_cu& /*gf1*/, const Vec3_cu& /*gf2*/) const {
+        return mk_tilde( f1, kA0(f2, _p.wA0A0, _p.wA0A1) ) +
+               mk_tilde( f2, kA0(f1, _p.wA1A1, _p.wA1A0) );
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        Vec3_cu g;
+        fngf(g, f1, f2, gf1, gf2);
+        return g;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        const float res1 = mk_tilde( f1, kA0(f2, _p.wA0A0, _p.wA0A1) );
+        const float res2 = mk_tilde( f2, kA0(f1, _p.wA1A1, _p.wA1A0) );
+        gf = gf1 * res1 + gf2 * res2;
+        return res1 + res2;
+    }
+
+private:
+    N_ary::Params _p;
+};
+
+// =============================================================================
+/// @name Dynamic operators (dyn_operators.hpp)
+// =============================================================================
+
+/// @see ::Dyn_Operator3D_cu
+/// The predefined operator 'op_t' is looked up once at construction
+class Dyn_operator_3D {
+public:
+    Dyn_operator_3D(const Tables& t, Blending_env::Op_t op_t, int ctrl_id) :
+        _t(t), _op_id(predefined_op_id(t, op_t)), _ctrl_id(ctrl_id)
+    { }
+
+    /// @return false if the operator is not enabled in Blending_env.
+    /// f() gf() and fngf() then return zeros like the device
+    bool is_enabled() const { return _op_id >= 0; }
+
+    float f(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        if( _op_id < 0 ) return 0.f;
+        const float tan_alpha = controller_fetch(_t, _ctrl_id, gf1.normalized().dot(gf2.normalized())).x;
+        return operator_fetch(_t, _op_id, f1, f2, tan_alpha);
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        Vec3_cu g;
+        fngf(g, f1, f2, gf1, gf2);
+        return g;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        if( _op_id < 0 ){
+            gf = Vec3_cu();
+            return 0.f;
+        }
+        const float tan_alpha = controller_fetch(_t, _ctrl_id, gf1.normalized().dot(gf2.normalized())).x;
+        const Vec2_cu dg = operator_grad_fetch(_t, _op_id, f1, f2, tan_alpha);
+        gf = gf1 * dg.x + gf2 * dg.y;
+        return operator_fetch(_t, _op_id, f1, f2, tan_alpha);
+    }
+
+private:
+    Tables              _t;
+    Blending_env::Op_id _op_id;
+    int                 _ctrl_id;
+};
+
+// -----------------------------------------------------------------------------
+
+/// @see ::Dyn_circle_anim
+struct Dyn_circle_anim : public Dyn_operator_3D {
+    Dyn_circle_anim(const Tables& t, int ctrl_id) : Dyn_operator_3D(t, Blending_env::C_D, ctrl_id) { }
+};
+
+/// @see ::Dyn_OMUCircle
+struct Dyn_OMUCircle : public Dyn_operator_3D {
+    Dyn_OMUCircle(const Tables& t, int ctrl_id) : Dyn_operator_3D(t, Blending_env::C_L, ctrl_id) { }
+};
+
+/// @see ::Dyn_Circle_Open_Hyperbola
+struct Dyn_Circle_Open_Hyperbola : public Dyn_operator_3D {
+    Dyn_Circle_Open_Hyperbola(const Tables& t, int ctrl_id) : Dyn_operator_3D(t, Blending_env::C_OH, ctrl_id) { }
+};
+
+// -----------------------------------------------------------------------------
+
+/// @see ::Dyn_4D_bulge and ::Base_4D_bulge
+class Dyn_4D_bulge {
+public:
+    Dyn_4D_bulge(const Tables& t, int ctrl_id, float mag) :
+        _t(t), _ctrl_id(ctrl_id), _magnitude(mag)
+    { }
+
+    /// @return false if the 4D bulge tables are not computed
+    bool is_enabled() const { return _t.bulge_4D_nb_mag > 0; }
+
+    float f(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        Vec2_cu gd;
+        return fngf_2D(gd, f1, f2, tan_alpha(gf1, gf2));
+    }
+
+    Vec3_cu gf(float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        Vec2_cu gd;
+        fngf_2D(gd, f1, f2, tan_alpha(gf1, gf2));
+        return gf1 * gd.x + gf2 * gd.y;
+    }
+
+    float fngf(Vec3_cu& gf, float f1, float f2, const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        Vec2_cu gd;
+        const float res = fngf_2D(gd, f1, f2, tan_alpha(gf1, gf2));
+        gf = gf1 * gd.x + gf2 * gd.y;
+        return res;
+    }
+
+    /// Base_4D_bulge::fngf()
+    float fngf_2D(Vec2_cu& gd, float f1, float f2, float tan_a) const
+    {
+        if((f1 <= 0.5f) & (f2 <= 0.5f))
+        {
+            gd = openable_bulge_4D_gradient_fetch(_t, f1, f2, tan_a, _magnitude);
+            return openable_bulge_4D_fetch(_t, f1, f2, tan_a, _magnitude);
+        }
+
+        const float off = tan_a * 0.5f;
+        if((f1 > off) & (f2 > off))
+        {
+            const float dx = f1 - off;
+            const float dy = f2 - off;
+            const float tan_t = (dx < dy) ? dx/dy : dy/dx;
+            const float r = std::sqrt(dx*dx + dy*dy) / profile_bulge_4D_fetch(_t, tan_t, _magnitude);
+            const Vec2_cu dg = profile_bulge_4D_normal_fetch(_t, tan_t, _magnitude);
+            gd = (dx < dy) ? dg : Vec2_cu(dg.y, dg.x);
+            return r + off;
+        }
+
+        if( f1 < f2 ){ gd = Vec2_cu(0.f, 1.f); return f2; }
+        else         { gd = Vec2_cu(1.f, 0.f); return f1; }
+    }
+
+private:
+    float tan_alpha(const Vec3_cu& gf1, const Vec3_cu& gf2) const {
+        return controller_fetch(_t, _ctrl_id, gf1.normalized().dot(gf2.normalized())).x;
+    }
+
+    Tables _t;
+    int    _ctrl_id;
+    float  _magnitude;
+};
+
+// =============================================================================
+/// @name Batch evaluation
+// =============================================================================
+
+/// Evaluate 'op' on 'nb' inputs: f[i] = op(f1[i], f2[i], gf1[i], gf2[i])
+/// @param gf : gradients output or NULL to only compute potentials
+template<class Op>
+static void eval(const Op& op,
+                 int nb,
+                 const float* f1, const float* f2,
+                 const Vec3_cu* gf1, const Vec3_cu* gf2,
+                 float* f, Vec3_cu* gf)
+{
+    if( gf != 0 )
+        for(int i = 0; i < nb; i++)
+            f[i] = op.fngf(gf[i], f1[i], f2[i], gf1[i], gf2[i]);
+    else
+        for(int i = 0; i < nb; i++)
+            f[i] = op.f(f1[i], f2[i], gf1[i], gf2[i]);
+}
+
+// =============================================================================
+/// @name Validation and benchmark
+// =============================================================================
+
+/// Compare every host operator to a reference evaluated in double precision
+/// on 'nb_samples' random inputs and print the max and rms errors:
+/// - n-ary operators against their formulas
+/// - dynamic operators against their profile and opening functions
+///   (IBL::Profile_polar IBL::Opening) and the controller function
+///   (IBL::Continuous::Controller)
+/// Operators not enabled in Blending_env are skipped.
+/// @param ctrl_id : controller instance used by the dynamic operators, its
+/// shape must be 'shape'
+/// @param tol : maximal rms error of the potentials (gradients: 10*tol)
+/// @return true if every operator is within tolerance
+bool validate(int ctrl_id,
+              const IBL::Ctrl_setup& shape,
+              int nb_samples = 20000,
+              float tol = 1e-2f);
+
+/// Print the number of evaluations (potential and gradient) per second of
+/// each host operator on one thread
+/// @param bulge_mag : magnitude used for Dyn_4D_bulge
+void benchmark(int ctrl_id, float bulge_mag = 0.7f, int nb_evals = 1 << 20);
+
+}// END HOST_OPERATORS NAMESPACE ===============================================
+
+#endif // HOST_OPERATORS_HPP__
@@ -2,6 +2,7 @@
 #define N_ARY_HPP
 
 #include "vec3_cu.hpp"
+#include "n_ary_constant_interface.hpp"
 
 // -----------------------------------------------------------------------------
 
@@ -270,10 +271,22 @@ struct RestrictedBlend{
 // TODO: these parameters should not be in constant mem but rather attributes
 // of their respective class.
 
+/// Host copy of the constants (RICCI_N is zero until set like its device
+/// counterpart)
+static N_ary::Params h_nary_params = { 0.f,
+                                       1.f, 1.f, 1.f, 1.f, 0.f, 0.f,
+                                       1.f, 1.f, 1.f, 1.f };
+
 // You should not need to add 'static keyword' as this header must be included
 // only once
 void init_nary_operators()
 {
+    const float ricci_n = h_nary_params.ricci_n;
+    const N_ary::Params defaults = { ricci_n,
+                                     1.f, 1.f, 1.f, 1.f, 0.f, 0.f,
+                                     1.f, 1.f, 1.f, 1.f };
+    h_nary_params = defaults;
+
     float value = 1.f;
     CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A0, &value, sizeof(float), 0, cudaMemcpyHostToDevice) );
     CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A1, &value, sizeof(float), 0, cudaMemcpyHostToDevice) );
@@ -294,18 +307,20 @@ void init_nary_operators()
 namespace N_ary {
 // =============================================================================
 
-void set_RICCI_N(float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(RICCI_N, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-
-void set_wA0A0(float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A0, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_wA0A1(float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A1, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_wA1A1(float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA1A1, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_wA1A0(float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA1A0, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_a0   (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(a0   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_w0   (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(w0   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_a1   (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(a1   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_w1   (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(w1   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_gji  (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(gji  , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
-void set_gij  (float v){ CUDA_SAFE_CALL( cudaMemcpyToSymbol(gij  , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+const Params& get_params(){ return h_nary_params; }
+
+void set_RICCI_N(float v){ h_nary_params.ricci_n = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(RICCI_N, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+
+void set_wA0A0(float v){ h_nary_params.wA0A0 = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A0, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_wA0A1(float v){ h_nary_params.wA0A1 = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA0A1, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_wA1A1(float v){ h_nary_params.wA1A1 = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA1A1, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_wA1A0(float v){ h_nary_params.wA1A0 = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(wA1A0, &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_a0   (float v){ h_nary_params.a0    = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(a0   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_w0   (float v){ h_nary_params.w0    = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(w0   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_a1   (float v){ h_nary_params.a1    = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(a1   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_w1   (float v){ h_nary_params.w1    = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(w1   , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_gji  (float v){ h_nary_params.gji   = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(gji  , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
+void set_gij  (float v){ h_nary_params.gij   = v; CUDA_SAFE_CALL( cudaMemcpyToSymbol(gij  , &v, sizeof(float), 0, cudaMemcpyHostToDevice) ); }
 
 } // END N_ary =================================================================
 
@@ -23,6 +23,16 @@ void set_w1   (float v);
 void set_gji  (float v);
 void set_gij  (float v);
 
+/// Host copy of the constant parameters of n_ary.hpp, kept in sync by the
+/// setters above (used by host_operators.hpp)
+struct Params {
+    float ricci_n;
+    float a0, w0, a1, w1, gji, gij;
+    float wA0A0, wA0A1, wA1A1, wA1A0;
+};
+
+const Params& get_params();
+
 } // END N_ary =================================================================
 
 #endif // N_ARY_CONSTANT_INTERFACE_HPP__
@@ -26,7 +26,7 @@ struct Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::global_controller_fetch( gf1n.dot(gf2n) ).x;
-        return Blending_env::operator_fetch( id, f1, f2, tan_alpha );
+        return Blending_env::operator_fetch( _op_idx, id, f1, f2, tan_alpha );
     }
 
     /// @param f1, f2 : values of composed implicit surfaces
@@ -39,7 +39,7 @@ struct Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::global_controller_fetch( gf1n.dot(gf2n) ).x;
-        float2 dg = Blending_env::operator_grad_fetch( id, f1, f2, tan_alpha );
+        float2 dg = Blending_env::operator_grad_fetch( _op_idx, id, f1, f2, tan_alpha );
         return gf1 *dg.x + gf2 * dg.y;
     }
 
@@ -55,9 +55,9 @@ struct Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::global_controller_fetch( gf1n.dot(gf2n) ).x;
-        float2 dg = Blending_env::operator_grad_fetch( id, f1, f2, tan_alpha );
+        float2 dg = Blending_env::operator_grad_fetch( _op_idx, id, f1, f2, tan_alpha );
         gf = gf1 *dg.x + gf2 * dg.y;
-        return Blending_env::operator_fetch( id, f1, f2, tan_alpha );
+        return Blending_env::operator_fetch( _op_idx, id, f1, f2, tan_alpha );
     }
 
 private:
@@ -87,7 +87,7 @@ struct Dyn_Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::controller_fetch( _ctrl_idx, gf1n.dot(gf2n) ).x;
-        return Blending_env::operator_fetch(id, f1, f2, tan_alpha);
+        return Blending_env::operator_fetch(_op_idx, id, f1, f2, tan_alpha);
     }
 
     /// @param f1, f2 : values of composed implicit surfaces
@@ -100,7 +100,7 @@ struct Dyn_Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::controller_fetch( _ctrl_idx, gf1n.dot(gf2n) ).x;
-        float2 dg = Blending_env::operator_grad_fetch(id, f1, f2, tan_alpha);
+        float2 dg = Blending_env::operator_grad_fetch(_op_idx, id, f1, f2, tan_alpha);
         return gf1 *dg.x + gf2 * dg.y;
     }
 
@@ -116,9 +116,9 @@ struct Dyn_Operator3D_cu {
         Vec3_cu gf1n = gf1.normalized();
         Vec3_cu gf2n = gf2.normalized();
         float tan_alpha = Blending_env::controller_fetch( _ctrl_idx, gf1n.dot(gf2n) ).x;
-        float2 dg = Blending_env::operator_grad_fetch(id, f1, f2, tan_alpha);
+        float2 dg = Blending_env::operator_grad_fetch(_op_idx, id, f1, f2, tan_alpha);
         gf = gf1 *dg.x + gf2 * dg.y;
-        return Blending_env::operator_fetch(id, f1, f2, tan_alpha);
+        return Blending_env::operator_fetch(_op_idx, id, f1, f2, tan_alpha);
     }
 
 private:
@@ -63,6 +63,10 @@ struct Grid3_cu {
     /// at the center of the new one.
     void padd(const Vec3i_cu& padding, Pad_t type = COPY, T val = T() );
 
+    /// Overwrite the cells of this grid starting at 'origin' with the cells
+    /// of 'g' (padding included). 'g' must fit inside this grid.
+    void set_block(const Vec3i_cu& origin, const Grid3_cu<T>& g);
+
     Vec3i_cu size() const { return _size; }
 
     Vec3i_cu get_padd_offset() const { return _pad_off; }
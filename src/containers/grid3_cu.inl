@@ -114,6 +114,19 @@ void Grid3_cu<T>::padd(const Vec3i_cu& padding, Pad_t type, T val)
 
 // -----------------------------------------------------------------------------
 
+template <class T>
+void Grid3_cu<T>::set_block(const Vec3i_cu& origin, const Grid3_cu<T>& g)
+{
+    assert( origin.x >= 0 && origin.x + g._size.x <= _size.x );
+    assert( origin.y >= 0 && origin.y + g._size.y <= _size.y );
+    assert( origin.z >= 0 && origin.z + g._size.z <= _size.z );
+
+    for(Idx3_cu idx(g._size, 0); idx.is_in(); ++idx)
+        _vals[ Idx3_cu(_size, origin + idx.to_3d()).to_linear() ] = g._vals[idx.to_linear()];
+}
+
+// -----------------------------------------------------------------------------
+
 template <class T>
 cudaArray* Grid3_cu<T>::
 
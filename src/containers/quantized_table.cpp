@@ -0,0 +1,171 @@
+#include "quantized_table.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+// -----------------------------------------------------------------------------
+
+// Version 2 also saves the error against the float values
+static const char QUANTIZED_TABLE_MAGIC[4] = {'O', 'P', 'C', '2'};
+
+// -----------------------------------------------------------------------------
+
+static inline unsigned texel_max(int bits){ return (1u << bits) - 1u; }
+
+// -----------------------------------------------------------------------------
+
+void Quantized_table::quantize(const float* vals,
+                               int nb_elt,
+                               int nb_channels,
+                               int bits)
+{
+    assert(bits == 32 || bits == 16 || bits == 8);
+    _bits        = bits;
+    _nb_elt      = nb_elt;
+    _nb_channels = nb_channels;
+    _scale. assign(nb_channels, 1.f);
+    _offset.assign(nb_channels, 0.f);
+
+    const int n = nb_elt * nb_channels;
+    _data.resize( n * (bits / 8) );
+
+    _err.max_abs = _err.rms = 0.f;
+
+    if(bits == 32)
+    {
+        if(n > 0) std::memcpy(&_data[0], vals, n * sizeof(float));
+        return;
+    }
+
+    // Range of each channel
+    for(int c = 0; c < nb_channels; c++)
+    {
+        float lo =  std::numeric_limits<float>::max();
+        float hi = -std::numeric_limits<float>::max();
+        for(int i = 0; i < nb_elt; i++){
+            lo = std::min(lo, vals[i*nb_channels + c]);
+            hi = std::max(hi, vals[i*nb_channels + c]);
+        }
+        if(nb_elt == 0) lo = hi = 0.f;
+        _offset[c] = lo;
+        _scale [c] = hi - lo;
+    }
+
+    const float tmax = (float)texel_max(bits);
+    for(int i = 0; i < n; i++)
+    {
+        const int c = i % nb_channels;
+        const float t = _scale[c] > 0.f ? (vals[i] - _offset[c]) / _scale[c] : 0.f;
+        const unsigned q = (unsigned)std::floor(std::min(std::max(t, 0.f), 1.f) * tmax + 0.5f);
+        if(bits == 16) reinterpret_cast<unsigned short*>(&_data[0])[i] = (unsigned short)q;
+        else           _data[i] = (unsigned char)q;
+    }
+
+    _err = table_error(vals, *this);
+}
+
+// -----------------------------------------------------------------------------
+
+float Quantized_table::get(int i, int c) const
+{
+    const int idx = i * _nb_channels + c;
+    if(_bits == 32)
+        return reinterpret_cast<const float*>(&_data[0])[idx];
+
+    const unsigned q = _bits == 16 ? reinterpret_cast<const unsigned short*>(&_data[0])[idx] : _data[idx];
+    return ((float)q / (float)texel_max(_bits)) * _scale[c] + _offset[c];
+}
+
+// -----------------------------------------------------------------------------
+
+void Quantized_table::dequantize(float* out) const
+{
+    for(int i = 0; i < _nb_elt; i++)
+        for(int c = 0; c < _nb_channels; c++)
+            out[i*_nb_channels + c] = get(i, c);
+}
+
+// -----------------------------------------------------------------------------
+
+bool Quantized_table::write(const std::string& path) const
+{
+    std::ofstream ostream(path.c_str(), std::ios::trunc | std::ios::out | std::ios::binary );
+
+    if( !ostream.is_open() )
+        return false;
+
+    ostream.write(QUANTIZED_TABLE_MAGIC, 4);
+    ostream.write(reinterpret_cast<const char*>(&_bits       ), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&_nb_elt     ), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&_nb_channels), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&_scale [0]), sizeof(float) * _nb_channels);
+    ostream.write(reinterpret_cast<const char*>(&_offset[0]), sizeof(float) * _nb_channels);
+    ostream.write(reinterpret_cast<const char*>(&_err), sizeof(Table_error));
+    if(_data.size() > 0)
+        ostream.write(reinterpret_cast<const char*>(&_data[0]), _data.size());
+
+    ostream.close();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Quantized_table::read(const std::string& path)
+{
+    std::ifstream istream(path.c_str(), std::ios::in | std::ios::binary);
+
+    if( !istream.is_open() )
+        return false;
+
+    char magic[4];
+    istream.read(magic, 4);
+    istream.read(reinterpret_cast<char*>(&_bits       ), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&_nb_elt     ), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&_nb_channels), sizeof(int));
+
+    if( !istream || std::memcmp(magic, QUANTIZED_TABLE_MAGIC, 4) != 0 ||
+        (_bits != 32 && _bits != 16 && _bits != 8) ||
+        _nb_elt < 0 || _nb_channels < 1 )
+    {
+        *this = Quantized_table();
+        return false;
+    }
+
+    _scale. resize(_nb_channels);
+    _offset.resize(_nb_channels);
+    _data.  resize(_nb_elt * _nb_channels * (_bits / 8));
+    istream.read(reinterpret_cast<char*>(&_scale [0]), sizeof(float) * _nb_channels);
+    istream.read(reinterpret_cast<char*>(&_offset[0]), sizeof(float) * _nb_channels);
+    istream.read(reinterpret_cast<char*>(&_err), sizeof(Table_error));
+    if(_data.size() > 0)
+        istream.read(reinterpret_cast<char*>(&_data[0]), _data.size());
+
+    const bool ok = !istream.fail();
+    istream.close();
+    if( !ok ) *this = Quantized_table();
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+Table_error table_error(const float* ref, const Quantized_table& q)
+{
+    Table_error err = {0.f, 0.f};
+    double sum = 0.;
+    const int n = q.nb_elt() * q.nb_channels();
+    for(int i = 0; i < q.nb_elt(); i++)
+    {
+        for(int c = 0; c < q.nb_channels(); c++)
+        {
+            const float e = std::abs(q.get(i, c) - ref[i*q.nb_channels() + c]);
+            err.max_abs = std::max(err.max_abs, e);
+            sum += (double)e * e;
+        }
+    }
+    err.rms = n > 0 ? (float)std::sqrt(sum / n) : 0.f;
+    return err;
+}
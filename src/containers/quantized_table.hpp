@@ -0,0 +1,99 @@
+#ifndef QUANTIZED_TABLE_HPP__
+#define QUANTIZED_TABLE_HPP__
+
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/// Error of a quantized table against the original float values
+struct Table_error {
+    float max_abs; ///< maximum absolute error
+    float rms;     ///< root mean square error
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @struct Quantized_table
+ * @brief Reduced precision storage of a table of floats
+ *
+ * Values are stored as 16 or 8 bits unsigned integers with a scale and an
+ * offset per channel:
+ * value = (texel / texel_max) * scale + offset
+ * This matches the way CUDA fetches textures with 'cudaReadModeNormalizedFloat'
+ * so 'data()' can be directly uploaded to a cudaArray. With 32 bits values are
+ * stored as plain floats (scale == 1 and offset == 0).
+ *
+ * The error against the float values is measured by quantize() and saved
+ * with the table so that it stays known once the floats are gone (e.g. when
+ * the table is read back from a cache file).
+ *
+ * Use case:
+ * @code
+ * Quantized_table q;
+ * q.quantize(vals, nb_elt, 1, 16);
+ * q.write("table_16.opc");
+ * Table_error err = q.error(); // against 'vals'
+ * float v = q.get(i);
+ * @endcode
+ */
+struct Quantized_table {
+
+    Quantized_table() : _bits(32), _nb_elt(0), _nb_channels(1) { _err.max_abs = _err.rms = 0.f; }
+
+    /// Quantize 'nb_elt' elements of 'nb_channels' interleaved floats and
+    /// measure the error against them (see error())
+    /// @param bits : 32, 16 or 8
+    void quantize(const float* vals, int nb_elt, int nb_channels, int bits);
+
+    /// Write back the values in 'out' (nb_elt * nb_channels floats)
+    void dequantize(float* out) const;
+
+    /// @return value of the channel 'c' of the ith element
+    float get(int i, int c = 0) const;
+
+    int bits()        const { return _bits;        }
+    int nb_elt()      const { return _nb_elt;      }
+    int nb_channels() const { return _nb_channels; }
+
+    float scale (int c) const { return _scale [c]; }
+    float offset(int c) const { return _offset[c]; }
+
+    /// Error against the float values given to quantize()
+    Table_error error() const { return _err; }
+
+    /// Overwrite the error when the float values given to quantize() were
+    /// themselves approximated (the new error must bound both)
+    void set_error(const Table_error& e) { _err = e; }
+
+    /// Raw storage: 'nb_elt*nb_channels' interleaved texels of 'bits/8' bytes
+    const std::vector<unsigned char>& data() const { return _data; }
+
+    /// @return number of bytes of the raw storage
+    int bytes() const { return (int)_data.size(); }
+
+    /// Save to 'path' a small header followed by the raw storage
+    /// @return wether the file has been written or not
+    bool write(const std::string& path) const;
+
+    /// Load a table saved with write()
+    /// @return false if the file doesn't exist or is corrupted
+    bool read(const std::string& path);
+
+private:
+    int _bits;
+    int _nb_elt;
+    int _nb_channels;
+    std::vector<float> _scale;  ///< per channel
+    std::vector<float> _offset; ///< per channel
+    std::vector<unsigned char> _data;
+    Table_error _err;
+};
+
+// -----------------------------------------------------------------------------
+
+/// @param ref : the float values 'q' has been built from
+Table_error table_error(const float* ref, const Quantized_table& q);
+
+#endif // QUANTIZED_TABLE_HPP__
@@ -0,0 +1,264 @@
+#include "base_potential_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "hrbf_cache.hpp"
+#include "skeleton.hpp"
+#include "cuda_ctrl.hpp"
+
+// =============================================================================
+namespace Base_potential_cache {
+// =============================================================================
+
+static const char BPOT_CACHE_MAGIC[4] = {'B', 'P', 'O', 'T'};
+
+/// Increment when the record layout or the potential evaluation changes
+/// so that older files are ignored
+static const int BPOT_CACHE_VERSION = 1;
+
+// -----------------------------------------------------------------------------
+
+template<class T>
+static uint64_t hash_val(const T& v, uint64_t seed){
+    return HRBF_cache::hash_bytes(&v, sizeof(T), seed);
+}
+
+static uint64_t hash_vec3(const Vec3_cu& v, uint64_t h){
+    h = hash_val(v.x, h);
+    h = hash_val(v.y, h);
+    return hash_val(v.z, h);
+}
+
+static uint64_t hash_vec3s(const std::vector<Vec3_cu>& v, uint64_t h){
+    h = hash_val((int)v.size(), h);
+    for(unsigned i = 0; i < v.size(); i++)
+        h = hash_vec3(v[i], h);
+    return h;
+}
+
+static uint64_t hash_ctrl(const IBL::Ctrl_setup& c, uint64_t h){
+    const float v[8] = { c.p0().x, c.p0().y, c.p1().x, c.p1().y,
+                         c.p2().x, c.p2().y, c.s0(), c.s1() };
+    return HRBF_cache::hash_bytes(v, sizeof(v), h);
+}
+
+// -----------------------------------------------------------------------------
+
+uint64_t global_key(const std::vector<Point_cu>& verts)
+{
+    uint64_t h = hash_val(BPOT_CACHE_VERSION, HRBF_cache::hash_bytes(0, 0));
+    h = hash_val((int)verts.size(), h);
+    for(unsigned i = 0; i < verts.size(); i++)
+        h = hash_vec3(verts[i], h);
+
+    const Blending_env::Table_resolution res = Cuda_ctrl::_operators.get_table_resolution();
+    h = hash_val(res.samples_xy   , h);
+    h = hash_val(res.samples_alpha, h);
+    h = hash_val(res.samples_4D   , h);
+    return hash_ctrl(Cuda_ctrl::_operators.get_global_controller(), h);
+}
+
+// -----------------------------------------------------------------------------
+
+static Bone_key bone_key(const Skeleton& skel, Bone::Id id)
+{
+    std::shared_ptr<const Bone> b = skel.get_bone(id);
+    const EBone::Bone_t type = b->get_type();
+
+    uint64_t h = hash_val(id, HRBF_cache::hash_bytes(0, 0));
+    h = hash_val(skel.parent(id), h);
+    h = hash_val((int)type, h);
+
+    // Blending with the parent
+    h = hash_val((int)skel.joint_blending(id), h);
+    h = hash_val(skel.get_joints_bulge_magnitude(id), h);
+    h = hash_ctrl(skel.get_joint_controller(id), h);
+
+    Bone_key key;
+    if(type != EBone::SSD)
+    {
+        const Transfo tr = b->get_world_space_matrix();
+        h = HRBF_cache::hash_bytes(tr.m, sizeof(tr.m), h);
+        h = hash_vec3(b->org(), h);
+        h = hash_vec3(b->end(), h);
+
+        const HermiteRBF& hrbf = b->get_hrbf();
+        std::vector<Vec3_cu> nodes, normals, betas;
+        std::vector<float> alphas;
+        hrbf.get_samples(nodes);
+        hrbf.get_normals(normals);
+        hrbf.get_coeffs(alphas, betas);
+        h = hash_val(hrbf.get_radius(), h);
+        h = hash_vec3s(nodes  , h);
+        h = hash_vec3s(normals, h);
+        h = hash_vec3s(betas  , h);
+        h = hash_val((int)alphas.size(), h);
+        if(alphas.size() > 0)
+            h = HRBF_cache::hash_bytes(&(alphas[0]), sizeof(float) * alphas.size(), h);
+
+        key.support = b->get_bbox();
+    }
+    key.hash = h;
+    return key;
+}
+
+// -----------------------------------------------------------------------------
+
+void bone_keys(const Skeleton& skel, std::map<Bone::Id, Bone_key>& keys)
+{
+    keys.clear();
+    std::set<Bone::Id> ids = skel.get_bone_ids();
+    for(std::set<Bone::Id>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+        keys[*it] = bone_key(skel, *it);
+}
+
+// -----------------------------------------------------------------------------
+
+void dirty_vertices(const Record& rec,
+                    const std::map<Bone::Id, Bone_key>& keys,
+                    const std::vector<Point_cu>& verts,
+                    std::vector<int>& dirty)
+{
+    // Supports (old and new) of the bones whose field changed
+    std::vector<BBox_cu> regions;
+    std::map<Bone::Id, Bone_key>::const_iterator it = keys.begin();
+    for(; it != keys.end(); ++it)
+    {
+        std::map<Bone::Id, Bone_key>::const_iterator old = rec.bones.find(it->first);
+        if(old != rec.bones.end() && old->second.hash == it->second.hash)
+            continue;
+        regions.push_back(it->second.support);
+        if(old != rec.bones.end())
+            regions.push_back(old->second.support);
+    }
+    // Removed bones
+    for(it = rec.bones.begin(); it != rec.bones.end(); ++it)
+        if(keys.find(it->first) == keys.end())
+            regions.push_back(it->second.support);
+
+    dirty.clear();
+    if(regions.size() == 0)
+        return;
+
+    for(unsigned i = 0; i < verts.size(); i++)
+    {
+        for(unsigned r = 0; r < regions.size(); r++)
+        {
+            if( regions[r].inside(verts[i]) ){
+                dirty.push_back(i);
+                break;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+static std::string record_path(uint64_t key)
+{
+    char name[32];
+    sprintf(name, "%016llx.bpot", (unsigned long long)key);
+    return HRBF_cache::get_cache_dir() + name;
+}
+
+// -----------------------------------------------------------------------------
+
+static void write_bbox(std::ofstream& ostream, const BBox_cu& bb)
+{
+    const float f[6] = {bb.pmin.x, bb.pmin.y, bb.pmin.z, bb.pmax.x, bb.pmax.y, bb.pmax.z};
+    ostream.write(reinterpret_cast<const char*>(f), sizeof(f));
+}
+
+static BBox_cu read_bbox(std::ifstream& istream)
+{
+    float f[6];
+    istream.read(reinterpret_cast<char*>(f), sizeof(f));
+    return BBox_cu(f[0], f[1], f[2], f[3], f[4], f[5]);
+}
+
+// -----------------------------------------------------------------------------
+
+bool save(uint64_t key, const Record& rec)
+{
+    if( HRBF_cache::get_cache_dir().size() == 0 )
+        return false;
+
+    std::ofstream ostream(record_path(key).c_str(), std::ios::trunc | std::ios::out | std::ios::binary );
+    if( !ostream.is_open() )
+        return false;
+
+    const int nb_bones = (int)rec.bones.size();
+    const int nb_verts = (int)rec.potential.size();
+    ostream.write(BPOT_CACHE_MAGIC, 4);
+    ostream.write(reinterpret_cast<const char*>(&BPOT_CACHE_VERSION), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&key     ), sizeof(uint64_t));
+    ostream.write(reinterpret_cast<const char*>(&nb_bones), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&nb_verts), sizeof(int));
+
+    std::map<Bone::Id, Bone_key>::const_iterator it = rec.bones.begin();
+    for(; it != rec.bones.end(); ++it){
+        ostream.write(reinterpret_cast<const char*>(&(it->first      )), sizeof(Bone::Id));
+        ostream.write(reinterpret_cast<const char*>(&(it->second.hash)), sizeof(uint64_t));
+        write_bbox(ostream, it->second.support);
+    }
+    if(nb_verts > 0)
+        ostream.write(reinterpret_cast<const char*>(&(rec.potential[0])), sizeof(float) * nb_verts);
+
+    const bool ok = !ostream.fail();
+    ostream.close();
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+bool load(uint64_t key, Record& rec)
+{
+    if( HRBF_cache::get_cache_dir().size() == 0 )
+        return false;
+
+    std::ifstream istream(record_path(key).c_str(), std::ios::in | std::ios::binary);
+    if( !istream.is_open() )
+        return false;
+
+    char magic[4];
+    int version = -1, nb_bones = -1, nb_verts = -1;
+    uint64_t file_key = 0;
+    istream.read(magic, 4);
+    istream.read(reinterpret_cast<char*>(&version ), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&file_key), sizeof(uint64_t));
+    istream.read(reinterpret_cast<char*>(&nb_bones), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&nb_verts), sizeof(int));
+
+    if( !istream || std::memcmp(magic, BPOT_CACHE_MAGIC, 4) != 0 ||
+        version != BPOT_CACHE_VERSION || file_key != key ||
+        nb_bones < 0 || nb_verts < 0 )
+    {
+        return false;
+    }
+
+    Record tmp;
+    for(int i = 0; i < nb_bones && istream; i++)
+    {
+        Bone::Id id;
+        Bone_key bk;
+        istream.read(reinterpret_cast<char*>(&id     ), sizeof(Bone::Id));
+        istream.read(reinterpret_cast<char*>(&bk.hash), sizeof(uint64_t));
+        bk.support = read_bbox(istream);
+        tmp.bones[id] = bk;
+    }
+    tmp.potential.resize(nb_verts);
+    if(nb_verts > 0)
+        istream.read(reinterpret_cast<char*>(&(tmp.potential[0])), sizeof(float) * nb_verts);
+
+    if( istream.fail() )
+        return false;
+
+    rec = tmp;
+    return true;
+}
+
+}// END BASE_POTENTIAL_CACHE NAMESPACE =========================================
@@ -0,0 +1,83 @@
+#ifndef BASE_POTENTIAL_CACHE_HPP__
+#define BASE_POTENTIAL_CACHE_HPP__
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "point_cu.hpp"
+#include "bbox.hpp"
+#include "bone.hpp"
+
+struct Skeleton;
+
+/**
+ * @namespace Base_potential_cache
+ * @brief Disk cache of the base potential of a mesh with the fingerprint of
+ * every bone field it was computed from
+ *
+ * The base potential of a vertex only depends on its rest position, the
+ * global operator setup and the fields of the bones whose support (the bbox of
+ * Bone::get_bbox()) contains it. A record stores the potential with a key per
+ * bone hashing everything its field and its blending with its parent read
+ * (rest frame, HRBF samples and coefficients, radius, joint controller,
+ * blending type and bulge magnitude) and the bbox of its support.
+ *
+ * When the potential is requested again (Animesh::update_base_potential())
+ * the record of the same mesh and operator setup (global_key()) is restored
+ * and compared to the current bone keys: only the vertices inside the old or
+ * new support of the bones that changed, appeared or disappeared are
+ * evaluated again. Re-sampling a single bone thus only recomputes its
+ * neighbourhood.
+ *
+ * Records are stored in HRBF_cache::get_cache_dir(), one file per global key.
+ */
+// =============================================================================
+namespace Base_potential_cache {
+// =============================================================================
+
+struct Bone_key {
+    Bone_key() : hash(0) { }
+    uint64_t hash;
+    BBox_cu  support; ///< empty for bones without a field (SSD)
+};
+
+struct Record {
+    std::map<Bone::Id, Bone_key> bones;
+    std::vector<float> potential; ///< one value per vertex of the mesh
+};
+
+// -----------------------------------------------------------------------------
+/// @name Keys
+// -----------------------------------------------------------------------------
+
+/// Key of the vertices rest positions and the global operator setup
+/// (blending tables resolution and global controller)
+uint64_t global_key(const std::vector<Point_cu>& verts);
+
+/// Keys of every bone of 'skel' (bones are expected in rest position)
+void bone_keys(const Skeleton& skel, std::map<Bone::Id, Bone_key>& keys);
+
+/// Vertices which potential stored in 'rec' is outdated given the current
+/// bone keys 'keys'.
+/// @param dirty : indices in 'verts' of the vertices to evaluate again
+void dirty_vertices(const Record& rec,
+                    const std::map<Bone::Id, Bone_key>& keys,
+                    const std::vector<Point_cu>& verts,
+                    std::vector<int>& dirty);
+
+// -----------------------------------------------------------------------------
+/// @name Storage
+// -----------------------------------------------------------------------------
+
+/// Restore the record stored under 'key'
+/// @return false if it doesn't exist, is corrupted or the cache is disabled
+bool load(uint64_t key, Record& rec);
+
+/// Store 'rec' under 'key', replacing any previous record
+/// @return wether the file has been written or not
+bool save(uint64_t key, const Record& rec);
+
+}// END BASE_POTENTIAL_CACHE NAMESPACE =========================================
+
+#endif // BASE_POTENTIAL_CACHE_HPP__
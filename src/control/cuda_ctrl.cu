@@ -13,7 +13,9 @@ using namespace std;
 #include "blending_env.hpp"
 #include "hrbf_env.hpp"
 #include "cuda_current_device.hpp"
+#include "cuda_launch_config.hpp"
 #include "constants_tex.hpp"
+#include "precomputed_prim.hpp"
 #include "timer.hpp"
 
 namespace Cuda_ctrl {
@@ -68,6 +70,10 @@ void cuda_start(const std::vector<Blending_env::Op_t>& op)
     printf("Device %d: \"%s\"\n", device_id, deviceProp.name);
     printf("Compute Capability   : %d.%d\n", deviceProp.major, deviceProp.minor);
 
+    // Kernel block sizes are resolved with the occupancy calculator at their
+    // first launch, the table in Launch_cfg being the fallback
+    Launch_cfg::init(device_id, true);
+
     Constants::init();
 
     //Cuda_utils::print_device_attribs(get_cu_device() );
@@ -83,8 +89,12 @@ void cuda_start(const std::vector<Blending_env::Op_t>& op)
     for(unsigned int i = 0; i < op.size(); ++i)
         Blending_env::enable_predefined_operator( op[i], true );
 
+    // Operators not listed in 'op' are loaded when a joint first selects them
+    // (see Blending_env::require_predefined_operator())
     Timer t; t.start();
-    if (!Blending_env::init_env_from_cache("ENV_CACHE")){
+    if( op.size() == 0 )
+        Blending_env::init_env();
+    else if (!Blending_env::init_env_from_cache("ENV_CACHE")){
         t.stop();
         Blending_env::init_env();
         Blending_env::make_cache_env("ENV_CACHE");
@@ -125,4 +135,22 @@ void cleanup()
     cudaDeviceReset();
 }
 
+// -----------------------------------------------------------------------------
+
+void memory_report(Memory_report& rep)
+{
+    HRBF_env::memory_report(rep);
+    Precomputed_prim::memory_report(rep);
+    Blending_env::memory_report(rep);
+    Skeleton_env::memory_report(rep);
+}
+
+// -----------------------------------------------------------------------------
+
+void load_report()
+{
+    Blending_env::load_report();
+    Launch_cfg::print();
+}
+
 }// END CUDA_CTRL NAMESPACE  ===================================================
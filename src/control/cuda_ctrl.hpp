@@ -8,6 +8,7 @@
 #include "debug_ctrl.hpp"
 
 class Mesh;
+struct Memory_report;
 
 /** @brief Mouse, keyboard, screen interface and more for the cuda library
 
@@ -33,6 +34,15 @@ void cuda_start(const std::vector<Blending_env::Op_t>& op);
 /// Free CUDA memory
 void cleanup();
 
+/// Add the memory used by every environments (HRBF_env, Precomputed_env,
+/// Blending_env, Skeleton_env) to 'rep'
+void memory_report(Memory_report& rep);
+
+/// Print the time and memory spent loading each blending operator family,
+/// then the block size and occupancy of the kernels launched so far
+/// (Launch_cfg::print())
+void load_report();
+
 }// END CUDA_CTRL NAMESPACE ====================================================
 
 #endif // CUDA_CTRL_HPP_
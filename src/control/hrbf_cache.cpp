@@ -0,0 +1,359 @@
+#include "hrbf_cache.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <map>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "mesh.hpp"
+#include "skeleton.hpp"
+#include "vert_to_bone_info.hpp"
+#include "hrbf_wrapper.hpp"
+
+// Work around Windows bugs:
+#if defined(WIN32)
+#include <windows.h>
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+// =============================================================================
+namespace HRBF_cache {
+// =============================================================================
+
+static const char HRBF_CACHE_MAGIC[4] = {'H', 'R', 'B', 'C'};
+
+/// Increment when the record layout or the sampling/fitting code changes
+/// so that older files are ignored
+static const int HRBF_CACHE_VERSION = 2;
+
+static bool        g_dir_set = false;
+static std::string g_dir;
+
+// -----------------------------------------------------------------------------
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* ptr = (const unsigned char*)data;
+    uint64_t h = seed;
+    for(size_t i = 0; i < size; i++){
+        h ^= (uint64_t)ptr[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// -----------------------------------------------------------------------------
+
+template<class T>
+static uint64_t hash_val(const T& v, uint64_t seed){
+    return hash_bytes(&v, sizeof(T), seed);
+}
+
+static uint64_t hash_vec3(const Vec3_cu& v, uint64_t h){
+    h = hash_val(v.x, h);
+    h = hash_val(v.y, h);
+    return hash_val(v.z, h);
+}
+
+// -----------------------------------------------------------------------------
+
+uint64_t mesh_hash(const Mesh& mesh)
+{
+    const int nb_vert = mesh.get_nb_vertices();
+    const int nb_tri  = mesh.get_nb_tri();
+    uint64_t h = hash_val(nb_vert, hash_val(nb_tri, hash_bytes(0, 0)));
+    if(nb_tri  > 0) h = hash_bytes(mesh.get_tri_index(), sizeof(int)   * nb_tri  * 3, h);
+    if(nb_vert > 0) h = hash_bytes(mesh.get_vertices() , sizeof(float) * nb_vert * 3, h);
+    return h;
+}
+
+// -----------------------------------------------------------------------------
+
+uint64_t sampling_key(const Mesh& mesh,
+                      const Skeleton& skel,
+                      const VertToBoneInfo& info,
+                      const SampleSet::SampleSetSettings& settings,
+                      const Transfo& rest,
+                      Bone::Id bone_id)
+{
+    uint64_t h = hash_val(HRBF_CACHE_VERSION, mesh_hash(mesh));
+    h = hash_val(bone_id, h);
+    h = hash_bytes(rest.m, sizeof(rest.m), h);
+
+    // Clusters
+    for(unsigned i = 0; i < info.bones_per_vertex.size(); i++)
+    {
+        const std::vector<Bone::Id>& bones = info.bones_per_vertex[i];
+        h = hash_val((int)bones.size(), h);
+        if(bones.size() > 0)
+            h = hash_bytes(&(bones[0]), sizeof(Bone::Id) * bones.size(), h);
+    }
+
+    // Rest skeleton (caps depend on the neighbouring bones)
+    std::set<Bone::Id> ids = skel.get_bone_ids();
+    for(std::set<Bone::Id>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+    {
+        std::shared_ptr<const Bone> b = skel.get_bone(*it);
+        h = hash_val(*it, h);
+        h = hash_val(skel.parent(*it), h);
+        h = hash_vec3(b->org(), h);
+        h = hash_vec3(b->end(), h);
+    }
+
+    // Settings ('factor_bones' is unused by the sampling)
+    h = hash_val((int)settings.mode, h);
+    h = hash_val(settings.pcap, h);
+    h = hash_val(settings.jcap, h);
+    h = hash_val(settings.jmax, h);
+    h = hash_val(settings.pmax, h);
+    h = hash_val(settings.min_dist, h);
+    h = hash_val(settings.fold, h);
+    h = hash_val(settings.nb_samples, h);
+    std::map<Bone::Id, float>::const_iterator it = settings.junction_radius.begin();
+    for(; it != settings.junction_radius.end(); ++it){
+        h = hash_val(it->first , h);
+        h = hash_val(it->second, h);
+    }
+    return h;
+}
+
+// -----------------------------------------------------------------------------
+
+uint64_t fit_key(const std::vector<Vec3_cu>& nodes,
+                 const std::vector<Vec3_cu>& normals,
+                 int kernel)
+{
+    uint64_t h = hash_val(HRBF_CACHE_VERSION, hash_bytes(0, 0));
+    h = hash_val((int)nodes.size(), h);
+    for(unsigned i = 0; i < nodes.size(); i++)
+        h = hash_vec3(nodes[i], h);
+    for(unsigned i = 0; i < normals.size(); i++)
+        h = hash_vec3(normals[i], h);
+    if(kernel != 0)
+        h = hash_val(kernel, h);
+    return h;
+}
+
+// -----------------------------------------------------------------------------
+
+void set_cache_dir(const std::string& dir)
+{
+    g_dir_set = true;
+    g_dir = dir;
+    if(g_dir.size() > 0 && g_dir[g_dir.size()-1] != '/' && g_dir[g_dir.size()-1] != '\\')
+        g_dir += "/";
+}
+
+// -----------------------------------------------------------------------------
+
+std::string get_cache_dir()
+{
+    if( g_dir_set )
+        return g_dir;
+
+    std::string dir;
+#if defined(WIN32)
+    char tmp[MAX_PATH+1];
+    GetTempPath(sizeof(tmp), tmp);
+    dir = tmp;
+    dir += "implicit/";
+#else
+    const char* home = getenv("HOME");
+    dir = std::string(home ? home : ".") + "/.implicit/";
+#endif
+    mkdir(dir.c_str(), 0755);
+    dir += "hrbf/";
+    mkdir(dir.c_str(), 0755);
+    return dir;
+}
+
+// -----------------------------------------------------------------------------
+
+static std::string record_path(uint64_t key)
+{
+    char name[32];
+    sprintf(name, "%016llx.hrbf", (unsigned long long)key);
+    return get_cache_dir() + name;
+}
+
+// -----------------------------------------------------------------------------
+
+static void write_vec3s(std::ofstream& ostream, const std::vector<Vec3_cu>& v)
+{
+    for(unsigned i = 0; i < v.size(); i++){
+        const float f[3] = {v[i].x, v[i].y, v[i].z};
+        ostream.write(reinterpret_cast<const char*>(f), sizeof(f));
+    }
+}
+
+static void read_vec3s(std::ifstream& istream, std::vector<Vec3_cu>& v, int n)
+{
+    v.resize(n);
+    for(int i = 0; i < n; i++){
+        float f[3];
+        istream.read(reinterpret_cast<char*>(f), sizeof(f));
+        v[i] = Vec3_cu(f[0], f[1], f[2]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool save(uint64_t key, const Bone_record& rec)
+{
+    if( get_cache_dir().size() == 0 )
+        return false;
+
+    std::ofstream ostream(record_path(key).c_str(), std::ios::trunc | std::ios::out | std::ios::binary );
+    if( !ostream.is_open() )
+        return false;
+
+    const int nb_samples = (int)rec.nodes.size();
+    const int nb_coeffs  = rec.has_coeffs() ? nb_samples : 0;
+    ostream.write(HRBF_CACHE_MAGIC, 4);
+    ostream.write(reinterpret_cast<const char*>(&HRBF_CACHE_VERSION), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&key       ), sizeof(uint64_t));
+    ostream.write(reinterpret_cast<const char*>(&rec.radius), sizeof(float));
+    ostream.write(reinterpret_cast<const char*>(&nb_samples), sizeof(int));
+    ostream.write(reinterpret_cast<const char*>(&nb_coeffs ), sizeof(int));
+    write_vec3s(ostream, rec.nodes  );
+    write_vec3s(ostream, rec.normals);
+    if(nb_coeffs > 0){
+        ostream.write(reinterpret_cast<const char*>(&(rec.alphas[0])), sizeof(float) * nb_coeffs);
+        write_vec3s(ostream, rec.betas);
+    }
+
+    const bool ok = !ostream.fail();
+    ostream.close();
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+bool load(uint64_t key, Bone_record& rec)
+{
+    if( get_cache_dir().size() == 0 )
+        return false;
+
+    std::ifstream istream(record_path(key).c_str(), std::ios::in | std::ios::binary);
+    if( !istream.is_open() )
+        return false;
+
+    char magic[4];
+    int version = -1, nb_samples = -1, nb_coeffs = -1;
+    uint64_t file_key = 0;
+    float radius = 0.f;
+    istream.read(magic, 4);
+    istream.read(reinterpret_cast<char*>(&version   ), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&file_key  ), sizeof(uint64_t));
+    istream.read(reinterpret_cast<char*>(&radius    ), sizeof(float));
+    istream.read(reinterpret_cast<char*>(&nb_samples), sizeof(int));
+    istream.read(reinterpret_cast<char*>(&nb_coeffs ), sizeof(int));
+
+    if( !istream || std::memcmp(magic, HRBF_CACHE_MAGIC, 4) != 0 ||
+        version != HRBF_CACHE_VERSION || file_key != key ||
+        nb_samples < 0 || (nb_coeffs != 0 && nb_coeffs != nb_samples) )
+    {
+        return false;
+    }
+
+    Bone_record tmp;
+    tmp.radius = radius;
+    read_vec3s(istream, tmp.nodes  , nb_samples);
+    read_vec3s(istream, tmp.normals, nb_samples);
+    if(nb_coeffs > 0){
+        tmp.alphas.resize(nb_coeffs);
+        istream.read(reinterpret_cast<char*>(&(tmp.alphas[0])), sizeof(float) * nb_coeffs);
+        read_vec3s(istream, tmp.betas, nb_coeffs);
+    }
+
+    if( istream.fail() )
+        return false;
+
+    rec = tmp;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+int solve_batch(const std::vector<Fit_request>& bones,
+                std::vector<Bone_record>& recs,
+                int nb_threads)
+{
+    recs.clear();
+    recs.resize( bones.size() );
+
+    // Only the bones not solved yet
+    std::vector<int>      ids;
+    std::vector<uint64_t> keys;
+    for(unsigned i = 0; i < bones.size(); i++)
+    {
+        const Fit_request& b = bones[i];
+        if( b.nodes.size() == 0 || b.nodes.size() != b.normals.size() )
+            continue;
+
+        Bone_record rec;
+        const uint64_t key = fit_key(b.nodes, b.normals, b.kernel);
+        if( load(key, rec) && rec.has_coeffs() && rec.nodes.size() == b.nodes.size() ){
+            recs[i] = rec;
+            continue;
+        }
+
+        ids. push_back(i);
+        keys.push_back(key);
+    }
+
+    if( ids.size() == 0 )
+        return 0;
+
+    std::vector<HRBF_wrapper::HRBF_coeffs> coeffs( ids.size() );
+    std::vector<HRBF_wrapper::Fit_job>     jobs  ( ids.size() );
+    for(unsigned j = 0; j < ids.size(); j++)
+    {
+        const Fit_request& b = bones[ids[j]];
+        const int size = (int)b.nodes.size();
+        jobs[j].points  = &(b.nodes  [0]);
+        jobs[j].normals = &(b.normals[0]);
+        jobs[j].size    = size;
+        jobs[j].res     = &(coeffs[j]);
+        if( b.kernel == HRBF_wrapper::RBF_WENDLAND_C2 )
+            jobs[j].support = HRBF_wrapper::support_radius(jobs[j].points, size);
+    }
+
+    const double wall = HRBF_wrapper::hermite_fit_batch(jobs, nb_threads);
+
+    double sum = 0.;
+    int nb_ill = 0;
+    for(unsigned j = 0; j < ids.size(); j++)
+    {
+        const Fit_request& b = bones[ids[j]];
+        const HRBF_wrapper::HRBF_coeffs& c = coeffs[j];
+        sum += jobs[j].time;
+        printf("HRBF_cache: bone %d, %d samples solved in %.3fs%s\n",
+               ids[j], jobs[j].size, jobs[j].time,
+               c.report.ill_conditioned ? " (ill-conditioned, not cached)" : "");
+
+        Bone_record& rec = recs[ids[j]];
+        rec.nodes   = b.nodes;
+        rec.normals = b.normals;
+        rec.radius  = b.radius;
+        rec.alphas.assign(c.alphas, c.alphas + c.size);
+        rec.betas. assign(c.betas,  c.betas  + c.size);
+        rec.report  = c.report;
+
+        if( c.report.ill_conditioned )
+            nb_ill++;
+        else
+            save(keys[j], rec);
+    }
+
+    printf("HRBF_cache: %d bones solved in %.3fs wall time (%.3fs of fits, %d ill-conditioned)\n",
+           (int)ids.size(), wall, sum, nb_ill);
+    return (int)ids.size();
+}
+
+}// END HRBF_CACHE NAMESPACE ===================================================
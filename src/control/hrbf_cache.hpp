@@ -0,0 +1,153 @@
+#ifndef HRBF_CACHE_HPP__
+#define HRBF_CACHE_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "vec3_cu.hpp"
+#include "transfo.hpp"
+#include "bone.hpp"
+#include "sample_set.hpp"
+#include "hrbf_data.hpp"
+
+struct Skeleton;
+struct VertToBoneInfo;
+class Mesh;
+
+/**
+ * @namespace HRBF_cache
+ * @brief Binary disk cache of per bone HRBF samples and fitted coefficients
+ *
+ * Sampling a bone (SampleSet::choose_hrbf_samples()) and solving its HRBF
+ * (HRBF_wrapper::hermite_fit()) dominates the loading time of heavy
+ * characters. Both only depend on their inputs, so their results are stored
+ * on disk, one file per key, and restored instead of being recomputed:
+ *
+ * - sampling_key() hashes everything the sampling reads: mesh topology and
+ *   rest positions, vertex to bone clusters, rest skeleton, the bone rest
+ *   transformation and the sampling settings.
+ * - fit_key() hashes the samples and normals the HRBF is solved from and
+ *   its radial basis function.
+ *
+ * Use case:
+ * @code
+ * HRBF_cache::Bone_record rec;
+ * uint64_t key = HRBF_cache::fit_key(nodes, normals);
+ * if( HRBF_cache::load(key, rec) && rec.has_coeffs() )
+ *     hrbf.init_coeffs(rec.nodes, rec.normals, rec.alphas, rec.betas);
+ * else {
+ *     hrbf.init_coeffs(nodes, normals);
+ *     // fill rec from hrbf ...
+ *     HRBF_cache::save(key, rec);
+ * }
+ * @endcode
+ *
+ * solve_batch() fits several bones at once, concurrently, and returns their
+ * records whether the cache is enabled or not.
+ */
+// =============================================================================
+namespace HRBF_cache {
+// =============================================================================
+
+/// What is stored for a bone. 'alphas' and 'betas' are empty when the record
+/// only holds samples (no HRBF solved yet)
+struct Bone_record {
+    Bone_record() : radius(0.f) { }
+
+    bool has_coeffs() const {
+        return alphas.size() > 0 && alphas.size() == nodes.size() && betas.size() == nodes.size();
+    }
+
+    std::vector<Vec3_cu> nodes;   ///< sample positions
+    std::vector<Vec3_cu> normals; ///< sample normals
+    std::vector<float>   alphas;  ///< HRBF alpha coefficient of each sample
+    std::vector<Vec3_cu> betas;   ///< HRBF beta coefficients of each sample
+    float radius;                 ///< HRBF radius (global to compact support)
+
+    /// Conditioning of the fit when the record comes from solve_batch()
+    /// (not stored on disk, nb_samples is zero for restored records)
+    HRBF_wrapper::HRBF_fit_report report;
+};
+
+// -----------------------------------------------------------------------------
+/// @name Keys
+// -----------------------------------------------------------------------------
+
+/// 64 bits FNV-1a hash of 'size' bytes
+/// @param seed : previous hash to chain several buffers
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+/// Hash of the vertex count, triangle indices and rest positions of 'mesh'
+uint64_t mesh_hash(const Mesh& mesh);
+
+/// Key of the samples SampleSet::choose_hrbf_samples() would compute for
+/// 'bone_id' with these inputs
+/// @param rest : rest transformation of the bone
+uint64_t sampling_key(const Mesh& mesh,
+                      const Skeleton& skel,
+                      const VertToBoneInfo& info,
+                      const SampleSet::SampleSetSettings& settings,
+                      const Transfo& rest,
+                      Bone::Id bone_id);
+
+/// Key of the HRBF solved from these samples
+/// @param kernel : HRBF_wrapper::Rbf_kernel of the fit (RBF_GLOBAL keys are
+/// the same as before kernels could be selected)
+uint64_t fit_key(const std::vector<Vec3_cu>& nodes,
+                 const std::vector<Vec3_cu>& normals,
+                 int kernel = 0);
+
+// -----------------------------------------------------------------------------
+/// @name Storage
+// -----------------------------------------------------------------------------
+
+/// Directory of the cache files. An empty string disables the cache
+void set_cache_dir(const std::string& dir);
+
+/// @return the directory of the cache files (with a trailing '/'). Defaults
+/// to "implicit/hrbf/" in the system temporary directory
+/// (or ~/.implicit/hrbf/)
+std::string get_cache_dir();
+
+/// Restore the record stored under 'key'
+/// @return false if it doesn't exist, is corrupted or the cache is disabled
+bool load(uint64_t key, Bone_record& rec);
+
+/// Store 'rec' under 'key', replacing any previous record
+/// @return wether the file has been written or not
+bool save(uint64_t key, const Bone_record& rec);
+
+// -----------------------------------------------------------------------------
+/// @name Batch
+// -----------------------------------------------------------------------------
+
+/// A bone of solve_batch()
+struct Fit_request {
+    Fit_request() : kernel(0), radius(0.f) { }
+
+    std::vector<Vec3_cu> nodes;
+    std::vector<Vec3_cu> normals;
+    int   kernel; ///< HRBF_wrapper::Rbf_kernel
+    float radius; ///< stored in the record
+};
+
+/// Solve every bone on a pool of threads (HRBF_wrapper::hermite_fit_batch())
+/// and hand back their records, ready for HermiteRBF::init_coeffs(). This
+/// doesn't depend on the disk cache: when it is enabled, bones whose
+/// fit_key() is stored are restored instead of solved and the new fits are
+/// saved. Ill-conditioned fits are returned with their report but not saved,
+/// like the per bone path, so that they are reported again when the bone is
+/// loaded. Prints the wall time of each fit and of the batch.
+/// @param recs : output, one record per bone, has_coeffs() is false for bones
+/// without samples
+/// @param nb_threads : 0 for one per core, lowered to keep the concurrent
+/// fits within HRBF_wrapper::FIT_BATCH_MAX_BYTES
+/// @return number of bones solved (restored ones excluded)
+int solve_batch(const std::vector<Fit_request>& bones,
+                std::vector<Bone_record>& recs,
+                int nb_threads = 0);
+
+}// END HRBF_CACHE NAMESPACE ===================================================
+
+#endif // HRBF_CACHE_HPP__
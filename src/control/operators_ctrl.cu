@@ -63,6 +63,43 @@ void Operators_ctrl::set_ricci_n(float N){
 
 // -----------------------------------------------------------------------------
 
+bool Operators_ctrl::set_table_resolution(const Blending_env::Table_resolution& res,
+                                          bool use_cache)
+{
+    return Blending_env::set_table_resolution(res, use_cache);
+}
+
+// -----------------------------------------------------------------------------
+
+Blending_env::Table_resolution Operators_ctrl::get_table_resolution()
+{
+    return Blending_env::get_table_resolution();
+}
+
+// -----------------------------------------------------------------------------
+
+Blending_env::Table_resolution Operators_ctrl::get_default_table_resolution()
+{
+    Blending_env::Table_resolution res = { NB_SAMPLES_OCU, NB_SAMPLES_ALPHA, NB_SAMPLES_4D_BULGE };
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Operators_ctrl::set_table_bits(int bits, bool use_cache)
+{
+    return Blending_env::set_table_bits(bits, use_cache);
+}
+
+// -----------------------------------------------------------------------------
+
+int Operators_ctrl::get_table_bits()
+{
+    return Blending_env::get_table_bits();
+}
+
+// -----------------------------------------------------------------------------
+
 IBL::Ctrl_setup Operators_ctrl::get_global_controller()
 {
     return Blending_env::get_global_ctrl_shape();
@@ -2,6 +2,7 @@
 #define OPERATORS_CTRL_HPP__
 
 #include "blending_lib/controller.hpp"
+#include "blending_env_type.hpp"
 
 class Operators_ctrl {
 public:
@@ -13,7 +14,8 @@ public:
     { }
 
 
-    /// @warning very slow !
+    /// Update the bulge operators to the magnitude of set_bulge_magnitude()
+    /// @note slow the first time (see Blending_env::update_3D_bulge())
     void update_bulge();
 
 
@@ -22,6 +24,21 @@ public:
     void set_bulge_magnitude(float magnitude);
     void set_ricci_n(float N);
 
+    /// Number of samples of the blending operators tables
+    /// @see Blending_env::set_table_resolution()
+    /// @{
+    bool set_table_resolution(const Blending_env::Table_resolution& res, bool use_cache = true);
+    Blending_env::Table_resolution get_table_resolution();
+    Blending_env::Table_resolution get_default_table_resolution();
+    /// @}
+
+    /// Storage of the blending operators tables (32, 16 or 8 bits)
+    /// @see Blending_env::set_table_bits()
+    /// @{
+    bool set_table_bits(int bits, bool use_cache = true);
+    int get_table_bits();
+    /// @}
+
     void set_global_controller(const IBL::Ctrl_setup& shape);
     void set_controller(int ctrl_id, const IBL::Ctrl_setup& shape);
 
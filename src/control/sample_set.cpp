@@ -1,8 +1,11 @@
 #include "sample_set.hpp"
 #include "skeleton.hpp"
 #include "animesh_hrbf_heuristic.hpp"
+#include "loader_rig.hpp"
 
 #include <sstream>
+#include <cstring>
+#include <cassert>
 
 void SampleSet::SampleSet::choose_hrbf_samples(const Mesh *mesh, const Skeleton *skel, const VertToBoneInfo &vertToBoneInfo, const SampleSetSettings &settings, int bone_id)
 {
@@ -163,6 +166,73 @@ void SampleSet::InputSample::add_samples(const std::vector<Vec3_cu>& p, const st
     n_nodes.insert(n_nodes.end(), n.begin(), n.end());
 }
 
+// -----------------------------------------------------------------------------
+
+namespace {
+    const char SAMPLES_MAGIC[4] = {'S', 'M', 'P', 'S'};
+    const int SAMPLES_VERSION = 1;
+    const size_t SAMPLES_HEADER_SIZE = 4 + 2 * sizeof(int);
+
+    void pack_vec3s(const std::vector<Vec3_cu>& v, float* dst)
+    {
+        for(unsigned i = 0; i < v.size(); i++) {
+            dst[i*3 + 0] = v[i].x;
+            dst[i*3 + 1] = v[i].y;
+            dst[i*3 + 2] = v[i].z;
+        }
+    }
+
+    void unpack_vec3s(const float* src, int nb, std::vector<Vec3_cu>& v)
+    {
+        v.resize(nb);
+        for(int i = 0; i < nb; i++)
+            v[i] = Vec3_cu(src[i*3 + 0], src[i*3 + 1], src[i*3 + 2]);
+    }
+}
+
+void SampleSet::InputSample::serialize(std::vector<char>& out) const
+{
+    assert(nodes.size() == n_nodes.size());
+    const int nb = (int) nodes.size();
+    out.resize(SAMPLES_HEADER_SIZE + nb * 6 * sizeof(float));
+
+    char* ptr = &out[0];
+    memcpy(ptr, SAMPLES_MAGIC, 4);                        ptr += 4;
+    memcpy(ptr, &SAMPLES_VERSION, sizeof(int));           ptr += sizeof(int);
+    memcpy(ptr, &nb, sizeof(int));                        ptr += sizeof(int);
+
+    // Copy through a float buffer: the block stays packed whatever the
+    // alignment of Vec3_cu
+    std::vector<float> buff(nb * 3);
+    if(nb == 0) return;
+    pack_vec3s(nodes, &buff[0]);
+    memcpy(ptr, &buff[0], nb * 3 * sizeof(float));        ptr += nb * 3 * sizeof(float);
+    pack_vec3s(n_nodes, &buff[0]);
+    memcpy(ptr, &buff[0], nb * 3 * sizeof(float));
+}
+
+bool SampleSet::InputSample::deserialize(const char* data, size_t size)
+{
+    if(size < SAMPLES_HEADER_SIZE || memcmp(data, SAMPLES_MAGIC, 4) != 0)
+        return false;
+
+    int version = 0, nb = 0;
+    memcpy(&version, data + 4, sizeof(int));
+    memcpy(&nb, data + 4 + sizeof(int), sizeof(int));
+    if(version != SAMPLES_VERSION || nb < 0 || size != SAMPLES_HEADER_SIZE + nb * 6 * sizeof(float))
+        return false;
+
+    std::vector<float> buff(nb * 3);
+    const char* ptr = data + SAMPLES_HEADER_SIZE;
+    if(nb > 0) memcpy(&buff[0], ptr, nb * 3 * sizeof(float));
+    unpack_vec3s(nb > 0 ? &buff[0] : 0, nb, nodes);
+    if(nb > 0) memcpy(&buff[0], ptr + nb * 3 * sizeof(float), nb * 3 * sizeof(float));
+    unpack_vec3s(nb > 0 ? &buff[0] : 0, nb, n_nodes);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
 void SampleSet::SampleSet::transform_samples(const std::vector<Transfo> &transfos, const std::vector<int>& bone_ids)
 {
     int acc = 0;
@@ -192,3 +262,17 @@ void SampleSet::SampleSet::get_all_bone_samples(Bone::Id bone_id, InputSample &o
 {
     out.append(_samples.at(bone_id));
 }
+
+void SampleSet::SampleSet::load_ism(Loader::Abs_ism &&ism)
+{
+    _samples.clear();
+    for(auto it = ism._samples.begin(); it != ism._samples.end(); ++it)
+    {
+        if(it->second._nodes.empty())
+            continue;
+
+        InputSample &sample = _samples[it->first];
+        sample.nodes.swap(it->second._nodes);
+        sample.n_nodes.swap(it->second._n_nodes);
+    }
+}
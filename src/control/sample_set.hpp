@@ -14,6 +14,7 @@
 struct Skeleton;
 class Mesh;
 struct VertToBoneInfo;
+namespace Loader { struct Abs_ism; }
 
 namespace SampleSet
 {
@@ -35,6 +36,15 @@ struct InputSample
 
     // Apply the given transformation to the samples.
     void transform(const Transfo &matrix);
+
+    /// Pack every sample into a single binary block: a small header followed
+    /// by the positions then the normals as packed floats. This doesn't
+    /// depend on Maya so the block can be stored in any container.
+    void serialize(std::vector<char>& out) const;
+
+    /// Replace the samples with a block written by serialize().
+    /// @return false if 'data' is not a valid block (samples are left untouched)
+    bool deserialize(const char* data, size_t size);
 };
 
 struct SampleSetSettings
@@ -91,6 +101,11 @@ struct SampleSet
 
     void get_all_bone_samples(Bone::Id bone_id, InputSample &out) const;
 
+    /// Replace the samples with the [HRBF_ENV] samples of a .ism file
+    /// (see Loader::load_ism()). Bones without samples are left out.
+    /// The samples are moved out of 'ism'.
+    void load_ism(Loader::Abs_ism &&ism);
+
 private:
     /// Compute caps at the tip of the bone to close the hrbf
     void compute_jcaps(const Skeleton &skel, const SampleSetSettings &settings, int bone_id, InputSample &out) const;
@@ -4,14 +4,37 @@
 namespace Skeleton_env {
 // =============================================================================
 
+/// Closed intersection test, bones touching a cell's face are listed in both
+/// neighbours
+static bool overlap(const BBox_cu& a, const BBox_cu& b)
+{
+    return a.pmin.x <= b.pmax.x && a.pmax.x >= b.pmin.x &&
+           a.pmin.y <= b.pmax.y && a.pmax.y >= b.pmin.y &&
+           a.pmin.z <= b.pmax.z && a.pmax.z >= b.pmin.z;
+}
+
+// -----------------------------------------------------------------------------
+
+/// @return the bbox of the ith octant of 'bb'
+static BBox_cu octant(const BBox_cu& bb, int i)
+{
+    const Vec3_cu c = (bb.pmin.to_vector() + bb.pmax.to_vector()) * 0.5f;
+    return BBox_cu((i & 1) ? c.x : bb.pmin.x,
+                   (i & 2) ? c.y : bb.pmin.y,
+                   (i & 4) ? c.z : bb.pmin.z,
+                   (i & 1) ? bb.pmax.x : c.x,
+                   (i & 2) ? bb.pmax.y : c.y,
+                   (i & 4) ? bb.pmax.z : c.z);
+}
+
+// -----------------------------------------------------------------------------
+
 Grid::Grid(const Tree* tree, int res) :
     _tree(tree)
 {
     if(res == -1)
-        res = 20;
-    _res = res;
-    _grid_cells.resize( _res * _res * _res);
-    build_grid();
+        res = 64;
+    set_res(res);
 }
 
 // -----------------------------------------------------------------------------
@@ -19,103 +42,214 @@ Grid::Grid(const Tree* tree, int res) :
 void Grid::set_res(int res)
 {
     assert( res > 0);
-    _grid_cells.clear();
-    _res = res;
-    _grid_cells.resize( res * res * res);
+    _max_depth = 0;
+    while( (1 << _max_depth) < res )
+        _max_depth++;
     build_grid();
 }
 
 // -----------------------------------------------------------------------------
 
-int Grid::res() const { return _res; }
+int Grid::res() const { return 1 << _max_depth; }
 
 // -----------------------------------------------------------------------------
 
-Vec3i_cu Grid::index_cell( Vec3_cu p ) const
+BBox_cu Grid::tree_bbox() const
 {
-    return _pos.index_grid_cell(Vec3i_cu(res(), res(), res()), p);
+    BBox_cu bb = _tree->bbox();
+    // Slightly enlarge bbox to avoid being perfectly aligned with bone bbox
+    const float e = 0.00001f;
+    const Vec3_cu eps(e, e, e);
+    bb.pmin = bb.pmin - eps;
+    bb.pmax = bb.pmax + eps;
+    return bb;
 }
 
 // -----------------------------------------------------------------------------
 
-Vec3_cu Grid::fsize_grid() const {
-    assert(_pos.is_valid());
-    return _pos.pmax - _pos.pmin;
-}
+void Grid::grid_bones(std::vector<const Bone*>& bones) const
+{
+    // Bones with a potential, in the tree order so that blending lists are
+    // ordered from root to leaves
+    bones.reserve( _tree->bones().size() );
+    for(auto bone: _tree->bones())
+    {
+        if( bone->get_type() == EBone::SSD)
+            continue;
 
-// -----------------------------------------------------------------------------
+        if( bone->get_type() == EBone::HRBF && bone->get_hrbf().empty() )
+            continue;
+
+        if( !bone->get_bbox().is_valid() )
+            continue;
 
-Vec3_cu Grid::cell_size() const { return fsize_grid() / (float)_res;}
+        bones.push_back( bone );
+    }
+}
 
 // -----------------------------------------------------------------------------
 
 void Grid::build_grid()
 {
     reset_grid();
-    _pos = _tree->bbox();
-    // Slightly enlarge bbox to avoid being perfectly aligned with bone bbox
-    const float e = 0.00001f;
-    const Vec3_cu eps(e, e, e);
-    _pos.pmin = _pos.pmin - eps;
-    _pos.pmax = _pos.pmax + eps;
+    _pos = tree_bbox();
 
     // If the bounding box is too small, don't do anything.
     if(!_pos.is_valid())
         return;
 
-    for(auto bone: _tree->bones())
-        add_bone(bone);
+    std::vector<const Bone*> bones;
+    grid_bones( bones );
+    build_node(0, _pos, bones, 0);
 }
 
-void Grid::reset_grid()
+// -----------------------------------------------------------------------------
+
+bool Grid::update_region(const std::vector<BBox_cu>& regions,
+                         std::vector<int>& dirty_nodes)
+{
+    // Every cell is a subdivision of the tree's bbox
+    const BBox_cu bb = tree_bbox();
+    if( !_pos.is_valid() || !bb.is_valid() ||
+        bb.pmin.x != _pos.pmin.x || bb.pmin.y != _pos.pmin.y || bb.pmin.z != _pos.pmin.z ||
+        bb.pmax.x != _pos.pmax.x || bb.pmax.y != _pos.pmax.y || bb.pmax.z != _pos.pmax.z )
+    {
+        build_grid();
+        return false;
+    }
+
+    std::vector<const Bone*> bones;
+    grid_bones( bones );
+    update_node(0, _pos, bones, 0, regions, dirty_nodes);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Grid::update_node(int node_id,
+                       const BBox_cu& bb,
+                       const std::vector<const Bone*>& bones,
+                       int depth,
+                       const std::vector<BBox_cu>& regions,
+                       std::vector<int>& dirty_nodes)
 {
-    int total_bones = _tree->bones().size();
-    for( unsigned i = 0; i < _grid_cells.size(); ++i) {
-        _grid_cells[i].clear();
-        _grid_cells[i].reserve(total_bones);
+    bool touched = false;
+    for(unsigned i = 0; i < regions.size() && !touched; ++i)
+        touched = regions[i].is_valid() && overlap(regions[i], bb);
+
+    if( !touched )
+        return;
+
+    // An internal node that still splits keeps its children, only those
+    // overlapping the regions are updated
+    BBox_cu child_bb[8];
+    std::vector<const Bone*> child_bones[8];
+    const int first = _nodes[node_id].first_child;
+    if( first != -1 && split_node(bb, bones, depth, child_bb, child_bones) )
+    {
+        for(int i = 0; i < 8; ++i)
+            update_node(first + i, child_bb[i], child_bones[i], depth + 1, regions, dirty_nodes);
+        return;
     }
-    _filled_cells.assign(_grid_cells.size(), false);
+
+    _nodes[node_id] = Node();
+    build_node(node_id, bb, bones, depth, &dirty_nodes);
 }
 
-void Grid::add_bone(const Bone *bone)
+// -----------------------------------------------------------------------------
+
+void Grid::leaves_overlapping(const BBox_cu& bb, std::vector<int>& nodes) const
 {
-    if( bone->get_type() == EBone::SSD)
+    if( _pos.is_valid() && bb.is_valid() )
+        leaves_overlapping(0, _pos, bb, nodes);
+}
+
+// -----------------------------------------------------------------------------
+
+void Grid::leaves_overlapping(int node_id,
+                              const BBox_cu& node_bb,
+                              const BBox_cu& bb,
+                              std::vector<int>& nodes) const
+{
+    if( !overlap(bb, node_bb) )
         return;
 
-    if( bone->get_type() == EBone::HRBF){
-        if( bone->get_hrbf().empty() )
-            return;
+    const Node& node = _nodes[node_id];
+    if( node.first_child != -1 )
+    {
+        for(int i = 0; i < 8; ++i)
+            leaves_overlapping(node.first_child + i, octant(node_bb, i), bb, nodes);
     }
+    else if( node.cell != -1 )
+        nodes.push_back( node_id );
+}
 
-    // Lookup every cell inside the bbox and add the bone id to these cells.
-    BBox_cu bb = bone->get_bbox();
-    if( !bb.is_valid() ) return;
+// -----------------------------------------------------------------------------
 
-    Vec3i_cu min_idx = index_cell( bb.pmin ).clamp(0, _res-1);
-    Vec3i_cu max_idx = index_cell( bb.pmax ).clamp(0, _res-1);
+void Grid::reset_grid()
+{
+    _nodes.assign(1, Node());
+    _grid_cells.clear();
+}
 
-    Vec3i_cu sub_size = max_idx - min_idx + 1;
-    assert(sub_size.product() >= 0);
+// -----------------------------------------------------------------------------
 
+bool Grid::split_node(const BBox_cu& bb,
+                      const std::vector<const Bone*>& bones,
+                      int depth,
+                      BBox_cu child_bb[8],
+                      std::vector<const Bone*> child_bones[8]) const
+{
+    if( (int)bones.size() <= MAX_BONES_PER_CELL || depth >= _max_depth )
+        return false;
 
-    Vec3i_cu grid_size(_res, _res, _res);
-    Idx3_cu offset(grid_size, min_idx);
-    for(Idx3_cu idx(sub_size, 0); idx.is_in(); ++idx)
+    // Don't split if every bone overlaps every octant: the children
+    // would hold the same list as their parent.
+    bool split = false;
+    for(int i = 0; i < 8; ++i)
     {
-        int i = (offset + idx.to_vec3i()).to_linear();
-        assert(i < grid_size.product() );
-        assert(i >= 0);
-        _filled_cells[i] = true;
-        _grid_cells[i].push_back( bone->get_bone_id() );
+        child_bb[i] = octant(bb, i);
+        for(const Bone* bone: bones)
+            if( overlap(bone->get_bbox(), child_bb[i]) )
+                child_bones[i].push_back( bone );
+
+        split = split || child_bones[i].size() < bones.size();
     }
+    return split;
+}
 
-    if( sub_size.product() == 0)
+// -----------------------------------------------------------------------------
+
+void Grid::build_node(int node_id,
+                      const BBox_cu& bb,
+                      const std::vector<const Bone*>& bones,
+                      int depth,
+                      std::vector<int>* nodes)
+{
+    if( nodes != NULL )
+        nodes->push_back( node_id );
+
+    if( bones.empty() )
+        return;
+
+    BBox_cu child_bb[8];
+    std::vector<const Bone*> child_bones[8];
+    if( split_node(bb, bones, depth, child_bb, child_bones) )
     {
-        int i = offset.to_linear();
-        assert( offset.is_in() );
-        _filled_cells[i] = true;
-        _grid_cells[i].push_back(bone->get_bone_id());
+        const int first = (int)_nodes.size();
+        _nodes[node_id].first_child = first;
+        _nodes.resize( first + 8 );
+        for(int i = 0; i < 8; ++i)
+            build_node(first + i, child_bb[i], child_bones[i], depth + 1, nodes);
+        return;
     }
+
+    _nodes[node_id].cell = (int)_grid_cells.size();
+    _grid_cells.push_back( std::vector<Bone::Id>() );
+    std::vector<Bone::Id>& cell = _grid_cells.back();
+    cell.reserve( bones.size() );
+    for(const Bone* bone: bones)
+        cell.push_back( bone->get_bone_id() );
 }
 
 }// NAMESPACE END Skeleton_env  ================================================
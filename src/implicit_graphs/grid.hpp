@@ -1,45 +1,81 @@
 #ifndef GRID_HPP
 #define GRID_HPP
 
-#include "idx3_cu.hpp"
 #include "vec3i_cu.hpp"
 #include "tree.hpp"
 #include <vector>
-#include <deque>
-#include <list>
-#include <set>
 
 // =============================================================================
 namespace Skeleton_env {
 // =============================================================================
 
+/**
+ * @struct Grid
+ * @brief Adaptive acceleration structure (octree) over the bones' bboxes.
+ *
+ * The root cell is the skeleton's bbox. A cell is split in eight while more
+ * than MAX_BONES_PER_CELL bones overlap it and the finest resolution res()
+ * is not reached. Empty regions and regions influenced by a single joint end
+ * up in large cells, dense joints (hands, feet) in small ones, so that the
+ * number of bones listed for a point only depends on the local overlap.
+ *
+ * Nodes are stored in a flat array, the eight children of a node are
+ * contiguous and ordered by octant: (x >= center.x) | (y >= center.y) << 1 |
+ * (z >= center.z) << 2
+*/
 struct Grid {
 
+    /// Cells overlapped by more bones than this are split
+    static const int MAX_BONES_PER_CELL = 2;
+
+    struct Node {
+        Node() : first_child(-1), cell(-1) { }
+        /// index of the first of the eight children in _nodes, -1 for leaves
+        int first_child;
+        /// index in _grid_cells for leaves, -1 if internal or empty
+        int cell;
+    };
+
+    /// @param res : finest resolution along each axis, see set_res()
     Grid(const Tree* tree, int res=-1);
 
     /// Update Grid's datas.
-    /// Build the grid cells given the current associated tree and states.
+    /// Build the octree given the current associated tree and states.
     /// Call this each time the tree data/position changes
     void build_grid();
 
+    /// Rebuild the octree where it overlaps 'regions' (bboxes of the bones
+    /// before and after an edit), as build_grid() would.
+    /// Nodes and cells of the replaced subtrees are left unused in _nodes and
+    /// _grid_cells.
+    /// @param dirty_nodes : nodes that were (re)built
+    /// @return false if the bbox of the tree changed: the octree was then
+    /// entirely rebuilt with build_grid() and 'dirty_nodes' is left empty.
+    bool update_region(const std::vector<BBox_cu>& regions,
+                       std::vector<int>& dirty_nodes);
+
+    /// Non empty leaves overlapping 'bb' (appended to 'nodes')
+    void leaves_overlapping(const BBox_cu& bb, std::vector<int>& nodes) const;
+
+    /// Bones listed by the octree, in the order of the cells
+    void grid_bones(std::vector<const Bone*>& bones) const;
+
+    void set_tree(const Tree* tree) { _tree = tree; }
+
     //--------------------------------------------------------------------------
     /// @name Accessors
     //--------------------------------------------------------------------------
 
-    /// Change the resolution x=y=z=res of the grid
+    /// Change the finest resolution of the grid, i.e. the number of cells along
+    /// each axis at the deepest level. It is rounded up to a power of two,
+    /// 1 disables the subdivision (a single cell holds every bone).
     void set_res(int res);
 
-    /// resolution of the grid res^3 = x.y.z
+    /// finest resolution of the grid along each axis (a power of two)
     int res() const;
 
-    /// 3d position to grid integer index
-    Vec3i_cu index_cell( Vec3_cu p ) const;
-
-    /// Total size in the scene of the grid;
-    Vec3_cu fsize_grid() const;
-
-    /// x, y and z cell size of the grid
-    Vec3_cu cell_size() const;
+    /// Maximal depth of the octree (res() == 1 << max_depth())
+    int max_depth() const { return _max_depth; }
 
     BBox_cu bbox() const { return _pos; }
 
@@ -47,12 +83,11 @@ struct Grid {
     /// @name Datas
     //--------------------------------------------------------------------------
 
-    /// 3D grid stored linearly of size _res*_res*_res.
-    /// Each cell contains a list of bones that intersects it
-    std::vector< std::vector<Bone::Id> > _grid_cells;
+    /// Octree nodes, _nodes[0] is the root.
+    std::vector<Node> _nodes;
 
-    /// Indices of the cells empty not empty.
-    std::vector<bool> _filled_cells;
+    /// List of bones that intersects each non empty leaf (see Node::cell)
+    std::vector< std::vector<Bone::Id> > _grid_cells;
 
 private:
 
@@ -60,11 +95,41 @@ private:
     /// @name Class tools
     //--------------------------------------------------------------------------
 
-    /// clear _filled_cells and list of bones for each cell in _grid_cells
+    /// clear _nodes and _grid_cells
     void reset_grid();
 
-    /// Add a bone to the cell the bounding box intersects
-    void add_bone(const Bone *bone);
+    /// Bbox of the root node for the current tree
+    BBox_cu tree_bbox() const;
+
+    /// Recursively fill the node 'node_id' of bbox 'bb' with 'bones' (the
+    /// bones overlapping the parent node)
+    /// @param nodes : if not NULL the filled nodes are appended to it
+    void build_node(int node_id,
+                    const BBox_cu& bb,
+                    const std::vector<const Bone*>& bones,
+                    int depth,
+                    std::vector<int>* nodes = NULL);
+
+    /// Whether a node of bbox 'bb' holding 'bones' is split, the bbox and
+    /// bones of its eight children are then filled in.
+    bool split_node(const BBox_cu& bb,
+                    const std::vector<const Bone*>& bones,
+                    int depth,
+                    BBox_cu child_bb[8],
+                    std::vector<const Bone*> child_bones[8]) const;
+
+    /// update_region() of the node 'node_id' of bbox 'bb' holding 'bones'
+    void update_node(int node_id,
+                     const BBox_cu& bb,
+                     const std::vector<const Bone*>& bones,
+                     int depth,
+                     const std::vector<BBox_cu>& regions,
+                     std::vector<int>& dirty_nodes);
+
+    void leaves_overlapping(int node_id,
+                            const BBox_cu& node_bb,
+                            const BBox_cu& bb,
+                            std::vector<int>& nodes) const;
 
     //--------------------------------------------------------------------------
     /// @name Attributes
@@ -73,8 +138,8 @@ private:
     /// Associated tree to the grid
     const Tree* _tree;
 
-    /// x, y resolutions of the grid
-    int _res;
+    /// depth of the finest cells
+    int _max_depth;
 
     ///  position and length of the grid represented with a bbox.
     BBox_cu _pos;
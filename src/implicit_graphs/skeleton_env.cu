@@ -5,6 +5,7 @@
 #include "grid.hpp"
 #include "tree_cu.hpp"
 #include "tree.hpp"
+#include <algorithm>
 #include <list>
 #include <deque>
 #include <map>
@@ -29,20 +30,21 @@ Cuda_utils::HD_Array<Cluster_cu> hd_blending_list;
 Cuda_utils::HD_Array<Cluster_data> hd_cluster_data;
 
 texture<int4, 1, cudaReadModeElementType> tex_blending_list;
-texture<int4, 1, cudaReadModeElementType> tex_grid_list;
+texture<int4, 1, cudaReadModeElementType> tex_grid_programs;
 texture<int, 1, cudaReadModeElementType> tex_grid;
 texture<float4, 1, cudaReadModeElementType> tex_grid_bbox;
 texture<int2, 1, cudaReadModeElementType> tex_offset;
 texture<float, 1, cudaReadModeElementType> tex_bulge_strength;
+texture<float, 1, cudaReadModeElementType> tex_grid_bulge;
 texture<int, 1, cudaReadModeElementType> tex_bone_type;
 texture<int   , 1, cudaReadModeElementType> tex_bone_hrbf;
 texture<int   , 1, cudaReadModeElementType> tex_bone_precomputed;
 
-/// Concatenated blendind list for every skeletons in each grid cell not empty.
-/// Each cell store a single blending list.
+/// Concatenated programs for every skeletons' grid cells not empty.
+/// Cells with the same blending list share a program.
 /**
  * @code
- *  |-list0-|-list1-|-list2-| |-list0-|-list1-|
+ *  |-prog0-|-prog1-|-prog2-| |-prog0-|-prog1-|
  *  *-----------------------* *---------------*
  *            skel0                 skel1
  * @endcode
@@ -62,16 +64,33 @@ public:
     Grid *h_grid;
 
     Tree_cu *h_tree_cu_instance;
+
+    /// Range of a concatenated device array used by the instance
+    struct Slice {
+        Slice() : off(0), size(0), cap(0) { }
+        int off;  ///< first element of the instance
+        int size; ///< number of elements used
+        int cap;  ///< number of elements reserved
+    };
+
+    /// Slices of the instance in hd_bone_arrays, hd_blending_list (and
+    /// hd_cluster_data), hd_grid and hd_grid_programs (and hd_grid_bulge).
+    /// They are reserved with some room so that edits are written in place
+    /// (see update_skel_instance()).
+    Slice bones, blist, nodes, progs;
+
+    /// Bbox of each bone the grid was last built with
+    std::map<Bone::Id, BBox_cu> bone_bbox;
 };
 
 std::deque<SkeletonEnv *> h_envs;
 
-Cuda_utils::HD_Array<Cluster_cu> hd_grid_blending_list;
+Cuda_utils::HD_Array<Blend_instr> hd_grid_programs;
+
+Cuda_utils::HD_Array<float> hd_grid_bulge;
 
-/// Concatenated datas corresponding to clusters listed hd_grid_blending_list
-Cuda_utils::HD_Array<Cluster_data> hd_grid_data;
-/// Table of indirection which maps grid cells to blending list.
-/// hd_grid[ hd_offset[Skel_id].grid_data + cell_idx] == offset in hd_grid_blending_list or -1 if empty cell
+/// Table of indirection which maps grid cells to programs.
+/// Octree nodes of every grids (see skeleton_env.hpp)
 Cuda_utils::HD_Array<int> hd_grid;
 
 Cuda_utils::HD_Array<float4> hd_grid_bbox;
@@ -122,7 +141,8 @@ void bind()
     hd_offset            .device_array().bind_tex( tex_offset          );
     hd_blending_list     .device_array().bind_tex( tex_blending_list   );
     hd_grid              .device_array().bind_tex( tex_grid            );
-    hd_grid_blending_list.device_array().bind_tex( tex_grid_list       );
+    hd_grid_programs     .device_array().bind_tex( tex_grid_programs   );
+    hd_grid_bulge        .device_array().bind_tex( tex_grid_bulge      );
     hd_grid_bbox         .device_array().bind_tex( tex_grid_bbox       );
 }
 
@@ -139,7 +159,8 @@ void unbind()
     CUDA_SAFE_CALL( cudaUnbindTexture(&tex_bulge_strength)   );
     CUDA_SAFE_CALL( cudaUnbindTexture(&tex_offset)           );
     CUDA_SAFE_CALL( cudaUnbindTexture(&tex_grid)             );
-    CUDA_SAFE_CALL( cudaUnbindTexture(&tex_grid_list)        );
+    CUDA_SAFE_CALL( cudaUnbindTexture(&tex_grid_programs)    );
+    CUDA_SAFE_CALL( cudaUnbindTexture(&tex_grid_bulge)       );
     CUDA_SAFE_CALL( cudaUnbindTexture(&tex_grid_bbox)        );
 }
 
@@ -147,164 +168,338 @@ void unbind()
 
 // =============================================================================
 
-/// @param env : SkeletonEnv
-/// @param cell_id : linear index of the 3d cell we want to extract the blending
-/// list
-/// @param blist : described the sub-skeleton in the
-int cell_to_blending_list(SkeletonEnv *env,
-                           int cell_id,
-                           std::vector< std::vector<Cluster> * >& blist,
-                           std::vector<std::vector<Cluster> > &blists)
-{
-    // Note: if in each cell the list of bones is order from root to leaf
-    // then blending list will be also ordered root to leaf
-    const Grid*    grid = env->h_grid;
-    const Tree_cu* tree = env->h_tree_cu_instance;
-    const std::vector<Bone::Id> &bones_in_cell = grid->_grid_cells[cell_id];
+/// Number of elements reserved for a slice of 'size' elements
+static int with_room(int size)
+{
+    return size + std::max(size / 2, 8);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Copy to the device the elements 'idx' of 'arr', contiguous elements are
+/// copied at once
+template<class HD_arr>
+static void update_device_mem(HD_arr& arr, const std::set<int>& idx)
+{
+    for(auto it = idx.begin(); it != idx.end(); )
+    {
+        const int start = *it;
+        int end = start + 1;
+        for(++it; it != idx.end() && *it == end; ++it)
+            end++;
+        arr.update_device_mem(start, end - start);
+    }
+}
 
-    std::vector<bool> cluster_done(tree->_clusters.size(), false);
+// -----------------------------------------------------------------------------
+
+/// Bbox of every bone of the instance, to know which cells an edit
+/// overlapped once the bone is changed (see update_bones_data())
+static void cache_bboxes(SkeletonEnv *env)
+{
+    env->bone_bbox.clear();
+    for(const auto& it: env->h_tree->parents())
+        env->bone_bbox[it.first] = env->h_tree->bone( it.first )->get_bbox();
+}
 
-    int total_size = 0;
+// -----------------------------------------------------------------------------
+
+/// Clusters of the bones of a cell, in the order of the bones (root to leaves)
+static void cell_clusters(const Tree_cu* tree,
+                          const std::vector<Bone::Id>& bones_in_cell,
+                          std::vector<Cluster_id>& clusters)
+{
     for(Bone::Id bone_id: bones_in_cell)
     {
-        DBone_id dbone = tree->hidx_to_didx(bone_id);
+        const Cluster_id clus_id = tree->bone_to_cluster( tree->hidx_to_didx(bone_id) );
+        if( std::find(clusters.begin(), clusters.end(), clus_id) == clusters.end() )
+            clusters.push_back( clus_id );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Compile the blending list of a cell into a program appended to 'prog'
+/// @param clusters : clusters of the cell (see cell_clusters())
+/// @param off_bone : offset of the skeleton's bones in the concatenated bones
+/// @param bulge : bulge strength of each instruction appended to 'prog'
+/// @return offset of the program in 'prog'
+static int compile_cell_program(const Tree_cu* tree,
+                                const std::vector<Cluster_id>& clusters,
+                                int off_bone,
+                                std::vector<Blend_instr>& prog,
+                                std::vector<float>& bulge)
+{
+    // Flatten the cell's blending list, clusters are blended by pairs.
+    std::vector<const Cluster*> list;
+    for(Cluster_id cid: clusters)
+    {
+        list.push_back( &tree->_blending_list[cid.id()*2 + 0] );
+        list.push_back( &tree->_blending_list[cid.id()*2 + 1] );
+    }
 
-        Cluster_id clus_id = tree->bone_to_cluster( dbone );
-        if( cluster_done[clus_id.id()] ) continue;
-        cluster_done[clus_id.id()] = true;
+    const int header = (int)prog.size();
+    prog.push_back( Blend_instr() );
+    bulge.push_back( 0.f );
+
+    int nb_instr = 0;
+    for(unsigned i = 0; i + 1 < list.size(); i += 2)
+    {
+        const Cluster* a = list[i    ];
+        const Cluster* b = list[i + 1];
+
+        // The pair is blended with the operator of its second cluster.
+        const EJoint::Joint_t type = b->datas._blend_type;
+        const Blending_env::Ctrl_id ctrl = b->datas._ctrl_id;
+
+        // Empty clusters are dropped, a pair with a single cluster is not blended.
+        if(a->nb_bone == 0) std::swap(a, b);
+        if(a->nb_bone == 0) continue;
+
+        assert(a->nb_bone < 256 && b->nb_bone < 256);
+        Blend_instr instr;
+        instr.first_bone_a = a->first_bone.id() + off_bone;
+        instr.first_bone_b = b->nb_bone > 0 ? b->first_bone.id() + off_bone : -1;
+        instr.sizes_type   = Blend_instr::pack(a->nb_bone, b->nb_bone, type);
+        instr.ctrl_id      = ctrl;
+        prog.push_back( instr );
+        bulge.push_back( b->datas._bulge_strength );
+        nb_instr++;
+    }
+
+    prog[header].first_bone_a = nb_instr;
+    return header;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Compile the programs of the octree nodes 'nodes' of an instance and encode
+/// the nodes (see hd_grid). Leaves with the same list share their program.
+/// @param vals : code of each node, program offsets are relative to the start
+/// of 'prog'
+static void compile_nodes(const SkeletonEnv *env,
+                          const std::vector<int>& nodes,
+                          std::vector<Blend_instr>& prog,
+                          std::vector<float>& bulge,
+                          std::vector<int>& vals)
+{
+    const Grid*    grid = env->h_grid;
+    const Tree_cu* tree = env->h_tree_cu_instance;
 
-        std::vector<Cluster> &cluster = blists[clus_id.id()];
+    std::map<std::vector<Cluster_id>, int> programs;
+    std::vector<Cluster_id> clusters;
+    vals.resize( nodes.size() );
+    for(unsigned i = 0; i < nodes.size(); ++i)
+    {
+        const Grid::Node& node = grid->_nodes[nodes[i]];
+        int val = -1;
+        if(node.first_child != -1)
+            val = -(node.first_child + 2);
+        else if(node.cell != -1)
+        {
+            clusters.clear();
+            cell_clusters(tree, grid->_grid_cells[node.cell], clusters);
 
-        total_size += cluster.size();
-        blist.push_back(&cluster);
+            auto it = programs.find(clusters);
+            if(it == programs.end())
+                it = programs.insert( std::make_pair(clusters, compile_cell_program(tree, clusters, env->bones.off, prog, bulge)) ).first;
+            val = it->second;
+        }
+        vals[i] = val;
     }
-    return total_size;
 }
 
 // -----------------------------------------------------------------------------
 
-/// Fill device array : hd_grid_blending_list; hd_offset (only grid_data field);
-/// hd_grid; hd_grid_data
-// XXX: This is fairly expensive, and we're updating every grid and not just the
-// one that was requested.  This is hard to fix right now, since all of the data
-// is put in the same array to allow putting it into a texture.  This doesn't really
-// need to be in a texture, and once that's changed this will be easier to fix.
+/// Nodes of the octree reachable from its root, unused nodes left by
+/// Grid::update_region() are skipped
+static void grid_nodes(const Grid* grid, int node_id, std::vector<int>& nodes)
+{
+    nodes.push_back( node_id );
+    const int first = grid->_nodes[node_id].first_child;
+    if( first != -1 )
+        for(int i = 0; i < 8; ++i)
+            grid_nodes(grid, first + i, nodes);
+}
 
-// This is only a temporary in update_device_grid.  Allocating this is a bit expensive
-// and this is a hot code path, so keep it around and reuse the allocation.  We aren't
-// reentrant, and we won't be called from multiple threads, so this is safe.
-static std::vector< std::vector< std::vector<Cluster> * > > blist_per_cell;
+// -----------------------------------------------------------------------------
 
+static void set_device_grid_bbox(Skel_id id)
+{
+    const Grid* grid = h_envs[id]->h_grid;
+    BBox_cu bb = grid->bbox();
+    hd_grid_bbox[id*2 + 0] = bb.pmin.to_float4();
+    hd_grid_bbox[id*2 + 1] = bb.pmax.to_float4();
+    hd_grid_bbox[id*2 + 0].w = (float)grid->res();
+}
+
+// -----------------------------------------------------------------------------
+
+/// Fill device array : hd_grid_programs; hd_offset (only grid_data field);
+/// hd_grid; hd_grid_bbox
+/// Each octree node is encoded with a single int in hd_grid (see hd_grid doc).
+/// The blending list of each leaf is compiled into a program, leaves with the
+/// same list share the same program.
+/// Every grid gets slices of hd_grid and hd_grid_programs with some room, so
+/// that update_instance_grid() rewrites them in place.
 static void update_device_grid()
 {
-#if 1
     assert( !binded );
-    hd_grid.fill( -1 );
 
-    // Look up every grids and compute the cells blending list.
-    // update offset to access blending list as well
-    int offset = 0;
-    int grid_offset = 0;
-    int off_bone = 0;
+    std::vector< std::vector<Blend_instr> > programs( h_envs.size() );
+    std::vector< std::vector<float> > bulges( h_envs.size() );
+    std::vector< std::vector<int> > nodes( h_envs.size() );
+    std::vector< std::vector<int> > vals( h_envs.size() );
 
+    int nb_nodes = 0;
+    int nb_instr = 0;
     for(unsigned grid_id = 0; grid_id < h_envs.size(); ++grid_id)
     {
         if(h_envs[grid_id] == NULL)
             continue;
 
         SkeletonEnv *env = h_envs[grid_id];
-        const Grid* grid = env->h_grid;
-        const Tree_cu *tree = env->h_tree_cu_instance;
-
-        // Cache cluster IDs to blending lists.
-        std::vector<std::vector<Cluster> > blist_cache;
-
-        Cluster_id clus_id(0);
-        for(Cluster c: tree->_clusters) {
-            std::vector<Cluster> cluster;
-            tree->add_cluster(clus_id, cluster);
-            blist_cache.push_back(cluster);
-            clus_id += 1;
-        }
+        grid_nodes(env->h_grid, 0, nodes[grid_id]);
+        compile_nodes(env, nodes[grid_id], programs[grid_id], bulges[grid_id], vals[grid_id]);
+
+        env->nodes.off  = nb_nodes;
+        env->nodes.size = (int)env->h_grid->_nodes.size();
+        env->nodes.cap  = with_room( env->nodes.size );
+        env->progs.off  = nb_instr;
+        env->progs.size = (int)programs[grid_id].size();
+        env->progs.cap  = with_room( env->progs.size );
+        nb_nodes += env->nodes.cap;
+        nb_instr += env->progs.cap;
+    }
 
-        // Get the blending list for each cell, and the total number of resulting clusters.
-        // Each element of blist_per_cell is a list of blending lists, pointing into blist_cache.
-        // The list is concatenated down below.
-        //
-        // The grid has res^3 cells.  We'll only process cells that actually have surfaces affecting them,
-        // but preallocate the maximum for efficiency.
-        if(blist_per_cell.size() < grid->_filled_cells.size())
-            blist_per_cell.resize(grid->_filled_cells.size());
-
-        int total_size = 0;
-        for(int cell_idx = 0; cell_idx < grid->_filled_cells.size(); ++cell_idx) {
-            std::vector< std::vector<Cluster> * > &blists_list = blist_per_cell[cell_idx];
-            // XXX: It's important that we only clear the list and don't deallocate it, so we don't
-            // reallocate hundreds of these every frame.  This is what clear() does in MSVC.  What about
-            // gnuc++?
-            blists_list.clear();
-
-            if(!grid->_filled_cells[cell_idx])
-                continue;
-
-            // The number of clusters that the blending list can possibly have is the number of bones.
-            // Preallocate that amount, so we don't have to reallocate.
-            blists_list.reserve(grid->_grid_cells[cell_idx].size());
-
-            total_size += cell_to_blending_list(env, cell_idx, blists_list, blist_cache);
-        }
+    hd_grid.         realloc( nb_nodes );
+    hd_grid_programs.realloc( nb_instr );
+    hd_grid_bulge.   realloc( nb_instr );
+    for(unsigned grid_id = 0; grid_id < h_envs.size(); ++grid_id)
+    {
+        if(h_envs[grid_id] == NULL)
+            continue;
 
-        // Allocate space for these clusters.
-        hd_grid_blending_list.realloc(offset + total_size);
-        hd_grid_data.realloc(offset + total_size);
-
-        // Iterate over _filled_cells again, copying the results to hd_grid_blending_list and hd_grid_data.
-        for(int cell_idx = 0; cell_idx < grid->_filled_cells.size(); ++cell_idx) {
-            if(!grid->_filled_cells[cell_idx])
-                continue;
-
-            const std::vector< std::vector<Cluster> *> &blists_list = blist_per_cell[cell_idx];
-
-            hd_grid[grid_offset + cell_idx] = offset;
-
-            int first_offset = offset;
-            int total_size = 0;
-            for(const std::vector<Cluster> *blists: blists_list) {
-                for(const Cluster &c: *blists) {
-                    // Convert cluster to cluster_cu and offset bones id to match the concateneted representation
-                    hd_grid_blending_list[offset] = c;
-                    hd_grid_blending_list[offset].first_bone += off_bone;
-                    hd_grid_data         [offset]._bulge_strength = c.datas._bulge_strength;
-                    offset++;
-                    total_size++;
-                }
-            }
-
-            // Store the total number of bones (divided by two) in the first item's blend_type.  If first_offset and offset
-            // are the same then there were no clusters at all, so don't do anything.
-            if(first_offset != offset)
-                hd_grid_blending_list[first_offset].blend_type = (EJoint::Joint_t) (total_size/2);
-        }
+        const SkeletonEnv *env = h_envs[grid_id];
+        for(int n = 0; n < env->nodes.cap; ++n)
+            hd_grid[env->nodes.off + n] = -1;
 
-        hd_offset[grid_id].grid_data = grid_offset;
-        const int res = grid->res();
-        grid_offset += res*res*res;
+        for(unsigned n = 0; n < nodes[grid_id].size(); ++n)
+        {
+            const int val = vals[grid_id][n];
+            hd_grid[env->nodes.off + nodes[grid_id][n]] = val >= 0 ? val + env->progs.off : val;
+        }
 
-        // Update grid bbox and resolution
-        BBox_cu bb = grid->bbox();
-        hd_grid_bbox[grid_id*2 + 0] = bb.pmin.to_float4();
-        hd_grid_bbox[grid_id*2 + 1] = bb.pmax.to_float4();
-        hd_grid_bbox[grid_id*2 + 0].w = (float)res;
+        for(int i = 0; i < env->progs.cap; ++i)
+        {
+            const bool used = i < env->progs.size;
+            hd_grid_programs[env->progs.off + i] = used ? programs[grid_id][i] : Blend_instr();
+            hd_grid_bulge   [env->progs.off + i] = used ? bulges  [grid_id][i] : 0.f;
+        }
 
-        off_bone += tree->_bone_aranged.size();
+        hd_offset[grid_id].grid_data = env->nodes.off;
+        set_device_grid_bbox( grid_id );
     }
 
     hd_offset.update_device_mem(); // This is also done in update_device_tree maybe we can factorize
     hd_grid.update_device_mem();
-    hd_grid_blending_list.update_device_mem();
-    hd_grid_data.update_device_mem();
+    hd_grid_programs.update_device_mem();
+    hd_grid_bulge.update_device_mem();
     hd_grid_bbox.update_device_mem();
-#endif
+}
+
+// -----------------------------------------------------------------------------
+
+/// Rewrite the grid of the instance 'id' where it changed: cells overlapping
+/// 'regions' (bboxes of edited bones, before and after) are rebuilt and
+/// leaves holding a bone of 'clusters' get a new program. Only those nodes of
+/// hd_grid are written, their programs are appended after the instance's
+/// programs in hd_grid_programs.
+/// @param rebuild : rebuild and rewrite the whole grid of the instance
+/// @return false if the instance's slices are too small, the device arrays
+/// must then be laid out again (see relayout())
+static bool update_instance_grid(Skel_id id,
+                                 const std::vector<BBox_cu>& regions,
+                                 const std::set<Cluster_id>& clusters,
+                                 bool rebuild = false)
+{
+    SkeletonEnv *env = h_envs[id];
+    Grid* grid = env->h_grid;
+    const Tree_cu* tree = env->h_tree_cu_instance;
+
+    std::vector<int> nodes;
+    if( !rebuild && regions.size() > 0 )
+        rebuild = !grid->update_region(regions, nodes);
+    else if( rebuild )
+        grid->build_grid();
+
+    if( rebuild )
+    {
+        // Every cell moved with the bbox of the skeleton
+        cache_bboxes( env );
+        grid_nodes(grid, 0, nodes);
+
+        // Previous programs are not referenced anymore
+        env->progs.size = 0;
+        set_device_grid_bbox( id );
+        hd_grid_bbox.update_device_mem(id*2, 2);
+    }
+    else
+    {
+        for(Cluster_id cid: clusters)
+        {
+            const Cluster& cl = tree->_clusters[cid.id()];
+            for(int i = 0; i < cl.nb_bone; ++i)
+                grid->leaves_overlapping(tree->_bone_aranged[(cl.first_bone + i).id()]->get_bbox(), nodes);
+        }
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    }
+
+    if( (int)grid->_nodes.size() > env->nodes.cap )
+        return false;
+
+    std::vector<Blend_instr> prog;
+    std::vector<float> bulge;
+    std::vector<int> vals;
+    compile_nodes(env, nodes, prog, bulge, vals);
+    if( env->progs.size + (int)prog.size() > env->progs.cap )
+        return false;
+
+    const int base = env->progs.off + env->progs.size;
+    for(unsigned i = 0; i < prog.size(); ++i)
+    {
+        hd_grid_programs[base + i] = prog [i];
+        hd_grid_bulge   [base + i] = bulge[i];
+    }
+    if( prog.size() > 0 )
+    {
+        hd_grid_programs.update_device_mem(base, (int)prog.size());
+        hd_grid_bulge.   update_device_mem(base, (int)prog.size());
+    }
+    env->progs.size += (int)prog.size();
+
+    std::set<int> written;
+    for(unsigned i = 0; i < nodes.size(); ++i)
+    {
+        const int n = env->nodes.off + nodes[i];
+        hd_grid[n] = vals[i] >= 0 ? vals[i] + base : vals[i];
+        written.insert( n );
+    }
+    env->nodes.size = (int)grid->_nodes.size();
+    update_device_mem(hd_grid, written);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Set the bone 'i' of hd_bone_arrays, unused slots ('b' == NULL) get an
+/// empty bone
+static void set_device_bone(int i, const Bone* b)
+{
+    hd_bone_arrays->hd_bone_hrbf       [i] = b != NULL ? b->get_hrbf()      : HermiteRBF();
+    hd_bone_arrays->hd_bone_precomputed[i] = b != NULL ? b->get_primitive() : Precomputed_prim();
+    hd_bone_arrays->hd_bone_types      [i] = b != NULL ? b->get_type()      : EBone::SSD;
 }
 
 // -----------------------------------------------------------------------------
@@ -322,21 +517,74 @@ static void fill_separated_bone_types(const std::vector<const Bone*>& generic_bo
     // For each bone, store the type, and the bone's HRBF and primitive ID.  We can store
     // the IDs even if the bone is in a different mode.
     for(int i = 0; i < nb_bones; i++)
-    {
-        const Bone* b = generic_bones[i];
-        hd_bone_arrays->hd_bone_hrbf[i] = b->get_hrbf();
-        hd_bone_arrays->hd_bone_precomputed[i] = b->get_primitive();
-        hd_bone_arrays->hd_bone_types[i] = b->get_type();
-    }
+        set_device_bone(i, generic_bones[i]);
+
     // Upload every arrays to GPU
     hd_bone_arrays->update_device_mem();
 }
 
 // -----------------------------------------------------------------------------
 
+/// Write the bone slots 'slots' of the instance 'id' in hd_bone_arrays and
+/// update the maps between host and device bone indices.
+/// @return false if the instance's slice is too small (see relayout())
+static bool update_device_bones(Skel_id id, const std::set<DBone_id>& slots)
+{
+    SkeletonEnv *env = h_envs[id];
+    const Tree_cu* tree = env->h_tree_cu_instance;
+    if( (int)tree->_bone_aranged.size() > env->bones.cap )
+        return false;
+    env->bones.size = (int)tree->_bone_aranged.size();
+
+    std::set<int> written;
+    for(DBone_id slot: slots)
+    {
+        const DBone_id didx = slot + env->bones.off;
+
+        // Forget the bone previously in the slot, unless it moved first
+        auto it = _didx_to_hidx.find( didx );
+        if( it != _didx_to_hidx.end() )
+        {
+            auto h = _hidx_to_didx.find( it->second );
+            if( h != _hidx_to_didx.end() && h->second == didx )
+                _hidx_to_didx.erase( h );
+            _didx_to_hidx.erase( it );
+        }
+
+        const Bone* bone = tree->_bone_aranged[slot.id()];
+        if( bone != NULL )
+        {
+            Hbone_id hidx(id, bone->get_bone_id());
+            _hidx_to_didx[ hidx ] = didx;
+            _didx_to_hidx[ didx ] = hidx;
+        }
+
+        set_device_bone(didx.id(), bone);
+        written.insert( didx.id() );
+    }
+
+    update_device_mem(*hd_bone_arrays, written);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Set the element 'i' of hd_blending_list and hd_cluster_data
+static void set_device_cluster(int i, Cluster c, int off_bone)
+{
+    c.first_bone += off_bone;
+    // Convert in device representation
+    hd_blending_list[i] = Cluster_cu( c );
+    hd_cluster_data [i]._bulge_strength = c.datas._bulge_strength;
+}
+
+// -----------------------------------------------------------------------------
 
 /// Fill device array : hd_blending_list; hd_offset (only list_data field);
 /// h_generic_bones; _hidx_to_didx; _didx_to_hidx;
+/// Every instance gets slices of the bones and of the blending list with some
+/// room, so that update_device_bones() and update_device_clusters() rewrite
+/// them in place. 'h_generic_bones' is NULL for unused bones.
 static void update_device_tree(std::vector<const Bone*> &h_generic_bones)
 {
     assert( !binded );
@@ -350,9 +598,13 @@ static void update_device_tree(std::vector<const Bone*> &h_generic_bones)
             continue;
 
         // Convert tree to GPU layout
-        delete h_envs[i]->h_tree_cu_instance;
-        h_envs[i]->h_tree_cu_instance = new Tree_cu( h_envs[i]->h_tree );
-        s_blend_list += h_envs[i]->h_tree_cu_instance->_blending_list.size();
+        SkeletonEnv *env = h_envs[i];
+        delete env->h_tree_cu_instance;
+        env->h_tree_cu_instance = new Tree_cu( env->h_tree );
+        env->blist.off  = s_blend_list;
+        env->blist.size = env->h_tree_cu_instance->_blending_list.size();
+        env->blist.cap  = with_room( env->blist.size / 2 ) * 2;
+        s_blend_list += env->blist.cap;
     }
 
     // Now we can allocate memory
@@ -368,19 +620,26 @@ static void update_device_tree(std::vector<const Bone*> &h_generic_bones)
     // Note that the bone identifiers in the new blending list must
     // be changed to match the list of concatenated bones
 
+    Cluster empty;
+    empty.nb_bone = 0;
+
     int off_bone  = 0; // Offset to store bones in h_bone_device
-    int off_blist = 0; // Offset to store blending list in
     for(unsigned t = 0; t < h_envs.size(); ++t)
     {
         if(h_envs[t] == NULL)
             continue;
 
-        const Tree_cu* tree_cu = h_envs[t]->h_tree_cu_instance;
+        SkeletonEnv *env = h_envs[t];
+        const Tree_cu* tree_cu = env->h_tree_cu_instance;
+        env->bones.off  = off_bone;
+        env->bones.size = tree_cu->_bone_aranged.size();
+        env->bones.cap  = with_room( env->bones.size );
+        h_generic_bones.resize( off_bone + env->bones.cap, NULL );
 
         for(unsigned i = 0; i < tree_cu->_bone_aranged.size(); ++i){
             DBone_id new_didx = DBone_id(i) + off_bone;
             Hbone_id hidx(t, tree_cu->get_id_bone_aranged( i ) );
-            h_generic_bones.push_back(tree_cu->_bone_aranged[i]);
+            h_generic_bones[new_didx.id()] = tree_cu->_bone_aranged[i];
             // Build correspondance between device/host index for the
             // concatenated bones
             _hidx_to_didx[ hidx     ] = new_didx;
@@ -388,31 +647,65 @@ static void update_device_tree(std::vector<const Bone*> &h_generic_bones)
         }
 
         // Concatenate blending list and update bone index accordingly
-        auto it = tree_cu->_blending_list.begin();
-        for(int i = 0; it != tree_cu->_blending_list.end(); ++it, ++i)
+        const int off_blist = env->blist.off;
+        for(int i = 0; i < env->blist.cap; ++i)
         {
-            Cluster c = *it;
-            c.first_bone += off_bone;
-            // Convert in device representation
-            Cluster_cu new_c( c );
-            hd_blending_list[off_blist + i] = new_c;
-            hd_cluster_data [off_blist + i]._bulge_strength = c.datas._bulge_strength;
+            if(i < env->blist.size)
+                set_device_cluster(off_blist + i, tree_cu->_blending_list[i], off_bone);
+            else
+                set_device_cluster(off_blist + i, empty, 0);
         }
         // We store nb_pairs in the first element of the list
-        assert(tree_cu->_blending_list.size() > 0); // unless we have no elements
-        hd_blending_list[off_blist].nb_pairs      = tree_cu->_blending_list.size()/2;
+        assert(env->blist.size > 0); // unless we have no elements
+        hd_blending_list[off_blist].nb_pairs = env->blist.size/2;
 
         hd_offset[t].list_data = off_blist;
 
-        off_blist += tree_cu->_blending_list.size();
-        off_bone  += tree_cu->_bone_aranged.size();
+        off_bone += env->bones.cap;
     }
 
     // Upload to GPU
     hd_offset.update_device_mem();
     hd_blending_list.update_device_mem();
     hd_cluster_data. update_device_mem();
-    assert( off_blist == s_blend_list );
+}
+
+// -----------------------------------------------------------------------------
+
+/// Write the elements of the clusters 'clusters' of the instance 'id' in
+/// hd_blending_list and hd_cluster_data.
+/// @return false if the instance's slice is too small (see relayout())
+static bool update_device_clusters(Skel_id id, const std::set<Cluster_id>& clusters)
+{
+    SkeletonEnv *env = h_envs[id];
+    const Tree_cu* tree = env->h_tree_cu_instance;
+    const int size = (int)tree->_blending_list.size();
+    if( size > env->blist.cap )
+        return false;
+
+    const bool nb_pairs_changed = size != env->blist.size;
+    env->blist.size = size;
+
+    std::set<int> written;
+    for(Cluster_id cid: clusters)
+    {
+        for(int i = cid.id()*2; i < cid.id()*2 + 2; ++i)
+        {
+            set_device_cluster(env->blist.off + i, tree->_blending_list[i], env->bones.off);
+            written.insert( env->blist.off + i );
+        }
+    }
+
+    // We store nb_pairs in the first element of the list
+    if( nb_pairs_changed || written.find( env->blist.off ) != written.end() )
+    {
+        hd_blending_list[env->blist.off].nb_pairs = size/2;
+        written.insert( env->blist.off );
+    }
+
+    update_device_mem(hd_blending_list, written);
+    update_device_mem(hd_cluster_data , written);
+    return true;
 }
 
 // -----------------------------------------------------------------------------
@@ -434,6 +727,17 @@ void update_device()
 
 // -----------------------------------------------------------------------------
 
+/// Lay out every instance again, when an edit of the instance 'id' does not
+/// fit in its slices. The grid of 'id' is rebuilt to drop its unused nodes.
+static void relayout(Skel_id id)
+{
+    h_envs[id]->h_grid->build_grid();
+    cache_bboxes( h_envs[id] );
+    update_device();
+}
+
+// -----------------------------------------------------------------------------
+
 void clean_env()
 {
     unbind();
@@ -446,10 +750,10 @@ void clean_env()
     _hidx_to_didx.clear();
     hd_offset.erase();
     hd_offset.update_device_mem();
-    hd_grid_blending_list.erase();
-    hd_grid_blending_list.update_device_mem();
-    hd_grid_data.erase();
-    hd_grid_data.update_device_mem();
+    hd_grid_programs.erase();
+    hd_grid_programs.update_device_mem();
+    hd_grid_bulge.erase();
+    hd_grid_bulge.update_device_mem();
     hd_grid.erase();
     hd_grid.update_device_mem();
     hd_grid_bbox.erase();
@@ -465,19 +769,46 @@ void clean_env()
 
 // -----------------------------------------------------------------------------
 
+void memory_report(Memory_report& rep)
+{
+    const char* sub = "Skeleton_env";
+    add_to_report(rep, sub, "hd_blending_list"     , hd_blending_list     );
+    add_to_report(rep, sub, "hd_cluster_data"      , hd_cluster_data      );
+    add_to_report(rep, sub, "hd_grid_programs"     , hd_grid_programs     );
+    add_to_report(rep, sub, "hd_grid_bulge"        , hd_grid_bulge        );
+    add_to_report(rep, sub, "hd_grid"              , hd_grid              );
+    add_to_report(rep, sub, "hd_grid_bbox"         , hd_grid_bbox         );
+    add_to_report(rep, sub, "hd_offset"            , hd_offset            );
+    if(hd_bone_arrays != 0)
+    {
+        add_to_report(rep, sub, "hd_bone_types"      , hd_bone_arrays->hd_bone_types      );
+        add_to_report(rep, sub, "hd_bone_hrbf"       , hd_bone_arrays->hd_bone_hrbf       );
+        add_to_report(rep, sub, "hd_bone_precomputed", hd_bone_arrays->hd_bone_precomputed);
+    }
+
+    // Host side acceleration grids (list of bones per cell)
+    for(unsigned i = 0; i < h_envs.size(); ++i)
+    {
+        if(h_envs[i] == NULL || h_envs[i]->h_grid == NULL)
+            continue;
+        const Grid* grid = h_envs[i]->h_grid;
+        size_t size = grid->_grid_cells.capacity() * sizeof(std::vector<Bone::Id>);
+        for(unsigned c = 0; c < grid->_grid_cells.size(); ++c)
+            size += grid->_grid_cells[c].capacity() * sizeof(Bone::Id);
+        size += grid->_nodes.capacity() * sizeof(Grid::Node);
+        rep.add(sub, "h_grid", size, Memory_report::HOST);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 void alloc_hd_grid()
 {
     assert( binded );
     unbind();
 
-    int total_size = 0;
-    for(unsigned i = 0; i < h_envs.size(); ++i){
-        if(h_envs[i] == NULL)
-            continue;
-        const int res = h_envs[i]->h_grid->res();
-        total_size += res*res*res;
-    }
-    hd_grid.malloc(total_size, -1);
+    // hd_grid depends on the octrees' subdivision, it is sized in
+    // update_device_grid()
     hd_grid_bbox.malloc( h_envs.size() * 2 ); // Two points for a bbox
 
     bind();
@@ -497,6 +828,23 @@ void init_env()
 
 // -----------------------------------------------------------------------------
 
+/// Load the Blending_env tables of the operators selected by 'joints'
+/// (see fetch_binop_and_blend())
+static void require_blending_operators(const std::map<Bone::Id, Joint_data>& joints)
+{
+    for(std::map<Bone::Id, Joint_data>::const_iterator it = joints.begin(); it != joints.end(); ++it)
+    {
+        switch(it->second._blend_type){
+        case EJoint::GC_ARC_CIRCLE_TWEAK: Blending_env::require_predefined_operator(Blending_env::C_D); break;
+        case EJoint::BULGE:               Blending_env::require_predefined_operator(Blending_env::B_D); break;
+        case EJoint::BULGE_4D:            Blending_env::require_family(Blending_env::FAMILY_4D_BULGE); break;
+        default: break; // MAX needs no table, custom operators are loaded by their owner
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 Skel_id new_skel_instance(const std::vector<const Bone*>& bones,
                           const std::map<Bone::Id, Bone::Id>& parents,
                           int grid_res)
@@ -505,6 +853,7 @@ Skel_id new_skel_instance(const std::vector<const Bone*>& bones,
     env->h_tree = new Tree(bones, parents);
     env->h_grid = new Grid(env->h_tree, grid_res);
     env->h_grid->build_grid();
+    cache_bboxes( env );
 
     // Find an empty slot.
     int id;
@@ -542,19 +891,146 @@ void delete_skel_instance(Skel_id skel_id)
 
 // -----------------------------------------------------------------------------
 
-void update_bones_data(Skel_id i)
+/// Bones of 'tree' whose joint data differ from 'joints'
+static void changed_joints(const Tree* tree,
+                           const std::map<Bone::Id, Joint_data>& joints,
+                           std::vector<Bone::Id>& changed)
 {
-    h_envs[i]->h_grid->build_grid();
-    update_device();
+    for(const auto& it: joints)
+    {
+        if( !tree->has_bone( it.first ) )
+            continue;
+
+        const Joint_data& d = tree->data( it.first );
+        if( d._blend_type     != it.second._blend_type ||
+            d._ctrl_id        != it.second._ctrl_id    ||
+            d._bulge_strength != it.second._bulge_strength )
+        {
+            changed.push_back( it.first );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void update_skel_instance(Skel_id i,
+                          const std::vector<const Bone*>& bones,
+                          const std::map<Bone::Id, Bone::Id>& parents,
+                          const std::map<Bone::Id, Joint_data>& joints)
+{
+    assert(i < h_envs.size());
+    assert(i >= 0);
+    SkeletonEnv *env = h_envs[i];
+    Tree_cu *tree_cu = env->h_tree_cu_instance;
+
+    require_blending_operators( joints );
+    Tree *tree = new Tree(bones, parents);
+    tree->set_joints_data( joints );
+
+    std::vector<Bone::Id> joints_changed;
+    changed_joints(env->h_tree, joints, joints_changed);
+
+    // Move the bones whose sibling group changed, other bones keep their slot
+    std::vector<Bone::Id> removed;
+    std::set<Cluster_id> clusters;
+    std::set<DBone_id> slots;
+    tree_cu->update(tree, removed, clusters, slots);
+    for(Bone::Id bid: joints_changed)
+        tree_cu->update_joint(bid, clusters);
+
+    // Cells overlapping removed, added or replaced bones are rebuilt.
+    // Removed bones may be deleted already, their cached bbox is used.
+    std::vector<BBox_cu> regions;
+    for(Bone::Id bid: removed)
+    {
+        auto it = env->bone_bbox.find( bid );
+        if( it == env->bone_bbox.end() )
+            continue;
+        regions.push_back( it->second );
+        env->bone_bbox.erase( it );
+    }
+
+    for(const Bone* bone: bones)
+    {
+        const Bone::Id bid = bone->get_bone_id();
+        if( env->h_tree->has_bone( bid ) && env->h_tree->bone( bid ) == bone )
+            continue;
+
+        auto it = env->bone_bbox.find( bid );
+        if( it != env->bone_bbox.end() )
+            regions.push_back( it->second );
+
+        const BBox_cu bb = bone->get_bbox();
+        regions.push_back( bb );
+        env->bone_bbox[bid] = bb;
+    }
+
+    env->h_grid->set_tree( tree );
+    delete env->h_tree;
+    env->h_tree = tree;
+
+    if( !update_device_bones   (i, slots   ) ||
+        !update_device_clusters(i, clusters) ||
+        !update_instance_grid  (i, regions, clusters) )
+    {
+        relayout( i );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void update_bones_data(Skel_id i, const std::vector<Bone::Id>& bones)
+{
+    SkeletonEnv *env = h_envs[i];
+    const Tree_cu *tree_cu = env->h_tree_cu_instance;
+
+    // Cells overlapping the bones before and after the change are rebuilt
+    std::set<DBone_id> slots;
+    std::vector<BBox_cu> regions;
+    for(Bone::Id bid: bones)
+    {
+        slots.insert( tree_cu->hidx_to_didx( bid ) );
+
+        auto it = env->bone_bbox.find( bid );
+        if( it != env->bone_bbox.end() )
+            regions.push_back( it->second );
+
+        const BBox_cu bb = env->h_tree->bone( bid )->get_bbox();
+        regions.push_back( bb );
+        env->bone_bbox[bid] = bb;
+    }
+
+    // When most bones changed the whole grid is cheaper to rebuild
+    const bool rebuild = bones.size() * 2 > env->bone_bbox.size();
+    if( !update_device_bones (i, slots) ||
+        !update_instance_grid(i, regions, std::set<Cluster_id>(), rebuild) )
+    {
+        relayout( i );
+    }
 }
 
 // -----------------------------------------------------------------------------
 
 void update_joints_data(Skel_id i, const std::map<Bone::Id, Joint_data>& joints)
 {
-    h_envs[i]->h_tree->set_joints_data( joints );
-    h_envs[i]->h_grid->build_grid();
-    update_device();
+    require_blending_operators( joints );
+
+    SkeletonEnv *env = h_envs[i];
+    std::vector<Bone::Id> joints_changed;
+    changed_joints(env->h_tree, joints, joints_changed);
+    env->h_tree->set_joints_data( joints );
+
+    // Only the blending of the clusters below the joints changed, the cells
+    // holding them get a new program
+    std::set<Cluster_id> clusters;
+    for(Bone::Id bid: joints_changed)
+        env->h_tree_cu_instance->update_joint(bid, clusters);
+
+    if( !update_device_clusters(i, clusters) ||
+        !update_instance_grid  (i, std::vector<BBox_cu>(), clusters) )
+    {
+        relayout( i );
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -563,6 +1039,7 @@ void set_grid_res(Skel_id i, int res)
 {
     assert( res > 0);
     h_envs[i]->h_grid->set_res( res );
+    cache_bboxes( h_envs[i] );
     alloc_hd_grid();
     update_device();
 }
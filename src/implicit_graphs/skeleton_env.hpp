@@ -48,12 +48,21 @@ extern Cuda_utils::HD_Array<Cluster_cu> hd_blending_list;
 /// Concatenated datas os the blending list
 extern Cuda_utils::HD_Array<Cluster_data> hd_cluster_data;
 
-/// Concatenated blendind list for every skeletons in each grid cell.
-/// Each cell store a single blending list. Cells are linearly arranged in
-/// memory as well as the blending list.
-extern Cuda_utils::HD_Array<Cluster_cu> hd_grid_blending_list;
-
-/// hd_grid[ hd_offset[Skel_id].grid_data + cell_idx] == offset in hd_grid_blending_list or -1 if empty cell
+/// Concatenated programs of every skeletons' grid cells.
+/// Each grid cell blending list is compiled into a program (a header followed
+/// by Blend_instr), cells with the same list share the same program.
+/// @see Blend_instr
+extern Cuda_utils::HD_Array<Blend_instr> hd_grid_programs;
+
+/// Bulge strength of the joint of each instruction of hd_grid_programs
+/// (EJoint::BULGE_4D), same index
+extern Cuda_utils::HD_Array<float> hd_grid_bulge;
+
+/// Concatenated octree nodes of every skeleton's grid (see Skeleton_env::Grid).
+/// n = hd_grid[ hd_offset[Skel_id].grid_data + node_idx] with :
+/// @li n >= 0 : leaf, offset of its program in hd_grid_programs
+/// @li n == -1 : empty leaf
+/// @li n <= -2 : internal node, its eight children are at node_idx = -n-2
 extern Cuda_utils::HD_Array<int> hd_grid;
 
 /// Bbox of each skeleton's grid.
@@ -68,23 +77,43 @@ extern Cuda_utils::HD_Array<Offset>  hd_offset;
 /// Erase environment
 void clean_env();
 
+/// Add the memory used by the blending lists, grids and bones to 'rep'
+void memory_report(Memory_report& rep);
+
 /// Allocate memory.
 /// To copy data of the skeleton on the Device use update_bones_device_mem()
 /// and update_joints_device_mem()
 void init_env();
 
-/// Set resolution for the acceleration structure grid
+/// Set the finest resolution of the acceleration structure (octree)
+/// @see Grid::set_res()
 void set_grid_res(Skel_id id, int res);
 
 /// Create a new skeleton instance
+/// @param grid_res : finest resolution of the acceleration structure, -1 for
+/// the default, 1 for a single cell
 Skel_id new_skel_instance(const std::vector<const Bone*>& bones,
                           const std::map<Bone::Id, Bone::Id>& parents,
                           int grid_res=-1);
 
 void delete_skel_instance(Skel_id i);
 
+/// Replace the bones, hierarchy and joints data of an existing skeleton
+/// instance. The instance keeps its id and grid resolution.
+/// Only the differences with the current instance are written: bones of the
+/// sibling groups that changed, the clusters blended with them and the grid
+/// cells overlapping them. Other bones keep their DBone_id.
+/// @note every instance has slices of the device arrays with some room for
+/// edits, when an edit does not fit every instance is laid out again.
+void update_skel_instance(Skel_id i,
+                          const std::vector<const Bone*>& bones,
+                          const std::map<Bone::Id, Bone::Id>& parents,
+                          const std::map<Bone::Id, Joint_data>& joints);
+
 /// Update the bone data ( type length etc.) of the skeleton in device memory
-void update_bones_data(Skel_id i);
+/// @param bones : bones that changed, the grid cells they overlap (before and
+/// after the change) are rebuilt
+void update_bones_data(Skel_id i, const std::vector<Bone::Id>& bones);
 
 /// Update the joints data (type, controller id, bulge strength)
 /// in device memory.
@@ -105,15 +134,14 @@ Bone::Id bone_didx_to_hidx(Skel_id skel_id, DBone_id bone_didx);
 /// @see Skeleton_env::Cluster_cu
 extern texture<int4, 1, cudaReadModeElementType> tex_blending_list;
 
-/// Grid cells concatenated blending list
-/// Cluster_cu (as describded with 'tex_blending_list')
-/// @see Skeleton_env::Cluster_cu tex_blending_list
-extern texture<int4, 1, cudaReadModeElementType> tex_grid_list;
+/// Grid cells concatenated programs (see hd_grid_programs)
+/// @see Skeleton_env::Blend_instr
+extern texture<int4, 1, cudaReadModeElementType> tex_grid_programs;
 
-/// Concatenated grid cells stored linearly
+/// Concatenated octree nodes (see hd_grid)
 extern texture<int, 1, cudaReadModeElementType> tex_grid;
 
-/// every grids bbox and resolution.
+/// every grids bbox and finest resolution.
 /// (bbox.pmin.x, bbox.pmin.y, bbox.pmin.z) == tex_grid_bbox[id_skel*2+0]{x,y,z}
 /// res == (int)tex_grid_bbox[id_skel*2+0]{w}
 /// (bbox.pmax.x, bbox.pmax.y, bbox.pmax.z) == tex_grid_bbox[id_skel*2+1]{x,y,z}
@@ -124,7 +152,7 @@ extern texture<float4, 1, cudaReadModeElementType> tex_grid_bbox;
 /// Offset to access the blending list or grid according to the skeleton
 /// instance tex_offset[skel_id] = offset
 /// @li x : offset to access tex_blending_list
-/// @li y : tex_blending_list tex_grid_list
+/// @li y : offset to access tex_grid
 /// @remarks Its more convenient to use 'struct Skeleton_env::Offset'
 /// than the int4.
 /// @see Skeleton_env::Offset
@@ -134,6 +162,10 @@ extern texture<int2, 1, cudaReadModeElementType> tex_offset;
 /// tex_bulge_strength
 extern texture<float, 1, cudaReadModeElementType> tex_bulge_strength;
 
+/// At each instruction of 'tex_grid_programs' corresponds a bulge strength in
+/// tex_grid_bulge (hd_grid_bulge)
+extern texture<float, 1, cudaReadModeElementType> tex_grid_bulge;
+
 // -----------------------------------------------------------------------------
 /// @name Per bones data
 // -----------------------------------------------------------------------------
@@ -156,14 +188,16 @@ void unbind();
 
 /// @param id : skeleton identifier
 /// @param pos : world position the blending list will be evaluated
-/// @return first element of the blending list contains in the grid cell
-/// at pos. TO evaluate the blending list use fetch_grid_blending_list()
+/// @return offset of the program of the octree leaf at pos, or -1 outside the
+/// grid or in an empty leaf. Instructions are read with fetch_grid_program()
+/// @note cost is the depth of the leaf, which is only high where many bones
+/// overlap
 IF_CUDA_DEVICE_HOST static inline
-Cluster_id fetch_grid_blending_list_offset(Skel_id id, const Vec3_cu& pos);
+int fetch_grid_program_offset(Skel_id id, const Vec3_cu& pos);
 
-/// Blending list of every skeletons for every grid's cells
+/// Programs of every skeletons for every grid's cells
 IF_CUDA_DEVICE_HOST static inline
-Cluster_cu fetch_grid_blending_list(Cluster_id i);
+Blend_instr fetch_grid_program(int i);
 
 // -----------------------------------------------------------------------------
 /// @name Blending list (no acceleration structure)
@@ -215,6 +249,8 @@ float fetch_and_eval_bone(DBone_id bone_id, Vec3_cu& gf, const Point_cu& x);
 /// @param gf the blended gradient
 /// @param type The blending type
 /// @param ctrl_id the controller id for the blending op if any.
+/// @param bulge_strength bulge magnitude of the joint, used by
+/// EJoint::BULGE_4D ('tex_bulge_strength' or 'tex_grid_bulge')
 /// @param f1 First potential value to blend
 /// @param f2 Second potential value to blend
 /// @param gf1 First gradient to blend
@@ -224,7 +260,7 @@ __device__ static inline
 float fetch_binop_and_blend(Vec3_cu& gf,
                             EJoint::Joint_t type,
                             Blending_env::Ctrl_id ctrl_id,
-                            Cluster_id clus_id,
+                            float bulge_strength,
                             float f1, float f2,
                             const Vec3_cu& gf1, const Vec3_cu& gf2);
 
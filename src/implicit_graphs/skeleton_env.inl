@@ -11,7 +11,7 @@ namespace Skeleton_env {
 // =============================================================================
 
 IF_CUDA_DEVICE_HOST static inline
-BBox_cu fetch_grid_bbox_and_res(Skel_id id, Vec3i_cu& res)
+BBox_cu fetch_grid_bbox(Skel_id id)
 {
     #ifdef __CUDA_ARCH__
     float4 a = tex1Dfetch(tex_grid_bbox, id*2 + 0);
@@ -20,7 +20,6 @@ BBox_cu fetch_grid_bbox_and_res(Skel_id id, Vec3i_cu& res)
     float4 a = hd_grid_bbox[id*2 + 0];
     float4 b = hd_grid_bbox[id*2 + 1];
     #endif
-    res.x = res.y = res.z = (int)a.w;
     return BBox_cu(a.x, a.y, a.z,
                    b.x, b.y, b.z);
 }
@@ -51,39 +50,53 @@ int fetch_grid(int offset, int cell_id){
 // -----------------------------------------------------------------------------
 
 IF_CUDA_DEVICE_HOST static inline
-Cluster_id fetch_grid_blending_list_offset(Skel_id id, const Vec3_cu& pos)
+int fetch_grid_program_offset(Skel_id id, const Vec3_cu& pos)
 {
-    Vec3i_cu res;
-    BBox_cu bb = fetch_grid_bbox_and_res( id, res);
-    // compute linear grid index
-    Vec3i_cu i3 = bb.index_grid_cell( res, pos );
-    Idx3_cu idx(res, i3);
+    BBox_cu bb = fetch_grid_bbox( id );
 
     // test if in grid
-    if( idx.is_out() ) return Cluster_id(-1);
+    if( pos.x <  bb.pmin.x || pos.y <  bb.pmin.y || pos.z <  bb.pmin.z ||
+        pos.x >= bb.pmax.x || pos.y >= bb.pmax.y || pos.z >= bb.pmax.z )
+        return -1;
 
-    // retreive offset
+    // Descend the octree from the root until we reach a leaf
     int offset = fetch_grid_offset(id);
-    int ptr_list = fetch_grid(offset, idx.to_linear());
+    int node = fetch_grid(offset, 0);
+    while( node < -1 )
+    {
+        const Vec3_cu c = (bb.pmin.to_vector() + bb.pmax.to_vector()) * 0.5f;
+        int octant = 0;
+        if(pos.x >= c.x){ octant |= 1; bb.pmin.x = c.x; } else bb.pmax.x = c.x;
+        if(pos.y >= c.y){ octant |= 2; bb.pmin.y = c.y; } else bb.pmax.y = c.y;
+        if(pos.z >= c.z){ octant |= 4; bb.pmin.z = c.z; } else bb.pmax.z = c.z;
+        node = fetch_grid(offset, -node - 2 + octant);
+    }
 
-    return Cluster_id(ptr_list);
+    return node;
 }
 
 // -----------------------------------------------------------------------------
 
-__device__ static inline
-Cluster_cu fetch_grid_blending_list(Cluster_id cid)
+IF_CUDA_DEVICE_HOST static inline
+Blend_instr fetch_grid_program(int i)
 {
     #ifdef __CUDA_ARCH__
-    int4 s = tex1Dfetch(tex_grid_list, cid.id());
-    return *reinterpret_cast<Cluster_cu*>(&s);
+    int4 s = tex1Dfetch(tex_grid_programs, i);
+    return *reinterpret_cast<Blend_instr*>(&s);
     #else
-    return hd_grid_blending_list[ cid.id() ];
+    return hd_grid_programs[ i ];
     #endif
 }
 
 // -----------------------------------------------------------------------------
 
+__device__ static inline
+float fetch_grid_bulge(int i){
+    return tex1Dfetch(tex_grid_bulge, i);
+}
+
+// -----------------------------------------------------------------------------
+
 __device__ static inline
 Cluster_id fetch_blending_list_offset(Skel_id id){
     int2 s = tex1Dfetch(tex_offset, id);
@@ -99,6 +112,13 @@ Cluster_cu fetch_blending_list(Cluster_id cid)
     return *reinterpret_cast<Cluster_cu*>(&s);
 }
 
+// -----------------------------------------------------------------------------
+
+__device__ static inline
+float fetch_bulge_strength(Cluster_id cid){
+    return tex1Dfetch(tex_bulge_strength, cid.id());
+}
+
 __device__ static inline
 HermiteRBF fetch_bone_hrbf(DBone_id i)
 {
@@ -153,7 +173,7 @@ __device__ static inline
 float fetch_binop_and_blend(Vec3_cu& grad,
                             EJoint::Joint_t type,
                             Blending_env::Ctrl_id ctrl_id,
-                            Cluster_id clus_id,
+                            float bulge_strength,
                             float f1, float f2,
                             const Vec3_cu& gf1, const Vec3_cu& gf2)
 {
@@ -192,6 +212,12 @@ float fetch_binop_and_blend(Vec3_cu& grad,
         #else
         return /*Static_4D_bulge*//*BulgeInContact*/BulgeFreeBlending::fngf(grad, f1, f2, gf1, gf2);
         #endif
+    }
+    else if( type == EJoint::BULGE_4D)
+    {
+        // Tables loaded by Skeleton_env::update_joints_data() (require_family())
+        const Dyn_4D_bulge op(ctrl_id, bulge_strength);
+        return op.fngf(grad, f1, f2, gf1, gf2);
     } else {
         Blending_env::Op_id id = ((int)type) - ((int)EJoint::BEGIN_CUSTOM_OP_ID);
         return Dyn_Operator3D_cu(id, ctrl_id).fngf(f1, f2, gf1, gf2, grad);
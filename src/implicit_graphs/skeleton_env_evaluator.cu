@@ -52,37 +52,21 @@ float eval_cluster(Vec3_cu& gf_clus, const Point_cu& p, int size, Skeleton_env::
     return f_clus;
 }
 
-__device__ static inline
-Skeleton_env::Cluster_cu fetch_blending_list_int(Skeleton_env::Cluster_id cid)
-{
-#ifndef USE_GRID_
-    return fetch_blending_list(cid);
-#else
-    return fetch_grid_blending_list(cid);
-#endif
-}
-
 __device__
 float Skeleton_env::compute_potential(Skel_id skel_id, const Point_cu& p, Vec3_cu& gf)
 {
-    typedef Cluster_cu Clus;
     float f = 0.f;
     gf = Vec3_cu(1.f, 0.f, 0.f);
 
 #ifndef USE_GRID_
     // Without space acceleration structure
+    typedef Cluster_cu Clus;
     Cluster_id off_cid = fetch_blending_list_offset( skel_id );
-#else
-    // With a grid as acceleration structure
-    Cluster_id off_cid = fetch_grid_blending_list_offset(skel_id, p.to_vector());
-    if( !off_cid.is_valid() /*Means we are outside the skeleton bbox*/)
-        return 0.f;
-#endif
 
     // Clusters contains at first a list of pairs with dynamic blending
     // each pair is blend to others with a max then the rest of the skeleton
     // is blended  with a max
-    Clus clus = fetch_blending_list_int( off_cid );
+    Clus clus = fetch_blending_list( off_cid );
 
     // In the first cluster we don't store the blending type and controller id
     const int nb_pairs      = clus.nb_pairs;
@@ -94,7 +78,7 @@ float Skeleton_env::compute_potential(Skel_id skel_id, const Point_cu& p, Vec3_c
         float fn;
         Vec3_cu gfn;
         for(int j = 0; j < 2; j++){
-            clus = fetch_blending_list_int( off_cid + i + j );
+            clus = fetch_blending_list( off_cid + i + j );
             if(clus.nb_bone == 0)
                 continue;
 
@@ -111,14 +95,47 @@ float Skeleton_env::compute_potential(Skel_id skel_id, const Point_cu& p, Vec3_c
                 first = false;
             } else {
                 // Blend the pair
-                fn = fetch_binop_and_blend(gfn, clus.blend_type, clus.ctrl_id,  off_cid + i,
-                        fn, xfn, gfn, xgfn); // FIXME: This call should be specific to grid when enabled
+                fn = fetch_binop_and_blend(gfn, clus.blend_type, clus.ctrl_id,
+                        fetch_bulge_strength(off_cid + i + j),
+                        fn, xfn, gfn, xgfn);
             }
         }
 
+        // Unused clusters have no bones (see Tree_cu::update())
+        if(first)
+            continue;
+
+        // Blend with the other pairs
+        f =  Blend_func::Pairs::fngf(gf, f, fn, gf, gfn);
+    }
+#else
+    // With a grid as acceleration structure the blending list of the cell is a
+    // precompiled program: empty clusters are already removed and bone indices
+    // and operators resolved.
+    const int prog = fetch_grid_program_offset(skel_id, p.to_vector());
+    if( prog < 0 /*Means we are outside the skeleton bbox or in an empty cell*/)
+        return 0.f;
+
+    const int nb_instr = fetch_grid_program( prog ).first_bone_a;
+    for(int i = prog + 1; i <= prog + nb_instr; ++i)
+    {
+        const Blend_instr instr = fetch_grid_program( i );
+
+        Vec3_cu gfn;
+        float fn = eval_cluster(gfn, p, instr.nb_bone_a(), DBone_id(instr.first_bone_a));
+        if( instr.nb_bone_b() > 0 )
+        {
+            // Blend the pair
+            Vec3_cu gfb;
+            const float fb = eval_cluster(gfb, p, instr.nb_bone_b(), DBone_id(instr.first_bone_b));
+            fn = fetch_binop_and_blend(gfn, instr.type(), instr.ctrl_id, fetch_grid_bulge(i),
+                                       fn, fb, gfn, gfb);
+        }
+
         // Blend with the other pairs
         f =  Blend_func::Pairs::fngf(gf, f, fn, gf, gfn);
     }
+#endif
 
     return f;
 }
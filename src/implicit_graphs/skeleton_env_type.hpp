@@ -55,6 +55,31 @@ struct Cluster_data {
     float _bulge_strength;
 };
 
+/// Instruction of a grid cell program (see Skeleton_env::hd_grid_programs).
+/// Evaluates the cluster 'a', blends it with the cluster 'b' (if any) using
+/// the operator 'type', then blends the result with the previous instructions.
+/// Bone indices are those of the concatenated device bones.
+/// The first instruction of a program is a header: 'first_bone_a' holds the
+/// number of instructions that follow.
+struct Blend_instr {
+    Blend_instr() :
+        first_bone_a(0), first_bone_b(-1), sizes_type(0), ctrl_id(-1)
+    { }
+
+    int first_bone_a; ///< first bone of cluster 'a'
+    int first_bone_b; ///< first bone of cluster 'b' or -1
+    int sizes_type;   ///< nb bones of a | nb bones of b << 8 | type << 16
+    Blending_env::Ctrl_id ctrl_id; ///< controller of the operator if needed
+
+    static int pack(int nb_bone_a, int nb_bone_b, EJoint::Joint_t type) {
+        return nb_bone_a | (nb_bone_b << 8) | ((int)type << 16);
+    }
+
+    IF_CUDA_DEVICE_HOST int nb_bone_a() const { return sizes_type & 0xFF; }
+    IF_CUDA_DEVICE_HOST int nb_bone_b() const { return (sizes_type >> 8) & 0xFF; }
+    IF_CUDA_DEVICE_HOST EJoint::Joint_t type() const { return (EJoint::Joint_t)(sizes_type >> 16); }
+};
+
 /// Bone identifier in host memory layout for skeleton env
 struct Hbone_id {
     Skel_id  _skel_id;
@@ -39,6 +39,8 @@ struct Tree {
     const Joint_data& data(Bone::Id hid) const { return _datas.at(hid); }
 
     const Bone* bone(Bone::Id hid) const { return _bones.at(hid); }
+
+    bool has_bone(Bone::Id hid) const { return _bones.find(hid) != _bones.end(); }
     
     const std::set<const Bone*> bones() const {
         std::set<const Bone*> result;
@@ -51,6 +53,9 @@ struct Tree {
 
     Bone::Id parent(Bone::Id hid) const { return _parents.at(hid); }
 
+    /// Parent of every bone of the tree (-1 for roots)
+    const std::map<Bone::Id, Bone::Id>& parents() const { return _parents; }
+
     // -------------------------------------------------------------------------
     /// @name Attributes
     // -------------------------------------------------------------------------
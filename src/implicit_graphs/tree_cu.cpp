@@ -11,7 +11,6 @@ Tree_cu::Tree_cu(const Tree *tree) :
     _clusters.       reserve( tree->bones().size() );
     _bone_aranged.   resize ( tree->bones().size() );
     _bone_to_cluster.resize ( tree->bones().size() );
-    _parents_aranged.resize ( tree->bones().size() );
 
     int nb_bones = 0;
     for(const Bone *bone: tree->bones())
@@ -30,16 +29,10 @@ Tree_cu::Tree_cu(const Tree *tree) :
 
     assert((unsigned)nb_bones == tree->bones().size());
 
-    // Build adjency for the new bone layout in '_bone_aranged'
-    for(int i = 0; i < nb_bones; ++i)
-    {
-        Bone::Id hidx     = _bone_aranged[i]->get_bone_id();
-        Bone::Id h_parent = tree->parent( hidx );
-        DBone_id parent_device_id = DBone_id(-1);
-        if(h_parent != -1)
-            parent_device_id = _hidx_to_didx.at(h_parent);
-        _parents_aranged[i] = parent_device_id;
-    }
+    // Clusters are packed, a sibling group that grows is moved by update()
+    _cluster_capacity.resize( _clusters.size() );
+    for(unsigned i = 0; i < _clusters.size(); ++i)
+        _cluster_capacity[i] = _clusters[i].nb_bone;
 
     compute_blending_list();
 }
@@ -118,9 +111,249 @@ void Tree_cu::clear_blending_list()
 
 // -----------------------------------------------------------------------------
 
+void Tree_cu::update_blending_list(Cluster_id cid)
+{
+    std::vector<Cluster> pair;
+    add_cluster(cid, pair);
+    _blending_list[cid.id()*2 + 0] = pair[0];
+    _blending_list[cid.id()*2 + 1] = pair[1];
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::update(const Tree* tree,
+                     std::vector<Bone::Id>& removed,
+                     std::set<Cluster_id>& dirty_clusters,
+                     std::set<DBone_id>& dirty_bones)
+{
+    const Tree* old = _tree;
+    _tree = tree;
+
+    // Look up the bones leaving their sibling group (removed or reparented).
+    // The groups they leave and the groups bones join are laid out again,
+    // other bones keep their slot.
+    std::set<Cluster_id> left_clusters;
+    std::set<Bone::Id>   fit_parents; // groups by parent
+    std::vector<Bone::Id> fit_roots;  // a root is a group of its own
+    for(const auto& it: _hidx_to_didx)
+    {
+        const Bone::Id bid = it.first;
+        const Bone::Id pt  = old->parent( bid );
+        if( tree->has_bone( bid ) && tree->parent( bid ) == pt )
+        {
+            // The group is the same but the bone may have been replaced
+            if( _bone_aranged[it.second.id()] != tree->bone( bid ) )
+            {
+                _bone_aranged[it.second.id()] = tree->bone( bid );
+                dirty_bones.insert( it.second );
+            }
+            continue;
+        }
+
+        if( !tree->has_bone( bid ) )
+            removed.push_back( bid );
+
+        left_clusters.insert( _bone_to_cluster[it.second.id()] );
+        if( pt != -1 && tree->has_bone( pt ) )
+            fit_parents.insert( pt );
+    }
+
+    for(const auto& it: tree->parents())
+    {
+        const Bone::Id bid = it.first;
+        if( old->has_bone( bid ) && old->parent( bid ) == it.second )
+            continue;
+
+        if( it.second == -1 ) fit_roots.push_back( bid );
+        else                  fit_parents.insert( it.second );
+    }
+
+    // A group keeps the cluster of one of the bones that stayed in it
+    std::set<Cluster_id> fitted;
+    auto fit = [&](const std::vector<Bone::Id>& sons)
+    {
+        if( sons.empty() )
+            return;
+
+        Cluster_id cid(-1);
+        for(Bone::Id bid: sons)
+        {
+            if( old->has_bone( bid ) && old->parent( bid ) == tree->parent( bid ) )
+            {
+                cid = bone_to_cluster( hidx_to_didx( bid ) );
+                break;
+            }
+        }
+
+        if( !cid.is_valid() && !_free_clusters.empty() )
+        {
+            cid = _free_clusters.back();
+            _free_clusters.pop_back();
+        }
+        else if( !cid.is_valid() )
+        {
+            cid = Cluster_id( (int)_clusters.size() );
+            Cluster cs = {0, DBone_id(0), Joint_data()};
+            _clusters.push_back( cs );
+            _cluster_capacity.push_back( 0 );
+        }
+
+        fill_cluster(cid, sons, dirty_bones);
+        fitted.insert( cid );
+        dirty_clusters.insert( cid );
+    };
+
+    for(Bone::Id pt: fit_parents)
+        fit( tree->sons( pt ) );
+
+    for(Bone::Id bid: fit_roots)
+        fit( std::vector<Bone::Id>(1, bid) );
+
+    // Groups every bone left
+    for(Cluster_id cid: left_clusters)
+    {
+        if( fitted.find( cid ) != fitted.end() )
+            continue;
+
+        clear_cluster_range(cid, dirty_bones);
+        _clusters[cid.id()].nb_bone = 0;
+        _cluster_capacity[cid.id()] = 0;
+        _free_clusters.push_back( cid );
+        dirty_clusters.insert( cid );
+    }
+
+    // A cluster is blended with the range of its parent's cluster
+    std::set<Cluster_id> sons;
+    for(Cluster_id cid: dirty_clusters)
+        sons_clusters(cid, sons);
+    dirty_clusters.insert(sons.begin(), sons.end());
+
+    _blending_list.resize( _clusters.size() * 2 );
+    for(Cluster_id cid: dirty_clusters)
+        update_blending_list( cid );
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::update_joint(Bone::Id bid, std::set<Cluster_id>& dirty_clusters)
+{
+    std::vector<Cluster_id> cids;
+    if( _tree->parent( bid ) == -1 )
+        cids.push_back( bone_to_cluster( hidx_to_didx( bid ) ) );
+
+    const std::vector<Bone::Id>& sons = _tree->sons( bid );
+    if( sons.size() > 0 )
+        cids.push_back( bone_to_cluster( hidx_to_didx( sons[0] ) ) );
+
+    for(Cluster_id cid: cids)
+    {
+        update_blending_list( cid );
+        dirty_clusters.insert( cid );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::fill_cluster(Cluster_id cid,
+                           const std::vector<Bone::Id>& sons,
+                           std::set<DBone_id>& dirty_bones)
+{
+    const int nb_sons = (int)sons.size();
+    if( nb_sons > _cluster_capacity[cid.id()] )
+    {
+        // Move the group after the last bone, with room to grow
+        clear_cluster_range(cid, dirty_bones);
+        _clusters[cid.id()].first_bone = DBone_id( (int)_bone_aranged.size() );
+        _cluster_capacity[cid.id()] = nb_sons * 2;
+        _bone_aranged.   resize( _bone_aranged.size() + nb_sons * 2, NULL );
+        _bone_to_cluster.resize( _bone_aranged.size(), cid );
+    }
+
+    Cluster& cl = _clusters[cid.id()];
+    cl.nb_bone = nb_sons;
+    for(int i = 0; i < _cluster_capacity[cid.id()]; ++i)
+    {
+        const DBone_id didx = cl.first_bone + i;
+        const Bone* bone = i < nb_sons ? _tree->bone( sons[i] ) : NULL;
+
+        // Bones that kept their place are left as is
+        auto it = _didx_to_hidx.find( didx );
+        const bool same = i < nb_sons ? (it != _didx_to_hidx.end() && it->second == sons[i]) :
+                                        (it == _didx_to_hidx.end());
+        if( same && _bone_aranged[didx.id()] == bone )
+            continue;
+
+        unmap_slot( didx );
+        if( i < nb_sons )
+        {
+            _hidx_to_didx[ sons[i] ] = didx;
+            _didx_to_hidx[ didx    ] = sons[i];
+        }
+        _bone_aranged   [didx.id()] = bone;
+        _bone_to_cluster[didx.id()] = cid;
+        dirty_bones.insert( didx );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::clear_cluster_range(Cluster_id cid, std::set<DBone_id>& dirty_bones)
+{
+    const DBone_id first = _clusters[cid.id()].first_bone;
+    for(int i = 0; i < _cluster_capacity[cid.id()]; ++i)
+    {
+        const DBone_id didx = first + i;
+        unmap_slot( didx );
+        if( _bone_aranged[didx.id()] != NULL )
+        {
+            _bone_aranged[didx.id()] = NULL;
+            dirty_bones.insert( didx );
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::unmap_slot(DBone_id didx)
+{
+    auto it = _didx_to_hidx.find( didx );
+    if( it == _didx_to_hidx.end() )
+        return;
+
+    auto h = _hidx_to_didx.find( it->second );
+    if( h != _hidx_to_didx.end() && h->second == didx )
+        _hidx_to_didx.erase( h );
+    _didx_to_hidx.erase( it );
+}
+
+// -----------------------------------------------------------------------------
+
+void Tree_cu::sons_clusters(Cluster_id cid, std::set<Cluster_id>& out) const
+{
+    const Cluster& cl = _clusters[cid.id()];
+    for(int i = 0; i < cl.nb_bone; ++i)
+    {
+        const std::vector<Bone::Id>& sons = _tree->sons( didx_to_hidx( cl.first_bone + i ) );
+        if( sons.size() > 0 )
+            out.insert( bone_to_cluster( hidx_to_didx( sons[0] ) ) );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 void Tree_cu::add_cluster(Cluster_id cid, std::vector<Cluster> &out) const
 {
     Cluster cl = _clusters[cid.id()];
+    if( cl.nb_bone == 0 )
+    {
+        // Unused cluster (see update())
+        Cluster empty;
+        empty.nb_bone = 0;
+        out.push_back( empty );
+        out.push_back( empty );
+        return;
+    }
+
     DBone_id d_bone_id = cl.first_bone;
     Bone::Id h_bone_id = _bone_aranged[d_bone_id.id()]->get_bone_id();
     Bone::Id h_parent  = _tree->parent( h_bone_id );
@@ -139,7 +372,7 @@ void Tree_cu::add_cluster(Cluster_id cid, std::vector<Cluster> &out) const
     }
     else
     {
-        DBone_id d_parent = _parents_aranged[ d_bone_id.id() ];
+        DBone_id d_parent = _hidx_to_didx.at( h_parent );
         Cluster_id cid_parent = _bone_to_cluster[ d_parent.id() ];
         Cluster c0 = _clusters[ cid.id()        ];
         Cluster c1 = _clusters[ cid_parent.id() ];
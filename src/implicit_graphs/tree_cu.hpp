@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <list>
 
 #include "tree.hpp"
@@ -20,6 +21,28 @@ struct Tree_cu {
         return _bone_to_cluster[id.id()];
     }
 
+    /// Apply the differences between the current tree and 'tree' (added,
+    /// removed and reparented bones) to the layout. A bone keeps its DBone_id
+    /// as long as its sibling group has room for it, a group that outgrows its
+    /// range is moved after the last bone, removed groups leave their range
+    /// and cluster unused (see '_bone_aranged' and '_clusters').
+    /// '_blending_list' is updated for the clusters that changed.
+    /// @param removed : bones that are not in 'tree' anymore
+    /// @param dirty_clusters : clusters whose entries in '_blending_list'
+    /// changed
+    /// @param dirty_bones : bone slots whose bone changed or was freed
+    /// @warning the joints data of 'tree' must already be set, the bones of
+    /// the previous tree are not dereferenced (they may be deleted)
+    void update(const Tree* tree,
+                std::vector<Bone::Id>& removed,
+                std::set<Cluster_id>& dirty_clusters,
+                std::set<DBone_id>& dirty_bones);
+
+    /// Clusters whose blending depends on the joint data of 'bid': the
+    /// cluster of its sons, or its own cluster if 'bid' is a root.
+    /// '_blending_list' is updated for them.
+    void update_joint(Bone::Id bid, std::set<Cluster_id>& dirty_clusters);
+
 private:
 
     DBone_id compute_clusters(Bone::Id bid,
@@ -34,6 +57,25 @@ private:
     /// fill attributes '_blending_list' '_nb_pairs' '_nb_singletons'
     void compute_blending_list();
 
+    /// Lay the sibling group 'sons' in the range of the cluster 'cid', the
+    /// range is reallocated after the last bone if it is too small.
+    void fill_cluster(Cluster_id cid,
+                      const std::vector<Bone::Id>& sons,
+                      std::set<DBone_id>& dirty_bones);
+
+    /// Free the bone slots of the range of 'cid'
+    void clear_cluster_range(Cluster_id cid, std::set<DBone_id>& dirty_bones);
+
+    /// Remove the bone of the slot 'didx' from the index maps, unless it
+    /// was already given another slot
+    void unmap_slot(DBone_id didx);
+
+    /// Recompute the two elements of 'cid' in '_blending_list'
+    void update_blending_list(Cluster_id cid);
+
+    /// Clusters of the sons of the bones of 'cid'
+    void sons_clusters(Cluster_id cid, std::set<Cluster_id>& out) const;
+
     /// @return wether its a pair or not
 //    bool add_elt_to_blending_list(Cluster_id cid, const std::list<Cluster>& blending_list);
 
@@ -43,6 +85,7 @@ public:
     }
 
     /// Add a cluster to the blending list.
+    /// Every cluster adds two elements, unused clusters two empty ones.
     void add_cluster(Cluster_id cid, std::vector<Cluster> &out) const;
 
     /// Erase every elements from the blending list
@@ -62,17 +105,15 @@ public:
 
     /// list of clusters _h_clusters[Cluster_id] = Cluster
     /// A cluster of bone can be blended with the operator of your choice
+    /// Clusters left unused by update() have no bones.
     std::vector<Cluster> _clusters;
 
     /// Bones list organized for device memory.
     /// Bones with same parents are contigus in memory.
     /// Index to acces this array must be a DBone_id.
+    /// Slots left unused by update() are NULL.
     std::vector<const Bone*> _bone_aranged;
 
-    /// Parents of bones in '_bone_aranged'
-    /// _parents_arranged[DBone_id] = Dparent_bone
-    std::vector<DBone_id> _parents_aranged;
-
     DBone_id hidx_to_didx(Bone::Id dbone_id) const { return _hidx_to_didx.at(dbone_id); }
     Bone::Id didx_to_hidx(DBone_id dbone_id) const { return _didx_to_hidx.at(dbone_id); }
 
@@ -80,6 +121,12 @@ private:
     /// Get the cluster associated to a bone
     /// _bone_to_cluster[DBone_id] = clus_id
     std::vector<Cluster_id> _bone_to_cluster;
+
+    /// Number of bone slots reserved for each cluster from its first bone
+    std::vector<int> _cluster_capacity;
+
+    /// Unused clusters, reused by update() before adding new ones
+    std::vector<Cluster_id> _free_clusters;
 private:
 
     /// host bone idx to device bone idx
@@ -13,9 +13,12 @@
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
 #include <maya/MArrayDataHandle.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MPlugArray.h>
 
 #include "maya/maya_helpers.hpp"
 #include "maya/maya_data.hpp"
+#include "implicit_surface.hpp"
 #include "utils/misc_utils.hpp"
 
 #include "skeleton.hpp"
@@ -201,12 +204,41 @@ void ImplicitBlend::load_mesh_geometry(MDataBlock &dataBlock)
     MarchingCubes::compute_surface(meshGeometry, skeleton.get(), iso);
 }
 
+// Solve the HRBFs of the ImplicitSurfaces connected to our inputs together, before they're
+// pulled.  Otherwise each of them solves its samples in its own compute(), one at a time.
+// Inputs coming from other ImplicitBlends batch their own surfaces.
+void ImplicitBlend::fit_input_surfaces() const
+{
+    MStatus status = MStatus::kSuccess;
+
+    vector<ImplicitSurface *> inputSurfaces;
+    MPlug surfacesPlug(thisMObject(), ImplicitBlend::surfaces);
+    for(int i = 0; i < (int) surfacesPlug.numElements(); ++i)
+    {
+        MPlug surfacePlug = surfacesPlug.elementByPhysicalIndex(i, &status); merr("surfacesPlug.elementByPhysicalIndex");
+        MPlug implicitPlug = surfacePlug.child(ImplicitBlend::implicit, &status); merr("surfacePlug.child");
+
+        MPlugArray sources;
+        implicitPlug.connectedTo(sources, true, false, &status); merr("implicitPlug.connectedTo");
+        if(sources.length() == 0)
+            continue;
+
+        MFnDependencyNode sourceNode(sources[0].node(), &status); merr("sourceNode(implicit)");
+        if(sourceNode.typeId() == ImplicitSurface::id)
+            inputSurfaces.push_back((ImplicitSurface *) sourceNode.userNode());
+    }
+
+    ImplicitSurface::fit_pending(inputSurfaces);
+}
+
 // Retrieve the list of input bones and their parents from our attributes.
 void ImplicitBlend::get_input_bones(MDataBlock &dataBlock,
     std::vector<shared_ptr<const Bone> > &bones, std::vector<Bone::Id> &parents) const
 {
     MStatus status = MStatus::kSuccess;
 
+    fit_input_surfaces();
+
     // Retrieve our input surfaces.  This will also update their transforms, etc. if needed.
     MArrayDataHandle surfacesHandle = dataBlock.inputArrayValue(ImplicitBlend::surfaces, &status); merr("inputArrayValue(surfaces)");
 
@@ -322,8 +354,12 @@ void ImplicitBlend::update_skeleton(MDataBlock &dataBlock)
         return;
     }
 
-    // Create a skeleton containing the bones, replacing any previous skeleton.
-    skeleton.reset(new Skeleton(bones, parents));
+    // Apply the differences to the skeleton we already have.  Joints that are still there keep
+    // their controllers and blending parameters, and the skeleton keeps its Skeleton_env instance.
+    if(skeleton.get() != NULL)
+        skeleton->update(bones, parents);
+    else
+        skeleton.reset(new Skeleton(bones, parents));
 }
 
 // Load the parameters associated with our input skeletons.  This is done on
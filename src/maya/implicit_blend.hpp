@@ -51,6 +51,7 @@ private:
     // compute() implementations:
     void load_world_implicit(const MPlug &plug, MDataBlock &dataBlock);
     void load_mesh_geometry(MDataBlock &dataBlock);
+    void fit_input_surfaces() const;
     void get_input_bones(MDataBlock &dataBlock, std::vector<shared_ptr<const Bone> > &bones, std::vector<Bone::Id> &parents) const;
     void update_skeleton(MDataBlock &dataBlock);
     void update_skeleton_params(MDataBlock &dataBlock);
@@ -31,11 +31,17 @@
 #include <maya/MDataHandle.h>
 #include <maya/MPointArray.h>
 #include <maya/MMatrix.h>
+#include <maya/MAnimControl.h>
+#include <maya/MTime.h>
 
 #include "maya/maya_helpers.hpp"
 #include "maya/maya_data.hpp"
 
 #include "skeleton.hpp"
+#include "cuda_ctrl.hpp"
+#include "memory_debug.hpp"
+#include "point_cache.hpp"
+#include "timer.hpp"
 
 #include <algorithm>
 #include <map>
@@ -67,6 +73,7 @@ using namespace std;
 const MTypeId ImplicitDeformer::id(0xEA115);
 MObject ImplicitDeformer::implicit;
 MObject ImplicitDeformer::basePotential;
+MObject ImplicitDeformer::deformSubset;
 MObject ImplicitDeformer::deformerIterations;
 MObject ImplicitDeformer::iterativeSmoothing;
 MObject ImplicitDeformer::finalFitting;
@@ -120,6 +127,10 @@ MStatus ImplicitDeformer::initialize()
         addAttribute(finalSmoothingMode);
         dependencies.add(ImplicitDeformer::finalSmoothingMode, ImplicitDeformer::outputGeom);
 
+        deformSubset = numAttr.create("deformSubset", "deformSubset", MFnNumericData::Type::kBoolean, false, &status);
+        addAttribute(deformSubset);
+        dependencies.add(ImplicitDeformer::deformSubset, ImplicitDeformer::outputGeom);
+
         // The base potential of the mesh.
         basePotential = numAttr.create("basePotential", "bp", MFnNumericData::Type::kFloat, 0, &status);
         numAttr.setArray(true);
@@ -140,6 +151,8 @@ void ImplicitDeformer::postConstructor()
 {
     implicitIsConnected = false;
     basePotentialIsDirty = false;
+    skeletonStructureSequence = 0;
+    subsetIsActive = false;
 }
 
 MStatus ImplicitDeformer::setDependentsDirty(const MPlug &plug, MPlugArray &plugArray)
@@ -211,8 +224,36 @@ MStatus ImplicitDeformer::deform(MDataBlock &dataBlock, MItGeometry &geomIter, c
     if(animesh.get() == NULL)
         return;
 
-    // Run the algorithm.  XXX: If we're being applied to a set, use init_vert_to_fit to only
-    // process the vertices we need to.
+    // Only deform the members of the deformer set that have a painted weight, if requested.
+    // Other vertices keep their input position.  The subset is only sent to the animesh when
+    // it changes.
+    bool subset = DagHelpers::readHandle<bool>(dataBlock, ImplicitDeformer::deformSubset, &status); merr("deformSubset");
+    if(subset)
+    {
+        vector<int> members;
+        for( ; !geomIter.isDone(); geomIter.next())
+        {
+            int vertex_index = geomIter.index();
+            if(weightValue(dataBlock, multiIndex, vertex_index) > 0)
+                members.push_back(vertex_index);
+        }
+        geomIter.reset();
+
+        if(!subsetIsActive || members != activeVertices)
+        {
+            animesh->set_active_vertices(members);
+            activeVertices.swap(members);
+            subsetIsActive = true;
+        }
+    }
+    else if(subsetIsActive)
+    {
+        animesh->clear_active_vertices();
+        activeVertices.clear();
+        subsetIsActive = false;
+    }
+
+    // Run the algorithm.
     int iterations = DagHelpers::readHandle<int>(dataBlock, ImplicitDeformer::deformerIterations, &status); merr("deformerIterations");
     animesh->set_nb_transform_steps(iterations);
 
@@ -291,8 +332,10 @@ void ImplicitDeformer::load_mesh(MDataBlock &dataBlock)
     // than the one we had, then this is a new skeleton.
     //
     // If our input skeleton has changed, it's guaranteed to be different from the Skeleton* pointer
-    // in animMesh, because animMesh won't release its previous Skeleton.
-    bool skeletonChanged = animesh.get() == NULL || animesh->get_skel() != skel.get();
+    // in animMesh, because animMesh won't release its previous Skeleton.  The skeleton may also have
+    // had joints added, removed or reparented in place, which changes its structure sequence.
+    bool skeletonChanged = animesh.get() == NULL || animesh->get_skel() != skel.get() ||
+        skel->get_structure_sequence() != skeletonStructureSequence;
 
     // Hack: We calculate a bunch of properties from the mesh, such as the nearest joint to each
     // vertex.  We don't want to recalculate that every time our input (skinned) geometry changes.
@@ -337,8 +380,12 @@ void ImplicitDeformer::load_mesh(MDataBlock &dataBlock)
     mesh.reset(new Mesh(loaderMesh));
     mesh->check_integrity();
 
-    // Create a new animMesh with the current mesh and skeleton.
-    animesh.reset(AnimeshBase::create(mesh.get(), skel));
+    // Create a new animMesh with the current mesh and skeleton.  Vertices are
+    // re-ordered internally for memory locality, which Animesh hides from us.
+    animesh.reset(AnimeshBase::create(mesh.get(), skel, true));
+    activeVertices.clear();
+    subsetIsActive = false;
+    skeletonStructureSequence = skel->get_structure_sequence();
 
     // Load base potential.
     load_base_potential(dataBlock);
@@ -359,9 +406,10 @@ MStatus ImplicitDeformer::calculate_base_potential()
     if(animesh.get() == NULL)
         return MStatus::kSuccess;
 
-    // Calculate the base potential.
+    // Calculate the base potential.  Only the vertices around bones that changed since
+    // the last calculation for this mesh are evaluated again.
     vector<float> pot;
-    animesh->calculate_base_potential(pot);
+    animesh->update_base_potential(pot);
 
     // Save it to ImplicitDeformer::basePotential.
     MPlug basePotentialPlug(thisMObject(), ImplicitDeformer::basePotential);
@@ -374,6 +422,136 @@ MStatus ImplicitDeformer::calculate_base_potential()
     return MStatus::kSuccess;
 }
 
+void ImplicitDeformer::memory_report(Memory_report &rep) const
+{
+    // If we don't have a mesh yet, there's nothing allocated.
+    if(animesh.get() == NULL)
+        return;
+
+    animesh->memory_report(rep);
+}
+
+namespace {
+    // Deform the current pose and return the resulting vertices.
+    vector<Point_cu> deform_pose(AnimeshBase &animesh)
+    {
+        animesh.transform_vertices();
+
+        vector<Point_cu> verts;
+        animesh.get_vertices(verts);
+        return verts;
+    }
+
+    double blending_env_memory(Memory_report::mem_loc loc)
+    {
+        Memory_report rep;
+        Cuda_ctrl::memory_report(rep);
+        return (double) rep.total(loc, "Blending_env");
+    }
+}
+
+MStatus ImplicitDeformer::table_resolution_sweep(const std::vector<int> &resolutions)
+{
+    MDataBlock &dataBlock = this->forceCache();
+    MStatus status = MStatus::kSuccess;
+
+    // Make sure our dependencies are up to date.
+    dataBlock.inputValue(ImplicitDeformer::implicit, &status); check("inputValue(implicit)");
+
+    load_mesh(dataBlock);
+
+    // If we don't have a mesh yet, don't do anything.
+    if(animesh.get() == NULL)
+        return MStatus::kSuccess;
+
+    const Blending_env::Table_resolution initial = Cuda_ctrl::_operators.get_table_resolution();
+    const Blending_env::Table_resolution reference = Cuda_ctrl::_operators.get_default_table_resolution();
+
+    // The base potential is kept as is: we measure the error of swapping the
+    // tables on an already bound character.
+    if(!Cuda_ctrl::_operators.set_table_resolution(reference))
+    {
+        printf("table_resolution_sweep: custom operators are alive, can't change the resolution\n");
+        return MStatus::kFailure;
+    }
+    const vector<Point_cu> ref_verts = deform_pose(*animesh);
+
+    printf("\n%10s %8s %12s %12s %12s %14s\n", "xy/alpha", "4D", "gen (s)", "device (MB)", "host (MB)", "max dev");
+    for(int i = 0; i < (int) resolutions.size(); ++i)
+    {
+        const int r = resolutions[i];
+        Blending_env::Table_resolution res = { r, r, std::max(r/2, 8) };
+
+        Timer t;
+        t.start();
+        if(!Cuda_ctrl::_operators.set_table_resolution(res))
+            break;
+        const double gen_time = t.stop();
+
+        const vector<Point_cu> verts = deform_pose(*animesh);
+        float max_dev = 0.f;
+        for(int v = 0; v < (int) verts.size(); ++v)
+            max_dev = std::max(max_dev, verts[v].distance_squared(ref_verts[v]));
+
+        printf("%10d %8d %12.3f %12.2f %12.2f %14.6f\n", res.samples_xy, res.samples_4D, gen_time,
+               blending_env_memory(Memory_report::DEVICE) / (1024.*1024.),
+               blending_env_memory(Memory_report::HOST) / (1024.*1024.),
+               sqrtf(max_dev));
+    }
+
+    Cuda_ctrl::_operators.set_table_resolution(initial);
+    return MStatus::kSuccess;
+}
+
+MStatus ImplicitDeformer::bake_point_cache(MString path, int first, int last)
+{
+    MDataBlock &dataBlock = this->forceCache();
+    MStatus status = MStatus::kSuccess;
+
+    dataBlock.inputValue(ImplicitDeformer::implicit, &status); check("inputValue(implicit)");
+    load_mesh(dataBlock);
+
+    // If we don't have a mesh yet, don't do anything.
+    if(animesh.get() == NULL || last < first)
+        return MStatus::kFailure;
+
+    const MTime::Unit unit = MTime::uiUnit();
+    const MTime initial_time = MAnimControl::currentTime();
+
+    Point_cache::Header header;
+    header.nb_points = animesh->get_nb_vertices();
+    header.nb_frames = last - first + 1;
+    header.start_frame = (float) first;
+    header.fps = (float) MTime(1.0, MTime::kSeconds).as(unit);
+
+    const std::string file = path.asChar();
+    MString ext = path.length() >= 4? path.substring(path.length() - 4, path.length() - 1): MString();
+    const bool mdd = ext.toLowerCase() == ".mdd";
+
+    Point_cache::Writer writer;
+    if(!writer.open(file, mdd ? Point_cache::MDD : Point_cache::PC2, header))
+    {
+        printf("bake_point_cache: can't create %s\n", file.c_str());
+        return MStatus::kFailure;
+    }
+
+    // Changing the time dirties the skeleton; pulling the implicit input updates
+    // the bone transforms of the animesh for the frame.
+    Point_cache::Bake_stats stats;
+    const bool ok = Point_cache::bake(*animesh, first, last, [&](int frame) {
+        MAnimControl::setCurrentTime(MTime((double) frame, unit));
+        MDataBlock &frameBlock = this->forceCache();
+        frameBlock.inputValue(ImplicitDeformer::implicit, &status);
+    }, writer, &stats);
+
+    MAnimControl::setCurrentTime(initial_time);
+
+    stats.print();
+    if(!ok)
+        printf("bake_point_cache: writing %s failed\n", file.c_str());
+    return ok ? MStatus::kSuccess : MStatus::kFailure;
+}
+
 std::shared_ptr<const Skeleton> ImplicitDeformer::get_implicit_skeleton(MDataBlock &dataBlock)
 {
     MStatus status;
@@ -25,9 +25,24 @@ public:
     MStatus setDependentsDirty(const MPlug &plug_, MPlugArray &plugArray);
 
     // Calculate the base potential based on the current mesh, and store it to the
-    // basePotential attribute.
+    // basePotential attribute.  The result is also cached on disk with the fingerprint
+    // of each bone's field (see Base_potential_cache).
     MStatus calculate_base_potential();
 
+    // Add the memory used by the deformer's mesh to the report.
+    void memory_report(Memory_report &rep) const;
+
+    // Deform the current pose with each blending table resolution in turn (the
+    // number of (f1, f2) samples, see Blending_env::set_table_resolution()), and
+    // print the generation time, the memory of the tables and the maximum deviation
+    // of the vertices from the default resolution.  The resolution is restored afterwards.
+    MStatus table_resolution_sweep(const std::vector<int> &resolutions);
+
+    // Deform every frame of [first, last] and write the vertices to a point cache
+    // (MDD if the path ends with .mdd, PC2 otherwise).  Each frame is posed by setting
+    // the current time.  The current time is restored afterwards.
+    MStatus bake_point_cache(MString path, int first, int last);
+
     // The base potential of the mesh.
     static MObject basePotential;
 
@@ -46,6 +61,10 @@ public:
 
     // The final smoothing method.  Note that this is independent of iterativeSmoothing.
     static MObject finalSmoothingMode;
+
+    // If true, only the members of the deformer set with a non-zero painted weight are
+    // deformed.  Other vertices keep their input (skinned) position.
+    static MObject deformSubset;
     
 private:
     static DagHelpers::MayaDependencies dependencies;
@@ -59,6 +78,14 @@ private:
     // If true, the contents of basePotential have been modified and not yet loaded.
     bool basePotentialIsDirty;
 
+    // Skeleton::get_structure_sequence() of the skeleton animesh was created with.  The blend node
+    // edits its skeleton in place, so this tells us when joints were added, removed or reparented.
+    uint64_t skeletonStructureSequence;
+
+    // The vertices animesh is restricted to with set_active_vertices(), if subsetIsActive.
+    std::vector<int> activeVertices;
+    bool subsetIsActive;
+
     // The loaded mesh.  We own this object.
     std::unique_ptr<Mesh> mesh;
 
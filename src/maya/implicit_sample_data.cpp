@@ -0,0 +1,75 @@
+#define NO_CUDA
+
+#include "implicit_sample_data.hpp"
+
+#include <maya/MArgList.h>
+
+#include <vector>
+
+const MTypeId ImplicitSampleData::id(0xEA11A);
+const MString ImplicitSampleData::typeName("ImplicitSampleData");
+
+// The ASCII format is the sample count followed by x y z nx ny nz for each sample.
+MStatus ImplicitSampleData::readASCII(const MArgList &argList, unsigned &endOfTheLastParsedElement)
+{
+    MStatus status = MStatus::kSuccess;
+    unsigned idx = endOfTheLastParsedElement;
+    int count = argList.asInt(idx++, &status);
+    if(status != MS::kSuccess || count < 0 || argList.length() < idx + count * 6)
+        return MS::kFailure;
+
+    SampleSet::InputSample newSamples;
+    newSamples.nodes.resize(count);
+    newSamples.n_nodes.resize(count);
+    for(int i = 0; i < count; ++i)
+    {
+        float v[6];
+        for(int j = 0; j < 6; ++j)
+            v[j] = (float) argList.asDouble(idx++, &status);
+        if(status != MS::kSuccess)
+            return status;
+
+        newSamples.nodes[i] = Vec3_cu(v[0], v[1], v[2]);
+        newSamples.n_nodes[i] = Vec3_cu(v[3], v[4], v[5]);
+    }
+
+    samples = newSamples;
+    endOfTheLastParsedElement = idx - 1;
+    return MS::kSuccess;
+}
+
+MStatus ImplicitSampleData::writeASCII(std::ostream &out)
+{
+    out << samples.nodes.size();
+    for(int i = 0; i < (int) samples.nodes.size(); ++i)
+    {
+        const Vec3_cu &p = samples.nodes[i];
+        const Vec3_cu &n = samples.n_nodes[i];
+        out << " " << p.x << " " << p.y << " " << p.z << " " << n.x << " " << n.y << " " << n.z;
+    }
+    return out.fail()? MS::kFailure: MS::kSuccess;
+}
+
+MStatus ImplicitSampleData::readBinary(std::istream &in, unsigned length)
+{
+    if(length == 0)
+    {
+        samples.clear();
+        return MS::kSuccess;
+    }
+
+    std::vector<char> block(length);
+    in.read(&block[0], length);
+    if(in.fail())
+        return MS::kFailure;
+
+    return samples.deserialize(&block[0], block.size())? MS::kSuccess: MS::kFailure;
+}
+
+MStatus ImplicitSampleData::writeBinary(std::ostream &out)
+{
+    std::vector<char> block;
+    samples.serialize(block);
+    out.write(&block[0], block.size());
+    return out.fail()? MS::kFailure: MS::kSuccess;
+}
@@ -0,0 +1,38 @@
+#ifndef IMPLICIT_SAMPLE_DATA_HPP
+#define IMPLICIT_SAMPLE_DATA_HPP
+
+#include <maya/MPxData.h> 
+#include <maya/MTypeId.h> 
+#include <maya/MString.h> 
+
+#include "sample_set.hpp"
+
+// This data type stores the HRBF samples of an ImplicitSurface as a single packed block,
+// instead of one plug per sample.  The binary file format is the block written by
+// SampleSet::InputSample::serialize().
+class ImplicitSampleData: public MPxData
+{
+public:
+    ImplicitSampleData() { }
+
+    void copy(const MPxData &cpy_) { const ImplicitSampleData &cpy = (ImplicitSampleData &) cpy_; samples = cpy.samples; }
+    MTypeId typeId() const { return id; }
+    MString name() const { return typeName; }
+
+    MStatus readASCII(const MArgList &argList, unsigned &endOfTheLastParsedElement);
+    MStatus writeASCII(std::ostream &out);
+    MStatus readBinary(std::istream &in, unsigned length);
+    MStatus writeBinary(std::ostream &out);
+
+    const SampleSet::InputSample &getSamples() const { return samples; }
+    void setSamples(const SampleSet::InputSample &samples_) { samples = samples_; }
+
+    static const MString typeName;
+    static const MTypeId id;
+    static void *creator() { return new ImplicitSampleData; }
+
+private:
+    SampleSet::InputSample samples;
+};
+
+#endif
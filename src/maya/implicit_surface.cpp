@@ -3,6 +3,7 @@
 #include "implicit_surface.hpp"
 
 #include <string.h>
+#include <stdio.h>
 #include <math.h>
 #include <assert.h>
 
@@ -26,13 +27,16 @@
 
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
+#include <maya/MDGModifier.h>
 
 #include "maya/maya_helpers.hpp"
 #include "maya/maya_data.hpp"
 
 #include "skeleton.hpp"
+#include "hrbf_cache.hpp"
 
 #include "implicit_surface_data.hpp"
+#include "implicit_sample_data.hpp"
 
 #include <algorithm>
 #include <map>
@@ -53,6 +57,15 @@ namespace {
         int logicalIndex = plug.logicalIndex(&status); merr("logicalIndex()");
         status = DagHelpers::addObjectToArray(dataBlock, plug.attribute(), logicalIndex, data); merr("addObjectToArray");
     }
+
+    // Ill-conditioned fits aren't cached, so this shows again the next time the samples are loaded.
+    void warnIllConditioned(const MString &nodeName, const HRBF_wrapper::HRBF_fit_report &report)
+    {
+        char msg[256];
+        sprintf(msg, ": ill-conditioned HRBF fit (cond %g, residual %g). Resample the bone or remove close samples.",
+            report.cond, report.residual);
+        MGlobal::displayWarning(nodeName + msg);
+    }
 }
 
 
@@ -72,6 +85,8 @@ namespace {
 MTypeId ImplicitSurface::id(0xEA117);
 
 MObject ImplicitSurface::hrbfRadiusAttr;
+MObject ImplicitSurface::hrbfKernelAttr;
+MObject ImplicitSurface::samplesAttr;
 MObject ImplicitSurface::samplePointAttr;
 MObject ImplicitSurface::sampleNormalAttr;
 MObject ImplicitSurface::initialDir;
@@ -94,6 +109,9 @@ MStatus ImplicitSurface::initialize()
         MFnTypedAttribute typedAttr;
         MFnEnumAttribute enumAttr;
 
+        samplesAttr = typedAttr.create("samples", "samples", ImplicitSampleData::id, MObject::kNullObj, &status);
+        addAttribute(samplesAttr);
+
         samplePointAttr = numAttr.create("point", "p", MFnNumericData::Type::k3Float, 0, &status);
         numAttr.setArray(true);
         addAttribute(samplePointAttr);
@@ -105,14 +123,22 @@ MStatus ImplicitSurface::initialize()
         hrbfRadiusAttr = numAttr.create("hrbfRadius", "hrbfRadius", MFnNumericData::Type::kFloat, 0, &status);
         addAttribute(hrbfRadiusAttr);
 
+        // Radial basis function of the HRBF: "compact" is the sparse Wendland fit for densely sampled bones.
+        hrbfKernelAttr = enumAttr.create("hrbfKernel", "hrbfKernel", HRBF_wrapper::RBF_GLOBAL, &status);
+        enumAttr.addField("global", HRBF_wrapper::RBF_GLOBAL);
+        enumAttr.addField("compact", HRBF_wrapper::RBF_WENDLAND_C2);
+        addAttribute(hrbfKernelAttr);
+
         sampleSetUpdateAttr = numAttr.create("sampleSetUpdate", "sampleSetUpdate", MFnNumericData::Type::kInt, 0, &status);
         numAttr.setStorable(false);
         numAttr.setHidden(true);
         addAttribute(sampleSetUpdateAttr);
 
+        dependencies.add(ImplicitSurface::samplesAttr, ImplicitSurface::sampleSetUpdateAttr);
         dependencies.add(ImplicitSurface::samplePointAttr, ImplicitSurface::sampleSetUpdateAttr);
         dependencies.add(ImplicitSurface::sampleNormalAttr, ImplicitSurface::sampleSetUpdateAttr);
         dependencies.add(ImplicitSurface::hrbfRadiusAttr, ImplicitSurface::sampleSetUpdateAttr);
+        dependencies.add(ImplicitSurface::hrbfKernelAttr, ImplicitSurface::sampleSetUpdateAttr);
 
         meshGeometryUpdateAttr = numAttr.create("meshGeometryUpdate", "meshGeometryUpdate", MFnNumericData::Type::kInt, 0, &status);
         numAttr.setStorable(false);
@@ -124,6 +150,7 @@ MStatus ImplicitSurface::initialize()
         enumAttr.addField("Max", 0);
         enumAttr.addField("Bulge", 1);
         enumAttr.addField("Circle", 2);
+        enumAttr.addField("Bulge 4D", 3);
         addAttribute(blendMode);
 
         bulgeStrength = numAttr.create("bulgeStrength", "bulgeStrength", MFnNumericData::Type::kFloat, 0.7, &status);
@@ -181,6 +208,8 @@ void *ImplicitSurface::creator() { return new ImplicitSurface(); }
 void ImplicitSurface::postConstructor()
 {
     handle_exceptions([&] {
+        fittedKey = 0;
+        batchFitKey = 0;
         bone.reset(new Bone());
 
         // Create a small, dummy Skeleton that contains just our bone.
@@ -218,27 +247,109 @@ void ImplicitSurface::save_sampleset(const SampleSet::InputSample &inputSample)
 {
     MStatus status = MStatus::kSuccess;
 
-    // Save the samples.
-    MPlug samplePointPlug(thisMObject(), ImplicitSurface::samplePointAttr);
-    MPlug sampleNormalPlug(thisMObject(), ImplicitSurface::sampleNormalAttr);
-    for(int sampleIdx = 0; sampleIdx < inputSample.nodes.size(); ++sampleIdx)
+    // Save the samples as a single packed block.
+    MFnPluginData dataCreator;
+    MObject dataObj = dataCreator.create(ImplicitSampleData::id, &status); merr("dataCreator(ImplicitSampleData)");
+    ImplicitSampleData *data = (ImplicitSampleData *) dataCreator.data(&status); merr("dataCreator.data");
+    data->setSamples(inputSample);
+
+    MPlug samplesPlug(thisMObject(), ImplicitSurface::samplesAttr);
+    status = samplesPlug.setValue(dataObj); merr("samplesPlug.setValue");
+
+    // Drop the per-sample attributes of older scenes, they are superseded by
+    // the packed block.
+    MDGModifier dgModifier;
+    const MObject legacyAttrs[] = { ImplicitSurface::samplePointAttr, ImplicitSurface::sampleNormalAttr };
+    for(const MObject &attr: legacyAttrs)
+    {
+        MPlug arrayPlug(thisMObject(), attr);
+        for(int i = (int) arrayPlug.numElements() - 1; i >= 0; --i)
+        {
+            status = dgModifier.removeMultiInstance(arrayPlug.elementByPhysicalIndex(i), true); merr("removeMultiInstance");
+        }
+    }
+    status = dgModifier.doIt(); merr("dgModifier.doIt");
+}
+
+void ImplicitSurface::set_batch_fit(uint64_t key, const HRBF_cache::Bone_record &record)
+{
+    batchFitKey = key;
+    batchFit.reset(new HRBF_cache::Bone_record(record));
+}
+
+void ImplicitSurface::read_fit_request(HRBF_cache::Fit_request &request) const
+{
+    MStatus status = MStatus::kSuccess;
+    MObject node = thisMObject();
+
+    MPlug hrbfRadiusPlug(node, ImplicitSurface::hrbfRadiusAttr);
+    request.radius = hrbfRadiusPlug.asFloat();
+
+    MPlug hrbfKernelPlug(node, ImplicitSurface::hrbfKernelAttr);
+    request.kernel = hrbfKernelPlug.asShort();
+
+    // The same samples as load_sampleset(): the packed block, or the per-sample attributes
+    // of older scenes when it was never set.
+    MObject samplesObj;
+    MPlug samplesPlug(node, ImplicitSurface::samplesAttr);
+    status = samplesPlug.getValue(samplesObj); merr("samplesPlug.getValue");
+    if(!samplesObj.isNull())
     {
-        MPlug samplePlug = samplePointPlug.elementByLogicalIndex(sampleIdx, &status); merr("samplePointPlug.elementByLogicalIndex");
+        MFnPluginData dataFn(samplesObj, &status); merr("MFnPluginData(samples)");
+        const ImplicitSampleData *samplesData = (const ImplicitSampleData *) dataFn.data(&status); merr("dataFn.data");
+        if(samplesData != NULL)
+        {
+            request.nodes = samplesData->getSamples().nodes;
+            request.normals = samplesData->getSamples().n_nodes;
+            return;
+        }
+    }
 
-        status = DagHelpers::setPlugValue(samplePlug,
-            inputSample.nodes[sampleIdx].x,
-            inputSample.nodes[sampleIdx].y,
-            inputSample.nodes[sampleIdx].z);
-        merr("setPlugValue(samplePlug)");
+    MPlug samplePointPlug(node, ImplicitSurface::samplePointAttr);
+    MPlug sampleNormalPlug(node, ImplicitSurface::sampleNormalAttr);
+    if(samplePointPlug.numElements() != sampleNormalPlug.numElements())
+        throw std::runtime_error("Element count mismatch");
+
+    for(int sampleIdx = 0; sampleIdx < (int) samplePointPlug.numElements(); ++sampleIdx)
+    {
+        MPlug point = samplePointPlug.elementByPhysicalIndex(sampleIdx, &status); merr("samplePointPlug.elementByPhysicalIndex");
+        MPlug normal = sampleNormalPlug.elementByPhysicalIndex(sampleIdx, &status); merr("sampleNormalPlug.elementByPhysicalIndex");
 
-        MPlug normalPlug = sampleNormalPlug.elementByLogicalIndex(sampleIdx, &status); merr("sampleNormalPlug.elementByLogicalIndex");
+        request.nodes.push_back(Vec3_cu(point.child(0).asFloat(), point.child(1).asFloat(), point.child(2).asFloat()));
+        request.normals.push_back(Vec3_cu(normal.child(0).asFloat(), normal.child(1).asFloat(), normal.child(2).asFloat()));
+    }
+}
 
-        status = DagHelpers::setPlugValue(normalPlug,
-            inputSample.n_nodes[sampleIdx].x,
-            inputSample.n_nodes[sampleIdx].y,
-            inputSample.n_nodes[sampleIdx].z);
-        merr("setPlugValue(normalPlug)");
+void ImplicitSurface::fit_pending(const vector<ImplicitSurface *> &surfaces)
+{
+    vector<ImplicitSurface *> pending;
+    vector<HRBF_cache::Fit_request> fitRequests;
+    vector<uint64_t> keys;
+    for(ImplicitSurface *surface: surfaces)
+    {
+        HRBF_cache::Fit_request fitRequest;
+        surface->read_fit_request(fitRequest);
+        if(fitRequest.nodes.empty())
+            continue;
+
+        // Skip the surfaces whose HRBF is already built from, or waiting for, these samples.
+        uint64_t key = HRBF_cache::fit_key(fitRequest.nodes, fitRequest.normals, fitRequest.kernel);
+        if(key == surface->fittedKey || (surface->batchFit && key == surface->batchFitKey))
+            continue;
+
+        pending.push_back(surface);
+        fitRequests.push_back(fitRequest);
+        keys.push_back(key);
     }
+
+    // A single surface gains nothing from the batch, it solves its samples in compute().
+    if(pending.size() < 2)
+        return;
+
+    vector<HRBF_cache::Bone_record> records;
+    HRBF_cache::solve_batch(fitRequests, records);
+    for(int i = 0; i < (int) pending.size(); ++i)
+        pending[i]->set_batch_fit(keys[i], records[i]);
 }
 
 void ImplicitSurface::load_sampleset(MDataBlock &dataBlock)
@@ -248,20 +359,35 @@ void ImplicitSurface::load_sampleset(MDataBlock &dataBlock)
     SampleSet::InputSample inputSample;
 
     // Load the samples.
+    MDataHandle samplesHandle = dataBlock.inputValue(ImplicitSurface::samplesAttr, &status); merr("inputValue(samplesAttr)");
     MArrayDataHandle samplePointHandle = dataBlock.inputArrayValue(ImplicitSurface::samplePointAttr, &status); merr("inputArrayValue(samplePointAttr)");
     MArrayDataHandle sampleNormalHandle = dataBlock.inputArrayValue(ImplicitSurface::sampleNormalAttr, &status); merr("inputArrayValue(samplePointAttr)");
 
     // Load the HRBF radius.  This isn't really part of the sample set.
+    float hrbfRadius = 0;
     {
         MDataHandle hrbfRadiusHandle = dataBlock.inputValue(ImplicitSurface::hrbfRadiusAttr, &status); merr("inputValue(hrbfRadiusAttr)");
-        float hrbfRadius = hrbfRadiusHandle.asFloat();
+        hrbfRadius = hrbfRadiusHandle.asFloat();
         bone->set_hrbf_radius(hrbfRadius, boneSkeleton.get());
     }
 
-    if(samplePointHandle.elementCount() != sampleNormalHandle.elementCount())
+    HRBF_wrapper::Rbf_kernel hrbfKernel = HRBF_wrapper::RBF_GLOBAL;
+    {
+        MDataHandle hrbfKernelHandle = dataBlock.inputValue(ImplicitSurface::hrbfKernelAttr, &status); merr("inputValue(hrbfKernelAttr)");
+        hrbfKernel = (HRBF_wrapper::Rbf_kernel) hrbfKernelHandle.asShort();
+    }
+
+    const ImplicitSampleData *samplesData = (const ImplicitSampleData *) samplesHandle.asPluginData();
+    if(samplesData != NULL)
+        inputSample = samplesData->getSamples();
+
+    // Fall back on the per-sample attributes of older scenes, which never set
+    // the packed block.  Once it is set, even to no samples, they are ignored.
+    int legacyCount = samplesData == NULL? (int) samplePointHandle.elementCount(): 0;
+    if(legacyCount > 0 && samplePointHandle.elementCount() != sampleNormalHandle.elementCount())
         throw std::runtime_error("Element count mismatch");
 
-    for(int sampleIdx = 0; sampleIdx < (int) samplePointHandle.elementCount(); ++sampleIdx)
+    for(int sampleIdx = 0; sampleIdx < legacyCount; ++sampleIdx)
     {
         status = samplePointHandle.jumpToElement(sampleIdx); merr("samplePointHandle.jumpToElement");
         status = sampleNormalHandle.jumpToElement(sampleIdx); merr("sampleNormalHandle.jumpToElement");
@@ -277,14 +403,55 @@ void ImplicitSurface::load_sampleset(MDataBlock &dataBlock)
     if(inputSample.nodes.empty())
     {
         bone->set_enabled(false);
+        fittedKey = 0;
+        batchFit.reset();
     }
     else
     {
-        // Solve/compute HRBF weights
+        // Solve/compute HRBF weights, or restore them if these samples were already solved.
         bone->set_enabled(true);
         bone->discard_precompute();
-        bone->get_hrbf().init_coeffs(inputSample.nodes, inputSample.n_nodes);
-        printf("update_bone_samples: Solved %i nodes\n", inputSample.nodes.size());
+
+        HermiteRBF &hrbf = bone->get_hrbf();
+        hrbf.set_kernel(hrbfKernel);
+        uint64_t key = HRBF_cache::fit_key(inputSample.nodes, inputSample.n_nodes, hrbfKernel);
+        HRBF_cache::Bone_record record;
+        if(batchFit && batchFitKey == key && batchFit->has_coeffs())
+        {
+            // Solved along with other surfaces by fit_pending() or at creation.
+            const HRBF_cache::Bone_record &fit = *batchFit;
+            hrbf.init_coeffs(fit.nodes, fit.normals, fit.alphas, fit.betas);
+            printf("update_bone_samples: Restored %i nodes from the batch fit\n", (int) inputSample.nodes.size());
+
+            if(fit.report.ill_conditioned)
+                warnIllConditioned(name(), fit.report);
+        }
+        else if(HRBF_cache::load(key, record) && record.has_coeffs() && record.nodes.size() == inputSample.nodes.size())
+        {
+            hrbf.init_coeffs(record.nodes, record.normals, record.alphas, record.betas);
+            printf("update_bone_samples: Restored %i nodes from cache\n", (int) inputSample.nodes.size());
+        }
+        else
+        {
+            hrbf.init_coeffs(inputSample.nodes, inputSample.n_nodes);
+            HRBF_wrapper::HRBF_fit_report report = hrbf.get_fit_report();
+            printf("update_bone_samples: Solved %i nodes (%i merged, cond %g, residual %g, %i refinements%s)\n",
+                (int) inputSample.nodes.size(), report.nb_merged, report.cond, report.residual,
+                report.nb_refinements, report.double_solve? ", double precision solve": "");
+
+            if(report.ill_conditioned)
+                warnIllConditioned(name(), report);
+            else
+            {
+                record.nodes = inputSample.nodes;
+                record.normals = inputSample.n_nodes;
+                record.radius = hrbfRadius;
+                hrbf.get_coeffs(record.alphas, record.betas);
+                HRBF_cache::save(key, record);
+            }
+        }
+        fittedKey = key;
+        batchFit.reset();
 
         // Make sure the current transforms are applied now that we've changed the bone.
         // XXX: If this is needed, Bone should probably do this internally.
@@ -363,6 +530,7 @@ void ImplicitSurface::load_world_implicit(const MPlug &plug, MDataBlock &dataBlo
     case 0: jointType = EJoint::Joint_t::MAX; break;
     case 1: jointType = EJoint::Joint_t::BULGE; break;
     case 2: jointType = EJoint::Joint_t::GC_ARC_CIRCLE_TWEAK; break;
+    case 3: jointType = EJoint::Joint_t::BULGE_4D; break;
     }
     boneSkeleton->set_joint_blending(bone->get_bone_id(), jointType);
 
@@ -12,8 +12,11 @@
 #include <maya/MGeometry.h>
 
 #include <memory>
+#include <vector>
+#include <stdint.h>
 
 class Bone;
+namespace HRBF_cache { struct Bone_record; struct Fit_request; }
 
 #include "implicit_surface_geometry_override.hpp"
 
@@ -27,6 +30,13 @@ public:
     static MTypeId id;
 
     static MObject hrbfRadiusAttr;
+    static MObject hrbfKernelAttr;
+
+    // The HRBF samples, packed in a single ImplicitSampleData.
+    static MObject samplesAttr;
+
+    // Samples stored one plug per sample by older scenes.  These are only read when
+    // samplesAttr is empty.
     static MObject samplePointAttr;
     static MObject sampleNormalAttr;
 
@@ -47,6 +57,17 @@ public:
 
     void save_sampleset(const SampleSet::InputSample &inputSample);
 
+    // Hand over the HRBF fitted from our samples along with other surfaces by
+    // HRBF_cache::solve_batch().  'key' is the HRBF_cache::fit_key() of the samples.  The
+    // next load of the same samples uses it instead of solving them alone.
+    void set_batch_fit(uint64_t key, const HRBF_cache::Bone_record &record);
+
+    // Solve the HRBFs of every surface in 'surfaces' whose samples aren't fitted yet in a
+    // single HRBF_cache::solve_batch(), and hand them over with set_batch_fit().  This is
+    // called before the surfaces are evaluated, otherwise each of them solves its own
+    // samples in compute(), one at a time.
+    static void fit_pending(const std::vector<ImplicitSurface *> &surfaces);
+
     const MeshGeom &get_mesh_geometry();
 
     // This is only used during creation.  Set the object-space direction of the bone away
@@ -57,7 +78,7 @@ public:
     // The mode used to blend this joint with its children.
     static MObject blendMode;
 
-    // The bulge strength, used only when blendMode is set to BULGE.
+    // The bulge strength, used only when blendMode is set to BULGE or BULGE_4D.
     static MObject bulgeStrength;
     
 private:
@@ -68,12 +89,22 @@ private:
 
     void set_world_space(Transfo tr);
 
+    // Read the samples, kernel and radius to fit from our plugs, outside of compute().
+    void read_fit_request(HRBF_cache::Fit_request &request) const;
+
     // The bone that we represent.  This is our primary data.
     std::shared_ptr<Bone> bone;
 
     // A skeleton containing just our bone.
     std::shared_ptr<Skeleton> boneSkeleton;
 
+    // The HRBF_cache::fit_key() of the samples our bone's HRBF was built from, or 0.
+    uint64_t fittedKey;
+
+    // The fit given to set_batch_fit() and the key of its samples, until it's used.
+    std::shared_ptr<const HRBF_cache::Bone_record> batchFit;
+    uint64_t batchFitKey;
+
     // This is updated by meshGeometryUpdateAttr, and contains a mesh reprensentation of the
     // implicit surface.  This is used for preview rendering.  If the surface shape is hidden
     // (which is normally is, when being used for deformation), this won't be evaluated.
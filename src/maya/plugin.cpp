@@ -43,9 +43,14 @@
 
 #include "skeleton.hpp"
 #include "sample_set.hpp"
+#include "hrbf_cache.hpp"
 #include "cuda_ctrl.hpp"
 #include "hrbf_env.hpp"
+#include "blending_env_host.hpp"
 #include "vert_to_bone_info.hpp"
+#include "vertex_clustering.hpp"
+#include "memory_debug.hpp"
+#include "loader_rig.hpp"
 
 #include <string.h>
 #include <math.h>
@@ -64,6 +69,10 @@ public:
 
     void init(MString nodeName);
     void calculate_base_potential(MString deformerName);
+    void memory_report(MString deformerName);
+    void table_sweep(MString deformerName);
+    void bake(MString deformerName, MString path, int first, int last);
+    void joint_operator_test();
 
     ImplicitDeformer *getDeformerByName(MString nodeName);
 
@@ -112,6 +121,44 @@ void ImplicitCommand::calculate_base_potential(MString deformerName)
     status = deformer->calculate_base_potential(); merr("calculate_base_potential");
 }
 
+// Print the GPU and host memory used by the deformer and the CUDA environments.
+// The total device memory in bytes is set as the command's result.
+void ImplicitCommand::memory_report(MString deformerName)
+{
+    ImplicitDeformer *deformer = getDeformerByName(deformerName);
+
+    Memory_report rep;
+    deformer->memory_report(rep);
+    Cuda_ctrl::memory_report(rep);
+    rep.print();
+    Cuda_ctrl::load_report();
+
+    setResult((double) rep.total(Memory_report::DEVICE));
+}
+
+// Deform the current pose of the deformer with a range of blending table
+// resolutions and print the accuracy/performance of each one.
+void ImplicitCommand::table_sweep(MString deformerName)
+{
+    MStatus status = MStatus::kSuccess;
+
+    static const int resolutions[] = { 16, 32, 48, 64, 96, 128 };
+    vector<int> res(resolutions, resolutions + sizeof(resolutions)/sizeof(int));
+
+    ImplicitDeformer *deformer = getDeformerByName(deformerName);
+    status = deformer->table_resolution_sweep(res); merr("table_resolution_sweep");
+}
+
+// Deform the frames [first, last] of the deformer's mesh and write them to a
+// PC2 or MDD point cache.
+void ImplicitCommand::bake(MString deformerName, MString path, int first, int last)
+{
+    MStatus status = MStatus::kSuccess;
+
+    ImplicitDeformer *deformer = getDeformerByName(deformerName);
+    status = deformer->bake_point_cache(path, first, last); merr("bake_point_cache");
+}
+
 // Create a shape node of a custom type, and return its interface.
 //
 // The shape name will be suffixed with "Shape", and the given name will be assigned to
@@ -326,61 +373,44 @@ namespace {
         return mesh;
     }
 
-    void clusterVerticesToBones(MObject skinClusterNode, const Mesh *mesh, const std::map<Bone::Id, BoneItem> &boneItems, std::vector< std::vector<Bone::Id> > &bonesPerVertex)
+    // Cluster each vertex to the nearest bone it's influenced by, and compute the default junction
+    // and HRBF radius of each bone from the same distances.
+    void clusterVerticesToBones(MObject skinClusterNode, const Mesh *mesh, const Skeleton *skeleton,
+        const std::map<Bone::Id, BoneItem> &boneItems, Vertex_clustering::Result &result)
     {
         // Retrieve skin weights.  We'll use these to cluster vertices to surfaces.
         vector<vector<double> > weightsPerIndex;
         MStatus status = DagHelpers::getWeightsForAllVertices(skinClusterNode, weightsPerIndex); merr("DagHelpers::getWeightsForAllVertices");
 
-        // Make a list of bones that we want each vertex to be a part of.  A vertex can be in
-        // more than one bone.
-        bonesPerVertex.reserve(weightsPerIndex.size());
-        for(int vertIdx = 0; vertIdx < (int) weightsPerIndex.size(); ++vertIdx)
+        // Make a list of the bones a vertex can be a part of.
+        std::vector<Vertex_clustering::Candidate> candidates;
+        for(auto &it: boneItems)
         {
-            vector<double> &weights = weightsPerIndex[vertIdx];
-            bonesPerVertex.emplace_back();
-            std::vector<int> &bones = bonesPerVertex.back();
+            const BoneItem &boneItem = it.second;
 
-            Point_cu currentVertex = mesh->get_vertex(vertIdx).to_point();
+            // We create a surface going from each joint to its parent, using the vertices
+            // that are influenced by the parent.  Root joints don't create surfaces, so skip
+            // them.
+            Bone::Id parentBoneId = boneItem.parent;
+            if(parentBoneId == -1)
+                continue;
 
-            // Look at each bone, and decide if we want this vertex to be included in it.
-            int closestBoneId = -1;
-            double closestBoneDistance = 999999;
-            for(auto &it: boneItems)
-            {
-                Bone::Id boneId = it.first;
-                const BoneItem &boneItem = it.second;
-
-                // We create a surface going from each joint to its parent, using the vertices
-                // that are influenced by the parent.  Root joints don't create surfaces, so skip
-                // them.
-                Bone::Id parentBoneId = boneItem.parent;
-                if(parentBoneId == -1)
-                    continue;
-
-                // If the parent joint has no physical index, then it doesn't influence any
-                // vertices.
-                const BoneItem &parentBoneItem = boneItems.at(parentBoneId);
-                if(parentBoneItem.physicalIndex == -1)
-                    continue;
-
-                // Ignore very low weights.
-                double weight = weights[parentBoneItem.physicalIndex];
-                double threshold = 0.05;
-                if(weight < threshold)
-                    continue;
-
-                float distanceFromBone = boneItem.bone->dist_sq_to(currentVertex);
-                if(distanceFromBone < closestBoneDistance)
-                {
-                    closestBoneDistance = distanceFromBone;
-                    closestBoneId = boneId;
-                }
-            }
+            // If the parent joint has no physical index, then it doesn't influence any
+            // vertices.
+            const BoneItem &parentBoneItem = boneItems.at(parentBoneId);
+            if(parentBoneItem.physicalIndex == -1)
+                continue;
 
-            if(closestBoneId != -1)
-                bones.push_back(closestBoneId);
+            Vertex_clustering::Candidate candidate;
+            candidate.bone_id = it.first;
+            candidate.bone = boneItem.bone.get();
+            candidate.weight_idx = parentBoneItem.physicalIndex;
+            candidates.push_back(candidate);
         }
+
+        // Ignore very low weights.
+        const double threshold = 0.05;
+        Vertex_clustering::cluster(*mesh, candidates, weightsPerIndex, threshold, skeleton->get_bone_ids(), result);
     }
 
     // Remove items from loaderSkeleton that have no samples, reparenting children.
@@ -439,29 +469,52 @@ void ImplicitCommand::init(MString skinClusterName)
     // implicit surfaces based on the skin cluster in its current pose.
     std::unique_ptr<Mesh> mesh(createMeshFromSkinClusterOutput(skinClusterPlug.node()));
 
-    // Create a list of the bones that each vertex should be included in.
-    std::vector< std::vector<Bone::Id> > bonesPerVertex;
-    clusterVerticesToBones(skinClusterPlug.node(), mesh.get(), loaderSkeleton, bonesPerVertex);
+    // Create a list of the bones that each vertex should be included in, along with the default
+    // radii of each bone.
+    Vertex_clustering::Result clusters;
+    clusterVerticesToBones(skinClusterPlug.node(), mesh.get(), skeleton.get(), loaderSkeleton, clusters);
 
-    VertToBoneInfo vertToBoneInfo(skeleton.get(), mesh.get(), bonesPerVertex);
+    VertToBoneInfo vertToBoneInfo(skeleton.get(), mesh.get(), clusters.bones_per_vertex);
     
     SampleSet::SampleSetSettings sampleSettings;
 
     // Get the default junction radius. XXX: this should be a parameter
-    vertToBoneInfo.get_default_junction_radius(skeleton.get(), mesh.get(), sampleSettings.junction_radius);
+    sampleSettings.junction_radius = clusters.junction_radius;
+
+    const std::map<Bone::Id,float> &hrbf_radius = clusters.hrbf_radius;
 
     // Run the sampling for each joint.  The joints are in world space, so the samples will also be in
-    // world space.
+    // world space.  Samples computed by a previous run with the same mesh, skeleton and settings are
+    // restored from the HRBF cache instead.
     SampleSet::SampleSet samples;
     for(Bone::Id bone_id: skeleton->get_bone_ids())
+    {
+        MMatrix restMatrix = loaderSkeleton.at(bone_id).dagPath.exclusiveMatrix(&status); merr("dagPath.exclusiveMatrix");
+        uint64_t key = HRBF_cache::sampling_key(*mesh, *skeleton, vertToBoneInfo, sampleSettings,
+                                                DagHelpers::MMatrixToTransfo(restMatrix), bone_id);
+
+        HRBF_cache::Bone_record record;
+        if(HRBF_cache::load(key, record))
+        {
+            samples._samples[bone_id].nodes = record.nodes;
+            samples._samples[bone_id].n_nodes = record.normals;
+            continue;
+        }
+
         samples.choose_hrbf_samples(mesh.get(), skeleton.get(), vertToBoneInfo, sampleSettings, bone_id);
+        if(samples._samples.find(bone_id) == samples._samples.end())
+            continue;
+
+        record.nodes = samples._samples.at(bone_id).nodes;
+        record.normals = samples._samples.at(bone_id).n_nodes;
+        if(hrbf_radius.find(bone_id) != hrbf_radius.end())
+            record.radius = hrbf_radius.at(bone_id);
+        HRBF_cache::save(key, record);
+    }
 
     // Remove surfaces that didn't find any samples.
     removeEmptySurfaces(loaderSkeleton, samples);
 
-    std::map<Bone::Id,float> hrbf_radius;
-    vertToBoneInfo.get_default_hrbf_radius(skeleton.get(), mesh.get(), hrbf_radius);
-
     // Create a group to store all of the nodes we'll create.
     MObject mainGroup = DagHelpers::createTransform(skinClusterName + "Implicit", status); merr("createTransform");
 
@@ -551,6 +604,7 @@ void ImplicitCommand::init(MString skinClusterName)
         // Store this surface's samples.
         surface->save_sampleset(inputSample);
 
+
         if(bone_item.parent != -1)
         {
             // The source bone has a parent.  If the parent is in the skeleton, we should have already
@@ -571,6 +625,10 @@ void ImplicitCommand::init(MString skinClusterName)
             parent_index.push_back(-1);
     }
 
+    // Solve every surface now on all cores and hand each one its HRBF, instead of letting them
+    // solve their samples one at a time when they're first evaluated.
+    ImplicitSurface::fit_pending(surfaces);
+
     int nextBlendInputIdx = 0;
 
     MDGModifier dgModifier;
@@ -604,6 +662,33 @@ void ImplicitCommand::init(MString skinClusterName)
     appendToResult(path);
 }
 
+// Select a 4D blending operator for a joint the way an ImplicitSurface's blendMode does
+// (Skeleton::set_joint_blending()), and check that its tables were loaded for it.
+void ImplicitCommand::joint_operator_test()
+{
+    const bool loadedBefore = Blending_env::is_family_loaded(Blending_env::FAMILY_4D_BULGE);
+
+    vector<shared_ptr<const Bone> > bones;
+    bones.push_back(shared_ptr<const Bone>(new Bone()));
+    bones.push_back(shared_ptr<const Bone>(new Bone()));
+    vector<Bone::Id> parents;
+    parents.push_back(-1);
+    parents.push_back(0);
+    Skeleton skeleton(bones, parents, true);
+
+    Bone::Id child = bones[1]->get_bone_id();
+    skeleton.set_joint_bulge_mag(child, 0.5f);
+    skeleton.set_joint_blending(child, EJoint::BULGE_4D);
+
+    if(skeleton.joint_blending(child) != EJoint::BULGE_4D)
+        throw runtime_error("jointOperatorTest: the joint didn't keep EJoint::BULGE_4D.");
+    if(!Blending_env::is_family_loaded(Blending_env::FAMILY_4D_BULGE))
+        throw runtime_error("jointOperatorTest: selecting EJoint::BULGE_4D didn't load the 4D bulge tables.");
+
+    MGlobal::displayInfo(MString("jointOperatorTest: passed") + (loadedBefore? " (4D bulge tables were already loaded)": ""));
+    setResult(true);
+}
+
 void ImplicitCommand::test(MString nodeName)
 {
     ImplicitDeformer *deformer = getDeformerByName(nodeName);
@@ -631,6 +716,60 @@ MStatus ImplicitCommand::doIt(const MArgList &args)
 
                 calculate_base_potential(nodeName);
             }
+            else if(args.asString(i, &status) == MString("-memoryReport") && MS::kSuccess == status)
+            {
+                ++i;
+                MString nodeName = args.asString(i, &status);
+                if(status != MS::kSuccess) merr("args.asString");
+
+                memory_report(nodeName);
+            }
+            else if(args.asString(i, &status) == MString("-tableSweep") && MS::kSuccess == status)
+            {
+                ++i;
+                MString nodeName = args.asString(i, &status);
+                if(status != MS::kSuccess) merr("args.asString");
+
+                table_sweep(nodeName);
+            }
+            else if(args.asString(i, &status) == MString("-bake") && MS::kSuccess == status)
+            {
+                // -bake deformer path first last
+                ++i;
+                MString nodeName = args.asString(i, &status);
+                if(status != MS::kSuccess) merr("args.asString");
+
+                ++i;
+                MString path = args.asString(i, &status);
+                if(status != MS::kSuccess) merr("args.asString");
+
+                ++i;
+                int first = args.asInt(i, &status);
+                if(status != MS::kSuccess) merr("args.asInt");
+
+                ++i;
+                int last = args.asInt(i, &status);
+                if(status != MS::kSuccess) merr("args.asInt");
+
+                bake(nodeName, path, first, last);
+            }
+            else if(args.asString(i, &status) == MString("-rigBench") && MS::kSuccess == status)
+            {
+                // -rigBench path/to/rig (without extension)
+                ++i;
+                MString basename = args.asString(i, &status);
+                if(status != MS::kSuccess) merr("args.asString");
+
+                Loader::benchmark(basename.asChar());
+            }
+            else if(args.asString(i, &status) == MString("-hrbfLayoutBench") && MS::kSuccess == status)
+            {
+                HRBF_env::benchmark_layouts();
+            }
+            else if(args.asString(i, &status) == MString("-jointOperatorTest") && MS::kSuccess == status)
+            {
+                joint_operator_test();
+            }
             else if(args.asString(i, &status) == MString("-test") && MS::kSuccess == status)
             {
                 ++i;
@@ -694,10 +833,8 @@ public:
 MStatus initializePlugin(MObject obj)
 {
     return handle_exceptions([&] {
+        // Blending operators are loaded when a joint first selects them
         std::vector<Blending_env::Op_t> op;
-        op.push_back( Blending_env::B_D  );
-        op.push_back( Blending_env::U_OH );
-        op.push_back( Blending_env::C_D  );
 
         // If CUDA initialization fails, this will throw an exception.  Don't call Cuda_ctrl::cleanup
         // in this case.
@@ -714,6 +851,9 @@ MStatus initializePlugin(MObject obj)
             status = plugin.registerData("ImplicitSurfaceData", ImplicitSurfaceData::id, ImplicitSurfaceData::creator);
             merr("registerData(ImplicitSurfaceData)");
 
+            status = plugin.registerData("ImplicitSampleData", ImplicitSampleData::id, ImplicitSampleData::creator);
+            merr("registerData(ImplicitSampleData)");
+
             status = ImplicitSurfaceGeometryOverride::initialize();
             merr("ImplicitSurfaceGeometryOverride::initialize");
 
@@ -772,5 +912,8 @@ MStatus uninitializePlugin(MObject obj)
 
         status = plugin.deregisterData(ImplicitSurfaceData::id);
         merr("deregisterData(ImplicitSurfaceData)");
+
+        status = plugin.deregisterData(ImplicitSampleData::id);
+        merr("deregisterData(ImplicitSampleData)");
     });
 }
@@ -24,5 +24,6 @@
 #include "implicit_blend.hpp"
 #include "implicit_deformer.hpp"
 #include "implicit_surface_data.hpp"
+#include "implicit_sample_data.hpp"
 
 #endif
@@ -0,0 +1,211 @@
+#include "mesh_reorder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+
+#include "mesh.hpp"
+#include "loader_mesh.hpp"
+
+// =============================================================================
+namespace Mesh_reorder {
+// =============================================================================
+
+/// Spread the 10 lower bits of 'v' every 3 bits
+static unsigned expand_bits(unsigned v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+
+/// 30 bits Morton code of every vertex inside the mesh bounding box
+static void compute_morton_codes(const Mesh& m, std::vector<unsigned>& codes)
+{
+    const int nb_vert = m.get_nb_vertices();
+    codes.resize(nb_vert);
+    if(nb_vert == 0) return;
+
+    const float inf = std::numeric_limits<float>::max();
+    Vec3_cu lo( inf,  inf,  inf);
+    Vec3_cu hi(-inf, -inf, -inf);
+    for(int i = 0; i < nb_vert; i++){
+        const Vec3_cu v = m.get_vertex(i);
+        lo = Vec3_cu(std::min(lo.x, v.x), std::min(lo.y, v.y), std::min(lo.z, v.z));
+        hi = Vec3_cu(std::max(hi.x, v.x), std::max(hi.y, v.y), std::max(hi.z, v.z));
+    }
+
+    const Vec3_cu len = hi - lo;
+    const float scale = 1023.f / std::max(std::max(len.x, len.y), std::max(len.z, 1e-6f));
+    for(int i = 0; i < nb_vert; i++)
+    {
+        const Vec3_cu v = (m.get_vertex(i) - lo) * scale;
+        const unsigned x = std::min(1023u, (unsigned)v.x);
+        const unsigned y = std::min(1023u, (unsigned)v.y);
+        const unsigned z = std::min(1023u, (unsigned)v.z);
+        codes[i] = (expand_bits(x) << 2) | (expand_bits(y) << 1) | expand_bits(z);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void compute_vertex_order(const Mesh& m, std::vector<int>& new_to_old)
+{
+    const int nb_vert = m.get_nb_vertices();
+    std::vector<unsigned> codes;
+    compute_morton_codes(m, codes);
+
+    struct Cmp {
+        const std::vector<unsigned>& c;
+        Cmp(const std::vector<unsigned>& c_) : c(c_) { }
+        bool operator()(int a, int b) const {
+            return c[a] < c[b] || (c[a] == c[b] && a < b);
+        }
+    } cmp(codes);
+
+    std::vector<int> seeds(nb_vert);
+    for(int i = 0; i < nb_vert; i++) seeds[i] = i;
+    std::sort(seeds.begin(), seeds.end(), cmp);
+
+    // Breadth first walk of the one-ring from each seed taken in Morton order.
+    // Neighbours are visited in Morton order too.
+    new_to_old.clear();
+    new_to_old.reserve(nb_vert);
+    std::vector<bool> visited(nb_vert, false);
+    std::deque<int> queue;
+    std::vector<int> ring;
+    for(int s = 0; s < nb_vert; s++)
+    {
+        if( visited[seeds[s]] ) continue;
+        visited[seeds[s]] = true;
+        queue.push_back(seeds[s]);
+
+        while( !queue.empty() )
+        {
+            const int v = queue.front();
+            queue.pop_front();
+            new_to_old.push_back(v);
+
+            ring.clear();
+            const int dep      = m.get_edge_offset(v*2    );
+            const int nb_neigh = m.get_edge_offset(v*2 + 1);
+            for(int n = dep; n < (dep+nb_neigh); n++){
+                const int j = m.get_edge(n);
+                if( !visited[j] ){
+                    visited[j] = true;
+                    ring.push_back(j);
+                }
+            }
+            std::sort(ring.begin(), ring.end(), cmp);
+            queue.insert(queue.end(), ring.begin(), ring.end());
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void compute_tri_order(const Mesh& m,
+                       const std::vector<int>& old_to_new,
+                       std::vector<int>& tri_new_to_old)
+{
+    const int nb_tri = m.get_nb_tri();
+    std::vector< std::pair<long long, int> > keys(nb_tri);
+    for(int t = 0; t < nb_tri; t++)
+    {
+        const int a = old_to_new[ m.get_tri(t*3    ) ];
+        const int b = old_to_new[ m.get_tri(t*3 + 1) ];
+        const int c = old_to_new[ m.get_tri(t*3 + 2) ];
+        const long long lo = std::min(a, std::min(b, c));
+        const long long hi = std::max(a, std::max(b, c));
+        keys[t] = std::make_pair((lo << 32) | hi, t);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    tri_new_to_old.resize(nb_tri);
+    for(int t = 0; t < nb_tri; t++) tri_new_to_old[t] = keys[t].second;
+}
+
+// -----------------------------------------------------------------------------
+
+std::vector<int> invert(const std::vector<int>& perm)
+{
+    std::vector<int> inv(perm.size());
+    for(unsigned i = 0; i < perm.size(); i++) inv[ perm[i] ] = i;
+    return inv;
+}
+
+// -----------------------------------------------------------------------------
+
+double mean_edge_span(const Mesh& m, const std::vector<int>& old_to_new)
+{
+    const int nb_tri = m.get_nb_tri();
+    if(nb_tri == 0) return 0.;
+
+    double sum = 0.;
+    for(int t = 0; t < nb_tri; t++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            int a = m.get_tri(t*3 + j);
+            int b = m.get_tri(t*3 + (j+1) % 3);
+            if( !old_to_new.empty() ){
+                a = old_to_new[a];
+                b = old_to_new[b];
+            }
+            sum += std::abs(a - b);
+        }
+    }
+    return sum / (3. * nb_tri);
+}
+
+// -----------------------------------------------------------------------------
+
+Mesh* apply_order(const Mesh& m, const std::vector<int>& new_to_old)
+{
+    const std::vector<int> old_to_new = invert(new_to_old);
+
+    std::vector<int> tri_new_to_old;
+    compute_tri_order(m, old_to_new, tri_new_to_old);
+
+    const int nb_vert = m.get_nb_vertices();
+    const int nb_tri  = m.get_nb_tri();
+
+    Loader::Abs_mesh abs_mesh;
+    abs_mesh._vertices.resize(nb_vert);
+    abs_mesh._normals. resize(nb_vert);
+    for(int i = 0; i < nb_vert; i++)
+    {
+        const int old = new_to_old[i];
+        abs_mesh._vertices[i] = m.get_vertex(old).to_point();
+        // Disconnected vertices have no normal
+        abs_mesh._normals [i] = m.is_disconnect(old) ? Vec3_cu(0.f, 0.f, 0.f) : m.get_mean_normal(old);
+    }
+
+    abs_mesh._triangles.resize(nb_tri);
+    for(int t = 0; t < nb_tri; t++)
+    {
+        Loader::Tri_face& f = abs_mesh._triangles[t];
+        for(int j = 0; j < 3; j++){
+            const int v = old_to_new[ m.get_tri(tri_new_to_old[t]*3 + j) ];
+            f.v[j] = v;
+            f.n[j] = v;
+        }
+    }
+
+    return new Mesh(abs_mesh);
+}
+
+// -----------------------------------------------------------------------------
+
+Mesh* reorder(const Mesh& m, std::vector<int>& new_to_old)
+{
+    compute_vertex_order(m, new_to_old);
+    return apply_order(m, new_to_old);
+}
+
+}// END Mesh_reorder NAMESPACE =================================================
@@ -0,0 +1,61 @@
+#ifndef MESH_REORDER_HPP__
+#define MESH_REORDER_HPP__
+
+#include <vector>
+
+class Mesh;
+
+/** @namespace Mesh_reorder
+    @brief Cache friendly re-ordering of the mesh vertices and triangles.
+
+    Vertex order usually comes straight from the source file. Kernels which
+    gather the one-ring of a vertex or look up its grid cell read memory all
+    over the place. We sort vertices along a Morton curve and then walk the
+    one-ring breadth first from each seed so that neighbours end up close in
+    memory. Triangles are then sorted by their smallest new vertex index.
+
+    @code
+    std::vector<int> new_to_old;
+    Mesh* m = Mesh_reorder::reorder(input_mesh, new_to_old);
+    // m->get_vertex(i) == input_mesh.get_vertex( new_to_old[i] )
+    @endcode
+*/
+// =============================================================================
+namespace Mesh_reorder {
+// =============================================================================
+
+/// Compute a locality preserving order for the vertices of 'm'.
+/// @param new_to_old : new_to_old[new_idx] == index of the vertex in 'm'
+void compute_vertex_order(const Mesh& m, std::vector<int>& new_to_old);
+
+/// Compute an order for the triangles of 'm' given the new vertex order.
+/// @param old_to_new : inverse permutation of the vertices
+/// @param tri_new_to_old : tri_new_to_old[new_idx] == index of the triangle
+/// in 'm'
+void compute_tri_order(const Mesh& m,
+                       const std::vector<int>& old_to_new,
+                       std::vector<int>& tri_new_to_old);
+
+/// @return the inverse of the permutation 'perm'
+std::vector<int> invert(const std::vector<int>& perm);
+
+/// Mean distance between the indices of the two vertices of an edge, which
+/// is how far apart in memory a one-ring gather reads.
+/// @param old_to_new : vertex permutation to measure, empty for the order
+/// of 'm'
+double mean_edge_span(const Mesh& m, const std::vector<int>& old_to_new = std::vector<int>());
+
+/// Build a copy of 'm' with its vertices in the order 'new_to_old' and its
+/// triangles re-ordered accordingly (compute_tri_order()).
+/// Normals of the new mesh are the mean normals of 'm'.
+/// @return the new mesh, to be deleted by the caller
+Mesh* apply_order(const Mesh& m, const std::vector<int>& new_to_old);
+
+/// compute_vertex_order() then apply_order()
+/// @param new_to_old : the vertex permutation used
+/// @return the new mesh, to be deleted by the caller
+Mesh* reorder(const Mesh& m, std::vector<int>& new_to_old);
+
+}// END Mesh_reorder NAMESPACE =================================================
+
+#endif // MESH_REORDER_HPP__
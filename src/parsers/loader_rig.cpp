@@ -0,0 +1,632 @@
+#include "loader_rig.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <deque>
+
+#include "parallel.hpp"
+
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+/// Minimal number of bytes worth a thread
+static const int MIN_CHUNK_BYTES = 64 * 1024;
+
+// -----------------------------------------------------------------------------
+/// @name Tokenizer
+// -----------------------------------------------------------------------------
+
+static inline bool is_blank(char c){ return c == ' ' || c == '\t' || c == '\r'; }
+
+static inline void skip_blanks(const char*& p){ while( is_blank(*p) ) ++p; }
+
+/// Skip blanks and ends of line, for formats where values span several lines
+static inline void skip_spaces(const char*& p){ while( is_blank(*p) || *p == '\n' ) ++p; }
+
+/// Move 'p' after the next end of line (or on the terminating null)
+static inline void skip_line(const char*& p, const char* end)
+{
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    p = eol ? eol + 1 : end;
+}
+
+/// @return true and move 'p' after the keyword if the line starts with 'key'
+/// followed by a blank
+static inline bool match(const char*& p, const char* key)
+{
+    const size_t len = strlen(key);
+    if( strncmp(p, key, len) != 0 || !is_blank(p[len]) ) return false;
+    p += len;
+    return true;
+}
+
+/// Parse an integer, skipping leading blanks
+static inline bool parse_int(const char*& p, int& val)
+{
+    skip_blanks(p);
+    const bool neg = *p == '-';
+    if( *p == '-' || *p == '+' ) ++p;
+    if( *p < '0' || *p > '9' ) return false;
+    int v = 0;
+    for( ; *p >= '0' && *p <= '9'; ++p) v = v*10 + (*p - '0');
+    val = neg ? -v : v;
+    return true;
+}
+
+/// Parse a decimal number with an optional exponent ("-2.49554e-009"),
+/// skipping leading blanks
+static inline bool parse_float(const char*& p, float& val)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                   1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                   1e16, 1e17, 1e18};
+    skip_blanks(p);
+    const bool neg = *p == '-';
+    if( *p == '-' || *p == '+' ) ++p;
+
+    // Mantissa on 18 significant digits, the extra ones only shift the exponent
+    unsigned long long m = 0;
+    int nb_digits = 0, exp = 0;
+    bool any = false;
+    for( ; *p >= '0' && *p <= '9'; ++p, any = true){
+        if(nb_digits < 18){ m = m*10 + (*p - '0'); if(m) nb_digits++; }
+        else exp++;
+    }
+    if( *p == '.' ){
+        for(++p; *p >= '0' && *p <= '9'; ++p, any = true){
+            if(nb_digits < 18){ m = m*10 + (*p - '0'); if(m) nb_digits++; exp--; }
+        }
+    }
+    if( !any ) return false;
+
+    if( *p == 'e' || *p == 'E' ){
+        const char* q = p + 1;
+        int e;
+        if( parse_int(q, e) ){ exp += e; p = q; }
+    }
+
+    double v = (double)m;
+    if     (exp < 0) v = exp >= -18 ? v / pow10[-exp] : v * std::pow(10., exp);
+    else if(exp > 0) v = exp <=  18 ? v * pow10[ exp] : v * std::pow(10., exp);
+    val = (float)(neg ? -v : v);
+    return true;
+}
+
+static inline bool parse_vec3(const char*& p, float& x, float& y, float& z)
+{
+    return parse_float(p, x) && parse_float(p, y) && parse_float(p, z);
+}
+
+/// Split [begin end[ in at most 'nb' chunks ending on an end of line
+/// @return chunk boundaries (number of chunks + 1 pointers)
+static std::vector<const char*> line_chunks(const char* begin, const char* end, int nb)
+{
+    std::vector<const char*> bounds(1, begin);
+    const size_t chunk = (end - begin) / std::max(nb, 1) + 1;
+    const char* p = begin;
+    while( p < end )
+    {
+        p = (size_t)(end - p) > chunk ? p + chunk : end;
+        skip_line(p, end);
+        bounds.push_back( p );
+    }
+    if( bounds.size() == 1 ) bounds.push_back( end );
+    return bounds;
+}
+
+static int threads_for(size_t size, int nb_threads)
+{
+    if(nb_threads > 0) return nb_threads;
+    return Parallel::nb_threads((int)std::min(size, (size_t)1 << 30), MIN_CHUNK_BYTES);
+}
+
+static bool error(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Loader: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    return false;
+}
+
+// =============================================================================
+/// @name .obj
+// =============================================================================
+
+/// What a thread extracts from its chunk of the .obj
+struct Obj_chunk {
+    Obj_chunk() : ok(true) { }
+    std::vector<Point_cu> verts;
+    std::vector<Vec3_cu>  normals;
+    std::vector<Tri_face> tris;
+    bool ok;
+};
+
+/// Parse a face corner "v", "v/vt", "v//vn" or "v/vt/vn" (1-based indices)
+static inline bool parse_corner(const char*& p, int& v, int& n)
+{
+    n = 0;
+    if( !parse_int(p, v) ) return false;
+    if( *p != '/' ) return true;
+    ++p;
+    int vt;
+    if( *p != '/' ) parse_int(p, vt);
+    if( *p != '/' ) return true;
+    ++p;
+    return parse_int(p, n);
+}
+
+static void parse_obj_chunk(const char* p, const char* end, Obj_chunk& out)
+{
+    // Fan triangulation of polygons, keep the corners in fixed arrays
+    const int MAX_CORNERS = 64;
+    int cv[MAX_CORNERS], cn[MAX_CORNERS];
+    while( p < end )
+    {
+        skip_blanks(p);
+        float x, y, z;
+        if( match(p, "v") )
+        {
+            if( !parse_vec3(p, x, y, z) ) { out.ok = false; return; }
+            out.verts.push_back( Point_cu(x, y, z) );
+        }
+        else if( match(p, "vn") )
+        {
+            if( !parse_vec3(p, x, y, z) ) { out.ok = false; return; }
+            out.normals.push_back( Vec3_cu(x, y, z) );
+        }
+        else if( match(p, "f") )
+        {
+            int nb = 0;
+            skip_blanks(p);
+            while( nb < MAX_CORNERS && *p != '\n' && *p != '\0' )
+            {
+                // Negative (relative) indices are not supported
+                if( !parse_corner(p, cv[nb], cn[nb]) || cv[nb] <= 0 ) { out.ok = false; return; }
+                nb++;
+                skip_blanks(p);
+            }
+            if( nb < 3 ) { out.ok = false; return; }
+            for(int i = 1; i < nb - 1; ++i)
+            {
+                Tri_face f;
+                const int c[3] = {0, i, i+1};
+                for(int k = 0; k < 3; ++k){
+                    f.v[k] = cv[c[k]] - 1;
+                    f.n[k] = cn[c[k]] - 1;
+                }
+                out.tris.push_back( f );
+            }
+        }
+        skip_line(p, end);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool parse_obj(const char* data, size_t size, Abs_mesh& mesh, int nb_threads)
+{
+    const std::vector<const char*> bounds = line_chunks(data, data + size, threads_for(size, nb_threads));
+    const int nb_chunks = (int)bounds.size() - 1;
+
+    std::vector<Obj_chunk> chunks(nb_chunks);
+    Parallel::for_chunks(nb_chunks, nb_chunks, [&](int, int begin, int end){
+        for(int c = begin; c < end; ++c)
+            parse_obj_chunk(bounds[c], bounds[c+1], chunks[c]);
+    });
+
+    // Concatenate in file order
+    size_t nb_verts = 0, nb_normals = 0, nb_tris = 0;
+    for(const Obj_chunk& c : chunks){
+        if( !c.ok ) return error("malformed .obj (chunk %d)", (int)(&c - &chunks[0]));
+        nb_verts += c.verts.size(); nb_normals += c.normals.size(); nb_tris += c.tris.size();
+    }
+
+    mesh._vertices. clear(); mesh._vertices. reserve(nb_verts  );
+    mesh._normals.  clear(); mesh._normals.  reserve(nb_normals);
+    mesh._triangles.clear(); mesh._triangles.reserve(nb_tris   );
+    for(const Obj_chunk& c : chunks){
+        mesh._vertices. insert(mesh._vertices. end(), c.verts.  begin(), c.verts.  end());
+        mesh._normals.  insert(mesh._normals.  end(), c.normals.begin(), c.normals.end());
+        mesh._triangles.insert(mesh._triangles.end(), c.tris.   begin(), c.tris.   end());
+    }
+
+    for(const Tri_face& f : mesh._triangles)
+        for(int k = 0; k < 3; ++k)
+            if( f.v[k] >= nb_verts || f.n[k] >= (int)nb_normals )
+                return error("face index out of range in .obj (%d)", (int)f.v[k]);
+    return true;
+}
+
+// =============================================================================
+/// @name .skel
+// =============================================================================
+
+bool parse_skel(const char* data, size_t /*size*/, Abs_skeleton& skel)
+{
+    const char* p = data;
+    int nb_joints, nb_edges;
+    skip_spaces(p);
+    if( !parse_int(p, nb_joints) || !parse_int(p, nb_edges) || nb_joints < 0 || nb_edges < 0 )
+        return error("malformed .skel header");
+
+    skel._joints.resize(nb_joints);
+    for(int i = 0; i < nb_joints; ++i){
+        float x, y, z;
+        skip_spaces(p);
+        if( !parse_vec3(p, x, y, z) ) return error("malformed .skel joint %d", i);
+        skel._joints[i] = Point_cu(x, y, z);
+    }
+
+    std::vector< std::vector<int> > adj(nb_joints);
+    for(int i = 0; i < nb_edges; ++i){
+        int a, b;
+        skip_spaces(p);
+        if( !parse_int(p, a) || !parse_int(p, b) ||
+            a < 0 || b < 0 || a >= nb_joints || b >= nb_joints )
+            return error("malformed .skel edge %d", i);
+        adj[a].push_back(b);
+        adj[b].push_back(a);
+    }
+
+    // Orient the edges from joint 0
+    skel._parents.assign(nb_joints, -1);
+    std::vector<bool> done(nb_joints, false);
+    std::deque<int> queue;
+    if(nb_joints > 0){ queue.push_back(0); done[0] = true; }
+    while( !queue.empty() )
+    {
+        const int j = queue.front();
+        queue.pop_front();
+        for(int c : adj[j]){
+            if( done[c] ) continue;
+            done[c] = true;
+            skel._parents[c] = j;
+            queue.push_back(c);
+        }
+    }
+    return true;
+}
+
+// =============================================================================
+/// @name .weights
+// =============================================================================
+
+struct Weights_chunk {
+    Weights_chunk() : ok(true) { }
+    std::vector<int>   counts;
+    std::vector<int>   bones;
+    std::vector<float> weights;
+    bool ok;
+};
+
+static void parse_weights_chunk(const char* p, const char* end, Weights_chunk& out)
+{
+    while( p < end )
+    {
+        int count = 0;
+        skip_blanks(p);
+        while( *p != '\n' && *p != '\0' )
+        {
+            int bone; float w;
+            if( !parse_int(p, bone) || !parse_float(p, w) ) { out.ok = false; return; }
+            out.bones.  push_back(bone);
+            out.weights.push_back(w);
+            count++;
+            skip_blanks(p);
+        }
+        out.counts.push_back(count);
+        skip_line(p, end);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool parse_weights(const char* data, size_t size, Abs_weights& w, int nb_threads)
+{
+    // A missing end of line at the end of the file doesn't add a vertex
+    while( size > 0 && (data[size-1] == '\n' || data[size-1] == '\r') ) size--;
+
+    const std::vector<const char*> bounds = line_chunks(data, data + size, threads_for(size, nb_threads));
+    const int nb_chunks = (int)bounds.size() - 1;
+
+    std::vector<Weights_chunk> chunks(nb_chunks);
+    Parallel::for_chunks(nb_chunks, nb_chunks, [&](int, int begin, int end){
+        for(int c = begin; c < end; ++c)
+            parse_weights_chunk(bounds[c], bounds[c+1], chunks[c]);
+    });
+
+    size_t nb_verts = 0, nb_entries = 0;
+    for(const Weights_chunk& c : chunks){
+        if( !c.ok ) return error("malformed .weights (chunk %d)", (int)(&c - &chunks[0]));
+        nb_verts += c.counts.size(); nb_entries += c.bones.size();
+    }
+
+    w._offsets.resize(nb_verts + 1);
+    w._bones.  clear(); w._bones.  reserve(nb_entries);
+    w._weights.clear(); w._weights.reserve(nb_entries);
+    int v = 0, off = 0;
+    for(const Weights_chunk& c : chunks){
+        for(int count : c.counts){ w._offsets[v++] = off; off += count; }
+        w._bones.  insert(w._bones.  end(), c.bones.  begin(), c.bones.  end());
+        w._weights.insert(w._weights.end(), c.weights.begin(), c.weights.end());
+    }
+    w._offsets[v] = off;
+    return true;
+}
+
+// =============================================================================
+/// @name .ism
+// =============================================================================
+
+/// Location of the samples of a bone in the [HRBF_ENV] section
+struct Ism_bone {
+    int bone_id;
+    int nb_points;
+    const char* first; ///< first line of the points
+};
+
+// -----------------------------------------------------------------------------
+
+/// Parse the 'nb' (position, normal) pairs starting at 'p'
+static bool parse_ism_points(const char* p, int nb, Abs_samples& out)
+{
+    out._nodes.  resize(nb);
+    out._n_nodes.resize(nb);
+    for(int i = 0; i < nb; ++i){
+        Vec3_cu& v = out._nodes[i];
+        Vec3_cu& n = out._n_nodes[i];
+        skip_spaces(p);
+        if( !parse_vec3(p, v.x, v.y, v.z) ) return false;
+        skip_spaces(p);
+        if( !parse_vec3(p, n.x, n.y, n.z) ) return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool parse_ism(const char* data, size_t size, Abs_ism& ism, int nb_threads)
+{
+    const char* p   = data;
+    const char* end = data + size;
+
+    ism = Abs_ism();
+    std::vector<Ism_bone> bones;
+    std::map<int, Abs_cap>* caps = 0;
+    enum { NONE, HRBF_ENV, CAPS, BONE_TYPES, SSD_IS_LERP, HRBF_RADIUS } section = NONE;
+    int bone_id = -1;
+
+    // The small sections are 'keyword value' lines, the samples are only
+    // located here and parsed afterward
+    while( p < end )
+    {
+        skip_blanks(p);
+        if( *p == '[' )
+        {
+            const char* name = p;
+            caps = 0;
+            if     ( !strncmp(name, "[HRBF_ENV]"      , 10) ) section = HRBF_ENV;
+            else if( !strncmp(name, "[HRBF_JCAPS_ENV]", 16) ) { section = CAPS; caps = &ism._jcaps; }
+            else if( !strncmp(name, "[HRBF_PCAPS_ENV]", 16) ) { section = CAPS; caps = &ism._pcaps; }
+            else if( !strncmp(name, "[BONE_TYPES]"    , 12) ) section = BONE_TYPES;
+            else if( !strncmp(name, "[SSD_IS_LERP]"   , 13) ) section = SSD_IS_LERP;
+            else if( !strncmp(name, "[HRBF_RADIUS]"   , 13) ) section = HRBF_RADIUS;
+            else section = NONE; // unknown sections are skipped
+            bone_id = -1;
+            skip_line(p, end);
+            continue;
+        }
+
+        int ival; float fval;
+        if( match(p, "nb_bone") ) { }
+        else if( match(p, "bone_id") ) {
+            if( !parse_int(p, bone_id) ) return error("malformed bone_id in .ism");
+        }
+        else if( section == HRBF_ENV && match(p, "nb_points") )
+        {
+            Ism_bone b;
+            b.bone_id = bone_id;
+            if( !parse_int(p, b.nb_points) || b.nb_points < 0 ) return error("malformed nb_points of bone %d in .ism", bone_id);
+            skip_line(p, end);
+            b.first = p;
+            // Skip the position and normal lines
+            for(int i = 0; i < b.nb_points*2 && p < end; ++i) skip_line(p, end);
+            bones.push_back( b );
+            continue;
+        }
+        else if( section == CAPS && match(p, "is_cap_enable") ) {
+            if( !parse_int(p, ival) ) return error("malformed is_cap_enable of bone %d in .ism", bone_id);
+            (*caps)[bone_id]._enable = ival != 0;
+        }
+        else if( section == CAPS && match(p, "cap_radius") ) {
+            if( !parse_float(p, fval) ) return error("malformed cap_radius of bone %d in .ism", bone_id);
+            (*caps)[bone_id]._radius = fval;
+        }
+        else if( section == BONE_TYPES && match(p, "bone_type") ) {
+            if( !parse_int(p, ival) ) return error("malformed bone_type of bone %d in .ism", bone_id);
+            ism._bone_types[bone_id] = ival;
+        }
+        else if( section == HRBF_RADIUS && match(p, "hrbf_radius") ) {
+            if( !parse_float(p, fval) ) return error("malformed hrbf_radius of bone %d in .ism", bone_id);
+            ism._hrbf_radius[bone_id] = fval;
+        }
+        else if( section == SSD_IS_LERP && match(p, "nb_points") )
+        {
+            int nb;
+            if( !parse_int(p, nb) || nb < 0 ) return error("malformed [SSD_IS_LERP] in .ism");
+            ism._ssd_is_lerp.resize(nb);
+            for(int i = 0; i < nb; ++i){
+                skip_spaces(p);
+                if( !parse_int(p, ival) ) return error("malformed [SSD_IS_LERP] value %d in .ism", i);
+                ism._ssd_is_lerp[i] = ival != 0;
+            }
+        }
+        skip_line(p, end);
+    }
+
+    // Samples of each bone in parallel
+    std::vector<Abs_samples*> dst(bones.size());
+    for(unsigned i = 0; i < bones.size(); ++i)
+        dst[i] = &ism._samples[ bones[i].bone_id ];
+
+    const int nb_bones = (int)bones.size();
+    std::vector<char> ok(nb_bones, 1);
+    Parallel::for_chunks(nb_bones, threads_for(size, nb_threads), [&](int, int begin, int end){
+        for(int i = begin; i < end; ++i)
+            ok[i] = parse_ism_points(bones[i].first, bones[i].nb_points, *dst[i]);
+    });
+
+    for(int i = 0; i < nb_bones; ++i)
+        if( !ok[i] ) return error("malformed samples of bone %d in .ism", bones[i].bone_id);
+    return true;
+}
+
+// =============================================================================
+/// @name Files
+// =============================================================================
+
+bool read_file(const std::string& path, std::vector<char>& buffer)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if( !f ) return false;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buffer.resize(size + 1);
+    const bool ok = size >= 0 && fread(buffer.data(), 1, size, f) == (size_t)size;
+    fclose(f);
+    buffer[size] = '\0';
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Read 'path' and run 'parse(data, size)'
+template<class Parse>
+static bool load(const std::string& path, const Parse& parse)
+{
+    std::vector<char> buffer;
+    if( !read_file(path, buffer) ){
+        fprintf(stderr, "Loader: can't read %s\n", path.c_str());
+        return false;
+    }
+    if( !parse(buffer.data(), buffer.size() - 1) ){
+        fprintf(stderr, "Loader: failed to parse %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_obj(const std::string& path, Abs_mesh& mesh){
+    return load(path, [&](const char* d, size_t s){ return parse_obj(d, s, mesh); });
+}
+
+bool load_skel(const std::string& path, Abs_skeleton& skel){
+    return load(path, [&](const char* d, size_t s){ return parse_skel(d, s, skel); });
+}
+
+bool load_weights(const std::string& path, Abs_weights& w){
+    return load(path, [&](const char* d, size_t s){ return parse_weights(d, s, w); });
+}
+
+bool load_ism(const std::string& path, Abs_ism& ism){
+    return load(path, [&](const char* d, size_t s){ return parse_ism(d, s, ism); });
+}
+
+// -----------------------------------------------------------------------------
+
+bool load_rig(const std::string& basename, Abs_rig& rig)
+{
+    return load_obj    (basename + ".obj"    , rig._mesh   ) &&
+           load_skel   (basename + ".skel"   , rig._skel   ) &&
+           load_weights(basename + ".weights", rig._weights) &&
+           load_ism    (basename + ".ism"    , rig._ism    );
+}
+
+// =============================================================================
+/// @name Benchmark
+// =============================================================================
+
+/// Best wall clock time in seconds of 'nb_runs' calls to 'parse()'.
+/// (Timer measures the process' cpu time which adds up every thread)
+template<class Parse>
+static double best_time(int nb_runs, const Parse& parse)
+{
+    double best = 1e30;
+    for(int i = 0; i < nb_runs; ++i)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        if( !parse() ) return -1.;
+        const auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+// -----------------------------------------------------------------------------
+
+void benchmark(const std::string& basename, int nb_runs)
+{
+    const char* exts[] = {".obj", ".skel", ".weights", ".ism"};
+    const int nb_cores = Parallel::nb_threads(1 << 30, 1);
+
+    printf("\nRig parsing: %s (best of %d runs, %d cores)\n", basename.c_str(), nb_runs, nb_cores);
+    printf("%-10s %10s %12s %12s %12s %12s\n", "file", "size (KB)", "1 thread (ms)", "MB/s", "n threads (ms)", "MB/s");
+
+    Abs_rig rig;
+    for(int e = 0; e < 4; ++e)
+    {
+        std::vector<char> buffer;
+        if( !read_file(basename + exts[e], buffer) ){
+            printf("%-10s missing\n", exts[e]);
+            continue;
+        }
+        const char*  data = buffer.data();
+        const size_t size = buffer.size() - 1;
+
+        double t[2];
+        for(int k = 0; k < 2; ++k)
+        {
+            const int nb = k == 0 ? 1 : nb_cores;
+            t[k] = best_time(nb_runs, [&]() -> bool {
+                switch(e){
+                case 0:  return parse_obj    (data, size, rig._mesh   , nb);
+                case 1:  return parse_skel   (data, size, rig._skel       );
+                case 2:  return parse_weights(data, size, rig._weights, nb);
+                default: return parse_ism    (data, size, rig._ism    , nb);
+                }
+            });
+        }
+
+        if( t[0] < 0. || t[1] < 0. ){
+            printf("%-10s parse error\n", exts[e]);
+            continue;
+        }
+        const double mb = size / (1024. * 1024.);
+        printf("%-10s %10.1f %12.3f %12.1f %12.3f %12.1f\n", exts[e], size / 1024.,
+               t[0]*1000., mb / t[0], t[1]*1000., mb / t[1]);
+    }
+
+    printf("%d vertices %d triangles, %d joints, %d weighted vertices, %d bones with samples\n",
+           (int)rig._mesh._vertices.size(), (int)rig._mesh._triangles.size(),
+           (int)rig._skel._joints.size(), rig._weights.nb_vertices(),
+           (int)rig._ism._samples.size());
+
+    // Whole rig as load_rig() does it: reading the files included
+    const double t = best_time(nb_runs, [&]() -> bool {
+        Abs_rig r;
+        return load_rig(basename, r);
+    });
+    if( t >= 0. )
+        printf("load_rig() with file reads: %.3f ms\n", t*1000.);
+}
+
+}// END Loader =================================================================
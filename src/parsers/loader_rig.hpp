@@ -0,0 +1,132 @@
+#ifndef LOADER_RIG_HPP__
+#define LOADER_RIG_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "loader_mesh.hpp"
+#include "vec3_cu.hpp"
+
+/**
+ * @file loader_rig.hpp
+ * @brief Native parsers of the rig formats shipped in resource/meshes
+ *
+ * A rig is stored as four files sharing a base name:
+ * - .obj : the mesh (vertices, normals and polygons, triangulated on load)
+ * - .skel : joint positions and the undirected edges between joints
+ * - .weights : one line per vertex of 'bone_id weight' pairs
+ * - .ism : text dump of the per bone HRBF samples ([HRBF_ENV]), caps,
+ *   bone types and radius of the original application
+ *
+ * Files are read in a single buffer and parsed in place: no per line or per
+ * token allocation. Big files (.obj .weights) are split in line aligned
+ * chunks parsed on every core then concatenated, the HRBF samples of the
+ * .ism are parsed in parallel by bone. Numbers are parsed without the C
+ * locale so '.' is always the decimal separator.
+ *
+ * None of this depends on CUDA or Maya:
+ * @code
+ * Loader::Abs_rig rig;
+ * if( Loader::load_rig("resource/meshes/juna/juna", rig) ){
+ *     Mesh mesh( rig._mesh );
+ *     SampleSet::SampleSet samples;
+ *     samples.load_ism( std::move(rig._ism) );
+ * }
+ * @endcode
+ *
+ * Parsers return false and print the reason on stderr on malformed files.
+ */
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+/// Skeleton of a .skel file
+struct Abs_skeleton {
+    std::vector<Point_cu> _joints;  ///< rest position of each joint
+    /// parent joint of each joint, -1 for the root. Edges of the file are
+    /// undirected, the hierarchy is rooted at joint 0.
+    std::vector<int>      _parents;
+};
+
+/// Skinning weights of a .weights file stored by vertex in CSR:
+/// influences of vertex i are in [ _offsets[i] _offsets[i+1] [
+struct Abs_weights {
+    std::vector<int>   _offsets; ///< nb_vertices() + 1 offsets
+    std::vector<int>   _bones;   ///< influencing bone of each entry
+    std::vector<float> _weights; ///< weight of each entry
+
+    int nb_vertices() const { return _offsets.empty() ? 0 : (int)_offsets.size() - 1; }
+};
+
+/// HRBF samples of a bone: positions and normals
+struct Abs_samples {
+    std::vector<Vec3_cu> _nodes;
+    std::vector<Vec3_cu> _n_nodes;
+};
+
+/// Cap settings of a bone ([HRBF_JCAPS_ENV] and [HRBF_PCAPS_ENV])
+struct Abs_cap {
+    Abs_cap() : _enable(false), _radius(0.f) { }
+    bool  _enable;
+    float _radius;
+};
+
+/// Content of a .ism file. Keys are bone ids.
+struct Abs_ism {
+    std::map<int, Abs_samples> _samples;     ///< [HRBF_ENV]
+    std::map<int, Abs_cap>     _jcaps;       ///< [HRBF_JCAPS_ENV]
+    std::map<int, Abs_cap>     _pcaps;       ///< [HRBF_PCAPS_ENV]
+    /// [BONE_TYPES] bone type as written by the original application
+    std::map<int, int>         _bone_types;
+    std::map<int, float>       _hrbf_radius; ///< [HRBF_RADIUS]
+    std::vector<bool>          _ssd_is_lerp; ///< [SSD_IS_LERP] by vertex
+};
+
+/// Every file of a rig
+struct Abs_rig {
+    Abs_mesh     _mesh;
+    Abs_skeleton _skel;
+    Abs_weights  _weights;
+    Abs_ism      _ism;
+};
+
+// -----------------------------------------------------------------------------
+/// @name Parsing from memory
+/// 'data' must be terminated by a null character after 'size' bytes.
+/// @param nb_threads : number of threads to use, -1 for every core
+// -----------------------------------------------------------------------------
+
+bool parse_obj    (const char* data, size_t size, Abs_mesh&     mesh, int nb_threads = -1);
+bool parse_skel   (const char* data, size_t size, Abs_skeleton& skel);
+bool parse_weights(const char* data, size_t size, Abs_weights&  w   , int nb_threads = -1);
+bool parse_ism    (const char* data, size_t size, Abs_ism&      ism , int nb_threads = -1);
+
+// -----------------------------------------------------------------------------
+/// @name Loading from files
+// -----------------------------------------------------------------------------
+
+/// Read a whole file in 'buffer' followed by a null character
+/// @return false if the file can't be read
+bool read_file(const std::string& path, std::vector<char>& buffer);
+
+bool load_obj    (const std::string& path, Abs_mesh&     mesh);
+bool load_skel   (const std::string& path, Abs_skeleton& skel);
+bool load_weights(const std::string& path, Abs_weights&  w   );
+bool load_ism    (const std::string& path, Abs_ism&      ism );
+
+/// Load 'basename'.obj .skel .weights and .ism
+/// @return false if a file is missing or malformed
+bool load_rig(const std::string& basename, Abs_rig& rig);
+
+// -----------------------------------------------------------------------------
+
+/// Print the size, parsing time and throughput (MB/s) of each file of the
+/// rig 'basename', with one thread then with every core. Files are read once
+/// beforehand so only the parsing is timed (best of 'nb_runs'). The whole
+/// load_rig(), reads included, is timed last.
+void benchmark(const std::string& basename, int nb_runs = 10);
+
+}// END Loader =================================================================
+
+#endif // LOADER_RIG_HPP__
@@ -48,6 +48,33 @@ void HermiteRBF::init_coeffs(const std::vector<Vec3_cu>& nodes,
     HRBF_env::add_samples(_id, nodes, normals, weights);
 }
 
+void HermiteRBF::init_coeffs(const std::vector<Vec3_cu>& nodes,
+                             const std::vector<Vec3_cu>& normals,
+                             const std::vector<float>&   alphas,
+                             const std::vector<Vec3_cu>& betas)
+{
+    assert(alphas.size() == nodes.size() && betas.size() == nodes.size());
+    std::vector<float4> weights(nodes.size());
+    for(unsigned i = 0; i < nodes.size(); i++)
+        weights[i] = make_float4(betas[i].x, betas[i].y, betas[i].z, alphas[i]);
+
+    init_coeffs(nodes, normals, weights);
+
+    HRBF_env::apply_hrbf_transfos();
+}
+
+void HermiteRBF::get_coeffs(std::vector<float>& alphas, std::vector<Vec3_cu>& betas) const
+{
+    std::vector<float4> weights;
+    HRBF_env::get_weights(_id, weights);
+    alphas.resize(weights.size());
+    betas. resize(weights.size());
+    for(unsigned i = 0; i < weights.size(); i++){
+        alphas[i] = weights[i].w;
+        betas [i] = Vec3_cu(weights[i].x, weights[i].y, weights[i].z);
+    }
+}
+
 /// Sets the radius of the HRBF used to transform the potential field from
 /// global to compact
 void HermiteRBF::set_radius(float r){ HRBF_env::set_inst_radius(_id, r); }
@@ -62,8 +89,89 @@ void HermiteRBF::get_normals(std::vector<Vec3_cu>& list) const {
     HRBF_env::get_normals(_id, list);
 }
 
+void HermiteRBF::set_kernel(HRBF_wrapper::Rbf_kernel kernel){
+    HRBF_env::set_inst_kernel(_id, kernel);
+}
+
+HRBF_wrapper::Rbf_kernel HermiteRBF::get_kernel() const {
+    return HRBF_env::get_inst_kernel(_id);
+}
+
+HRBF_wrapper::HRBF_fit_report HermiteRBF::get_fit_report() const {
+    return HRBF_env::get_fit_report(_id);
+}
+
+/// Potential of one sample at 'diff' = x - node, its gradient is added to
+/// 'grad'. Null weights give a null contribution (padding of the structure of
+/// arrays storage).
+IF_CUDA_DEVICE_HOST static inline
+float sample_fngf(Vec3_cu& grad, const Vec3_cu& diff, float alpha, const Vec3_cu& beta)
+{
+    Vec3_cu diffNormalized = diff;
+    float l = diffNormalized.safe_normalize();
+
+    // thin plates + generalisation
+    #if defined(HERMITE_WITH_X3)
+    float _3l      = 3 * l;
+    float alpha3l  = alpha * _3l;
+    float bDotd3   = beta.dot(diff) * 3;
+
+    grad.x += alpha3l * diff.x;
+    grad.x += beta.x * _3l + diffNormalized.x * bDotd3;
+
+    grad.y += alpha3l * diff.y;
+    grad.y += beta.y * _3l + diffNormalized.y * bDotd3;
+
+    grad.z += alpha3l * diff.z;
+    grad.z += beta.z * _3l + diffNormalized.z * bDotd3;
+
+    return (alpha * l * l + beta.dot(diff) * 3.f) * l ;
+
+    #elif defined(HERMITE_RBF_HPP__)
+    // cf wxMaxima with function = alpha * phi(sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2))
+    //                             + dphi(sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2)) * ((cx-x)*bx + (cy-y)*by + (cz-z)*bz) / sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2);
+
+    if( l > 0.00001f)
+    {
+        float dphi = RBFWrapper::PHI_TYPE::df(l);
+        float ddphi = RBFWrapper::PHI_TYPE::ddf(l);
+
+        float alpha_dphi = alpha * dphi;
+
+        float bDotd_l = beta.dot(diff)/l;
+        float squared_l = diff.norm_squared();
+
+        grad.x += alpha_dphi * diffNormalized.x;
+        grad.x += bDotd_l * (ddphi * diffNormalized.x - diff.x * dphi / squared_l) + beta.x * dphi / l ;
+
+        grad.y += alpha_dphi * diffNormalized.y;
+        grad.y += bDotd_l * (ddphi * diffNormalized.y - diff.y * dphi / squared_l) + beta.y * dphi / l ;
+
+        grad.z += alpha_dphi * diffNormalized.z;
+        grad.z += bDotd_l * (ddphi * diffNormalized.z - diff.z * dphi / squared_l) + beta.z * dphi / l ;
+
+        return alpha * RBFWrapper::PHI_TYPE::f(l) + beta.dot(diff)*dphi/l;
+    }
+    return 0.f;
+    #endif
+}
+
 IF_CUDA_DEVICE_HOST
 float HermiteRBF::fngf_global(Vec3_cu& grad, const Point_cu& x) const
+{
+    const float support = HRBF_env::fetch_support(_id);
+    if( support > 0.f )
+        return fngf_global_compact(grad, x, support);
+
+#if defined(HRBF_SOA)
+    return fngf_global_soa(grad, x);
+#else
+    return fngf_global_aos(grad, x);
+#endif
+}
+
+IF_CUDA_DEVICE_HOST
+float HermiteRBF::fngf_global_aos(Vec3_cu& grad, const Point_cu& x) const
 {
     grad = Vec3_cu(0., 0., 0.);
 
@@ -77,58 +185,157 @@ float HermiteRBF::fngf_global(Vec3_cu& grad, const Point_cu& x) const
         Point_cu  node;
         Vec3_cu beta;
         float alpha     = HRBF_env::fetch_weights_point(beta, node, i+size_off.x);
-        Vec3_cu diff  = x - node;
-
-        Vec3_cu diffNormalized = diff;
-        float l = diffNormalized.safe_normalize();
-
-        // thin plates + generalisation
-        #if defined(HERMITE_WITH_X3)
-        float _3l      = 3 * l;
-        float alpha3l  = alpha * _3l;
-        float bDotd3   = beta.dot(diff) * 3;
-
-        grad.x += alpha3l * diff.x;
-        grad.x += beta.x * _3l + diffNormalized.x * bDotd3;
-
-        grad.y += alpha3l * diff.y;
-        grad.y += beta.y * _3l + diffNormalized.y * bDotd3;
+        ret += sample_fngf(grad, x - node, alpha, beta);
+    }
 
-        grad.z += alpha3l * diff.z;
-        grad.z += beta.z * _3l + diffNormalized.z * bDotd3;
+    return ret;
+}
 
-        ret += (alpha * l * l + beta.dot(diff) * 3.f) * l ;
+IF_CUDA_DEVICE_HOST
+float HermiteRBF::fngf_global_compact(Vec3_cu& grad, const Point_cu& x, float support) const
+{
+    typedef HRBF_wrapper::Rbf_wendland_c2<float> Phi;
 
-        #elif defined(HERMITE_RBF_HPP__)
-        // cf wxMaxima with function = alpha * phi(sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2))
-        //                             + dphi(sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2)) * ((cx-x)*bx + (cy-y)*by + (cz-z)*bz) / sqrt((cx-x)^2 + (cy-y)^2 + (cz-z)^2);
+    grad = Vec3_cu(0., 0., 0.);
+    const int4 dims = HRBF_env::fetch_compact_dims(_id);
+    if(dims.w < 0) return 0.f;
+
+    // Grid and base capsule are in rest pose
+    const float4 fx = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_FRAME_X);
+    const float4 fy = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_FRAME_Y);
+    const float4 fz = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_FRAME_Z);
+    const Vec3_cu rx(fx.x, fx.y, fx.z), ry(fy.x, fy.y, fy.z), rz(fz.x, fz.y, fz.z);
+    const Vec3_cu xr(rx.dot(x) + fx.w, ry.dot(x) + fy.w, rz.dot(x) + fz.w);
+
+    const float4 ba = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_BASE_A);
+    const float4 bb = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_BASE_B);
+    HRBF_wrapper::HRBF_capsule base;
+    base.a      = Vec3_cu(ba.x, ba.y, ba.z);
+    base.b      = Vec3_cu(bb.x, bb.y, bb.z);
+    base.radius = ba.w;
+    Vec3_cu gbase;
+    float ret = base.fngf(gbase, xr);
+    // Gradient back to world space (transpose of the inverse)
+    grad = rx * gbase.x + ry * gbase.y + rz * gbase.z;
+
+    // Cell of the point, no sample's support reaches it beyond one cell
+    // around the grid
+    const float4 go = HRBF_env::fetch_compact(_id, HRBF_env::COMPACT_GRID);
+    const float cx = floorf((xr.x - go.x) * go.w);
+    const float cy = floorf((xr.y - go.y) * go.w);
+    const float cz = floorf((xr.z - go.z) * go.w);
+    if( cx < -1.f || cx > (float)dims.x ||
+        cy < -1.f || cy > (float)dims.y ||
+        cz < -1.f || cz > (float)dims.z )
+    {
+        return ret;
+    }
 
-        if( l > 0.00001f)
+    const int off = HRBF_env::fetch_inst_size_and_offset(_id).x;
+    // Samples are animated: distances in world space, scaled by 1/support
+    // like the fit
+    const float inv_h = 1.f / support;
+    Vec3_cu gk(0.f, 0.f, 0.f);
+    const int x0 = cx > 0.f ? (int)cx - 1 : 0, x1 = cx < dims.x - 1 ? (int)cx + 1 : dims.x - 1;
+    const int y0 = cy > 0.f ? (int)cy - 1 : 0, y1 = cy < dims.y - 1 ? (int)cy + 1 : dims.y - 1;
+    const int z0 = cz > 0.f ? (int)cz - 1 : 0, z1 = cz < dims.z - 1 ? (int)cz + 1 : dims.z - 1;
+    for(int k = z0; k <= z1; k++)
+    for(int j = y0; j <= y1; j++)
+    {
+        // Cells of a row are contiguous
+        const int row = dims.w + (k * dims.y + j) * dims.x;
+        const int end = HRBF_env::fetch_cell(row + x1 + 1);
+        for(int c = HRBF_env::fetch_cell(row + x0); c < end; c++)
         {
-            float dphi = RBFWrapper::PHI_TYPE::df(l);
-            float ddphi = RBFWrapper::PHI_TYPE::ddf(l);
-
-            float alpha_dphi = alpha * dphi;
-
-            float bDotd_l = beta.dot(diff)/l;
-            float squared_l = diff.norm_squared();
+            Point_cu  node;
+            Vec3_cu beta;
+            const int i = HRBF_env::fetch_cell(c) + off;
+            const float alpha = HRBF_env::fetch_weights_point(beta, node, i);
+
+            const Vec3_cu diff = (x - node) * inv_h;
+            const float l2 = diff.norm_squared();
+            // Samples beyond the support add nothing
+            if( l2 >= 1.f ) continue;
+
+            const float l      = sqrtf(l2);
+            const float dphi_l = Phi::df_x(l);
+            const float bDotd  = beta.dot(diff);
+
+            ret += alpha * Phi::f(l) + bDotd * dphi_l;
+            gk  += diff * (alpha * dphi_l) + beta * dphi_l;
+            if( l2 > 0.f )
+                gk += diff * ((Phi::ddf(l) - dphi_l) / l2 * bDotd);
+        }
+    }
 
-            grad.x += alpha_dphi * diffNormalized.x;
-            grad.x += bDotd_l * (ddphi * diffNormalized.x - diff.x * dphi / squared_l) + beta.x * dphi / l ;
+    grad += gk * inv_h;
+    return ret;
+}
 
-            grad.y += alpha_dphi * diffNormalized.y;
-            grad.y += bDotd_l * (ddphi * diffNormalized.y - diff.y * dphi / squared_l) + beta.y * dphi / l ;
+IF_CUDA_DEVICE_HOST
+float HermiteRBF::fngf_global_soa(Vec3_cu& grad, const Point_cu& x) const
+{
+    grad = Vec3_cu(0., 0., 0.);
 
-            grad.z += alpha_dphi * diffNormalized.z;
-            grad.z += bDotd_l * (ddphi * diffNormalized.z - diff.z * dphi / squared_l) + beta.z * dphi / l ;
+    const int2 blk = HRBF_env::fetch_soa_offset(_id);
+    if(blk.y == 0) return 0.f;
 
-            ret += alpha * RBFWrapper::PHI_TYPE::f(l) + beta.dot(diff)*dphi/l;
+#ifdef __CUDA_ARCH__
+    // Threads of a warp read the same samples: no lanes, only the actual
+    // samples are visited
+    const int nb_samples = HRBF_env::fetch_inst_size_and_offset(_id).y;
+    float ret = 0.f;
+    for(int i = 0; i < nb_samples; i++)
+    {
+        const int idx = blk.x + i;
+        const Point_cu node(HRBF_env::fetch_soa(idx + HRBF_env::SOA_X  * blk.y),
+                            HRBF_env::fetch_soa(idx + HRBF_env::SOA_Y  * blk.y),
+                            HRBF_env::fetch_soa(idx + HRBF_env::SOA_Z  * blk.y));
+        const Vec3_cu beta(HRBF_env::fetch_soa(idx + HRBF_env::SOA_BX * blk.y),
+                           HRBF_env::fetch_soa(idx + HRBF_env::SOA_BY * blk.y),
+                           HRBF_env::fetch_soa(idx + HRBF_env::SOA_BZ * blk.y));
+        const float alpha = HRBF_env::fetch_soa(idx + HRBF_env::SOA_ALPHA * blk.y);
+        ret += sample_fngf(grad, x - node, alpha, beta);
+    }
+    return ret;
+#else
+    const float* soa = HRBF_env::hd_soa.ptr() + blk.x;
+    const float* px = soa + HRBF_env::SOA_X     * blk.y;
+    const float* py = soa + HRBF_env::SOA_Y     * blk.y;
+    const float* pz = soa + HRBF_env::SOA_Z     * blk.y;
+    const float* bx = soa + HRBF_env::SOA_BX    * blk.y;
+    const float* by = soa + HRBF_env::SOA_BY    * blk.y;
+    const float* bz = soa + HRBF_env::SOA_BZ    * blk.y;
+    const float* al = soa + HRBF_env::SOA_ALPHA * blk.y;
+
+    // One accumulator per lane so that lanes are independent
+    float f [HRBF_SOA_PAD] = {0.f};
+    float gx[HRBF_SOA_PAD] = {0.f};
+    float gy[HRBF_SOA_PAD] = {0.f};
+    float gz[HRBF_SOA_PAD] = {0.f};
+    for(int b = 0; b < blk.y; b += HRBF_SOA_PAD)
+    {
+        for(int k = 0; k < HRBF_SOA_PAD; k++)
+        {
+            const int i = b + k;
+            Vec3_cu g(0.f, 0.f, 0.f);
+            const Vec3_cu diff(x.x - px[i], x.y - py[i], x.z - pz[i]);
+            f [k] += sample_fngf(g, diff, al[i], Vec3_cu(bx[i], by[i], bz[i]));
+            gx[k] += g.x;
+            gy[k] += g.y;
+            gz[k] += g.z;
         }
-        #endif
-
     }
 
+    float ret = 0.f;
+    for(int k = 0; k < HRBF_SOA_PAD; k++){
+        ret    += f [k];
+        grad.x += gx[k];
+        grad.y += gy[k];
+        grad.z += gz[k];
+    }
     return ret;
+#endif
 }
 
 IF_CUDA_DEVICE_HOST
@@ -64,6 +64,17 @@ struct HermiteRBF
                             const std::vector<float4>&  weights);
 #endif
 
+    /// init HRBF from samples and previously fitted coefficients
+    /// (alpha scalar and beta vector of each sample) without solving again
+    /// before calling this one must initialize the hrbf with initialize()
+    void init_coeffs(const std::vector<Vec3_cu>& nodes,
+                     const std::vector<Vec3_cu>& normals,
+                     const std::vector<float>&   alphas,
+                     const std::vector<Vec3_cu>& betas);
+
+    /// Get the fitted coefficients of each sample (rest position)
+    void get_coeffs(std::vector<float>& alphas, std::vector<Vec3_cu>& betas) const;
+
     /// Sets the radius of the HRBF used to transform the potential field from
     /// global to compact
     void set_radius(float r);
@@ -74,6 +85,15 @@ struct HermiteRBF
 
     void get_normals(std::vector<Vec3_cu>& list) const;
 
+    /// Select the radial basis function, takes effect at the next
+    /// init_coeffs() (HRBF_env::set_inst_kernel())
+    void set_kernel(HRBF_wrapper::Rbf_kernel kernel);
+
+    HRBF_wrapper::Rbf_kernel get_kernel() const;
+
+    /// Conditioning of the last fit of the samples (HRBF_env::get_fit_report())
+    HRBF_wrapper::HRBF_fit_report get_fit_report() const;
+
     // =========================================================================
     /// @name Evaluation of the potential and gradient (compact support)
     // =========================================================================
@@ -83,9 +103,28 @@ struct HermiteRBF
     // =========================================================================
     /// @name Evaluation of the potential and gradient (global support)
     // =========================================================================
+    /// Dispatches to fngf_global_compact() for RBF_WENDLAND_C2 instances
     IF_CUDA_DEVICE_HOST
     float fngf_global(Vec3_cu& gf, const Point_cu& p) const;
 
+    /// fngf_global() of RBF_WENDLAND_C2 instances (interleaved arrays only).
+    /// The base capsule of the instance plus the samples whose support
+    /// contains 'p': only the 27 cells of the instance's grid around 'p' are
+    /// visited (HRBF_env::hd_cells), none when 'p' is away from the grid.
+    IF_CUDA_DEVICE_HOST
+    float fngf_global_compact(Vec3_cu& gf, const Point_cu& p, float support) const;
+
+    /// fngf_global() over the interleaved float4 arrays
+    /// (HRBF_env::hd_points, HRBF_env::hd_alphas_betas)
+    IF_CUDA_DEVICE_HOST
+    float fngf_global_aos(Vec3_cu& gf, const Point_cu& p) const;
+
+    /// fngf_global() over the structure of arrays storage (HRBF_env::hd_soa).
+    /// On host samples are processed HRBF_SOA_PAD at a time in independent
+    /// lanes the compiler can vectorize.
+    IF_CUDA_DEVICE_HOST
+    float fngf_global_soa(Vec3_cu& gf, const Point_cu& p) const;
+
     /// @return id of the hrbf in HRBF_env namespace @see HRBF_env
     inline int get_id() const { return _id; }
 
@@ -6,13 +6,23 @@
 #define HRBF_CORE_HPP__
 
 #include <Eigen/LU>
+#include <Eigen/Sparse>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 // =============================================================================
 namespace HRBF_wrapper {
 // =============================================================================
 
+/// Same radial basis function 'Rbf' evaluated with the scalar type 'T'
+template<typename Rbf, typename T> struct Rbf_rebind;
+
+template<template<typename> class R, typename S, typename T>
+struct Rbf_rebind< R<S>, T > { typedef R<T> type; };
+
 /// @brief fitting surface on a cloud point and evaluating the implicit surface
 /// @tparam _Scalar : a base type float double...
 /// @tparam _Dim : dimension of the ambient space
@@ -48,60 +58,308 @@ public:
         assert( points.size() == normals.size() );
         int nb_points           = points.size();
         int nb_nodes            = nodes.size();
-        int nb_hrbf_constraints = (Dim+1)*nb_points;
-        int nb_constraints      = nb_hrbf_constraints;
-        int nb_coeffs           = (Dim+1)*nb_nodes;
 
         _node_centers.resize(Dim, nb_nodes);
         _betas.       resize(Dim, nb_nodes);
         _alphas.      resize(nb_nodes);
 
-        // Assemble the "design" and "value" matrix and vector
-        MatrixXX  D(nb_constraints, nb_coeffs);
-        VectorX   f(nb_constraints);
-        VectorX   x(nb_coeffs);
-
         // copy the node centers
         for(int i = 0; i < nb_nodes; ++i)
             _node_centers.col(i) = nodes[i];
 
+        // Assemble the "design" and "value" matrix and vector
+        MatrixXX  D;
+        VectorX   f;
+        VectorX   x;
+        assemble<Scalar, Rbf>(points, normals, nodes, D, f);
+
+        if(nb_points == nb_nodes) x = D.lu().solve(f);
+        else                      x = (D.transpose()*D).lu().solve(D.transpose()*f);
+
+        Eigen::Map< Eigen::Matrix<Scalar,Dim+1,Eigen::Dynamic> > mx( x.data(), Dim + 1, nb_nodes);
+
+        _alphas = mx.row(0);
+        _betas  = mx.template bottomRows<Dim>();
+    }
+
+    // --------------------------------------------------------------------------
+
+    /// Conditioning of the last hermite_fit_refined()
+    struct Fit_info {
+        int    nb_merged;      ///< samples merged with a previous one
+        double cond;           ///< estimate of the 1-norm condition number
+        double residual;       ///< |f - D x| / |f| with x rounded to Scalar
+        int    nb_refinements; ///< refinement steps done
+        bool   double_solve;   ///< refinement didn't converge, solved in double
+    };
+
+    /// Same as hermite_fit(points, normals) but robust to near coincident
+    /// samples and with a conditioning report:
+    /// - samples closer than 'merge_dist' to a previous sample are merged
+    /// into it (normals are averaged). They keep a node with zero weights so
+    /// the coefficient arrays still match the input samples.
+    /// - the precision is chosen before factoring, the factorization being
+    /// the whole cost: systems of at most 'max_single' samples whose
+    /// cond_guess() is within reach of GMRES-IR are assembled and factorized
+    /// in Scalar precision then refined with double precision residuals,
+    /// each correction is solved with GMRES preconditioned by the Scalar
+    /// factorization (GMRES-IR). The others are assembled and factorized in
+    /// double directly.
+    /// - if the condition estimate of the Scalar factorization turns out
+    /// beyond what refinement can fix, or the refinement stalls above
+    /// 'max_residual', the system is factorized again in double.
+    void hermite_fit_refined(const std::vector<Vector>& points,
+                             const std::vector<Vector>& normals,
+                             Scalar merge_dist,
+                             double max_residual,
+                             int max_single,
+                             Fit_info& info)
+    {
+        typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixXXd;
+        typedef Eigen::Matrix<double,Eigen::Dynamic,1>              VectorXd;
+        typedef typename Rbf_rebind<Rbf, double>::type              Rbf_d;
+
+        assert( points.size() == normals.size() );
+        const int nb_points = points.size();
+
+        info.nb_merged      = 0;
+        info.cond           = 0.;
+        info.residual       = 0.;
+        info.nb_refinements = 0;
+        info.double_solve   = false;
+
+        _node_centers.resize(Dim, nb_points);
+        _betas.       resize(Dim, nb_points);
+        _alphas.      resize(nb_points);
+        _betas. setZero();
+        _alphas.setZero();
         for(int i = 0; i < nb_points; ++i)
+            _node_centers.col(i) = points[i];
+
+        if( nb_points == 0 ) return;
+
+        // Merge near duplicates: two such samples give two nearly identical
+        // row blocks in D
+        std::vector<Vector> kept_points, kept_normals;
+        std::vector<int>    kept_ids;
+        merge_samples(points, normals, merge_dist, kept_points, kept_normals, kept_ids);
+
+        const int nb_kept = kept_points.size();
+        info.nb_merged = nb_points - nb_kept;
+
+        // Plain refinement needs cond * epsilon < 1, less than a well
+        // sampled bone. GMRES corrections still converge in a few
+        // iterations for cond * epsilon up to a few tens, beyond that
+        // a double solve is cheaper. The guess is only trusted up to 20:
+        // between 20 and 30 refinement failed as often as it converged in
+        // our measurements, and a failure costs the Scalar factorization
+        const double eps      = (double)std::numeric_limits<Scalar>::epsilon();
+        const double max_cond = 30. / eps;
+
+        VectorXd x;
+        double   res = std::numeric_limits<double>::infinity();
+        if( nb_kept <= max_single && cond_guess( kept_points ) <= 20. / eps )
         {
-            Vector p = points[i];
-            Vector n = normals[i];
+            MatrixXX D;
+            VectorX  f;
+            assemble<Scalar, Rbf>(kept_points, kept_normals, kept_points, D, f);
 
-            int io = (Dim+1) * i;
-            f(io) = 0;
-            f.template segment<Dim>(io + 1) = n;
+            Eigen::PartialPivLU<MatrixXX> lu( D );
+            info.cond = norm1( D ) * inverse_norm1_estimate( lu );
 
-            for(int j = 0; j < nb_nodes; ++j)
+            if( info.cond <= max_cond )
             {
-                int jo = (Dim + 1) * j;
-                Vector diff = p - _node_centers.col(j);
-                Scalar l = diff.norm();
-                if( l == 0 ) {
-                    D.template block<Dim+1,Dim+1>(io,jo).setZero();
-                } else {
-                    Scalar w    = Rbf::f(l);
-                    Scalar dw_l = Rbf::df(l)/l;
-                    Scalar ddw  = Rbf::ddf(l);
-                    Vector g    = diff * dw_l;
-                    D(io,jo) = w;
-                    D.row(io).template segment<Dim>(jo+1) = g.transpose();
-                    D.col(jo).template segment<Dim>(io+1) = g;
-                    D.template block<Dim,Dim>(io+1,jo+1)  = (ddw - dw_l)/(l*l) * (diff * diff.transpose());
-                    D.template block<Dim,Dim>(io+1,jo+1).diagonal().array() += dw_l;
+                x = lu.solve( f ).template cast<double>();
+
+                const double f_norm = std::max((double)f.norm(), 1e-30);
+                VectorXd r = residual(D, f, x);
+                res = r.norm() / f_norm;
+                const int max_steps = 5;
+                while( info.nb_refinements < max_steps && res > max_residual )
+                {
+                    VectorXd d;
+                    gmres(D, lu, r, 1e-4, 30, d);
+                    VectorXd x2 = x + d;
+                    VectorXd r2 = residual(D, f, x2);
+                    double res2 = r2.norm() / f_norm;
+                    // Diverging (or NaN): keep the previous iterate
+                    if( !(res2 < res) ) break;
+
+                    x = x2;
+                    r = r2;
+                    info.nb_refinements++;
+                    const bool stalled = res2 > 0.5 * res;
+                    res = res2;
+                    if( stalled ) break;
                 }
+
+                // The field is evaluated with Scalar coefficients, report the
+                // residual of what is actually stored
+                x = x.template cast<Scalar>().template cast<double>();
+                res = residual(D, f, x).norm() / f_norm;
             }
+        }   // Release the Scalar system before a double solve
+
+        if( !(res <= max_residual) )
+        {
+            MatrixXXd D;
+            VectorXd  f;
+            assemble<double, Rbf_d>(kept_points, kept_normals, kept_points, D, f);
+            Eigen::PartialPivLU<MatrixXXd> lu_d( D );
+            x = lu_d.solve( f );
+            info.double_solve = true;
+            info.cond = norm1( D ) * inverse_norm1_estimate( lu_d );
+
+            x = x.template cast<Scalar>().template cast<double>();
+            info.residual = (f - D * x).norm() / std::max(f.norm(), 1e-30);
         }
+        else
+            info.residual = res;
 
-        if(nb_points == nb_nodes) x = D.lu().solve(f);
-        else                      x = (D.transpose()*D).lu().solve(D.transpose()*f);
+        store_coeffs(x.template cast<Scalar>(), kept_ids);
+    }
 
-        Eigen::Map< Eigen::Matrix<Scalar,Dim+1,Eigen::Dynamic> > mx( x.data(), Dim + 1, nb_nodes);
+    // --------------------------------------------------------------------------
 
-        _alphas = mx.row(0);
-        _betas  = mx.template bottomRows<Dim>();
+    /// Fit with the compactly supported function 'R' (zero beyond 1, smooth
+    /// at 0, e.g. Rbf_wendland_c2) on top of the field 'base': the RBFs fit
+    /// the difference between 'base' and the samples, and the potential to
+    /// evaluate is base(x) plus the RBFs, which is base(x) away from the
+    /// samples. 'base(p, grad)' returns the base potential at 'p' and its
+    /// gradient in 'grad'.
+    /// The system is assembled in the sample space scaled by 1/support: the
+    /// coefficients are to be evaluated with distances divided by 'support'
+    /// and gradients divided by 'support'. Only pairs of samples closer than
+    /// 'support' are assembled (uniform grid of cell size 'support') and the
+    /// sparse system is solved with BiCGSTAB. Near duplicates are merged like
+    /// in hermite_fit_refined().
+    /// info.cond is not estimated (0), info.nb_refinements holds the solver
+    /// iterations and info.double_solve is set when BiCGSTAB didn't converge
+    /// and a dense LU was used instead.
+    template<typename R, typename Base>
+    void hermite_fit_sparse(const std::vector<Vector>& points,
+                            const std::vector<Vector>& normals,
+                            Scalar support,
+                            Scalar merge_dist,
+                            double max_residual,
+                            const Base& base,
+                            Fit_info& info)
+    {
+        typedef Eigen::Matrix<double,Dim,1>                         Vectord;
+        typedef Eigen::Matrix<double,Eigen::Dynamic,1>              VectorXd;
+        typedef Eigen::SparseMatrix<double>                         SpMat;
+        typedef Eigen::Triplet<double>                              Triplet;
+
+        assert( points.size() == normals.size() );
+        assert( support > Scalar(0) );
+        const int nb_points = points.size();
+
+        info.nb_merged      = 0;
+        info.cond           = 0.;
+        info.residual       = 0.;
+        info.nb_refinements = 0;
+        info.double_solve   = false;
+
+        _node_centers.resize(Dim, nb_points);
+        _betas.       resize(Dim, nb_points);
+        _alphas.      resize(nb_points);
+        _betas. setZero();
+        _alphas.setZero();
+        for(int i = 0; i < nb_points; ++i)
+            _node_centers.col(i) = points[i];
+
+        if( nb_points == 0 ) return;
+
+        std::vector<Vector> kept_points, kept_normals;
+        std::vector<int>    kept_ids;
+        merge_samples(points, normals, merge_dist, kept_points, kept_normals, kept_ids);
+        const int nb_kept = kept_points.size();
+        info.nb_merged = nb_points - nb_kept;
+
+        // Scaled space: unit support. Normals are scaled by the support so
+        // that gradients are the input normals once divided by the support
+        const double inv_h = 1. / (double)support;
+        std::vector<Vectord> p(nb_kept);
+        for(int i = 0; i < nb_kept; ++i)
+            p[i] = kept_points[i].template cast<double>() * inv_h;
+
+        std::vector< std::pair<long long, int> > cells;
+        sort_in_cells(p, cells);
+
+        const int n = (Dim+1) * nb_kept;
+        VectorXd f(n);
+        std::vector<Triplet> coeffs;
+        std::vector<int> neighs;
+        for(int i = 0; i < nb_kept; ++i)
+        {
+            // Zero and the normal at the sample once the base is added
+            Vector gb;
+            const Scalar b = base(kept_points[i], gb);
+            const int io = (Dim+1) * i;
+            f(io) = -(double)b;
+            f.template segment<Dim>(io + 1) = (kept_normals[i] - gb).template cast<double>() * (double)support;
+
+            find_neighbours(cells, p[i], neighs);
+            for(unsigned k = 0; k < neighs.size(); ++k)
+            {
+                const int j  = neighs[k];
+                const int jo = (Dim+1) * j;
+                const Vectord diff = p[i] - p[j];
+                const double l = diff.norm();
+                if( l >= 1. ) continue;
+
+                if( l == 0. ) {
+                    coeffs.push_back( Triplet(io, jo, R::f(0.)) );
+                    for(int d = 1; d <= Dim; ++d)
+                        coeffs.push_back( Triplet(io + d, jo + d, R::ddf(0.)) );
+                    continue;
+                }
+
+                const double w    = R::f(l);
+                const double dw_l = R::df(l)/l;
+                const double ddw  = R::ddf(l);
+                const Vectord g   = diff * dw_l;
+                coeffs.push_back( Triplet(io, jo, w) );
+                for(int d = 0; d < Dim; ++d) {
+                    coeffs.push_back( Triplet(io, jo + 1 + d, g(d)) );
+                    coeffs.push_back( Triplet(io + 1 + d, jo, g(d)) );
+                }
+                const double s = (ddw - dw_l)/(l*l);
+                for(int a = 0; a < Dim; ++a)
+                    for(int b = 0; b < Dim; ++b)
+                        coeffs.push_back( Triplet(io + 1 + a, jo + 1 + b,
+                                                  s * diff(a) * diff(b) + (a == b ? dw_l : 0.)) );
+            }
+        }
+
+        SpMat D(n, n);
+        D.setFromTriplets(coeffs.begin(), coeffs.end());
+
+        Eigen::BiCGSTAB<SpMat, Eigen::IncompleteLUT<double> > solver;
+        solver.setTolerance( max_residual * 0.1 );
+        // Low fill: the default factorization is nearly a complete LU and
+        // costs more than the iterations it saves
+        solver.preconditioner().setDroptol( 1e-3 );
+        solver.preconditioner().setFillfactor( 2 );
+        solver.compute( D );
+        VectorXd x;
+        if( solver.info() == Eigen::Success )
+        {
+            x = solver.solve( f );
+            info.nb_refinements = solver.iterations();
+        }
+
+        const double f_norm = std::max(f.norm(), 1e-30);
+        if( solver.info() != Eigen::Success || !((f - D * x).norm() / f_norm <= max_residual) )
+        {
+            Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> Dd( D );
+            x = Dd.lu().solve( f );
+            info.double_solve = true;
+        }
+
+        VectorX xs = x.template cast<Scalar>();
+        info.residual = (f - D * xs.template cast<double>()).norm() / f_norm;
+        store_coeffs(xs, kept_ids);
     }
 
     // --------------------------------------------------------------------------
@@ -165,6 +423,302 @@ public:
     VectorX   _alphas;
     MatrixDX  _betas;
 
+private:
+
+    /// Fill the hermite system of the samples 'points' with 'normals' and
+    /// RBFs centered at 'nodes'
+    /// @tparam T : Scalar type of the system
+    /// @tparam R : radial basis function evaluated with T
+    template<typename T, typename R>
+    static void assemble(const std::vector<Vector>& points,
+                         const std::vector<Vector>& normals,
+                         const std::vector<Vector>& nodes,
+                         Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>& D,
+                         Eigen::Matrix<T,Eigen::Dynamic,1>& f)
+    {
+        typedef Eigen::Matrix<T,Dim,1> VectorT;
+
+        int nb_points = points.size();
+        int nb_nodes  = nodes.size();
+        D.resize((Dim+1)*nb_points, (Dim+1)*nb_nodes);
+        f.resize((Dim+1)*nb_points);
+
+        for(int i = 0; i < nb_points; ++i)
+        {
+            VectorT p = points [i].template cast<T>();
+            VectorT n = normals[i].template cast<T>();
+
+            int io = (Dim+1) * i;
+            f(io) = 0;
+            f.template segment<Dim>(io + 1) = n;
+
+            for(int j = 0; j < nb_nodes; ++j)
+            {
+                int jo = (Dim + 1) * j;
+                VectorT diff = p - nodes[j].template cast<T>();
+                T l = diff.norm();
+                if( l == 0 ) {
+                    D.template block<Dim+1,Dim+1>(io,jo).setZero();
+                } else {
+                    T w    = R::f(l);
+                    T dw_l = R::df(l)/l;
+                    T ddw  = R::ddf(l);
+                    VectorT g = diff * dw_l;
+                    D(io,jo) = w;
+                    D.row(io).template segment<Dim>(jo+1) = g.transpose();
+                    D.col(jo).template segment<Dim>(io+1) = g;
+                    D.template block<Dim,Dim>(io+1,jo+1)  = (ddw - dw_l)/(l*l) * (diff * diff.transpose());
+                    D.template block<Dim,Dim>(io+1,jo+1).diagonal().array() += dw_l;
+                }
+            }
+        }
+    }
+
+    /// Guess of the 1-norm condition number of the cubic Hermite system of
+    /// 'points' without assembling it: 0.04 * (d / s)^6.5 with 'd' the
+    /// bounding box diagonal and 's' the mean distance to the nearest
+    /// neighbour. Fitted on bones sampled with a minimum distance and on
+    /// regular rings (100 to 1000 samples), within a factor 3.5 of the
+    /// estimate from the LU. O(n^2) distances, negligible next to the
+    /// O(n^3) factorization.
+    static double cond_guess(const std::vector<Vector>& points)
+    {
+        const int n = points.size();
+        if( n < 2 ) return 1.;
+
+        Vector bmin = points[0], bmax = points[0];
+        double sum_nn = 0.;
+        for(int i = 0; i < n; ++i)
+        {
+            bmin = bmin.cwiseMin( points[i] );
+            bmax = bmax.cwiseMax( points[i] );
+            Scalar nn2 = std::numeric_limits<Scalar>::max();
+            for(int j = 0; j < n; ++j)
+                if( j != i ) nn2 = std::min(nn2, (points[i] - points[j]).squaredNorm());
+            sum_nn += std::sqrt( (double)nn2 );
+        }
+        if( !(sum_nn > 0.) ) return std::numeric_limits<double>::infinity();
+
+        const double ratio = (double)(bmax - bmin).norm() * n / sum_nn;
+        return 0.04 * std::pow(ratio, 6.5);
+    }
+
+    /// Maximum absolute column sum of 'A'
+    template<typename T>
+    static double norm1(const Eigen::Matrix<T,Eigen::Dynamic,Eigen::Dynamic>& A)
+    {
+        return (double)A.cwiseAbs().colwise().sum().maxCoeff();
+    }
+
+    /// f - D x accumulated in double, column by column to avoid a double
+    /// copy of 'D'
+    static Eigen::Matrix<double,Eigen::Dynamic,1>
+    residual(const MatrixXX& D,
+             const VectorX& f,
+             const Eigen::Matrix<double,Eigen::Dynamic,1>& x)
+    {
+        Eigen::Matrix<double,Eigen::Dynamic,1> r = f.template cast<double>();
+        for(int j = 0; j < D.cols(); ++j)
+            r -= D.col(j).template cast<double>() * x(j);
+        return r;
+    }
+
+    /// Keep the first of every group of samples closer than 'merge_dist',
+    /// the normals of a group are averaged
+    /// @param kept_ids : index in 'points' of each kept sample
+    static void merge_samples(const std::vector<Vector>& points,
+                              const std::vector<Vector>& normals,
+                              Scalar merge_dist,
+                              std::vector<Vector>& kept_points,
+                              std::vector<Vector>& kept_normals,
+                              std::vector<int>& kept_ids)
+    {
+        std::vector<int> nb_merged;
+        for(unsigned i = 0; i < points.size(); ++i)
+        {
+            int j = 0;
+            for(; j < (int)kept_points.size(); ++j)
+                if( (points[i] - kept_points[j]).norm() <= merge_dist )
+                    break;
+
+            if( j < (int)kept_points.size() ) {
+                kept_normals[j] += normals[i];
+                nb_merged[j]++;
+            } else {
+                kept_points. push_back( points [i] );
+                kept_normals.push_back( normals[i] );
+                kept_ids.    push_back( i );
+                nb_merged.   push_back( 0 );
+            }
+        }
+        for(unsigned j = 0; j < kept_normals.size(); ++j)
+            if( nb_merged[j] > 0 && kept_normals[j].norm() > Scalar(0) )
+                kept_normals[j].normalize();
+    }
+
+    /// Write the solution 'x' of the system of the kept samples to the
+    /// coefficients of the input samples (merged samples keep zero weights)
+    void store_coeffs(const VectorX& x, const std::vector<int>& kept_ids)
+    {
+        for(unsigned j = 0; j < kept_ids.size(); ++j)
+        {
+            const int io = (Dim+1) * j;
+            const int i  = kept_ids[j];
+            _alphas(i)    = x(io);
+            _betas.col(i) = x.template segment<Dim>(io + 1);
+        }
+    }
+
+    /// Grid cell of 'p' (unit cells) packed in 21 bits per coordinate
+    template<typename V>
+    static long long cell_key(const V& p, const int* offset = 0)
+    {
+        long long key = 0;
+        for(int d = 0; d < Dim; ++d){
+            long long c = (long long)std::floor( p(d) ) + (offset ? offset[d] : 0);
+            key = (key << 21) | ((c + (1 << 20)) & ((1 << 21) - 1));
+        }
+        return key;
+    }
+
+    /// Sort sample indices by cell of the unit grid
+    template<typename V>
+    static void sort_in_cells(const std::vector<V>& p,
+                              std::vector< std::pair<long long, int> >& cells)
+    {
+        cells.resize( p.size() );
+        for(unsigned i = 0; i < p.size(); ++i)
+            cells[i] = std::make_pair( cell_key(p[i]), (int)i );
+        std::sort(cells.begin(), cells.end());
+    }
+
+    /// Samples of the 3^Dim cells around 'q' (unit grid, superset of the
+    /// samples closer than 1)
+    template<typename V>
+    static void find_neighbours(const std::vector< std::pair<long long, int> >& cells,
+                                const V& q,
+                                std::vector<int>& neighs)
+    {
+        neighs.clear();
+        int nb_cells = 1;
+        for(int d = 0; d < Dim; ++d) nb_cells *= 3;
+        for(int c = 0; c < nb_cells; ++c)
+        {
+            int offset[Dim];
+            for(int d = 0, r = c; d < Dim; ++d, r /= 3) offset[d] = r % 3 - 1;
+
+            const std::pair<long long, int> first( cell_key(q, offset), -1 );
+            typename std::vector< std::pair<long long, int> >::const_iterator it;
+            it = std::lower_bound(cells.begin(), cells.end(), first);
+            for(; it != cells.end() && it->first == first.first; ++it)
+                neighs.push_back( it->second );
+        }
+    }
+
+    /// Solve D d = r with GMRES left preconditioned by 'lu', the Scalar
+    /// factorization of 'D'. Products and Krylov basis are in double.
+    /// @param tol : stop when the preconditioned residual is reduced by 'tol'
+    /// @return the number of iterations
+    template<typename LU>
+    static int gmres(const MatrixXX& D,
+                     const LU& lu,
+                     const Eigen::Matrix<double,Eigen::Dynamic,1>& r,
+                     double tol,
+                     int max_it,
+                     Eigen::Matrix<double,Eigen::Dynamic,1>& d)
+    {
+        typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixXXd;
+        typedef Eigen::Matrix<double,Eigen::Dynamic,1>              VectorXd;
+
+        const int n = r.size();
+        d.setZero(n);
+        VectorXd z = lu.solve( r.template cast<Scalar>() ).template cast<double>();
+        const double beta = z.norm();
+        if( !(beta > 0.) ) return 0;
+
+        MatrixXXd V(n, max_it + 1);
+        MatrixXXd H = MatrixXXd::Zero(max_it + 1, max_it);
+        VectorXd  g = VectorXd::Zero(max_it + 1);
+        VectorXd  cs(max_it), sn(max_it);
+        V.col(0) = z / beta;
+        g(0) = beta;
+
+        int k = 0;
+        while( k < max_it )
+        {
+            // w = M^-1 D v_k, D v_k accumulated in double
+            VectorXd w = VectorXd::Zero(n);
+            for(int j = 0; j < n; ++j)
+                w += D.col(j).template cast<double>() * V(j, k);
+            w = lu.solve( w.template cast<Scalar>() ).template cast<double>();
+
+            // Modified Gram-Schmidt
+            for(int i = 0; i <= k; ++i) {
+                H(i, k) = w.dot( V.col(i) );
+                w -= H(i, k) * V.col(i);
+            }
+            const double w_norm = w.norm();
+            H(k+1, k) = w_norm;
+
+            // Givens rotations of the Hessenberg column
+            for(int i = 0; i < k; ++i) {
+                const double t = cs(i) * H(i, k) + sn(i) * H(i+1, k);
+                H(i+1, k) = -sn(i) * H(i, k) + cs(i) * H(i+1, k);
+                H(i, k)   = t;
+            }
+            const double h = std::sqrt( H(k, k) * H(k, k) + w_norm * w_norm );
+            if( !(h > 0.) ) break;
+            cs(k) = H(k, k) / h;
+            sn(k) = w_norm  / h;
+            H(k, k) = h;
+            H(k+1, k) = 0.;
+            g(k+1) = -sn(k) * g(k);
+            g(k)   =  cs(k) * g(k);
+            ++k;
+
+            if( std::abs( g(k) ) <= tol * beta || !(w_norm > 0.) ) break;
+            V.col(k) = w / w_norm;
+        }
+
+        if( k == 0 ) return 0;
+        VectorXd y = H.topLeftCorner(k, k).template triangularView<Eigen::Upper>().solve( g.head(k) );
+        d = V.leftCols(k) * y;
+        return k;
+    }
+
+    /// Hager's estimate of |A^-1|_1 given the LU factorization of A
+    /// (a handful of solves, no explicit inverse)
+    template<typename LU>
+    static double inverse_norm1_estimate(const LU& lu)
+    {
+        typedef typename LU::MatrixType::Scalar            T;
+        typedef Eigen::Matrix<T,Eigen::Dynamic,1>          VectorT;
+
+        const int n = lu.matrixLU().rows();
+        VectorT x = VectorT::Constant(n, T(1) / T(n));
+        double estimate = 0.;
+        for(int it = 0; it < 5; ++it)
+        {
+            VectorT y = lu.solve( x );
+            estimate = y.template lpNorm<1>();
+
+            VectorT xi(n);
+            for(int i = 0; i < n; ++i) xi(i) = y(i) < T(0) ? T(-1) : T(1);
+
+            // z = A^-T xi with A = P^T L U
+            VectorT z = lu.matrixLU().template triangularView<Eigen::Upper>().transpose().solve( xi );
+            lu.matrixLU().template triangularView<Eigen::UnitLower>().transpose().solveInPlace( z );
+            z = lu.permutationP().transpose() * z;
+
+            int j;
+            const T z_max = z.cwiseAbs().maxCoeff(&j);
+            if( !(z_max > z.dot( x )) ) break;
+            x.setZero();
+            x(j) = T(1);
+        }
+        return estimate;
+    }
+
 }; // END HermiteRbfReconstruction Class =======================================
 
 }// END RBFWrapper =============================================================
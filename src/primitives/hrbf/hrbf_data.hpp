@@ -13,6 +13,49 @@
 namespace HRBF_wrapper {
 // =============================================================================
 
+    /// Conditioning and accuracy of a Hermite RBF fit
+    struct HRBF_fit_report {
+        int   nb_samples;      ///< samples given to the fit (0: not fitted)
+        int   nb_merged;       ///< near duplicates merged before assembly
+        float cond;            ///< 1-norm condition number estimate
+        float residual;        ///< |f - D x| / |f| with the float coefficients
+        int   nb_refinements;  ///< iterative refinement steps
+        bool  double_solve;    ///< the single precision factorization wasn't enough
+        bool  ill_conditioned; ///< cond or residual above tolerance
+
+        HRBF_fit_report() :
+            nb_samples(0), nb_merged(0), cond(0.f), residual(0.f),
+            nb_refinements(0), double_solve(false), ill_conditioned(false)
+        { }
+    };
+
+    /// Base term of RBF_WENDLAND_C2 instances: signed distance to the capsule
+    /// of axis [a, b] and radius 'radius', negative inside. The compactly
+    /// supported kernels only fit the difference between this field and the
+    /// samples, so away from the samples the potential is the capsule's.
+    struct HRBF_capsule {
+        Vec3_cu a, b;
+        float   radius;
+
+        IF_CUDA_DEVICE_HOST
+        HRBF_capsule() : a(0.f, 0.f, 0.f), b(0.f, 0.f, 0.f), radius(0.f) { }
+
+        /// @return the signed distance at 'x', its gradient in 'grad'
+        /// (null on the axis)
+        IF_CUDA_DEVICE_HOST
+        float fngf(Vec3_cu& grad, const Vec3_cu& x) const
+        {
+            const Vec3_cu ab   = b - a;
+            const float   len2 = ab.norm_squared();
+            float t = len2 > 0.f ? (x - a).dot(ab) / len2 : 0.f;
+            t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+            const Vec3_cu q = x - (a + ab * t);
+            const float   d = q.norm();
+            grad = d > 0.f ? q * (1.f / d) : Vec3_cu(0.f, 0.f, 0.f);
+            return d - radius;
+        }
+    };
+
     /// HermiteRbfReconstruction data wrapper in order to store RBF coeffs
     ///	for post evaluation of the potential field
     struct HRBF_coeffs {
@@ -23,6 +66,12 @@ namespace HRBF_wrapper {
         Vec3_cu* betas;
         int size;        ///< size of the previous arrays
 
+        HRBF_fit_report report;
+
+        HRBF_coeffs() :
+            alphas(0), nodeCenters(0), normals(0), betas(0), size(0)
+        { }
+
         ~HRBF_coeffs (){
             delete[] alphas;
             delete[] nodeCenters;
@@ -1,4 +1,8 @@
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include <fstream>
 #include <limits>
 #include <iostream>
@@ -7,6 +11,8 @@
 #include "hrbf_env.hpp"
 #include "hrbf_wrapper.hpp"
 #include "hrbf_kernels.hpp"
+#include "hermiteRBF.hpp"
+#include "timer.hpp"
 
 #ifndef M_PI
 #define M_PI (3.14159265358979323846f)
@@ -30,6 +36,36 @@ HA_Vec3_cu h_normals;
 
 HDA_float hd_radius;
 
+HA_int    h_kernel;
+HDA_float hd_support;
+
+HDA_float hd_soa;
+DA_int2   d_soa_offset;
+HA_int2   h_soa_offset;
+
+HDA_float4 hd_compact;
+HDA_int4   hd_compact_dims;
+HDA_int    hd_cells;
+
+/// Grid and base capsule of an RBF_WENDLAND_C2 instance, concatenated into
+/// hd_compact, hd_compact_dims and hd_cells by update_compact_arrays()
+struct Compact_grid {
+    Compact_grid() :
+        grid(make_float4(0.f, 0.f, 0.f, 0.f)),
+        base_a(make_float4(0.f, 0.f, 0.f, 0.f)),
+        base_b(make_float4(0.f, 0.f, 0.f, 0.f)),
+        dims(make_int4(0, 0, 0, -1))
+    { }
+
+    float4 grid, base_a, base_b; ///< rows COMPACT_GRID to COMPACT_BASE_B
+    int4   dims;                 ///< w < 0: no grid
+    /// nx*ny*nz + 1 cell starts relative to the block then the samples
+    std::vector<int> cells;
+};
+
+/// Grid of each instance (indexed like h_offset)
+std::vector<Compact_grid> h_grids;
+
 /// Transformations associated to each HRBF instances
 HD_Array<Transfo> hd_transfo;
 
@@ -37,12 +73,21 @@ HD_Array<Transfo> hd_transfo;
 /// in hd_transfo
 DA_int d_map_transfos;
 
+/// Last fit report of each instance (indexed like h_offset)
+std::vector<HRBF_wrapper::HRBF_fit_report> h_fit_reports;
+
 int nb_hrbf_instance = 0;
 
 texture<float4, 1, cudaReadModeElementType> tex_points;
 texture<float4, 1, cudaReadModeElementType> tex_alphas_betas;
 texture<int2, 1, cudaReadModeElementType> tex_offset;
 texture<float, 1, cudaReadModeElementType> tex_radius;
+texture<float, 1, cudaReadModeElementType> tex_support;
+texture<float4, 1, cudaReadModeElementType> tex_compact;
+texture<int4, 1, cudaReadModeElementType> tex_compact_dims;
+texture<int, 1, cudaReadModeElementType> tex_cells;
+texture<float, 1, cudaReadModeElementType> tex_soa;
+texture<int2, 1, cudaReadModeElementType> tex_soa_offset;
 
 /// Are textures currently binded with arrays
 bool binded = false;
@@ -70,6 +115,26 @@ static void setup_tex()
     tex_radius.addressMode[1] = cudaAddressModeWrap;
     tex_radius.filterMode = cudaFilterModePoint;
     tex_radius.normalized = false;
+    // tex_support setup
+    tex_support.addressMode[0] = cudaAddressModeWrap;
+    tex_support.addressMode[1] = cudaAddressModeWrap;
+    tex_support.filterMode = cudaFilterModePoint;
+    tex_support.normalized = false;
+    // tex_compact setup
+    tex_compact.addressMode[0] = cudaAddressModeWrap;
+    tex_compact.addressMode[1] = cudaAddressModeWrap;
+    tex_compact.filterMode = cudaFilterModePoint;
+    tex_compact.normalized = false;
+    // tex_compact_dims setup
+    tex_compact_dims.addressMode[0] = cudaAddressModeWrap;
+    tex_compact_dims.addressMode[1] = cudaAddressModeWrap;
+    tex_compact_dims.filterMode = cudaFilterModePoint;
+    tex_compact_dims.normalized = false;
+    // tex_cells setup
+    tex_cells.addressMode[0] = cudaAddressModeWrap;
+    tex_cells.addressMode[1] = cudaAddressModeWrap;
+    tex_cells.filterMode = cudaFilterModePoint;
+    tex_cells.normalized = false;
 }
 
 /// Bind hermite array data.
@@ -82,6 +147,12 @@ void bind()
     hd_alphas_betas.device_array().bind_tex( tex_alphas_betas );
     hd_points.      device_array().bind_tex( tex_points       );
     hd_radius.      device_array().bind_tex( tex_radius       );
+    hd_support.     device_array().bind_tex( tex_support      );
+    hd_compact.     device_array().bind_tex( tex_compact      );
+    hd_compact_dims.device_array().bind_tex( tex_compact_dims );
+    hd_cells.       device_array().bind_tex( tex_cells        );
+    hd_soa.         device_array().bind_tex( tex_soa          );
+    d_soa_offset.bind_tex( tex_soa_offset );
 }
 
 // -----------------------------------------------------------------------------
@@ -93,6 +164,12 @@ void unbind()
     CUDA_SAFE_CALL( cudaUnbindTexture(tex_alphas_betas) );
     CUDA_SAFE_CALL( cudaUnbindTexture(tex_offset)       );
     CUDA_SAFE_CALL( cudaUnbindTexture(tex_radius)       );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_support)      );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_compact)      );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_compact_dims) );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_cells)        );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_soa)          );
+    CUDA_SAFE_CALL( cudaUnbindTexture(tex_soa_offset)   );
 }
 
 void clean_env()
@@ -110,9 +187,24 @@ void clean_env()
     h_normals.erase();
     hd_radius.erase();
     hd_radius.update_device_mem();
+    h_kernel.erase();
+    hd_support.erase();
+    hd_support.update_device_mem();
     hd_transfo.erase();
     hd_transfo.update_device_mem();
     d_map_transfos.erase();
+    hd_soa.erase();
+    hd_soa.update_device_mem();
+    d_soa_offset.erase();
+    h_soa_offset.erase();
+    hd_compact.erase();
+    hd_compact.update_device_mem();
+    hd_compact_dims.erase();
+    hd_compact_dims.update_device_mem();
+    hd_cells.erase();
+    hd_cells.update_device_mem();
+    h_grids.clear();
+    h_fit_reports.clear();
 }
 
 // -----------------------------------------------------------------------------
@@ -124,6 +216,31 @@ void reset_env()
 
 // -----------------------------------------------------------------------------
 
+void memory_report(Memory_report& rep)
+{
+    const char* sub = "HRBF_env";
+    add_to_report(rep, sub, "hd_points"        , hd_points        );
+    add_to_report(rep, sub, "hd_alphas_betas"  , hd_alphas_betas  );
+    add_to_report(rep, sub, "d_offset"         , d_offset         );
+    add_to_report(rep, sub, "h_offset"         , h_offset         );
+    add_to_report(rep, sub, "d_init_points"    , d_init_points    );
+    add_to_report(rep, sub, "d_init_alpha_beta", d_init_alpha_beta);
+    add_to_report(rep, sub, "h_normals"        , h_normals        );
+    add_to_report(rep, sub, "hd_radius"        , hd_radius        );
+    add_to_report(rep, sub, "h_kernel"         , h_kernel         );
+    add_to_report(rep, sub, "hd_support"       , hd_support       );
+    add_to_report(rep, sub, "hd_transfo"       , hd_transfo       );
+    add_to_report(rep, sub, "d_map_transfos"   , d_map_transfos   );
+    add_to_report(rep, sub, "hd_soa"           , hd_soa           );
+    add_to_report(rep, sub, "d_soa_offset"     , d_soa_offset     );
+    add_to_report(rep, sub, "h_soa_offset"     , h_soa_offset     );
+    add_to_report(rep, sub, "hd_compact"       , hd_compact       );
+    add_to_report(rep, sub, "hd_compact_dims"  , hd_compact_dims  );
+    add_to_report(rep, sub, "hd_cells"         , hd_cells         );
+}
+
+// -----------------------------------------------------------------------------
+
 void get_instance_id_list(std::vector<int>& list_id){
     list_id.clear();
 
@@ -321,6 +438,36 @@ float get_inst_radius(int hrbf_id)
 
 // -----------------------------------------------------------------------------
 
+HRBF_wrapper::Rbf_kernel get_inst_kernel(int hrbf_id)
+{
+    assert(hrbf_id < h_offset.size());
+    assert(hrbf_id >= 0);
+    assert( h_offset[hrbf_id].x >= 0 );
+    return (HRBF_wrapper::Rbf_kernel)h_kernel[hrbf_id];
+}
+
+// -----------------------------------------------------------------------------
+
+float get_inst_support(int hrbf_id)
+{
+    assert(hrbf_id < h_offset.size());
+    assert(hrbf_id >= 0);
+    assert( h_offset[hrbf_id].x >= 0 );
+    return hd_support[hrbf_id];
+}
+
+// -----------------------------------------------------------------------------
+
+HRBF_wrapper::HRBF_fit_report get_fit_report(int hrbf_id)
+{
+    assert(hrbf_id < h_offset.size());
+    assert(hrbf_id >= 0);
+    if( hrbf_id < (int)h_fit_reports.size() ) return h_fit_reports[hrbf_id];
+    else                                      return HRBF_wrapper::HRBF_fit_report();
+}
+
+// -----------------------------------------------------------------------------
+
 Transfo get_transfo(int hrbf_id)
 {
     assert(hrbf_id < h_offset.size());
@@ -365,6 +512,120 @@ static void update_offset(int hrbf_id, int new_size)
 
 // -----------------------------------------------------------------------------
 
+/// Private function
+/// Re-compute the structure of arrays layout from h_offset and fill it with
+/// the current hd_points and hd_alphas_betas
+static void update_soa()
+{
+    assert(!binded);
+
+    const int nb_inst = h_offset.size();
+    h_soa_offset.malloc(nb_inst);
+    int acc = 0;
+    for(int i = 0; i < nb_inst; i++)
+    {
+        if(h_offset[i].x < 0){
+            h_soa_offset[i] = make_int2(-1, 0);
+            continue;
+        }
+        const int padded = (h_offset[i].y + HRBF_SOA_PAD - 1) / HRBF_SOA_PAD * HRBF_SOA_PAD;
+        h_soa_offset[i] = make_int2(acc, padded);
+        acc += SOA_NB_PLANES * padded;
+    }
+
+    if(nb_inst > 0){
+        d_soa_offset.malloc(nb_inst);
+        d_soa_offset.copy_from(h_soa_offset);
+    }else
+        d_soa_offset.erase();
+
+    // Zeroed padding: null weights
+    if(acc > 0) hd_soa.malloc(acc, 0.f);
+    else        hd_soa.erase();
+    hd_soa.update_device_mem();
+
+    HRBF_kernels::hrbf_to_soa(d_map_transfos);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Private function
+/// Write the rows COMPACT_FRAME_X to COMPACT_FRAME_Z of every instance from
+/// hd_transfo (host memory only)
+static void update_compact_frames()
+{
+    for(int i = 0; i < h_offset.size(); i++)
+    {
+        const Transfo inv = hd_transfo[i].fast_invert();
+        for(int r = 0; r < 3; r++)
+            hd_compact[i * COMPACT_NB_ROWS + COMPACT_FRAME_X + r] =
+                    make_float4(inv.m[4*r], inv.m[4*r + 1], inv.m[4*r + 2], inv.m[4*r + 3]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Private function
+/// Concatenate the grids of h_grids into hd_compact, hd_compact_dims and
+/// hd_cells
+static void update_compact_arrays()
+{
+    assert(!binded);
+    assert((int)h_grids.size() == h_offset.size());
+
+    const int nb_inst = h_offset.size();
+    int nb_cells = 0;
+    for(int i = 0; i < nb_inst; i++)
+        nb_cells += (int)h_grids[i].cells.size();
+
+    hd_compact.     malloc(nb_inst * COMPACT_NB_ROWS);
+    hd_compact_dims.malloc(nb_inst);
+    hd_cells.       malloc(nb_cells);
+
+    int acc = 0;
+    for(int i = 0; i < nb_inst; i++)
+    {
+        const Compact_grid& g = h_grids[i];
+        hd_compact[i * COMPACT_NB_ROWS + COMPACT_GRID  ] = g.grid;
+        hd_compact[i * COMPACT_NB_ROWS + COMPACT_BASE_A] = g.base_a;
+        hd_compact[i * COMPACT_NB_ROWS + COMPACT_BASE_B] = g.base_b;
+
+        int4 dims = g.dims;
+        if(h_offset[i].x < 0 || g.cells.size() == 0)
+            dims.w = -1;
+        else
+        {
+            // Cell starts become indices in hd_cells
+            const int nb = dims.x * dims.y * dims.z + 1;
+            for(unsigned c = 0; c < g.cells.size(); c++)
+                hd_cells[acc + c] = (int)c < nb ? g.cells[c] + acc : g.cells[c];
+            dims.w = acc;
+            acc += (int)g.cells.size();
+        }
+        hd_compact_dims[i] = dims;
+    }
+    update_compact_frames();
+
+    hd_compact.     update_device_mem();
+    hd_compact_dims.update_device_mem();
+    hd_cells.       update_device_mem();
+}
+
+// -----------------------------------------------------------------------------
+
+/// Private function
+/// Rebuild the evaluation arrays that depend on the samples' layout
+/// (hd_soa, hd_compact, hd_compact_dims and hd_cells)
+static void update_eval_arrays()
+{
+#if defined(HRBF_SOA)
+    update_soa();
+#endif
+    update_compact_arrays();
+}
+
+// -----------------------------------------------------------------------------
+
 /// Allocate one more element at the top of the array to store another hrbf
 /// instance
 static void add_instance_memory()
@@ -381,14 +642,20 @@ static void add_instance_memory()
     d_offset.  realloc( size );
     hd_radius. realloc( size );
     hd_transfo.realloc( size );
+    h_kernel.  realloc( size );
+    hd_support.realloc( size );
+    h_grids.   resize ( size );
 
     h_offset[size - 1] = make_int2(0, 0);
     d_offset.set(size - 1, make_int2(0, 0));
     hd_radius [size - 1] = 5.f;
     hd_transfo[size - 1] = Transfo::identity();
+    h_kernel  [size - 1] = HRBF_wrapper::RBF_GLOBAL;
+    hd_support[size - 1] = 0.f;
 
     hd_radius. update_device_mem();
     hd_transfo.update_device_mem();
+    hd_support.update_device_mem();
 }
 
 // -----------------------------------------------------------------------------
@@ -406,9 +673,22 @@ static void erase_instance_memory()
     d_offset.  realloc(d_offset.  size() - 1);
     hd_radius. realloc(hd_radius. size() - 1);
     hd_transfo.realloc(hd_transfo.size() - 1);
+    h_kernel.  realloc(h_kernel.  size() - 1);
+    hd_support.realloc(hd_support.size() - 1);
+    h_grids.   pop_back();
 
     hd_radius.update_device_mem();
     hd_transfo.update_device_mem();
+    hd_support.update_device_mem();
+}
+
+// -----------------------------------------------------------------------------
+
+static void set_fit_report(int hrbf_id, const HRBF_wrapper::HRBF_fit_report& rep)
+{
+    if( hrbf_id >= (int)h_fit_reports.size() )
+        h_fit_reports.resize(hrbf_id + 1);
+    h_fit_reports[hrbf_id] = rep;
 }
 
 // -----------------------------------------------------------------------------
@@ -430,9 +710,14 @@ int new_instance()
         add_instance_memory();
 
     update_offset(idx, 0);
+    h_kernel[idx] = HRBF_wrapper::RBF_GLOBAL;
+    hd_support.set_hd(idx, 0.f);
+    h_grids[idx] = Compact_grid();
+    set_fit_report(idx, HRBF_wrapper::HRBF_fit_report());
 
     nb_hrbf_instance++;
 
+    update_eval_arrays();
     HRBF_env::bind();
     return idx;
 }
@@ -468,6 +753,8 @@ void delete_instance(int hrbf_id)
 
     // Compute the new offsets
     update_offset(hrbf_id, 0);
+    set_fit_report(hrbf_id, HRBF_wrapper::HRBF_fit_report());
+    h_grids[hrbf_id] = Compact_grid();
 
     if(hrbf_id == (h_offset.size()-1))
     {
@@ -485,6 +772,7 @@ void delete_instance(int hrbf_id)
 
     nb_hrbf_instance--;
 
+    update_eval_arrays();
     HRBF_env::bind();
 }
 
@@ -500,6 +788,7 @@ void reset_instance(int hrbf_id)
 
     HRBF_env::unbind();
     float radius = hd_radius[hrbf_id];
+    int kernel = h_kernel[hrbf_id];
     Transfo tr = get_transfo(hrbf_id);
     HRBF_env::bind();
 
@@ -512,13 +801,87 @@ void reset_instance(int hrbf_id)
     // Compute the new offsets
     update_offset(hrbf_id, 0);
     hd_radius.set_hd(hrbf_id, radius);
+    h_kernel[hrbf_id] = kernel;
     set_transfo( hrbf_id, tr);
     nb_hrbf_instance++;
+    update_eval_arrays();
     HRBF_env::bind();
 }
 
 // -----------------------------------------------------------------------------
 
+/// private function
+/// Re-compute the support radius, the base capsule and the grid of the
+/// samples of the instance (0 and no grid for RBF_GLOBAL instances).
+/// The grid is only copied to the device by update_compact_arrays()
+static void update_compact(int hrbf_id)
+{
+    assert(!HRBF_env::binded);
+    Compact_grid& g = h_grids[hrbf_id];
+    g = Compact_grid();
+    float support = 0.f;
+    const int size = h_offset[hrbf_id].y;
+    if( h_kernel[hrbf_id] == HRBF_wrapper::RBF_WENDLAND_C2 && size > 0 )
+    {
+        HA_float4  vert_float(size);
+        HA_Vec3_cu vertices  (size);
+        mem_cpy_dth(vert_float.ptr(), d_init_points.ptr() + h_offset[hrbf_id].x, size);
+        for(int i = 0; i < size; i++)
+            vertices[i] = Vec3_cu(vert_float[i].x, vert_float[i].y, vert_float[i].z);
+        support = HRBF_wrapper::support_radius(vertices.ptr(), size);
+
+        const HRBF_wrapper::HRBF_capsule cap = HRBF_wrapper::fit_capsule(vertices.ptr(), size);
+        g.base_a = make_float4(cap.a.x, cap.a.y, cap.a.z, cap.radius);
+        g.base_b = make_float4(cap.b.x, cap.b.y, cap.b.z, 0.f);
+
+        Vec3_cu bmin = vertices[0], bmax = vertices[0];
+        for(int i = 1; i < size; i++){
+            bmin = Vec3_cu(std::min(bmin.x, vertices[i].x), std::min(bmin.y, vertices[i].y), std::min(bmin.z, vertices[i].z));
+            bmax = Vec3_cu(std::max(bmax.x, vertices[i].x), std::max(bmax.y, vertices[i].y), std::max(bmax.z, vertices[i].z));
+        }
+        const Vec3_cu ext = bmax - bmin;
+
+        // Cells no smaller than the support so that the 27 cells around a
+        // point hold every sample whose support contains it
+        float cell = std::max(support, 1e-6f);
+        int nx, ny, nz;
+        for(;;)
+        {
+            nx = (int)(ext.x / cell) + 1;
+            ny = (int)(ext.y / cell) + 1;
+            nz = (int)(ext.z / cell) + 1;
+            if( (double)nx * ny * nz <= (double)HRBF_wrapper::WENDLAND_CELLS_PER_SAMPLE * size ) break;
+            cell *= 1.25f;
+        }
+        const int nb_cells = nx * ny * nz;
+        const float inv_cell = 1.f / cell;
+        g.grid = make_float4(bmin.x, bmin.y, bmin.z, inv_cell);
+        g.dims = make_int4(nx, ny, nz, 0);
+
+        // Counting sort of the samples by cell
+        std::vector<int> cell_of(size);
+        g.cells.assign(nb_cells + 1 + size, 0);
+        for(int i = 0; i < size; i++)
+        {
+            const Vec3_cu c = (vertices[i] - bmin) * inv_cell;
+            const int cx = std::min((int)c.x, nx - 1);
+            const int cy = std::min((int)c.y, ny - 1);
+            const int cz = std::min((int)c.z, nz - 1);
+            cell_of[i] = (cz * ny + cy) * nx + cx;
+            g.cells[cell_of[i] + 1]++;
+        }
+        g.cells[0] = nb_cells + 1;
+        for(int c = 0; c < nb_cells; c++)
+            g.cells[c + 1] += g.cells[c];
+        std::vector<int> fill(g.cells.begin(), g.cells.begin() + nb_cells);
+        for(int i = 0; i < size; i++)
+            g.cells[ fill[cell_of[i]]++ ] = i;
+    }
+    hd_support.set_hd(hrbf_id, support);
+}
+
+// -----------------------------------------------------------------------------
+
 /// private function
 /// Compute hrbf coeffs from d_points and h_normals. usefull when you
 /// change/delete/add a sample.
@@ -531,7 +894,9 @@ void reset_instance(int hrbf_id)
 /// @param d_alphas_betas array in device memory
 /// (parameter is likely to be HRBF_Env::d_init_alpha_beta.ptr()+offset)
 /// @param nb_points size of the arrays
-static void update_coeff(const Vec3_cu* h_normals,
+/// @param hrbf_id instance the fit report is stored for
+static void update_coeff(int hrbf_id,
+                         const Vec3_cu* h_normals,
                          const float4* d_points,
                          float4* d_alphas_betas,
                          int nb_points)
@@ -549,8 +914,18 @@ static void update_coeff(const Vec3_cu* h_normals,
         vertices[i] = Vec3_cu(v.x, v.y, v.z);
     }
 
+    update_compact(hrbf_id);
+
     HRBF_coeffs coeffs;
-    hermite_fit(vertices.ptr(), normals.ptr(), nb_points, coeffs);
+    hermite_fit(vertices.ptr(), normals.ptr(), nb_points, coeffs, hd_support[hrbf_id]);
+    set_fit_report(hrbf_id, coeffs.report);
+    if( coeffs.report.ill_conditioned )
+    {
+        fprintf(stderr, "WARNING: ill-conditioned HRBF fit (instance %d, "
+                        "%d samples, %d merged): cond %g residual %g\n",
+                hrbf_id, coeffs.report.nb_samples, coeffs.report.nb_merged,
+                coeffs.report.cond, coeffs.report.residual);
+    }
     // updates weights with the newly computed weights
     HA_float4 h_alpha_beta(nb_points);
     for(int i=0; i<nb_points; i++){
@@ -597,12 +972,14 @@ void set_sample(int hrbf_id,
     d_init_points.set(idx, fpoint);
     hd_points.set_hd(idx, fpoint);
     // re-compute the weights
-    update_coeff(h_normals.ptr()+offset,
+    update_coeff(hrbf_id,
+                 h_normals.ptr()+offset,
                  d_init_points.ptr()+offset,
                  d_init_alpha_beta.ptr()+offset,
                  inst_size);
 
     update_anim_alpha_betas(hrbf_id);
+    update_eval_arrays();
     HRBF_env::bind();
 }
 
@@ -626,13 +1003,15 @@ void set_sample_normal(int hrbf_id,
     int idx = sample_index+offset;
     h_normals[idx] = n;
     // re-compute the weights
-    update_coeff(h_normals.ptr()+offset,
+    update_coeff(hrbf_id,
+                 h_normals.ptr()+offset,
                  d_init_points.ptr()+offset,
                  d_init_alpha_beta.ptr()+offset,
                  inst_size);
 
     update_anim_alpha_betas(hrbf_id);
 
+    update_eval_arrays();
     HRBF_env::bind();
 }
 
@@ -651,6 +1030,17 @@ void set_inst_radius(int hrbf_id, float radius)
 
 // -----------------------------------------------------------------------------
 
+void set_inst_kernel(int hrbf_id, HRBF_wrapper::Rbf_kernel kernel)
+{
+    assert(hrbf_id < h_offset.size());
+    assert(hrbf_id >= 0);
+    assert( h_offset[hrbf_id].x >= 0 );
+
+    h_kernel[hrbf_id] = kernel;
+}
+
+// -----------------------------------------------------------------------------
+
 void set_transfo(int hrbf_id, const Transfo& tr)
 {
     assert(hrbf_id < h_offset.size());
@@ -670,6 +1060,10 @@ void set_transfo(int hrbf_id, const Transfo& tr)
 void apply_hrbf_transfos()
 {
     hd_transfo.update_device_mem();
+    if(hd_compact.size() > 0){
+        update_compact_frames();
+        hd_compact.update_device_mem();
+    }
     HRBF_kernels::hrbf_transform(hd_transfo.device_array(), d_map_transfos);
 }
 
@@ -712,13 +1106,15 @@ void delete_samples(int hrbf_id, const std::vector<int>& samples_idx)
     // Compute new offsets
     update_offset(hrbf_id, size_inst - samples_idx.size());
 
-    update_coeff(h_normals.ptr()+offset,
+    update_coeff(hrbf_id,
+                 h_normals.ptr()+offset,
                  d_init_points.ptr()+offset,
                  d_init_alpha_beta.ptr()+offset,
                  get_instance_size(hrbf_id));
 
     update_anim_alpha_betas(hrbf_id);
 
+    update_eval_arrays();
     HRBF_env::bind();
 }
 
@@ -779,7 +1175,8 @@ int add_samples(int hrbf_id,
         d_init_alpha_beta.insert(offset, ha_points/*insert dummy data*/ );
         hd_alphas_betas  .insert(offset, ha_points/*insert dummy data*/ );
 
-        update_coeff(h_normals.ptr()+offset,
+        update_coeff(hrbf_id,
+                     h_normals.ptr()+offset,
                      d_init_points.ptr()+offset,
                      d_init_alpha_beta.ptr()+offset,
                      get_instance_size(hrbf_id));
@@ -790,9 +1187,12 @@ int add_samples(int hrbf_id,
     {
         d_init_alpha_beta.insert(offset, weights );
         hd_alphas_betas  .insert(offset, weights );
+        update_compact(hrbf_id);
+        set_fit_report(hrbf_id, HRBF_wrapper::HRBF_fit_report());
         hd_alphas_betas.update_device_mem();
     }
 
+    update_eval_arrays();
     HRBF_env::bind();
 
     return get_instance_size(hrbf_id) - points.size();
@@ -808,6 +1208,156 @@ int add_sample(int hrbf_id, const Vec3_cu& point, const Vec3_cu& normal)
     return add_samples(hrbf_id, points, normals);
 }
 
+// -----------------------------------------------------------------------------
+/// @name Benchmark
+// -----------------------------------------------------------------------------
+
+__global__ static
+void bench_layout_ker(HermiteRBF hrbf, const Point_cu* pts, int n, bool soa, float* out)
+{
+    const int p = blockIdx.x * blockDim.x + threadIdx.x;
+    if(p < n)
+    {
+        Vec3_cu gf;
+        const float f = soa ? hrbf.fngf_global_soa(gf, pts[p]) :
+                              hrbf.fngf_global_aos(gf, pts[p]);
+        out[p] = f + gf.x + gf.y + gf.z;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+static float rand_unit(){ return 2.f * (float)rand() / (float)RAND_MAX - 1.f; }
+
+// -----------------------------------------------------------------------------
+
+/// @return evaluations per second on host, results in 'out'
+static double bench_host(const HermiteRBF& hrbf, const std::vector<Point_cu>& pts,
+                         bool soa, std::vector<float>& out)
+{
+    const int nb = (int)pts.size();
+    Timer t;
+    t.reset();
+    t.start();
+    for(int i = 0; i < nb; i++){
+        Vec3_cu gf;
+        const float f = soa ? hrbf.fngf_global_soa(gf, pts[i]) :
+                              hrbf.fngf_global_aos(gf, pts[i]);
+        out[i] = f + gf.x + gf.y + gf.z;
+    }
+    const double secs = t.stop();
+    return secs > 0. ? nb / secs : 0.;
+}
+
+// -----------------------------------------------------------------------------
+
+/// @return evaluations per second on device, results in 'out'
+static double bench_device(const HermiteRBF& hrbf, const Device::Array<Point_cu>& d_pts,
+                           bool soa, std::vector<float>& out)
+{
+    const int nb = d_pts.size();
+    const int block_size = 128;
+    const int grid_size  = (nb + block_size - 1) / block_size;
+    Device::Array<float> d_out(nb);
+
+    // Warm up
+    bench_layout_ker<<<grid_size, block_size>>>(hrbf, d_pts.ptr(), nb, soa, d_out.ptr());
+
+    cudaEvent_t start, stop;
+    CUDA_SAFE_CALL( cudaEventCreate(&start) );
+    CUDA_SAFE_CALL( cudaEventCreate(&stop ) );
+    CUDA_SAFE_CALL( cudaEventRecord(start) );
+    bench_layout_ker<<<grid_size, block_size>>>(hrbf, d_pts.ptr(), nb, soa, d_out.ptr());
+    CUDA_SAFE_CALL( cudaEventRecord(stop) );
+    CUDA_SAFE_CALL( cudaEventSynchronize(stop) );
+    CUDA_CHECK_ERRORS();
+
+    float ms = 0.f;
+    CUDA_SAFE_CALL( cudaEventElapsedTime(&ms, start, stop) );
+    CUDA_SAFE_CALL( cudaEventDestroy(start) );
+    CUDA_SAFE_CALL( cudaEventDestroy(stop ) );
+
+    out = d_out.to_host_vector();
+    return ms > 0.f ? nb / (ms * 1e-3) : 0.;
+}
+
+// -----------------------------------------------------------------------------
+
+static float max_diff(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float d = 0.f;
+    for(unsigned i = 0; i < a.size(); i++)
+        d = std::max(d, std::abs(a[i] - b[i]) / std::max(1.f, std::abs(a[i])));
+    return d;
+}
+
+// -----------------------------------------------------------------------------
+
+void benchmark_layouts(int nb_evals)
+{
+    assert(binded);
+    static const int sizes[] = { 15, 64, 250, 1024, 4096 };
+    const int nb_sizes = sizeof(sizes) / sizeof(int);
+
+    srand(0);
+    std::vector<Point_cu> pts(nb_evals);
+    for(int i = 0; i < nb_evals; i++)
+        pts[i] = Point_cu(rand_unit(), rand_unit(), rand_unit()) * 2.f;
+    Device::Array<Point_cu> d_pts(nb_evals);
+    d_pts.copy_from(pts);
+
+    printf("HRBF evaluations per second (f and gf, %d evals), Mevals/s:\n", nb_evals);
+    printf("%8s | %10s %10s | %10s %10s | %s\n",
+           "samples", "host AoS", "host SoA", "dev AoS", "dev SoA", "max rel diff");
+
+    std::vector<float> f_aos(nb_evals), f_soa(nb_evals);
+    for(int s = 0; s < nb_sizes; s++)
+    {
+        // Weights don't need to be fitted to measure the evaluation
+        const int n = sizes[s];
+        std::vector<Vec3_cu> nodes(n), normals(n), betas(n);
+        std::vector<float>   alphas(n);
+        for(int i = 0; i < n; i++){
+            nodes  [i] = Vec3_cu(rand_unit(), rand_unit(), rand_unit());
+            normals[i] = Vec3_cu(rand_unit(), rand_unit(), rand_unit()).normalized();
+            betas  [i] = Vec3_cu(rand_unit(), rand_unit(), rand_unit()) * 0.1f;
+            alphas [i] = rand_unit() * 0.1f;
+        }
+
+        HermiteRBF hrbf;
+        hrbf.initialize();
+        hrbf.init_coeffs(nodes, normals, alphas, betas);
+#if !defined(HRBF_SOA)
+        // Not maintained by the edits: built for the benchmark only
+        unbind();
+        update_soa();
+        bind();
+#endif
+
+        const double h_aos = bench_host(hrbf, pts, false, f_aos);
+        const double h_soa = bench_host(hrbf, pts, true , f_soa);
+        float diff = max_diff(f_aos, f_soa);
+
+        const double d_aos = bench_device(hrbf, d_pts, false, f_aos);
+        const double d_soa = bench_device(hrbf, d_pts, true , f_soa);
+        diff = std::max(diff, max_diff(f_aos, f_soa));
+
+        printf("%8d | %10.3f %10.3f | %10.3f %10.3f | %g\n", n,
+               h_aos * 1e-6, h_soa * 1e-6, d_aos * 1e-6, d_soa * 1e-6, diff);
+
+        hrbf.clear();
+    }
+
+#if !defined(HRBF_SOA)
+    unbind();
+    hd_soa.erase();
+    hd_soa.update_device_mem();
+    d_soa_offset.erase();
+    h_soa_offset.erase();
+    bind();
+#endif
+}
+
 // -----------------------------------------------------------------------------
 
 }// END HRBF_ENV NAMESPACE =====================================================
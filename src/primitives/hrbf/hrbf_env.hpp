@@ -5,6 +5,8 @@
 
 #include "cuda_utils.hpp"
 #include "transfo.hpp"
+#include "hrbf_data.hpp"
+#include "hrbf_setup.hpp"
 
 // -----------------------------------------------------------------------------
 
@@ -14,6 +16,7 @@
 // -----------------------------------------------------------------------------
 
 struct Skeleton;
+struct Memory_report;
 
 // -----------------------------------------------------------------------------
 
@@ -71,6 +74,77 @@ extern Cuda_utils::HA_Vec3_cu h_normals;
 
 /// Radius of the hrbfs to transform from global to compact support.
 extern Cuda_utils::HDA_float hd_radius;
+
+/// Radial basis function of each instance (HRBF_wrapper::Rbf_kernel)
+extern Cuda_utils::HA_int h_kernel;
+/// Support radius of RBF_WENDLAND_C2 instances, 0 for RBF_GLOBAL instances.
+/// Computed from the samples each time they change.
+extern Cuda_utils::HDA_float hd_support;
+#endif
+
+// -----------------------------------------------------------------------------
+/// @name Structure of arrays storage
+/// Same data as hd_points and hd_alphas_betas with one plane per component.
+/// The block of an instance is SOA_NB_PLANES planes of 'padded size' floats
+/// (instance size rounded up to SOA_PAD) so that 8 and 16 wide lanes never
+/// straddle two instances. Padding samples have null weights and add nothing
+/// to the field. Rebuilt by apply_hrbf_transfos() and every sample edit
+/// when HRBF_SOA is defined (hrbf_setup.hpp), empty otherwise.
+// -----------------------------------------------------------------------------
+
+/// Planes in the block of an instance
+enum Soa_plane {
+    SOA_X = 0, SOA_Y, SOA_Z,    ///< animated sample
+    SOA_BX, SOA_BY, SOA_BZ,     ///< animated beta
+    SOA_ALPHA,
+    SOA_NB_PLANES
+};
+
+/// Plane lengths are multiple of this
+#define HRBF_SOA_PAD (16)
+
+#if !defined(NO_CUDA)
+extern Cuda_utils::HDA_float hd_soa;
+
+/// d_soa_offset[HRBF_ID].x start of the instance block in hd_soa
+/// d_soa_offset[HRBF_ID].y padded size (length of a plane)
+/// Negative offsets for deleted instances like d_offset
+extern Cuda_utils::DA_int2 d_soa_offset;
+extern Cuda_utils::HA_int2 h_soa_offset;
+#endif
+
+// -----------------------------------------------------------------------------
+/// @name Grid of the samples of RBF_WENDLAND_C2 instances
+/// Samples are listed in a uniform grid built in rest pose (d_init_points)
+/// with cells at least as wide as the support radius: the samples whose
+/// support contains a point are in the 27 cells around it. Grids, base
+/// capsules (HRBF_wrapper::HRBF_capsule) and supports are recomputed each
+/// time the samples of the instance change.
+// -----------------------------------------------------------------------------
+
+/// Rows of hd_compact, an instance owns rows
+/// [hrbf_id * COMPACT_NB_ROWS, (hrbf_id+1) * COMPACT_NB_ROWS[
+enum Compact_row {
+    COMPACT_GRID = 0, ///< grid origin (x, y, z), inverse of the cell size (w)
+    COMPACT_BASE_A,   ///< base capsule: first end (x, y, z), radius (w)
+    COMPACT_BASE_B,   ///< base capsule: second end (x, y, z)
+    COMPACT_FRAME_X,  ///< rows of the inverse of the instance transformation
+    COMPACT_FRAME_Y,  ///< (world to rest pose), updated by
+    COMPACT_FRAME_Z,  ///< apply_hrbf_transfos()
+    COMPACT_NB_ROWS
+};
+
+#if !defined(NO_CUDA)
+extern Cuda_utils::HDA_float4 hd_compact;
+
+/// hd_compact_dims[HRBF_ID] number of cells along x, y, z and start of the
+/// instance's block in hd_cells (w). w is negative for RBF_GLOBAL and empty
+/// instances
+extern Cuda_utils::HDA_int4 hd_compact_dims;
+
+/// Block of an instance: nx*ny*nz + 1 cell starts (indices in hd_cells),
+/// then the index in the instance of each sample sorted by cell
+extern Cuda_utils::HDA_int hd_cells;
 #endif
 
 // -----------------------------------------------------------------------------
@@ -85,6 +159,16 @@ void clean_env();
 /// If you wish to erase every hrbf and refill the env use this
 void reset_env();
 
+/// Add the memory used by every hrbf instances to 'rep'
+void memory_report(Memory_report& rep);
+
+/// Print the number of fngf_global() evaluations per second with the
+/// interleaved float4 arrays (AoS) and the structure of arrays storage (SoA),
+/// on host and device, for several instance sizes. Temporary instances with
+/// random samples and weights are created then deleted. Without HRBF_SOA the
+/// SoA storage is built for the benchmark and freed afterwards.
+void benchmark_layouts(int nb_evals = 1 << 14);
+
 //------------------------------------------------------------------------------
 /// @name Manage HRBF instances
 //------------------------------------------------------------------------------
@@ -150,6 +234,12 @@ void set_sample_normal(int hrbf_id,
 /// Set the radius of the ith instance for going to global to compact support
 void set_inst_radius(int hrbf_id, float radius);
 
+/// Select the radial basis function of the instance. Takes effect at the
+/// next fit (add_samples(), set_sample() etc.); weights given to
+/// add_samples() must come from a fit with the same kernel.
+/// Kept by reset_instance().
+void set_inst_kernel(int hrbf_id, HRBF_wrapper::Rbf_kernel kernel);
+
 /// Set transformations of the ith instance which will be used to compute
 /// Animated samples and weights of the HRBF
 /// @warning to apply the transformation call apply_hrbf_transfos()
@@ -221,17 +311,58 @@ float get_inst_radius(int hrbf_id);
 /// Get transformations of the ith instance
 Transfo get_transfo(int hrbf_id);
 
+HRBF_wrapper::Rbf_kernel get_inst_kernel(int hrbf_id);
+
+/// Support radius of the instance's radial basis function
+/// (0 for RBF_GLOBAL instances)
+float get_inst_support(int hrbf_id);
+
+/// Conditioning of the last fit of the instance (see
+/// HRBF_wrapper::hermite_fit()). report.nb_samples is zero if the weights
+/// were never fitted by HRBF_env (e.g. given to add_samples())
+HRBF_wrapper::HRBF_fit_report get_fit_report(int hrbf_id);
+
 
 /// @return the instance radius to transform from global to compact support
 IF_CUDA_DEVICE_HOST static inline
 float fetch_radius(int id_instance);
 
+/// @return the support radius of the instance (0: global support)
+IF_CUDA_DEVICE_HOST static inline
+float fetch_support(int id_instance);
+
+/// @return the row 'row' (Compact_row) of the instance
+#if !defined(NO_CUDA)
+IF_CUDA_DEVICE_HOST static inline
+float4 fetch_compact(int id_instance, int row);
+
+/// @return grid size in x, y, z and cells block start in w
+IF_CUDA_DEVICE_HOST static inline
+int4 fetch_compact_dims(int id_instance);
+#endif
+
+/// @return an element of hd_cells
+IF_CUDA_DEVICE_HOST static inline
+int fetch_cell(int raw_idx);
+
 /// @return the instance offset in x and size in y
 #if !defined(NO_CUDA)
 IF_CUDA_DEVICE_HOST static inline
 int2 fetch_inst_size_and_offset(int id_instance);
 #endif
 
+/// @return the instance block start in x and padded size in y
+/// (structure of arrays storage)
+#if !defined(NO_CUDA)
+IF_CUDA_DEVICE_HOST static inline
+int2 fetch_soa_offset(int id_instance);
+#endif
+
+/// fetch one float of the structure of arrays storage
+/// @param raw_idx : block start + plane * padded size + sample index
+IF_CUDA_DEVICE_HOST static inline
+float fetch_soa(int raw_idx);
+
 /// fetch at the same time points and weights (more efficient than functions below)
 /// @param raw_idx The raw index to fetch directly from the texture.
 /// raw_idx equals the offset plus the indice of the fetched sample
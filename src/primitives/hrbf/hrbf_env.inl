@@ -32,6 +32,14 @@ extern texture<float4, 1, cudaReadModeElementType> tex_alphas_betas;
 extern texture<int2, 1, cudaReadModeElementType> tex_offset;
 
 extern texture<float, 1, cudaReadModeElementType> tex_radius;
+extern texture<float, 1, cudaReadModeElementType> tex_support;
+
+extern texture<float4, 1, cudaReadModeElementType> tex_compact;
+extern texture<int4, 1, cudaReadModeElementType> tex_compact_dims;
+extern texture<int, 1, cudaReadModeElementType> tex_cells;
+
+extern texture<float, 1, cudaReadModeElementType> tex_soa;
+extern texture<int2, 1, cudaReadModeElementType> tex_soa_offset;
 #endif
 
 // -----------------------------------------------------------------------------
@@ -46,6 +54,46 @@ float fetch_radius(int id_instance)
     #endif
 }
 
+IF_CUDA_DEVICE_HOST static inline
+float fetch_support(int id_instance)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_support, id_instance);
+    #else
+    return hd_support[id_instance];
+    #endif
+}
+
+IF_CUDA_DEVICE_HOST static inline
+float4 fetch_compact(int id_instance, int row)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_compact, id_instance * COMPACT_NB_ROWS + row);
+    #else
+    return hd_compact[id_instance * COMPACT_NB_ROWS + row];
+    #endif
+}
+
+IF_CUDA_DEVICE_HOST static inline
+int4 fetch_compact_dims(int id_instance)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_compact_dims, id_instance);
+    #else
+    return hd_compact_dims[id_instance];
+    #endif
+}
+
+IF_CUDA_DEVICE_HOST static inline
+int fetch_cell(int raw_idx)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_cells, raw_idx);
+    #else
+    return hd_cells[raw_idx];
+    #endif
+}
+
 IF_CUDA_DEVICE_HOST static inline
 int2 fetch_inst_size_and_offset(int id_instance)
 {
@@ -56,6 +104,26 @@ int2 fetch_inst_size_and_offset(int id_instance)
     #endif
 }
 
+IF_CUDA_DEVICE_HOST static inline
+int2 fetch_soa_offset(int id_instance)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_soa_offset, id_instance);
+    #else
+    return h_soa_offset[id_instance];
+    #endif
+}
+
+IF_CUDA_DEVICE_HOST static inline
+float fetch_soa(int raw_idx)
+{
+    #ifdef __CUDA_ARCH__
+    return tex1Dfetch(tex_soa, raw_idx);
+    #else
+    return hd_soa[raw_idx];
+    #endif
+}
+
 IF_CUDA_DEVICE_HOST inline static
 float fetch_weights_point(Vec3_cu& beta,
                           Point_cu& point,
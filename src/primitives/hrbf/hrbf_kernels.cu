@@ -1,5 +1,6 @@
 #include "hrbf_kernels.hpp"
 #include "hrbf_env.hpp"
+#include "cuda_launch_config.hpp"
 
 #include <iostream>
 
@@ -39,6 +40,37 @@ void hrbf_transform_ker(const int nb_verts,
 
 // -----------------------------------------------------------------------------
 
+__global__
+void hrbf_to_soa_ker(const int nb_verts,
+                     const float4* points,
+                     const float4* alpha_beta,
+                     const int* map_instance,
+                     const int2* offset,
+                     const int2* soa_offset,
+                     float* soa)
+{
+    const int p = blockIdx.x * blockDim.x + threadIdx.x;
+
+    if(p < nb_verts)
+    {
+        const int  inst = map_instance[p];
+        const int2 so   = soa_offset[inst];
+        float* out = soa + so.x + (p - offset[inst].x);
+
+        const float4 pt = points[p];
+        const float4 ab = alpha_beta[p];
+        out[HRBF_env::SOA_X     * so.y] = pt.x;
+        out[HRBF_env::SOA_Y     * so.y] = pt.y;
+        out[HRBF_env::SOA_Z     * so.y] = pt.z;
+        out[HRBF_env::SOA_BX    * so.y] = ab.x;
+        out[HRBF_env::SOA_BY    * so.y] = ab.y;
+        out[HRBF_env::SOA_BZ    * so.y] = ab.z;
+        out[HRBF_env::SOA_ALPHA * so.y] = ab.w;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 /// Transform each vertex of each rbf primitive
 /// @param d_transform Map for a bone parent index its rigid transformation
 /// (tab[parent[ith_bone]] = ith_bone_transformation)
@@ -47,9 +79,9 @@ void hrbf_transform(const Cuda_utils::Device::Array<Transfo>& d_transform,
 {
     if(HRBF_env::d_init_points.size() == 0) return;
 
-    const int block_size = 16;
+    const int block_size = Launch_cfg::block_size(Launch_cfg::HRBF_TRANSFORM, hrbf_transform_ker);
     const int grid_size  =
-            (HRBF_env::d_init_points.size() + block_size - 1) / block_size;
+            Launch_cfg::grid_size(block_size, HRBF_env::d_init_points.size());
 
     HRBF_env::unbind();
 
@@ -68,7 +100,35 @@ void hrbf_transform(const Cuda_utils::Device::Array<Transfo>& d_transform,
 
     CUDA_CHECK_ERRORS();
 
+#if defined(HRBF_SOA)
+    hrbf_to_soa(d_map_transfos);
+#endif
+
     HRBF_env::bind();
 }
 
+// -----------------------------------------------------------------------------
+
+void hrbf_to_soa(const Cuda_utils::DA_int& d_map_instance)
+{
+    const int nb_verts = HRBF_env::hd_points.size();
+    if(nb_verts == 0) return;
+
+    const int block_size = Launch_cfg::block_size(Launch_cfg::HRBF_TO_SOA, hrbf_to_soa_ker);
+    const int grid_size  = Launch_cfg::grid_size(block_size, nb_verts);
+
+    hrbf_to_soa_ker
+            <<<grid_size, block_size >>>
+            (nb_verts,
+             HRBF_env::hd_points.d_ptr(),
+             HRBF_env::hd_alphas_betas.d_ptr(),
+             d_map_instance.ptr(),
+             HRBF_env::d_offset.ptr(),
+             HRBF_env::d_soa_offset.ptr(),
+             HRBF_env::hd_soa.d_ptr());
+
+    CUDA_CHECK_ERRORS();
+    HRBF_env::hd_soa.update_host_mem();
+}
+
 }// END HRBF_ENV NAMESPACE =====================================================
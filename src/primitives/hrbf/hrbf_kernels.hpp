@@ -17,6 +17,13 @@ namespace HRBF_kernels{
 void hrbf_transform(const Cuda_utils::Device::Array<Transfo>& d_transform,
                     const Cuda_utils::DA_int& d_map_transfos);
 
+/// Scatter the animated samples and weights (HRBF_env::hd_points and
+/// HRBF_env::hd_alphas_betas) into the structure of arrays storage
+/// HRBF_env::hd_soa on device and host. Its layout (HRBF_env::d_soa_offset)
+/// must be up to date and the padding already zeroed.
+/// @param d_map_instance : instance id of each sample
+void hrbf_to_soa(const Cuda_utils::DA_int& d_map_instance);
+
 }// END HRBF_ENV NAMESPACE =====================================================
 
 #endif // HRBF_KERNELS_HPP__
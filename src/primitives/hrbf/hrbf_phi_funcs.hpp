@@ -73,6 +73,39 @@ struct Rbf_thin_plate
 
 // =============================================================================
 
+/// Wendland's C2 function (1-x)^4 (4x+1), zero for x >= 1. Distances are
+/// expressed in units of the support radius. Unlike the functions above it is
+/// smooth at 0: f(0) = 1, df(0) = 0, ddf(0) = -20
+template<typename Scalar>
+struct Rbf_wendland_c2
+{
+    IF_CUDA_DEVICE_HOST
+    static inline Scalar f  (const Scalar& x) {
+        if( x >= Scalar(1) ) return Scalar(0);
+        Scalar t = Scalar(1) - x, t2 = t * t;
+        return t2 * t2 * (Scalar(4) * x + Scalar(1));
+    }
+    IF_CUDA_DEVICE_HOST
+    static inline Scalar df (const Scalar& x) {
+        return x * df_x(x);
+    }
+    IF_CUDA_DEVICE_HOST
+    static inline Scalar ddf(const Scalar& x) {
+        if( x >= Scalar(1) ) return Scalar(0);
+        Scalar t = Scalar(1) - x;
+        return Scalar(20) * t * t * (Scalar(4) * x - Scalar(1));
+    }
+    /// df(x) / x, defined at 0
+    IF_CUDA_DEVICE_HOST
+    static inline Scalar df_x(const Scalar& x) {
+        if( x >= Scalar(1) ) return Scalar(0);
+        Scalar t = Scalar(1) - x;
+        return Scalar(-20) * t * t * t;
+    }
+};
+
+// =============================================================================
+
 }// END RBF_wrapper ============================================================
 
 #endif //HRBF_PHI_FUNCS_HPP_
@@ -10,6 +10,51 @@ namespace HRBF_wrapper {
    const int   RBF_POLY_DEG = 1;
    const float MESH_SIZE    = 15.0f;
 
+   /// Samples closer than this ratio of the samples' bounding box diagonal
+   /// are merged before a fit
+   const float  FIT_MERGE_DIST   = 1e-4f;
+   /// Relative residual the single precision solve is refined to, fits still
+   /// above it or with a condition number above FIT_MAX_COND are reported as
+   /// ill-conditioned. (Hermite systems with cubic RBFs are badly scaled,
+   /// 1e8 to 1e9 is common for well sampled bones)
+   const double FIT_MAX_RESIDUAL = 1e-5;
+   const double FIT_MAX_COND     = 1e12;
+   /// Fits of more samples skip the single precision factorization and are
+   /// solved in double directly: beyond about 550 samples per bone the
+   /// refinement never converged in our measurements (the guess of the
+   /// condition number decides below)
+   const int    FIT_SINGLE_MAX_SAMPLES = 600;
+   /// Memory hermite_fit_batch() lets its concurrent fits use (bytes). A dense
+   /// fit of n samples peaks at about 16*(4n)^2 bytes (fit_peak_bytes()), 1GB
+   /// for 2000 samples
+   const double FIT_BATCH_MAX_BYTES = 4. * 1024. * 1024. * 1024.;
+
+   /// Radial basis function of an HRBF instance
+   /// (HRBF_env::set_inst_kernel())
+   enum Rbf_kernel {
+       RBF_GLOBAL = 0,   ///< PHI_TYPE, dense system, every sample evaluated
+       RBF_WENDLAND_C2   ///< Rbf_wendland_c2, sparse system, only samples
+                         ///< within the support radius are evaluated
+                         ///< (grid of the samples) on top of a base
+                         ///< capsule
+   };
+
+   /// Support radius of RBF_WENDLAND_C2 instances in average sample spacing
+   /// (about 20 neighbours per sample on a surface). Beyond the support of
+   /// the samples the potential is the instance's base capsule
+   /// (HRBF_capsule).
+   const float  WENDLAND_SUPPORT_FACTOR = 2.5f;
+   /// Samples of RBF_WENDLAND_C2 instances are listed in a uniform grid of
+   /// cells at least the support radius wide. The cells are widened until
+   /// there are at most this many per sample.
+   const int    WENDLAND_CELLS_PER_SAMPLE = 8;
+
+   // Evaluate with the structure of arrays storage of HRBF_env (hd_soa)
+   // instead of the interleaved float4 arrays. hd_soa is only allocated and
+   // filled when defined (HRBF_env::benchmark_layouts() builds it for the
+   // duration of the benchmark otherwise)
+//#define HRBF_SOA 1
+
    // thin plates
 
 #define HERMITE_WITH_X3 1
@@ -1,23 +1,35 @@
 #include "hrbf_phi_funcs.hpp"
 #include "hrbf_data.hpp"
 #include "hrbf_setup.hpp"
+#include "hrbf_wrapper.hpp"
 
 #include "hrbf_core.hpp" ///< This file must be compile with gcc
 
+#include <Eigen/Eigenvalues>
+
+#include "parallel.hpp"
+
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
 // =============================================================================
 namespace HRBF_wrapper {
 // =============================================================================
 
 typedef HRBF_fit< float, 3, PHI_TYPE> HRBF_3f;
 
-HRBF_3f* g_hrbf = 0;
-
 typedef HRBF_3f::MatrixDD MatrixDD;
 typedef HRBF_3f::Vector   Vector;
 typedef HRBF_3f::MatrixXX MatrixDX;
 typedef HRBF_3f::MatrixXX MatrixXX;
 typedef HRBF_3f::VectorX  VectorX;
 
+/// Rows of the system per sample: the value and the gradient
+static const int ROWS_PER_SAMPLE = 3 + 1;
+
 // Wrapper Tools ---------------------------------------------------------------
 
 /// convert a MatrixDX into a newly allocated Vec3_cu array of
@@ -47,15 +59,98 @@ void vectorX_to_array(const VectorX& vec, Scalar*& tab)
         tab[i] = vec(i);
 }
 
+/// HRBF_capsule as the base field of HRBF_3f::hermite_fit_sparse()
+struct Capsule_base {
+    Capsule_base(const HRBF_capsule& c) : capsule(c) { }
+
+    float operator()(const Vector& p, Vector& grad) const
+    {
+        Vec3_cu g;
+        const float d = capsule.fngf(g, Vec3_cu(p(0), p(1), p(2)));
+        grad = Vector(g.x, g.y, g.z);
+        return d;
+    }
+
+    HRBF_capsule capsule;
+};
+
 // End  Wrapper Tools ----------------------------------------------------------
 
+float support_radius(const Vec3_cu* points, int size)
+{
+    if(size == 0) return 0.f;
+
+    Vec3_cu bmin = points[0], bmax = points[0];
+    for(int i = 1; i < size; i++){
+        bmin = Vec3_cu(std::min(bmin.x, points[i].x), std::min(bmin.y, points[i].y), std::min(bmin.z, points[i].z));
+        bmax = Vec3_cu(std::max(bmax.x, points[i].x), std::max(bmax.y, points[i].y), std::max(bmax.z, points[i].z));
+    }
+    // Samples lie on a surface: spacing from the area of the bounding box
+    // (tight enough for elongated bones)
+    const Vec3_cu e = bmax - bmin;
+    const float area    = 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    const float spacing = std::sqrt( std::max(area, 1e-12f) / (float)size );
+    return WENDLAND_SUPPORT_FACTOR * spacing;
+}
+
+// -----------------------------------------------------------------------------
+
+HRBF_capsule fit_capsule(const Vec3_cu* points, int size)
+{
+    HRBF_capsule res;
+    if(size == 0) return res;
+
+    typedef Eigen::Matrix<double, 3, 1> Vec3d;
+    typedef Eigen::Matrix<double, 3, 3> Mat3d;
+
+    Vec3d c = Vec3d::Zero();
+    for(int i = 0; i < size; i++)
+        c += Vec3d(points[i].x, points[i].y, points[i].z);
+    c /= (double)size;
+
+    Mat3d cov = Mat3d::Zero();
+    for(int i = 0; i < size; i++){
+        const Vec3d d = Vec3d(points[i].x, points[i].y, points[i].z) - c;
+        cov += d * d.transpose();
+    }
+    // Eigen values are sorted increasingly: the last vector is the main axis
+    Eigen::SelfAdjointEigenSolver<Mat3d> eig(cov);
+    const Vec3d axis = eig.eigenvectors().col(2).normalized();
+
+    double tmin =  std::numeric_limits<double>::max();
+    double tmax = -std::numeric_limits<double>::max();
+    double r    = 0.;
+    for(int i = 0; i < size; i++){
+        const Vec3d  d = Vec3d(points[i].x, points[i].y, points[i].z) - c;
+        const double t = d.dot(axis);
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+        r   += (d - axis * t).norm();
+    }
+    r /= (double)size;
+
+    // The caps are half spheres: the axis stops 'r' before the last samples
+    double ta = tmin + r, tb = tmax - r;
+    if(ta > tb) ta = tb = 0.5 * (tmin + tmax);
+
+    const Vec3d a = c + axis * ta;
+    const Vec3d b = c + axis * tb;
+    res.a      = Vec3_cu((float)a(0), (float)a(1), (float)a(2));
+    res.b      = Vec3_cu((float)b(0), (float)b(1), (float)b(2));
+    res.radius = (float)r;
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+
 void hermite_fit(const Vec3_cu* points,
                  const Vec3_cu* normals,
                  int size,
-                 HRBF_coeffs& res)
+                 HRBF_coeffs& res,
+                 float support)
 {
-    delete g_hrbf;
-    g_hrbf = new HRBF_fit< float, 3, PHI_TYPE>();
+    // Fitting state is local: concurrent calls are safe
+    HRBF_3f hrbf;
 
     std::vector<Vector> vec_points, vec_normals;
     for(int i = 0; i < size; i++)
@@ -65,15 +160,98 @@ void hermite_fit(const Vec3_cu* points,
     }
 
     // Compute coeffs :
-    g_hrbf->hermite_fit(vec_points, vec_normals);
+    Vector bmin = Vector::Constant( std::numeric_limits<float>::max());
+    Vector bmax = Vector::Constant(-std::numeric_limits<float>::max());
+    for(int i = 0; i < size; i++){
+        bmin = bmin.cwiseMin(vec_points[i]);
+        bmax = bmax.cwiseMax(vec_points[i]);
+    }
+    const float merge_dist = size > 0 ? FIT_MERGE_DIST * (bmax - bmin).norm() : 0.f;
+
+    HRBF_3f::Fit_info info;
+    if(support > 0.f)
+    {
+        const Capsule_base base( fit_capsule(points, size) );
+        hrbf.hermite_fit_sparse< Rbf_wendland_c2<double> >(vec_points, vec_normals, support, merge_dist, FIT_MAX_RESIDUAL, base, info);
+    }
+    else
+        hrbf.hermite_fit_refined(vec_points, vec_normals, merge_dist, FIT_MAX_RESIDUAL, FIT_SINGLE_MAX_SAMPLES, info);
+
+    res.report = HRBF_fit_report();
+    res.report.nb_samples      = size;
+    res.report.nb_merged       = info.nb_merged;
+    res.report.cond            = (float)info.cond;
+    res.report.residual        = (float)info.residual;
+    res.report.nb_refinements  = info.nb_refinements;
+    res.report.double_solve    = info.double_solve;
+    // Written so that NaNs are ill-conditioned too
+    res.report.ill_conditioned = !(info.cond     <= FIT_MAX_COND    ) ||
+                                 !(info.residual <= FIT_MAX_RESIDUAL);
 
     // return Coeffs :
-    res.size = (int) g_hrbf->_node_centers.cols();
-    vectorX_to_array<float>  (g_hrbf->_alphas,       res.alphas      );
-    matrixDX_to_Vec3_cu_array(g_hrbf->_betas,        res.betas       );
-    matrixDX_to_Vec3_cu_array(g_hrbf->_node_centers, res.nodeCenters );
+    res.size = (int) hrbf._node_centers.cols();
+    vectorX_to_array<float>  (hrbf._alphas,       res.alphas      );
+    matrixDX_to_Vec3_cu_array(hrbf._betas,        res.betas       );
+    matrixDX_to_Vec3_cu_array(hrbf._node_centers, res.nodeCenters );
     res.normals = new Vec3_cu[size];
     memcpy(res.normals, normals, size*sizeof(Vec3_cu));
 }
 
+// -----------------------------------------------------------------------------
+
+double fit_peak_bytes(int size, float support)
+{
+    const double n = (double)(ROWS_PER_SAMPLE * (size + (support > 0.f ? 0 : 1)));
+    if(support > 0.f)
+    {
+        // 20 neighbours, (Dim+1)^2 entries each: a triplet (16 bytes), the
+        // matrix entry (12 bytes) and twice as much in the incomplete LU
+        const double nnz = n * ROWS_PER_SAMPLE * 20.;
+        return nnz * (16. + 12. + 24.);
+    }
+    // System kept for the residuals plus its LU factors, in double
+    return 2. * sizeof(double) * n * n;
+}
+
+// -----------------------------------------------------------------------------
+
+double hermite_fit_batch(std::vector<Fit_job>& jobs, int nb_threads, double max_bytes)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    if(nb_threads <= 0)
+        nb_threads = Parallel::nb_threads((int)jobs.size(), 1);
+
+    // Largest systems first so that the last fits to start are the short ones
+    std::vector<int> order(jobs.size());
+    for(unsigned i = 0; i < jobs.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b){ return jobs[a].size > jobs[b].size; });
+
+    // Workers start with the largest fits: at most as many as fit in memory
+    double bytes = 0.;
+    for(int t = 0; t < nb_threads && t < (int)order.size(); t++)
+    {
+        const Fit_job& job = jobs[ order[t] ];
+        bytes += fit_peak_bytes(job.size, job.support);
+        if(t > 0 && bytes > max_bytes){
+            printf("HRBF_wrapper: %d fitting threads instead of %d (%.0f MB per fit)\n",
+                   t, nb_threads, fit_peak_bytes(job.size, job.support) / (1024.*1024.));
+            nb_threads = t;
+            break;
+        }
+    }
+
+    // Eigen caches the processor's cache sizes on first use
+    Eigen::initParallel();
+
+    const Clock::time_point start = Clock::now();
+    Parallel::for_each_dynamic((int)jobs.size(), nb_threads, [&](int, int i){
+        Fit_job& job = jobs[ order[i] ];
+        const Clock::time_point t = Clock::now();
+        hermite_fit(job.points, job.normals, job.size, *job.res, job.support);
+        job.time = std::chrono::duration<double>(Clock::now() - t).count();
+    });
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
 }// END RBFWrapper =============================================================
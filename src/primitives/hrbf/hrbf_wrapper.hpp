@@ -5,6 +5,8 @@
 #include "hrbf_data.hpp"
 #include "hrbf_setup.hpp"
 
+#include <vector>
+
 /** @brief Wrapper interface of the RBF's classes
     The wrapper is design to separate nvcc code to gcc code.
 
@@ -24,11 +26,60 @@ namespace HRBF_wrapper {
 // =============================================================================
 
 /// Compute Hermite RBF coeffs with the given points and normals
+/// Near duplicate samples are merged (they keep zero weights) and the
+/// conditioning of the fit is written to res.report
 /// @param res : result of the fit with the computed coeficients
+/// @param support : 0 to fit with PHI_TYPE (global support). Otherwise the
+/// support radius of Rbf_wendland_c2: the system is sparse, the coefficients
+/// are meant for distances divided by 'support' and fit the samples minus
+/// the base capsule fit_capsule(points, size)
+/// (see HermiteRBF::fngf_global())
+/// @note reentrant: concurrent calls with different 'res' are safe
 void hermite_fit(const Vec3_cu* points,
                  const Vec3_cu* normals,
                  int size,
-                 HRBF_coeffs& res);
+                 HRBF_coeffs& res,
+                 float support = 0.f);
+
+/// A fit of hermite_fit_batch(), same parameters as hermite_fit()
+struct Fit_job {
+    Fit_job() : points(0), normals(0), size(0), support(0.f), res(0), time(0.) { }
+
+    const Vec3_cu* points;
+    const Vec3_cu* normals;
+    int            size;
+    float          support;
+    HRBF_coeffs*   res;   ///< where the coefficients are written
+    double         time;  ///< output: wall time of the fit in seconds
+};
+
+/// Run hermite_fit() on every job concurrently. Fits are independent, each
+/// worker picks the next job (largest first) as soon as it is done.
+/// @param nb_threads : number of workers, 0 for one per core. Lowered so that
+/// the largest fits running together stay within 'max_bytes'
+/// (fit_peak_bytes()), at least one worker runs
+/// @return wall time of the whole batch in seconds
+/// @note host only, don't touch HRBF_env from the jobs
+double hermite_fit_batch(std::vector<Fit_job>& jobs,
+                         int nb_threads = 0,
+                         double max_bytes = FIT_BATCH_MAX_BYTES);
+
+/// Estimated peak memory of hermite_fit() in bytes. Dense fits hold the
+/// system and its LU factors of size 4*(size+1) in float, or in double when
+/// the refinement gives up: 16*(4*(size+1))^2. Sparse fits hold about 20
+/// neighbours per sample (triplets, matrix and incomplete LU), their dense
+/// fallback is not accounted for.
+double fit_peak_bytes(int size, float support = 0.f);
+
+/// Base field of RBF_WENDLAND_C2 fits: the capsule along the main axis of
+/// the samples 'points' (principal component) with their mean distance to
+/// that axis as radius. The segment stops one radius before the extreme
+/// samples. Deterministic, so it is recomputed rather than stored.
+HRBF_capsule fit_capsule(const Vec3_cu* points, int size);
+
+/// Support radius of RBF_WENDLAND_C2 fits of the samples 'points':
+/// WENDLAND_SUPPORT_FACTOR times their average spacing
+float support_radius(const Vec3_cu* points, int size);
 
 }// END RBF_WRAPPER ============================================================
 
@@ -241,6 +241,19 @@ void Precomputed_prim::update_device_transformations()
         update_device(i);
 }
 
+void Precomputed_prim::memory_report(Memory_report& rep)
+{
+    const char* sub = "Precomputed_env";
+    rep.add(sub, "h_precomputed_info", h_precomputed_info.size() * sizeof(PrecomputedInfo), Memory_report::HOST);
+    add_to_report(rep, sub, "d_precomputed_info", d_precomputed_info);
+    for(int i = 0; i < (int) h_precomputed_info.size(); ++i)
+    {
+        const PrecomputedInfo &info = h_precomputed_info[i];
+        if(info.id != -1 && info.d_grid != NULL)
+            add_to_report(rep, sub, "d_grid", *info.d_grid);
+    }
+}
+
 void Precomputed_prim::initialize()
 {
     using namespace Precomputed_env;
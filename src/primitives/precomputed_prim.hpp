@@ -11,6 +11,7 @@ namespace Skeleton_env {
     typedef int Skel_id;
 }
 class Bone;
+struct Memory_report;
 
 // TODO: we should be able to store any kind of implicit prim (template or class polyphormism)
 /** @namespace Precomputed_env
@@ -70,6 +71,9 @@ struct Precomputed_prim {
     /// @see set_transform()
     static void update_device_transformations();
 
+    /// Add the memory used by every precomputed grids to 'rep'
+    static void memory_report(Memory_report& rep);
+
 #if !defined(NO_CUDA)
     /// @name Evaluation of the potential and gradient
     /// @{
@@ -0,0 +1,155 @@
+#include "cuda_launch_config.hpp"
+
+#include <cstdio>
+#include <cassert>
+
+// =============================================================================
+namespace Launch_cfg {
+// =============================================================================
+
+/// Architectures of the block size table
+enum Arch_t {
+    FERMI = 0, ///< sm_2x
+    KEPLER,    ///< sm_3x
+    MAXWELL,   ///< sm_5x and later
+    NB_ARCHS
+};
+
+struct Entry {
+    const char* name;
+    int sizes[NB_ARCHS];
+};
+
+/// Default block sizes. match_base_potential() evaluates the whole skeleton
+/// field at every step and is bounded by registers, hence smaller blocks.
+/// The other kernels are memory bound and want enough warps in flight to
+/// hide latency.
+static const Entry g_table[] = {
+    // name                    Fermi Kepler Maxwell+
+    {"match_base_potential", {  64,    64,   128 }},
+    {"compute_base_potential",{  64,   128,   128 }},
+    {"conservative_smooth" , { 128,   256,   256 }},
+    {"laplacian_smooth"    , { 128,   256,   256 }},
+    {"hc_laplacian_smooth" , { 128,   256,   256 }},
+    {"tangential_smooth"   , { 128,   256,   256 }},
+    {"diffusion"           , { 128,   256,   256 }},
+    {"copy_arrays"         , { 256,   256,   256 }},
+    {"compute_normals"     , { 256,   256,   256 }},
+    {"pack"                , { 256,   256,   256 }},
+    {"group_by_color"      , { 256,   256,   256 }},
+    {"hrbf_transform"      , {  64,   128,   128 }},
+    {"hrbf_to_soa"         , { 128,   256,   256 }},
+};
+static_assert(sizeof(g_table) / sizeof(Entry) == NB_KERNELS,
+              "Launch_cfg: one g_table entry per Kernel_t");
+
+static Arch_t g_arch = MAXWELL;
+static bool g_auto_tune = false;
+static int g_max_threads_per_sm = 2048;
+
+/// Resolved block size of each kernel or -1
+static int g_block_size[NB_KERNELS];
+
+/// Active blocks per multiprocessor of each resolved kernel or -1
+static int g_nb_active[NB_KERNELS];
+
+/// Where the block size of each kernel comes from
+enum Origin_t { TABLE, TUNED, USER };
+static Origin_t g_origin[NB_KERNELS];
+
+/// Mark every kernel as unresolved
+static bool reset_resolved()
+{
+    for(int i = 0; i < NB_KERNELS; i++){
+        g_block_size[i] = -1;
+        g_nb_active [i] = -1;
+        g_origin    [i] = TABLE;
+    }
+    return true;
+}
+
+static bool g_reset = reset_resolved();
+
+// -----------------------------------------------------------------------------
+
+void init(int device_id, bool auto_tune)
+{
+    cudaDeviceProp prop;
+    if( cudaGetDeviceProperties(&prop, device_id) == cudaSuccess )
+    {
+        if(prop.major < 3)      g_arch = FERMI;
+        else if(prop.major < 5) g_arch = KEPLER;
+        else                    g_arch = MAXWELL;
+        g_max_threads_per_sm = prop.maxThreadsPerMultiProcessor;
+    }
+    else
+    {
+        cudaGetLastError();
+        fprintf(stderr, "Launch_cfg: can't read device %d properties, "
+                        "using default block sizes\n", device_id);
+    }
+
+    g_auto_tune = auto_tune;
+    reset_resolved();
+}
+
+// -----------------------------------------------------------------------------
+
+void set_block_size(Kernel_t k, int block_size)
+{
+    assert(k < NB_KERNELS);
+    assert(block_size > 0);
+    g_block_size[k] = block_size;
+    g_nb_active [k] = -1;
+    g_origin    [k] = USER;
+}
+
+// -----------------------------------------------------------------------------
+
+const char* kernel_name(Kernel_t k)
+{
+    assert(k < NB_KERNELS);
+    return g_table[k].name;
+}
+
+// -----------------------------------------------------------------------------
+
+void print()
+{
+    static const char* origins[] = {"table", "tuned", "user"};
+    printf("Kernel launch configuration:\n");
+    for(int i = 0; i < NB_KERNELS; i++)
+    {
+        if(g_block_size[i] < 0) continue;
+
+        printf("  %-24s block %4d (%s)", g_table[i].name, g_block_size[i], origins[g_origin[i]]);
+        if(g_nb_active[i] >= 0)
+        {
+            const int nb_threads = g_nb_active[i] * g_block_size[i];
+            printf("  occupancy %5.1f%%", 100.f * (float)nb_threads / (float)g_max_threads_per_sm);
+        }
+        printf("\n");
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool is_resolved(Kernel_t k){ return g_block_size[k] > 0; }
+
+bool auto_tune(){ return g_auto_tune; }
+
+int table_block_size(Kernel_t k){ return g_table[k].sizes[g_arch]; }
+
+int resolved_block_size(Kernel_t k){ return g_block_size[k]; }
+
+// -----------------------------------------------------------------------------
+
+void resolve(Kernel_t k, int block_size, bool tuned, int nb_active_blocks)
+{
+    assert(k < NB_KERNELS);
+    g_block_size[k] = block_size;
+    g_nb_active [k] = nb_active_blocks;
+    g_origin    [k] = tuned ? TUNED : TABLE;
+}
+
+}// END LAUNCH_CFG NAMESPACE ===================================================
@@ -0,0 +1,118 @@
+#ifndef CUDA_LAUNCH_CONFIG_HPP_
+#define CUDA_LAUNCH_CONFIG_HPP_
+
+#include <cuda_runtime.h>
+
+/**
+ * @file cuda_launch_config.hpp
+ * @brief Block sizes of the 1D kernels launched over the mesh vertices
+ *
+ * Each kernel has an entry in a table indexed by the compute capability of
+ * the device selected with init(). When auto tuning is enabled the first
+ * launch of a kernel asks the occupancy calculator
+ * (cudaOccupancyMaxPotentialBlockSize()) for a block size instead, which takes
+ * the actual register and shared memory usage of the compiled kernel into
+ * account. Once resolved the block size of a kernel does not change anymore.
+ *
+ * Usage:
+ * @code
+ * const int block = Launch_cfg::block_size(Launch_cfg::PACK, pack);
+ * const int grid  = Launch_cfg::grid_size(block, nb_threads);
+ * pack<<<grid, block>>>(...);
+ * @endcode
+ *
+ * The register and shared memory usage of every kernel can be obtained
+ * without a GPU with the 'kernel_report' CMake target.
+ */
+
+// =============================================================================
+namespace Launch_cfg {
+// =============================================================================
+
+enum Kernel_t {
+    MATCH_BASE_POTENTIAL = 0, ///< Animesh_kers::match_base_potential()
+    BASE_POTENTIAL,           ///< Animesh_kers::compute_base_potential()
+    CONSERVATIVE_SMOOTH,
+    LAPLACIAN_SMOOTH,
+    HC_SMOOTH,
+    TANGENTIAL_SMOOTH,
+    DIFFUSION,
+    COPY_ARRAYS,
+    COMPUTE_NORMALS,
+    PACK,                     ///< Animesh::pack_vert_to_fit_gpu()
+    GROUP_BY_COLOR,           ///< Animesh_kers::conservative_smooth()
+    HRBF_TRANSFORM,
+    HRBF_TO_SOA,
+    NB_KERNELS
+};
+
+/// Select the table entries of the device 'device_id' (runtime identifier).
+/// Block sizes already resolved are reset.
+/// @param auto_tune : resolve block sizes with the occupancy calculator
+/// rather than the table
+void init(int device_id, bool auto_tune);
+
+/// Force the block size of a kernel (neither the table nor the occupancy
+/// calculator are consulted for it afterwards)
+void set_block_size(Kernel_t k, int block_size);
+
+/// @return the kernel name used by print()
+const char* kernel_name(Kernel_t k);
+
+/// Print for each kernel launched so far its block size and theoretical
+/// occupancy
+void print();
+
+// -----------------------------------------------------------------------------
+/// @name Used by block_size(), not meant to be called directly
+// -----------------------------------------------------------------------------
+
+bool is_resolved(Kernel_t k);
+bool auto_tune();
+int  table_block_size(Kernel_t k);
+int  resolved_block_size(Kernel_t k);
+/// @param tuned : 'block_size' comes from the occupancy calculator
+/// @param nb_active_blocks : blocks per multiprocessor at 'block_size'
+/// or -1 if unknown
+void resolve(Kernel_t k, int block_size, bool tuned, int nb_active_blocks);
+
+// -----------------------------------------------------------------------------
+
+/// @return the block size to launch 'kernel' with
+/// @param dyn_smem : dynamic shared memory per block in bytes
+template<class Ker>
+int block_size(Kernel_t k, Ker kernel, size_t dyn_smem = 0)
+{
+    if( !is_resolved(k) )
+    {
+        bool failed = false;
+        int block = table_block_size(k);
+        int min_grid = 0, tuned_size = 0;
+        bool tuned = false;
+        if( auto_tune() )
+        {
+            failed = cudaOccupancyMaxPotentialBlockSize(&min_grid, &tuned_size, kernel, dyn_smem) != cudaSuccess;
+            tuned  = !failed && tuned_size > 0;
+            if( tuned ) block = tuned_size;
+        }
+
+        int nb_active = -1;
+        if( cudaOccupancyMaxActiveBlocksPerMultiprocessor(&nb_active, kernel, block, dyn_smem) != cudaSuccess ){
+            nb_active = -1;
+            failed = true;
+        }
+        // Don't let a failed query be reported by the next CUDA_CHECK_ERRORS()
+        if( failed ) cudaGetLastError();
+        resolve(k, block, tuned, nb_active);
+    }
+    return resolved_block_size(k);
+}
+
+/// @return number of blocks to cover 'nb_threads'
+inline int grid_size(int block_size, int nb_threads){
+    return (nb_threads + block_size - 1) / block_size;
+}
+
+}// END LAUNCH_CFG NAMESPACE ===================================================
+
+#endif // CUDA_LAUNCH_CONFIG_HPP_
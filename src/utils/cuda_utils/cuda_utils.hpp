@@ -271,6 +271,42 @@ typedef HD_Array<Vec3_cu> HDA_Vec3_cu;
 typedef HD_Array<Point_cu> HDA_Point_cu;
 /// @}
 
+// -----------------------------------------------------------------------------
+
+/// @name Memory report
+/// Add the memory held by an array to a Memory_report
+/// @see Memory_report
+/// @{
+template <class T>
+void add_to_report(Memory_report& rep, const char* subsystem, const char* name,
+                   const Device::Array<T>& a)
+{
+    rep.add(subsystem, name, a.size() * sizeof(T), Memory_report::DEVICE);
+}
+
+template <class T>
+void add_to_report(Memory_report& rep, const char* subsystem, const char* name,
+                   const Device::CuArray<T>& a)
+{
+    rep.add(subsystem, name, a.size() * sizeof(T), Memory_report::DEVICE);
+}
+
+template <class T, bool page_locked>
+void add_to_report(Memory_report& rep, const char* subsystem, const char* name,
+                   const Host::ArrayTemplate<T, page_locked>& a)
+{
+    rep.add(subsystem, name, a.size() * sizeof(T), Memory_report::HOST);
+}
+
+template <class T>
+void add_to_report(Memory_report& rep, const char* subsystem, const char* name,
+                   const HD_Array<T>& a)
+{
+    rep.add(subsystem, name, a.size() * sizeof(T), Memory_report::HOST);
+    add_to_report(rep, subsystem, name, a.device_array());
+}
+/// @}
+
 }// END CUDA_UTILS NAMESPACE ====================================================
 
 #endif
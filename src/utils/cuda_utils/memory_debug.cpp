@@ -43,3 +43,49 @@ int Memory_stack::n = 0;
 int Memory_stack::stack_size = DEFAULT_STACK_SIZE;
 Memory_stack::mem_s* Memory_stack::entries = new Memory_stack::mem_s[DEFAULT_STACK_SIZE];
 
+
+// -----------------------------------------------------------------------------
+
+void Memory_report::add(const char* subsystem, const char* name, size_t size, mem_loc loc){
+	if(size == 0)
+		return;
+	entry_s e;
+	e.subsystem = subsystem;
+	e.name = name;
+	e.size = size;
+	e.loc = loc;
+	_entries.push_back(e);
+}
+
+size_t Memory_report::total(mem_loc loc, const char* subsystem) const{
+	size_t acc = 0;
+	for(unsigned i = 0; i < _entries.size(); i++){
+		const entry_s& e = _entries[i];
+		if(e.loc != loc) continue;
+		if(subsystem != 0 && e.subsystem != subsystem) continue;
+		acc += e.size;
+	}
+	return acc;
+}
+
+void Memory_report::print() const{
+	const double mo = 1024.0 * 1024.0;
+	printf("subsystem\tloc\tsize(bytes)\tname\n");
+	std::vector<std::string> subsystems;
+	for(unsigned i = 0; i < _entries.size(); i++){
+		const entry_s& e = _entries[i];
+		printf("%s\t%s\t%lu\t%s\n", e.subsystem.c_str(), (e.loc == DEVICE)?"D":"H", (unsigned long)e.size, e.name.c_str());
+		bool found = false;
+		for(unsigned j = 0; j < subsystems.size() && !found; j++)
+			found = subsystems[j] == e.subsystem;
+		if(!found)
+			subsystems.push_back(e.subsystem);
+	}
+	printf("\nsubsystem\tdevice(Mo)\thost(Mo)\n");
+	for(unsigned i = 0; i < subsystems.size(); i++){
+		const char* sub = subsystems[i].c_str();
+		printf("%s\t%f\t%f\n", sub, total(DEVICE, sub) / mo, total(HOST, sub) / mo);
+	}
+	printf("total\t%f\t%f\n", total(DEVICE) / mo, total(HOST) / mo);
+	fflush(stdout);
+}
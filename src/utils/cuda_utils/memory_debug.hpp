@@ -3,6 +3,8 @@
 
 
 #include <stdio.h>
+#include <string>
+#include <vector>
 #define DEFAULT_STACK_SIZE 32
 #define MAX_NAME_LEN 64
 
@@ -70,4 +72,53 @@ private:
     static void realloc();
 };
 
+// -----------------------------------------------------------------------------
+
+/** @brief Memory footprint of the library broken down by subsystem
+
+    Unlike Memory_stack this does not hook allocations: each subsystem
+    (Animesh, HRBF_env, Precomputed_env, Blending_env, Skeleton_env ...)
+    adds the size of the buffers it currently owns. This works without
+    TRACE_MEMORY and gives the actual size of resizable containers.
+
+    @code
+    Memory_report rep;
+    animesh->memory_report(rep);
+    Cuda_ctrl::memory_report(rep);
+    rep.print();
+    @endcode
+
+    @note This header does not include CUDA and can be used in NO_CUDA files.
+*/
+struct Memory_report{
+
+    typedef enum{
+        DEVICE,
+        HOST
+    } mem_loc;
+
+    /// Register a buffer of 'size' bytes named 'name' owned by 'subsystem'.
+    /// Empty buffers are ignored.
+    void add(const char* subsystem, const char* name, size_t size, mem_loc loc = DEVICE);
+
+    /// @return the total number of bytes in 'loc' for 'subsystem' or for every
+    /// subsystems if 'subsystem' is null
+    size_t total(mem_loc loc, const char* subsystem = 0) const;
+
+    /// Print every buffer and the totals per subsystem
+    void print() const;
+
+    void clear(){ _entries.clear(); }
+
+private:
+    struct entry_s{
+        std::string subsystem;
+        std::string name;
+        size_t size;
+        mem_loc loc;
+    };
+
+    std::vector<entry_s> _entries;
+};
+
 #endif // MEMORY_DEBUG_HPP__
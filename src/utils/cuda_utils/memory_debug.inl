@@ -118,6 +118,24 @@ inline cudaError_t cuda_free_array_and_untrace(struct cudaArray* array){
 
 // -----------------------------------------------------------------------------
 
+/// @return the size in bytes of a cudaArray (1D, 2D or 3D) or 0 if null
+inline size_t cuda_array_size(const struct cudaArray* array)
+{
+#define __MAXT(x,y) ((x>y)?x:y)
+    if(array == 0)
+        return 0;
+    cudaChannelFormatDesc desc;
+    cudaExtent extent;
+    unsigned flags;
+    if(cudaArrayGetInfo(&desc, &extent, &flags, const_cast<cudaArray*>(array)) != cudaSuccess)
+        return 0;
+    size_t size_ch = ((desc.x+7)/8 + (desc.y+7)/8 + (desc.z+7)/8 + (desc.w+7)/8);
+    return size_ch * __MAXT(extent.depth,1) * __MAXT(extent.height,1) * extent.width;
+#undef __MAXT
+}
+
+// -----------------------------------------------------------------------------
+
 #ifdef TRACE_MEMORY
 
 #define STRINGIFY(x) #x
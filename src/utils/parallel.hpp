@@ -0,0 +1,95 @@
+#ifndef PARALLEL_HPP__
+#define PARALLEL_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+    @namespace Parallel
+    @brief Minimal CPU multithreading helpers (host code only)
+
+    Work is split in contiguous chunks, one per thread, so each thread can
+    accumulate in its own flat buffer which is reduced afterward. This avoids
+    any locking in the loops.
+
+    usage:
+    @code
+    const int nb_threads = Parallel::nb_threads(nb_elts);
+    std::vector<float> acc(nb_threads, 0.f);
+    Parallel::for_chunks(nb_elts, nb_threads, [&](int thread, int begin, int end){
+        for(int i = begin; i < end; i++)
+            acc[thread] += vals[i];
+    });
+    float sum = 0.f;
+    for(float a : acc) sum += a;
+    @endcode
+*/
+// =============================================================================
+namespace Parallel {
+// =============================================================================
+
+/// Number of threads worth launching for 'nb_elts' elements
+/// @param min_chunk : minimal number of elements processed by a thread
+static inline int nb_threads(int nb_elts, int min_chunk = 1024)
+{
+    int nb = (int)std::thread::hardware_concurrency();
+    nb = std::max(nb, 1);
+    return std::max(1, std::min(nb, nb_elts / std::max(min_chunk, 1)));
+}
+
+/// Call 'f(thread, begin, end)' on 'nb_threads' contiguous chunks of
+/// [0 nb_elts[ and wait for every chunk to be processed.
+/// The calling thread processes the first chunk.
+template<class Func>
+static void for_chunks(int nb_elts, int nb_threads, const Func& f)
+{
+    nb_threads = std::max(1, std::min(nb_threads, nb_elts));
+    if(nb_elts <= 0) return;
+
+    const int chunk = (nb_elts + nb_threads - 1) / nb_threads;
+    std::vector<std::thread> threads;
+    for(int t = 1; t < nb_threads; t++)
+    {
+        const int begin = t * chunk;
+        const int end   = std::min(nb_elts, begin + chunk);
+        if(begin >= end) break;
+        threads.push_back( std::thread(f, t, begin, end) );
+    }
+
+    f(0, 0, std::min(nb_elts, chunk));
+
+    for(unsigned t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+/// Call 'f(thread, i)' for every i of [0 nb_elts[ on 'nb_threads' workers
+/// picking the next element as soon as they are done with the previous one,
+/// and wait for every element to be processed. Meant for few elements of
+/// uneven cost: put the most expensive first. The calling thread is a worker.
+template<class Func>
+static void for_each_dynamic(int nb_elts, int nb_threads, const Func& f)
+{
+    nb_threads = std::max(1, std::min(nb_threads, nb_elts));
+    if(nb_elts <= 0) return;
+
+    std::atomic<int> next(0);
+    auto worker = [&](int t){
+        for(int i = next++; i < nb_elts; i = next++)
+            f(t, i);
+    };
+
+    std::vector<std::thread> threads;
+    for(int t = 1; t < nb_threads; t++)
+        threads.push_back( std::thread(worker, t) );
+
+    worker(0);
+
+    for(unsigned t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+}// END PARALLEL NAMESPACE =====================================================
+
+#endif // PARALLEL_HPP__